@@ -0,0 +1,186 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Benchmarks against a throwaway sshd daemon started by `rake bench`.
+#
+# Usage: mruby bench/ssh.rb USER KEY ROUNDS PORT
+#
+# The results are written to stdout as JSON. Algorithms the linked crypto
+# backend does not support are reported as errors.
+
+USER    = ARGV[0]
+KEY     = ARGV[1]
+ROUNDS  = ARGV[2].to_i > 0 ? ARGV[2].to_i : 50
+PORT    = ARGV[3].to_i
+
+LINES   = 200_000
+BYTES   = 64 * 1024 * 1024
+
+KEX     = %w[curve25519-sha256 ecdh-sha2-nistp256 diffie-hellman-group14-sha256 diffie-hellman-group-exchange-sha256].freeze
+CIPHERS = %w[aes128-ctr aes256-ctr aes128-gcm@openssh.com aes256-gcm@openssh.com chacha20-poly1305@openssh.com].freeze
+ESCAPES = { 0x22 => '\\"', 0x5c => '\\\\', 0x08 => '\\b', 0x0c => '\\f', 0x0a => '\\n', 0x0d => '\\r', 0x09 => '\\t' }.freeze
+
+def measure
+  time = SSH.clock
+  yield
+  SSH.clock - time
+end
+
+def start(opts = {}, &block)
+  SSH.start('127.0.0.1', USER, opts.merge(port: PORT, key: KEY), &block)
+end
+
+def latencies(samples)
+  samples.sort!
+
+  {
+    min: samples[0],
+    avg: samples.inject(0.0) { |sum, t| sum + t } / samples.size,
+    p50: samples[samples.size / 2],
+    p99: samples[(samples.size - 1) * 99 / 100],
+    max: samples[-1]
+  }
+end
+
+def json_string(str)
+  res = '"'
+  str.bytes.each { |b| res << (ESCAPES[b] || (b < 0x20 ? format('\\u%04x', b) : b.chr)) }
+  res << '"'
+end
+
+def to_json(obj)
+  case obj
+  when Hash   then "{#{obj.map { |k, v| "#{to_json(k.to_s)}:#{to_json(v)}" }.join(',')}}"
+  when Array  then "[#{obj.map { |v| to_json(v) }.join(',')}]"
+  when String then json_string(obj)
+  when Float  then obj.finite? ? obj.to_s : 'null'
+  when nil    then 'null'
+  else obj.to_s
+  end
+end
+
+def connects
+  time = measure do
+    ROUNDS.times { SSH::Session.new('127.0.0.1', port: PORT).close }
+  end
+
+  { rounds: ROUNDS, per_sec: ROUNDS / time }
+end
+
+def algorithms
+  start(&:algorithms)
+end
+
+def handshakes
+  res   = {}
+  prefs = KEX.map { |kex| ["kex:#{kex}", { kex: kex }] }
+  prefs.concat(CIPHERS.map { |cipher| ["cipher:#{cipher}", { ciphers: cipher }] })
+
+  prefs.each do |name, opts|
+    samples = []
+
+    begin
+      ROUNDS.times do
+        ssh = SSH::Session.new('127.0.0.1', opts.merge(port: PORT))
+        samples << ssh.stats[:handshake_time]
+        ssh.close
+      end
+
+      res[name] = latencies(samples)
+    rescue SSH::Exception => e
+      res[name] = { error: e.message }
+    end
+  end
+
+  res
+end
+
+def lines
+  start do |ssh|
+    io, = ssh.open_channel.popen2("seq 1 #{LINES}")
+    count = 0
+    time  = measure { count += 1 while io.gets }
+
+    { lines: count, per_sec: count / time }
+  end
+end
+
+def bulk(opts = {}, bytes = BYTES, channel_opts = {})
+  start(opts) do |ssh|
+    channel = SSH::Channel.new(ssh)
+    channel.open(channel_opts)
+
+    io, = channel.popen2("head -c #{bytes} /dev/zero")
+    size = 0
+    time = measure { size = io.gets(nil).to_s.bytesize }
+
+    { bytes: size, mb_per_sec: size / time / 1024 / 1024, window: channel.stats[:window] }
+  end
+end
+
+def bulk_by_cipher
+  res = {}
+
+  CIPHERS.each do |cipher|
+    begin
+      res[cipher] = bulk({ ciphers: cipher }, BYTES / 4)
+    rescue SSH::Exception => e
+      res[cipher] = { error: e.message }
+    end
+  end
+
+  res
+end
+
+def execs
+  start do |ssh|
+    samples = Array.new(ROUNDS) { measure { ssh.exec('true') } }
+    latencies(samples)
+  end
+end
+
+def channel_opens
+  start do |ssh|
+    time = measure do
+      ROUNDS.times do
+        channel = SSH::Channel.new(ssh)
+        channel.open
+        channel.close
+      end
+    end
+
+    { rounds: ROUNDS, per_sec: ROUNDS / time }
+  end
+end
+
+puts to_json(
+  rounds: ROUNDS,
+  algorithms: algorithms,
+  connects: connects,
+  handshakes: handshakes,
+  gets: lines,
+  gets_nil: bulk,
+  gets_nil_window_auto: bulk({}, BYTES, window: :auto),
+  gets_nil_by_cipher: bulk_by_cipher,
+  exec: execs,
+  channel_opens: channel_opens
+)
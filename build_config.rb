@@ -28,6 +28,7 @@ MRuby::Build.new do |conf|
 
   conf.build_mrbc_exec
 
+  conf.gem core: 'mruby-bin-mruby'
   conf.gem __dir__
 end
 
@@ -25,14 +25,62 @@
 #define MRUBY_SSH_H
 
 #include <mruby.h>
+#include <stdint.h>
 #include <libssh2.h>
 
 MRB_BEGIN_DECL
 
+#define MRB_SSH_STATE_READY     0
+#define MRB_SSH_STATE_CONNECT   1
+#define MRB_SSH_STATE_HANDSHAKE 2
+
+typedef struct mrb_ssh_stats
+{
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t waits;
+    uint64_t channel_opens;
+    uint64_t execs;
+    uint64_t compress_in;
+    uint64_t compress_out;
+    uint64_t decompress_in;
+    uint64_t decompress_out;
+    int64_t wait_time;
+    int64_t handshake_time;
+    int64_t auth_time;
+    int64_t channel_open_time;
+    int64_t exec_time;
+    int64_t since;
+} mrb_ssh_stats_t;
+
+#ifndef MRB_SSH_POOL_CLASSES
+# define MRB_SSH_POOL_CLASSES 11
+#endif
+
+typedef struct mrb_ssh_pool
+{
+    mrb_state *mrb;
+    void *free[MRB_SSH_POOL_CLASSES];
+    int cached[MRB_SSH_POOL_CLASSES];
+    size_t cached_bytes;
+    size_t live;
+    size_t peak;
+    uint64_t allocs;
+    uint64_t hits;
+} mrb_ssh_pool_t;
+
 typedef struct mrb_ssh
 {
     LIBSSH2_SESSION *session;
     libssh2_socket_t sock;
+    int port;
+    int keepalive;
+    int keepalive_reply;
+    int state;
+    int blocking;
+    int compress_level;
+    mrb_ssh_stats_t stats;
+    mrb_ssh_pool_t pool;
 } mrb_ssh_t;
 
 #define E_SSH_ERROR                  (mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "Exception"))
@@ -45,11 +93,13 @@ typedef struct mrb_ssh
 #define E_SSH_DISCONNECT_ERROR       (mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "ConnectionLost"))
 #define E_SSH_HOST_KEY_ERROR         (mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "HostKeyError"))
 #define E_SSH_TIMEOUT_ERROR          (mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "Timeout"))
+#define E_SSH_SFTP_ERROR             (mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "SFTPError"))
 
 MRB_API unsigned int mrb_ssh_initialized();
 MRB_API int mrb_ssh_wait_sock (mrb_ssh_t *ssh);
 MRB_API void mrb_ssh_raise_last_error (mrb_state *mrb, mrb_ssh_t *ssh);
 MRB_API void mrb_ssh_raise (mrb_state *mrb, int err, const char* msg);
+MRB_API mrb_value mrb_ssh_exc_new (mrb_state *mrb, int err, const char* msg);
 
 MRB_END_DECL
 
@@ -0,0 +1,173 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+require 'rake/file_utils'
+require 'socket'
+
+module SSH
+  class Sshd
+    include Rake::FileUtilsExt
+
+    # Initializes a throwaway OpenSSH daemon listening on the loopback device.
+    #
+    # @param [ String ]            dir  Where to place the keys and configs.
+    # @param [ Hash<String, _> ]   opts Additional sshd_config directives.
+    #
+    # @return [ Void ]
+    def initialize(dir, opts = {})
+      @dir  = File.expand_path(dir)
+      @opts = opts
+      @port = free_port
+    end
+
+    # The port the daemon is listening on.
+    #
+    # @return [ Int ]
+    attr_reader :port
+
+    # The private key to authenticate the current user with.
+    #
+    # @return [ String ]
+    def key
+      "#{@dir}/id_rsa"
+    end
+
+    # The name of the user to authenticate with.
+    #
+    # @return [ String ]
+    def user
+      ENV.fetch('USER') { `id -un`.chomp }
+    end
+
+    # Generates the host and user keys, writes the config and starts the
+    # daemon in foreground mode.
+    #
+    # @return [ SSH::Sshd ] self
+    def start
+      mkdir_p @dir, verbose: false
+
+      keygen 'ssh_host_rsa_key', 'rsa'
+      keygen 'ssh_host_ecdsa_key', 'ecdsa'
+      keygen 'id_rsa', 'rsa'
+
+      cp "#{key}.pub", "#{@dir}/authorized_keys", verbose: false
+
+      File.write(config, directives.map { |kv| kv.join(' ') }.join("\n") << "\n")
+
+      @pid = spawn(executable, '-D', '-e', '-f', config, err: "#{@dir}/sshd-#{@port}.log")
+
+      wait_until_listening
+    end
+
+    # Stops the daemon.
+    #
+    # @return [ Void ]
+    def stop
+      return unless @pid
+
+      Process.kill('TERM', @pid)
+      Process.wait(@pid)
+    rescue Errno::ESRCH, Errno::ECHILD
+      nil
+    ensure
+      @pid = nil
+    end
+
+    private
+
+    # The path of the generated sshd_config file.
+    #
+    # @return [ String ]
+    def config
+      "#{@dir}/sshd_config-#{@port}"
+    end
+
+    # The directives for the sshd_config file.
+    #
+    # @return [ Array<Array<String>> ]
+    def directives
+      [
+        ['ListenAddress', "127.0.0.1:#{@port}"],
+        ['HostKey', "#{@dir}/ssh_host_rsa_key"],
+        ['HostKey', "#{@dir}/ssh_host_ecdsa_key"],
+        ['PidFile', "#{@dir}/sshd-#{@port}.pid"],
+        ['AuthorizedKeysFile', "#{@dir}/authorized_keys"],
+        ['PasswordAuthentication', 'no'],
+        ['KbdInteractiveAuthentication', 'no'],
+        ['PubkeyAuthentication', 'yes'],
+        ['StrictModes', 'no'],
+        ['UsePAM', 'no'],
+        ['UseDNS', 'no'],
+        ['MaxStartups', '1000'],
+        ['MaxSessions', '1000'],
+        ['LogLevel', 'ERROR']
+      ].concat(@opts.to_a)
+    end
+
+    # Generates a key pair unless it exists already. Keys are written in PEM
+    # format as that's what all libssh2 crypto backends can read.
+    #
+    # @param [ String ] name The file name of the private key.
+    # @param [ String ] type The type of the key.
+    #
+    # @return [ Void ]
+    def keygen(name, type)
+      path = "#{@dir}/#{name}"
+      sh "ssh-keygen -q -m PEM -t #{type} -N '' -f #{path}", verbose: false unless File.exist? path
+    end
+
+    # The absolute path to the sshd binary as sshd refuses to start otherwise.
+    #
+    # @return [ String ]
+    def executable
+      ENV.fetch('SSHD') do
+        %w[/usr/sbin/sshd /usr/local/sbin/sshd /usr/bin/sshd].find { |path| File.executable? path } ||
+          raise('sshd not found, set SSHD to its absolute path')
+      end
+    end
+
+    # Asks the kernel for an unused port on the loopback device.
+    #
+    # @return [ Int ]
+    def free_port
+      server = TCPServer.new('127.0.0.1', 0)
+      server.addr[1]
+    ensure
+      server&.close
+    end
+
+    # Blocks until the daemon accepts connections.
+    #
+    # @return [ SSH::Sshd ] self
+    def wait_until_listening
+      50.times do
+        TCPSocket.new('127.0.0.1', @port).close
+        return self
+      rescue Errno::ECONNREFUSED
+        sleep 0.1
+      end
+
+      stop
+      raise "sshd did not start, see #{@dir}/sshd-#{@port}.log"
+    end
+  end
+end
@@ -116,6 +116,13 @@
 # define HAVE_ALLOCA_H 1
 #endif
 
+/* Route the zlib calls through mruby-ssh, see src/compress.c */
+#ifdef LIBSSH2_HAVE_ZLIB
+# define deflateInit_ mrb_ssh_deflateInit_
+# define deflate      mrb_ssh_deflate
+# define inflate      mrb_ssh_inflate
+#endif
+
 /* Enable large inode numbers on Mac OS X 10.5.  */
 #ifndef _DARWIN_USE_64_BIT_INODE
 # define _DARWIN_USE_64_BIT_INODE 1
@@ -38,7 +38,8 @@ module SSH
     return session unless block_given?
 
     begin
-      yield session
+      return yield(session) unless cfg[:compress] == :auto
+      Compression.measure(session) { yield session }
     ensure
       session.close
     end
@@ -250,10 +250,16 @@ module SSH
     #
     # @return [ String ] nil if the subsystem could not be requested.
     def __capture__(cmd, opts, ext)
-      request('exec', cmd, ext)
+      line = opts.is_a?(Hash)
+      res  = __exec__(cmd, ext)[0, ext == EXT_NORMAL ? 2 : 1]
+
+      # Same result as Stream#gets(opts): a Hash reads the first line only
+      res.map! do |str|
+        str = str[0, str.index("\n") + 1] if line && str.index("\n")
+        next if str.empty?
+        line && opts[:chomp] ? str.chomp : str
+      end
 
-      res = [Stream.new(self, 0).gets(opts)]
-      res << Stream.new(self, 1).gets(opts) if ext == EXT_NORMAL
       res << true
     rescue SSH::ChannelRequestFailed
       [false]
@@ -0,0 +1,152 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  # Decides whether new sessions to a host should be compressed, based on
+  # the throughput and the compression ratio seen before. Compression pays
+  # off on slow links with compressible payload, but wastes CPU on fast links
+  # or with already compressed data.
+  #
+  #   SSH.start(host, user, compress: :auto) { |ssh| ssh.exec('cat app.log') }
+  module Compression
+    # Only sessions that transferred more bytes tell something about the link.
+    MIN_BYTES = 64 * 1024
+
+    @hosts          = {}
+    @max_throughput = 4 * 1024 * 1024
+    @max_ratio      = 0.8
+    @default        = false
+
+    class << self
+      # Links faster than that (in bytes per second) are not compressed.
+      # Defaults to: 4 MiB/s
+      #
+      # @return [ Int ]
+      attr_accessor :max_throughput
+
+      # Payload that doesn't compress better than that is not compressed.
+      # Defaults to: 0.8
+      #
+      # @return [ Float ]
+      attr_accessor :max_ratio
+
+      # The decision for hosts without any history.
+      # Defaults to: false
+      #
+      # @return [ Boolean ]
+      attr_accessor :default
+    end
+
+    # Times the block as one transfer of the session and learns from it.
+    #
+    # @param [ SSH::Session ] session A connected session.
+    #
+    # @return [ Object ] The result of the block.
+    def self.measure(session)
+      before = session.stats
+      since  = SSH.clock
+
+      yield
+    ensure
+      record(session, SSH.clock - since, before) if since
+    end
+
+    # Learns from the stats of the session. The throughput is estimated from
+    # the bytes on the wire and the wall-clock time the transfer took.
+    #
+    # @param [ SSH::Session ] session A connected session.
+    # @param [ Float ]        time    The seconds the transfer took.
+    # @param [ Hash ]         before  The stats of the session when the
+    #                                 transfer started. Defaults to none.
+    #
+    # @return [ Hash ] The history of the host or nil if not connected.
+    def self.record(session, time, before = nil)
+      stats = session.stats
+      return unless stats && session.host
+
+      stats = delta(stats, before) if before
+
+      entry = (@hosts[session.host] ||= {})
+      bytes = stats[:bytes_sent] + stats[:bytes_received]
+      plain = stats[:compress_in] + stats[:decompress_out]
+      zlib  = stats[:compress_out] + stats[:decompress_in]
+
+      entry[:throughput] = average(entry[:throughput], bytes / time) if bytes >= MIN_BYTES && time > 0
+      entry[:ratio]      = average(entry[:ratio], zlib.to_f / plain) if plain >= MIN_BYTES
+
+      entry
+    end
+
+    # If new sessions to the host should be compressed.
+    #
+    # @param [ String ] host The host name.
+    #
+    # @return [ Boolean ]
+    def self.compress?(host)
+      entry = @hosts[host]
+
+      return @default unless entry
+      return false if entry[:ratio] && entry[:ratio] > @max_ratio
+      return entry[:throughput] < @max_throughput if entry[:throughput]
+
+      entry[:ratio] ? true : @default
+    end
+
+    # The history of the host.
+    #
+    # @param [ String ] host The host name.
+    #
+    # @return [ Hash ] nil if unknown.
+    def self.[](host)
+      @hosts[host]
+    end
+
+    # Forgets the history of all hosts.
+    #
+    # @return [ Void ]
+    def self.clear
+      @hosts.clear
+    end
+
+    # The counters of stats minus the ones of before.
+    #
+    # @param [ Hash ] stats  The current stats.
+    # @param [ Hash ] before The previous stats.
+    #
+    # @return [ Hash ]
+    def self.delta(stats, before)
+      res = {}
+      stats.each { |key, val| res[key] = val.is_a?(Integer) ? val - (before[key] || 0) : val }
+      res
+    end
+
+    # Exponentially weighted moving average of the old and new value.
+    #
+    # @param [ Float ] old   nil if there is no previous value.
+    # @param [ Float ] value The new value.
+    #
+    # @return [ Float ]
+    def self.average(old, value)
+      old ? old * 0.7 + value * 0.3 : value.to_f
+    end
+  end
+end
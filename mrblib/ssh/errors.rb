@@ -71,6 +71,13 @@ module SSH
 
   # Base class for host key exceptions.
   class HostKeyError < SSH::Exception; end
+
+  # This exception is raised when the pool has no more sessions to hand out.
+  class PoolExhausted < SSH::Exception; end
+
+  # This exception is raised when the SFTP server rejects a request. The errno
+  # holds the SFTP status code.
+  class SFTPError < SSH::Exception; end
 end
 
 unless Object.const_defined? :EOFError
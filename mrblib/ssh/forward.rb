@@ -0,0 +1,63 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  class Session
+    # Listens on a local port and tunnels each accepted connection through
+    # its own direct-tcpip channel to remote_host:remote_port, as seen from
+    # the server. The tunnels are relayed by SSH::Forward#process or #run.
+    #
+    # @param [ Integer ]        local_port  The local port, 0 picks a free one.
+    # @param [ String ]         remote_host The host to connect to.
+    # @param [ Integer ]        remote_port The port to connect to.
+    # @param [ Hash<Symbol, _>] opts        The local address to bind: to,
+    #                                       defaults to 127.0.0.1. And
+    #                                       window: :auto with max_window:
+    #                                       as for SSH::Channel#open.
+    #
+    # @return [ SSH::Forward ]
+    def forward_local(local_port, remote_host, remote_port, opts = {})
+      Forward.new(self, local_port, remote_host, remote_port, opts)
+    end
+  end
+
+  class Forward
+    # The session the tunnels are opened through.
+    #
+    # @return [ SSH::Session ]
+    attr_reader :session
+
+    # Relays the tunnels until the forward gets closed or the time is up.
+    #
+    # @param [ Float ] seconds Max. number of seconds to run, nil for no limit.
+    #
+    # @return [ Void ]
+    def run(seconds = nil)
+      stop = SSH.clock + seconds if seconds
+
+      until closed?
+        process(stop ? [((stop - SSH.clock) * 1000).ceil, 100].min : 100)
+        break if stop && SSH.clock >= stop
+      end
+    end
+  end
+end
@@ -96,8 +96,9 @@ module SSH
     #
     # @return [ Void ]
     def print(*items)
-      items.each { |item| write(item.to_s) }
-      write($\) && nil if $\
+      items = items.map(&:to_s)
+      items << $\ if $\
+      write_v(*items) && nil
     end
 
     # Writes each argument to the stream, appending a newline to any item that
@@ -107,11 +108,12 @@ module SSH
     #
     # @return [ Void ]
     def puts(*items)
-      items.each do |item|
+      lines = items.map do |item|
         data = item.to_s
-        write(data[-1] == "\n" ? data : "#{data}\n")
+        data[-1] == "\n" ? data : "#{data}\n"
       end
-      nil
+
+      write_v(*lines) && nil
     end
 
     # Writes the string to the stream.
@@ -0,0 +1,86 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  # Services the keepalives of many sessions from a single timer. Sessions
+  # need a keepalive interval, see the keepalive option of SSH.start.
+  #
+  #   SSH::Keepalive.add(ssh)
+  #   loop { sleep SSH::Keepalive.tick || 60 }
+  module Keepalive
+    @sessions = []
+
+    # Adds the session to the list of serviced sessions.
+    #
+    # @param [ SSH::Session ] session The session to keep alive.
+    #
+    # @return [ SSH::Session ]
+    def self.add(session)
+      @sessions << session unless @sessions.include? session
+      session
+    end
+
+    # Removes the session from the list of serviced sessions.
+    #
+    # @param [ SSH::Session ] session The session to remove.
+    #
+    # @return [ SSH::Session ] nil if not found.
+    def self.delete(session)
+      @sessions.delete(session)
+    end
+
+    # The serviced sessions.
+    #
+    # @return [ Array<SSH::Session> ]
+    def self.sessions
+      @sessions.dup
+    end
+
+    # Sends the keepalives which are due. Sessions which are closed get
+    # removed, sessions which failed to send get closed and removed.
+    #
+    # @param [ Proc ] block Optional callback invoked with each dead session
+    #                       and the raised error.
+    #
+    # @return [ Int ] Seconds until the next keepalive is due or nil.
+    def self.tick(&block)
+      due = nil
+
+      @sessions.reject! do |ssh|
+        next true if ssh.closed?
+
+        begin
+          secs = ssh.keepalive_tick
+        rescue SSH::Exception => e
+          ssh.close
+          block.call(ssh, e) if block
+          next true
+        end
+
+        due = secs if secs && (!due || secs < due)
+        false
+      end
+
+      due
+    end
+  end
+end
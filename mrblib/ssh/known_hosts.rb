@@ -0,0 +1,48 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  # Process wide store of the host keys listed in the known_hosts file. The
+  # file gets loaded once and is indexed by host name, later changes to the
+  # file are picked up at most once a second on lookup.
+  module KnownHosts
+    # Verifies the host key of the session against the known hosts.
+    #
+    # @param [ SSH::Session ] session The connected session.
+    # @param [ Symbol ]       mode    :always to fail for unknown hosts or
+    #                                 :accept_new to add them to the file.
+    #
+    # @return [ Symbol ] :match or :added
+    def self.verify!(session, mode = :always)
+      case res = verify(session)
+      when :match
+        res
+      when :not_found
+        raise HostKeyError, "Host key for #{session.host} not known." unless mode == :accept_new
+
+        add(session) && :added
+      else
+        raise HostKeyError, "Host key for #{session.host} #{res == :revoked ? 'is revoked' : 'has changed'}."
+      end
+    end
+  end
+end
@@ -0,0 +1,45 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  # Executes the command on all hosts at once. Connect, handshake, login and
+  # the command itself of all sessions are interleaved by a single-threaded
+  # scheduler, so the total time is bounded by the slowest host rather than
+  # the sum of all hosts. Host names are resolved up front on a small thread
+  # pool to fill the DNS cache. Duplicate host names are run only once and a
+  # failed or timed out host is disconnected without waiting on the server.
+  #
+  # @param [ Array<String> ] hosts The host names.
+  # @param [ String ]        cmd   The command to execute.
+  # @param [ Hash ]          opts  Login options like user, password, key,
+  #                                passphrase, use_agent and port. In addition
+  #                                concurrency (max. number of simultaneous
+  #                                sessions, defaults to 32) and timeout (max.
+  #                                milliseconds per host, defaults to 60000).
+  #
+  # @return [ Hash<String, Hash> ] The out, err, exitstatus and error per host.
+  def self.parallel(hosts, cmd, opts = {})
+    startup
+    DNS.warm(hosts) if hosts.size > 1 && DNS.ttl > 0
+    __parallel__(hosts, cmd, opts)
+  end
+end
@@ -0,0 +1,58 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  # Readiness multiplexer for many sessions at once. Depending on the platform
+  # the poller is backed by epoll or poll, which are not limited by
+  # FD_SETSIZE like select.
+  class Poller
+    # Waits until at least one of the sessions is ready to resume the
+    # operation it is blocked on.
+    #
+    # @param [ Array<SSH::Session> ] sessions The sessions to wait for.
+    # @param [ Int ]                 timeout  Max milliseconds to wait.
+    #                                         Defaults to: nil (forever)
+    #
+    # @return [ Array<SSH::Session> ] Empty if the timeout has expired.
+    def self.wait(sessions, timeout = nil)
+      poller = new(:poll)
+      sessions.each { |ssh| poller.add(ssh) }
+      poller.wait(timeout)
+    end
+
+    # Add the session to the list of monitored sessions.
+    #
+    # @param [ SSH::Session ] session The connected session.
+    #
+    # @return [ SSH::Poller ] self
+    def <<(session)
+      add(session)
+    end
+
+    # If there are no sessions to wait for.
+    #
+    # @return [ Boolean ]
+    def empty?
+      size.zero?
+    end
+  end
+end
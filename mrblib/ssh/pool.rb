@@ -0,0 +1,211 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  # A pool of authenticated sessions keyed by host, port and user. Sessions
+  # which are checked in stay connected and get handed out again to the next
+  # caller, which saves the TCP connect, key exchange and login of a new one.
+  #
+  #   pool = SSH::Pool.new(password: 'password', ttl: 60)
+  #   pool.with('test.rebex.net', 'demo') { |ssh| ssh.exec('hostname') }
+  class Pool
+    # Initializes an empty pool.
+    #
+    # @param [ Hash ] opts Default options for new sessions, see SSH.start.
+    #                      In addition the pool accepts max (max. number of
+    #                      sessions per host, defaults to 4) and ttl (seconds
+    #                      an idle session is kept, defaults to 300). Pass
+    #                      keepalive to keep idle sessions warm, see
+    #                      SSH::Pool#keepalive.
+    #
+    # @return [ Void ]
+    def initialize(opts = {})
+      @opts   = opts.dup
+      @max    = @opts.delete(:max) || 4
+      @ttl    = @opts.delete(:ttl) || 300
+      @idle   = {}
+      @leased = {}
+      @closed = false
+    end
+
+    # Max. number of sessions per host.
+    #
+    # @return [ Int ]
+    attr_reader :max
+
+    # Seconds an idle session is kept before it gets closed.
+    #
+    # @return [ Numeric ]
+    attr_reader :ttl
+
+    # Hands out an authenticated session to the host. An idle session gets
+    # reused if it is still alive, otherwise a new one gets started.
+    #
+    # @param [ String ] host The host name.
+    # @param [ String ] user Optional user name.
+    # @param [ Hash ]   opts See SSH.start
+    #
+    # @return [ SSH::Session ]
+    def checkout(host, user = nil, opts = {})
+      raise SSH::Exception, 'Pool closed.' if @closed
+
+      cfg = @opts.merge(opts)
+      key = key_for(host, user || cfg[:user], cfg[:port] || 22)
+
+      reap
+
+      list = @idle[key] || []
+
+      while (entry = list.pop)
+        return lease(key, entry[0]) if entry[0].alive?
+        entry[0].close
+      end
+
+      raise PoolExhausted, "Too many sessions to #{key}." if count(key) >= @max
+
+      lease(key, SSH.start(host, user, cfg))
+    end
+
+    # Returns the session back into the pool. Closed sessions are removed,
+    # sessions checked in after the pool got closed are closed.
+    #
+    # @param [ SSH::Session ] session A session returned by checkout.
+    #
+    # @return [ Void ]
+    def checkin(session)
+      key = @leased.delete(session)
+
+      return unless key
+      return if session.closed?
+      return session.close if @closed
+
+      (@idle[key] ||= []) << [session, SSH.clock]
+      nil
+    end
+
+    # Hands out a session for the time the block is executed. Sessions which
+    # have raised a connection error are not given back to the pool.
+    #
+    # @param See SSH::Pool#checkout
+    #
+    # @return [ Object ] The result of the block.
+    def with(host, user = nil, opts = {})
+      ssh = checkout(host, user, opts)
+      yield(ssh)
+    rescue ConnectionLost, Timeout
+      ssh.close if ssh
+      raise
+    ensure
+      checkin(ssh) if ssh
+    end
+
+    # Closes all idle sessions which have not been used for ttl seconds.
+    #
+    # @return [ Int ] The number of closed sessions.
+    def reap
+      time  = SSH.clock - @ttl
+      count = 0
+
+      @idle.each_value do |list|
+        list.reject! do |ssh, used|
+          next false if used >= time
+          count += 1
+          ssh.close || true
+        end
+      end
+
+      count
+    end
+
+    # Sends the keepalives of all idle sessions which are due. Sessions which
+    # failed to send get closed and removed. Requires the keepalive option.
+    #
+    # @return [ Int ] Seconds until the next keepalive is due or nil.
+    def keepalive
+      due = nil
+
+      @idle.each_value do |list|
+        list.reject! do |ssh, _|
+          begin
+            secs = ssh.keepalive_tick
+          rescue SSH::Exception
+            next ssh.close || true
+          end
+
+          due = secs if secs && (!due || secs < due)
+          false
+        end
+      end
+
+      due
+    end
+
+    # The number of idle and leased sessions.
+    #
+    # @return [ Int ]
+    def size
+      @idle.values.inject(@leased.size) { |sum, list| sum + list.size }
+    end
+
+    # Closes all idle sessions. Leased sessions stay open for their callers
+    # and are closed when checked in. A closed pool hands out no sessions.
+    #
+    # @return [ Void ]
+    def close
+      @closed = true
+      @idle.each_value { |list| list.each { |ssh, _| ssh.close } }
+      @idle.clear
+      nil
+    end
+
+    # If the pool has been closed.
+    #
+    # @return [ Boolean ]
+    def closed?
+      @closed
+    end
+
+    private
+
+    # The pool key for the session.
+    #
+    # @return [ String ]
+    def key_for(host, user, port)
+      "#{user}@#{host}:#{port}"
+    end
+
+    # The number of idle and leased sessions for the key.
+    #
+    # @return [ Int ]
+    def count(key)
+      (@idle[key] || []).size + @leased.values.select { |k| k == key }.size
+    end
+
+    # Marks the session as leased.
+    #
+    # @return [ SSH::Session ]
+    def lease(key, session)
+      @leased[session] = key
+      session
+    end
+  end
+end
@@ -43,7 +43,10 @@ module SSH
       return unless host
 
       SSH.startup
+
+      opts = opts.merge(compress: Compression.compress?(host)) if opts[:compress] == :auto
       connect(host, opts)
+      verify_host_key(opts[:verify_host_key]) if opts[:verify_host_key]
 
       login(opts[:user], opts) if opts.include? :user
     end
@@ -106,5 +109,20 @@ module SSH
     def userauth_method_supported?(user, method)
       userauth_methods(user).include? method
     end
+
+    private
+
+    # Verifies the host key against the known hosts and closes the
+    # session if the verification failed.
+    #
+    # @param [ Symbol ] mode :always or :accept_new
+    #
+    # @return [ Void ]
+    def verify_host_key(mode)
+      KnownHosts.verify!(self, mode == true ? :always : mode)
+    rescue HostKeyError
+      close
+      raise
+    end
   end
 end
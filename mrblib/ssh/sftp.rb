@@ -0,0 +1,130 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+module SSH
+  # Client for the SSH File Transfer Protocol. Each instance runs the sftp
+  # subsystem on top of an authenticated session and hands out remote files.
+  #
+  # Reads and writes larger than a single SFTP packet are split by libssh2
+  # into several requests which are kept in flight at the same time.
+  class SFTP
+    # Access modes in the style of Kernel#open mapped to SFTP open flags.
+    MODES = {
+      'r'  => READ,
+      'r+' => READ | WRITE,
+      'w'  => WRITE | CREAT | TRUNC,
+      'w+' => READ | WRITE | CREAT | TRUNC,
+      'a'  => WRITE | CREAT | APPEND,
+      'a+' => READ | WRITE | CREAT | APPEND
+    }.freeze
+
+    # The session the sftp subsystem runs on.
+    #
+    # @return [ SSH::Session ]
+    attr_reader :session
+
+    # Opens a remote file.
+    #
+    # @param [ String ] path   The path of the remote file.
+    # @param [ String ] mode   One of r, r+, w, w+, a or a+.
+    #                          Defaults to: r
+    # @param [ Int ]    perm   The permissions of newly created files.
+    #                          Defaults to: 0644
+    # @param [ Proc ]   &block If given it will be invoked with the file.
+    #
+    # @return [ SSH::SFTP::File ] nil if &block is given.
+    def open(path, mode = 'r', perm = 0o644, &block)
+      flags = MODES[mode.to_s.sub('b', '')]
+
+      raise ArgumentError, "invalid access mode #{mode}" unless flags
+
+      file = File.new(self, path, flags, perm)
+
+      block ? yield(file) && nil : file
+    ensure
+      file.close if block && file
+    end
+
+    # Reads the content of a remote file.
+    #
+    # @param [ String ] path The path of the remote file.
+    #
+    # @return [ String ]
+    def read(path)
+      open(path) { |file| return file.read }
+    end
+
+    # If the sftp subsystem is running.
+    #
+    # @return [ Boolean ]
+    def open?
+      !closed?
+    end
+
+    # A remote file opened through SSH::SFTP#open.
+    class File
+      # The path of the remote file.
+      #
+      # @return [ String ]
+      attr_reader :path
+
+      # The size of the remote file in bytes.
+      #
+      # @return [ Int ]
+      def size
+        stat[:size]
+      end
+
+      # Sets the file position back to the beginning.
+      #
+      # @return [ Int ] 0
+      def rewind
+        seek(0)
+      end
+
+      # Writes the given string to the file.
+      #
+      # @param [ String ] str The string to write.
+      #
+      # @return [ SSH::SFTP::File ] self
+      def <<(str)
+        write(str.to_s)
+        self
+      end
+    end
+  end
+
+  class Session
+    # Starts the sftp subsystem on top of the session.
+    #
+    # @param [ Proc ] &block If given it will be invoked with the client.
+    #
+    # @return [ SSH::SFTP ] nil if &block is given.
+    def sftp(&block)
+      sftp = SFTP.new(self)
+
+      block ? yield(sftp) && nil : sftp
+    ensure
+      sftp.close if block && sftp
+    end
+  end
+end
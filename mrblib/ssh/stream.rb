@@ -55,6 +55,7 @@ module SSH
     #
     # @return [ Void ]
     def close(wait_for_eof = true)
+      __flush__
       channel.eof(wait_for_eof)
     end
   end
@@ -0,0 +1,839 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "agent.h"
+#include "alloc.h"
+#include "store.h"
+
+#include "mruby.h"
+#include "mruby/hash.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libssh2.h>
+
+#ifndef _WIN32
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <unistd.h>
+#endif
+
+#define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
+
+#define MRB_SSH_AGENT_FAILURE           5
+#define MRB_SSH_AGENT_LIST_REQUEST      11
+#define MRB_SSH_AGENT_LIST_ANSWER       12
+#define MRB_SSH_AGENT_SIGN_REQUEST      13
+#define MRB_SSH_AGENT_SIGN_RESPONSE     14
+#define MRB_SSH_AGENT_RSA_SHA2_256      2
+#define MRB_SSH_AGENT_RSA_SHA2_512      4
+
+MRB_SSH_MUTEX(mrb_ssh_agent_mutex);
+#define mrb_ssh_agent_lock()   mrb_ssh_mutex_lock(mrb_ssh_agent_mutex)
+#define mrb_ssh_agent_unlock() mrb_ssh_mutex_unlock(mrb_ssh_agent_mutex)
+
+/* Remembers the identity which logged in user@host:port the last time. */
+typedef struct mrb_ssh_agent_memo
+{
+    struct mrb_ssh_agent_memo *next;
+    char *name;
+    mrb_ssh_agent_key_t key;
+} mrb_ssh_agent_memo_t;
+
+/* The connection to the agent and its identities are shared by all sessions
+   of the process, the agent only gets asked again for its identities if a
+   login failed with all of them. */
+static struct
+{
+    int fd;
+    int stale;
+    long pid;
+    mrb_ssh_agent_key_t *keys;
+    size_t count;
+    mrb_ssh_agent_memo_t *memos[MRB_SSH_AGENT_MEMO_BUCKETS];
+    mrb_int memo_count;
+    mrb_int connects;
+    mrb_int hits;
+    mrb_int misses;
+} mrb_ssh_agent = { -1, 1, 0, NULL, 0, { NULL }, 0, 0, 0, 0 };
+
+static void
+mrb_ssh_agent_set_error (mrb_ssh_t *ssh, int rc, const char *msg)
+{
+#if LIBSSH2_VERSION_NUM >= 0x010601
+    libssh2_session_set_last_error(ssh->session, rc, msg);
+#endif
+}
+
+static void
+mrb_ssh_agent_put_u32 (unsigned char *buf, uint32_t val)
+{
+    buf[0] = (unsigned char)(val >> 24);
+    buf[1] = (unsigned char)(val >> 16);
+    buf[2] = (unsigned char)(val >> 8);
+    buf[3] = (unsigned char)val;
+}
+
+static uint32_t
+mrb_ssh_agent_get_u32 (const unsigned char *buf)
+{
+    return (uint32_t)buf[0] << 24 | (uint32_t)buf[1] << 16 | (uint32_t)buf[2] << 8 | (uint32_t)buf[3];
+}
+
+/* Reads a length prefixed string and advances the cursor. */
+static const unsigned char *
+mrb_ssh_agent_get_str (const unsigned char **buf, const unsigned char *end, size_t *len)
+{
+    const unsigned char *str;
+
+    if (end - *buf < 4) return NULL;
+
+    *len = mrb_ssh_agent_get_u32(*buf);
+    str  = *buf + 4;
+
+    if ((size_t)(end - str) < *len) return NULL;
+
+    *buf = str + *len;
+
+    return str;
+}
+
+static void
+mrb_ssh_agent_free_keys (mrb_ssh_agent_key_t *keys, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        free(keys[i].blob);
+    }
+
+    free(keys);
+}
+
+static int
+mrb_ssh_agent_copy_key (mrb_ssh_agent_key_t *dst, const unsigned char *blob, size_t len)
+{
+    if (!(dst->blob = malloc(len))) return 0;
+
+    memcpy(dst->blob, blob, len);
+    dst->len = len;
+
+    return 1;
+}
+
+static void
+mrb_ssh_agent_name (char *buf, size_t size, const char *user, const char *host, int port)
+{
+    snprintf(buf, size, "%s@%s:%d", user, host ? host : "", port);
+}
+
+static unsigned int
+mrb_ssh_agent_hash (const char *name)
+{
+    return mrb_ssh_str_hash(name) % MRB_SSH_AGENT_MEMO_BUCKETS;
+}
+
+static mrb_ssh_agent_memo_t *
+mrb_ssh_agent_memo_get (const char *name)
+{
+    mrb_ssh_agent_memo_t *memo;
+
+    for (memo = mrb_ssh_agent.memos[mrb_ssh_agent_hash(name)]; memo; memo = memo->next) {
+        if (strcmp(memo->name, name) == 0) return memo;
+    }
+
+    return NULL;
+}
+
+static void
+mrb_ssh_agent_memo_set (const char *name, const mrb_ssh_agent_key_t *key)
+{
+    mrb_ssh_agent_memo_t *memo = mrb_ssh_agent_memo_get(name);
+    unsigned int i;
+
+    if (memo) {
+        if (memo->key.len == key->len && memcmp(memo->key.blob, key->blob, key->len) == 0)
+            return;
+
+        free(memo->key.blob);
+        memo->key.blob = NULL;
+
+        if (!mrb_ssh_agent_copy_key(&memo->key, key->blob, key->len))
+            memo->key.len = 0;
+
+        return;
+    }
+
+    if (!(memo = calloc(1, sizeof(mrb_ssh_agent_memo_t)))) return;
+
+    if (!(memo->name = strdup(name)) || !mrb_ssh_agent_copy_key(&memo->key, key->blob, key->len)) {
+        free(memo->name);
+        free(memo);
+        return;
+    }
+
+    i                       = mrb_ssh_agent_hash(name);
+    memo->next              = mrb_ssh_agent.memos[i];
+    mrb_ssh_agent.memos[i]  = memo;
+    mrb_ssh_agent.memo_count++;
+}
+
+static void
+mrb_ssh_agent_reset (void)
+{
+    mrb_ssh_agent_free_keys(mrb_ssh_agent.keys, mrb_ssh_agent.count);
+
+    mrb_ssh_agent.keys  = NULL;
+    mrb_ssh_agent.count = 0;
+    mrb_ssh_agent.stale = 1;
+}
+
+static int
+mrb_ssh_agent_same_key (const mrb_ssh_agent_key_t *a, const unsigned char *blob, size_t len)
+{
+    return a->len == len && memcmp(a->blob, blob, len) == 0;
+}
+
+/* Copies the keys into the login state, the memoized one first. */
+static int
+mrb_ssh_agent_auth_keys (mrb_ssh_agent_auth_t *auth, const mrb_ssh_agent_key_t *keys, size_t count)
+{
+    mrb_ssh_agent_memo_t *memo = mrb_ssh_agent_memo_get(auth->name);
+    size_t i;
+
+    if (!count)
+        return LIBSSH2_ERROR_AUTHENTICATION_FAILED;
+
+    if (!(auth->keys = calloc(count, sizeof(mrb_ssh_agent_key_t))))
+        return LIBSSH2_ERROR_ALLOC;
+
+    if (memo && memo->key.len) {
+        for (i = 0; i < count; i++) {
+            if (mrb_ssh_agent_same_key(&keys[i], memo->key.blob, memo->key.len)) {
+                auth->memoized = mrb_ssh_agent_copy_key(&auth->keys[0], keys[i].blob, keys[i].len);
+                auth->count    = (size_t)auth->memoized;
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (auth->memoized && mrb_ssh_agent_same_key(&auth->keys[0], keys[i].blob, keys[i].len))
+            continue;
+
+        if (mrb_ssh_agent_copy_key(&auth->keys[auth->count], keys[i].blob, keys[i].len))
+            auth->count++;
+    }
+
+    return 0;
+}
+
+#ifndef _WIN32
+
+static void
+mrb_ssh_agent_disconnect (void)
+{
+    if (mrb_ssh_agent.fd != -1) {
+        close(mrb_ssh_agent.fd);
+    }
+
+    mrb_ssh_agent.fd = -1;
+}
+
+static int
+mrb_ssh_agent_connect (void)
+{
+    const char *path = getenv("SSH_AUTH_SOCK");
+    struct sockaddr_un addr;
+    int fd;
+
+    /* A forked child must not share the parent's agent connection. */
+    if (mrb_ssh_agent.fd != -1 && mrb_ssh_agent.pid == (long)getpid()) return 1;
+
+    mrb_ssh_agent_disconnect();
+
+    if (!path || strlen(path) >= sizeof(addr.sun_path)) return 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) return 0;
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+#ifdef SO_NOSIGPIPE
+    {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    mrb_ssh_agent.fd  = fd;
+    mrb_ssh_agent.pid = (long)getpid();
+    mrb_ssh_agent.connects++;
+
+    return 1;
+}
+
+/* The socket is non-blocking so that a stuck agent can't hold the lock
+   longer than MRB_SSH_AGENT_TIMEOUT for each read or write. */
+static int
+mrb_ssh_agent_io (unsigned char *buf, size_t len, int write)
+{
+    struct pollfd fd;
+    ssize_t n;
+    int rc;
+
+    while (len > 0) {
+#ifdef MSG_NOSIGNAL
+        n = write ? send(mrb_ssh_agent.fd, buf, len, MSG_NOSIGNAL) : recv(mrb_ssh_agent.fd, buf, len, 0);
+#else
+        n = write ? send(mrb_ssh_agent.fd, buf, len, 0) : recv(mrb_ssh_agent.fd, buf, len, 0);
+#endif
+        if (n > 0) {
+            buf += n;
+            len -= (size_t)n;
+            continue;
+        }
+
+        if (n == 0) return 0;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return 0;
+
+        fd.fd      = mrb_ssh_agent.fd;
+        fd.events  = write ? POLLOUT : POLLIN;
+        fd.revents = 0;
+
+        while ((rc = poll(&fd, 1, MRB_SSH_AGENT_TIMEOUT)) < 0 && errno == EINTR);
+
+        if (rc <= 0) return 0;
+    }
+
+    return 1;
+}
+
+/* Sends a request which includes its length prefix and reads the answer.
+   The connection gets reopened once if the agent went away meanwhile. */
+static unsigned char *
+mrb_ssh_agent_request (unsigned char *req, size_t len, size_t *res_len)
+{
+    unsigned char head[4], *res;
+    int attempt;
+
+    for (attempt = 0; attempt < 2; attempt++) {
+        if (!mrb_ssh_agent_connect()) return NULL;
+
+        if (mrb_ssh_agent_io(req, len, 1) && mrb_ssh_agent_io(head, 4, 0)) {
+            *res_len = mrb_ssh_agent_get_u32(head);
+
+            if (*res_len == 0 || *res_len > 256 * 1024 || !(res = malloc(*res_len)))
+                break;
+
+            if (mrb_ssh_agent_io(res, *res_len, 0))
+                return res;
+
+            free(res);
+        }
+
+        mrb_ssh_agent_disconnect();
+    }
+
+    mrb_ssh_agent_disconnect();
+
+    return NULL;
+}
+
+static int
+mrb_ssh_agent_list (void)
+{
+    unsigned char req[5], *res;
+    const unsigned char *pos, *end, *blob;
+    mrb_ssh_agent_key_t *keys;
+    size_t len, blob_len, count = 0, i;
+
+    mrb_ssh_agent_put_u32(req, 1);
+    req[4] = MRB_SSH_AGENT_LIST_REQUEST;
+
+    if (!(res = mrb_ssh_agent_request(req, sizeof(req), &len)))
+        return 0;
+
+    pos = res + 5;
+    end = res + len;
+
+    if (len < 5 || res[0] != MRB_SSH_AGENT_LIST_ANSWER || (count = mrb_ssh_agent_get_u32(res + 1)) > 1024 ||
+        !(keys = calloc(count ? count : 1, sizeof(mrb_ssh_agent_key_t)))) {
+        free(res);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!(blob = mrb_ssh_agent_get_str(&pos, end, &blob_len)) ||
+            !mrb_ssh_agent_get_str(&pos, end, &len) ||
+            !mrb_ssh_agent_copy_key(&keys[i], blob, blob_len))
+            break;
+    }
+
+    free(res);
+
+    mrb_ssh_agent_reset();
+
+    mrb_ssh_agent.keys  = keys;
+    mrb_ssh_agent.count = i;
+    mrb_ssh_agent.stale = 0;
+
+    return 1;
+}
+
+/* The data to sign carries the signature algorithm libssh2 picked, RSA keys
+   need to tell the agent which hash to use. */
+static uint32_t
+mrb_ssh_agent_sign_flags (const unsigned char *data, size_t data_len)
+{
+    const unsigned char *pos = data, *end = data + data_len, *method = NULL;
+    size_t len = 0;
+    int i;
+
+    if (!mrb_ssh_agent_get_str(&pos, end, &len) || pos == end) return 0;
+
+    pos++;
+
+    for (i = 0; i < 4; i++) {
+        if (!(method = mrb_ssh_agent_get_str(&pos, end, &len))) return 0;
+        if (i == 2) {
+            if (pos == end) return 0;
+            pos++;
+        }
+    }
+
+    if (len == 12 && memcmp(method, "rsa-sha2-256", 12) == 0)
+        return MRB_SSH_AGENT_RSA_SHA2_256;
+
+    if (len == 12 && memcmp(method, "rsa-sha2-512", 12) == 0)
+        return MRB_SSH_AGENT_RSA_SHA2_512;
+
+    return 0;
+}
+
+static
+LIBSSH2_USERAUTH_PUBLICKEY_SIGN_FUNC(mrb_ssh_agent_sign)
+{
+    mrb_ssh_agent_key_t *key = *abstract;
+    unsigned char *req, *res;
+    const unsigned char *pos, *end, *blob;
+    size_t len, req_len, blob_len;
+
+    req_len = 4 + 1 + 4 + key->len + 4 + data_len + 4;
+
+    if (!(req = malloc(req_len))) return -1;
+
+    mrb_ssh_agent_put_u32(req, (uint32_t)(req_len - 4));
+    req[4] = MRB_SSH_AGENT_SIGN_REQUEST;
+    mrb_ssh_agent_put_u32(req + 5, (uint32_t)key->len);
+    memcpy(req + 9, key->blob, key->len);
+    mrb_ssh_agent_put_u32(req + 9 + key->len, (uint32_t)data_len);
+    memcpy(req + 13 + key->len, data, data_len);
+    mrb_ssh_agent_put_u32(req + 13 + key->len + data_len, mrb_ssh_agent_sign_flags(data, data_len));
+
+    mrb_ssh_agent_lock();
+    res = mrb_ssh_agent_request(req, req_len, &len);
+    mrb_ssh_agent_unlock();
+
+    free(req);
+
+    if (!res) return -1;
+
+    pos = res + 1;
+    end = res + len;
+
+    if (res[0] != MRB_SSH_AGENT_SIGN_RESPONSE || !(pos = mrb_ssh_agent_get_str(&pos, end, &len))) {
+        free(res);
+        return -1;
+    }
+
+    /* string signature := string format, string blob */
+    end = pos + len;
+
+    if (!mrb_ssh_agent_get_str(&pos, end, &len) ||
+        !(blob = mrb_ssh_agent_get_str(&pos, end, &blob_len)) ||
+        !(*sig = mrb_ssh_alloc(blob_len, libssh2_session_abstract(session)))) {
+        free(res);
+        return -1;
+    }
+
+    memcpy(*sig, blob, blob_len);
+    *sig_len = blob_len;
+
+    free(res);
+
+    return 0;
+}
+
+static int
+mrb_ssh_agent_auth_init (mrb_ssh_agent_auth_t *auth, mrb_ssh_t *ssh)
+{
+    int rc;
+
+    mrb_ssh_agent_lock();
+
+    if (mrb_ssh_agent.stale && !mrb_ssh_agent_list()) {
+        rc = LIBSSH2_ERROR_AGENT_PROTOCOL;
+    } else {
+        rc = mrb_ssh_agent_auth_keys(auth, mrb_ssh_agent.keys, mrb_ssh_agent.count);
+    }
+
+    if (rc != 0) {
+        mrb_ssh_agent.stale = 1;
+    }
+
+    mrb_ssh_agent_unlock();
+
+    return rc;
+}
+
+static int
+mrb_ssh_agent_auth_try (mrb_ssh_agent_auth_t *auth, mrb_ssh_t *ssh, const char *user, mrb_ssh_agent_key_t *key)
+{
+    return libssh2_userauth_publickey(ssh->session, user, key->blob, key->len, mrb_ssh_agent_sign, (void **)&key);
+}
+
+#else
+
+static void
+mrb_ssh_agent_disconnect (void) {}
+
+/* Windows talks to Pageant or the OpenSSH pipe through libssh2 for each
+   login, only the identity memo applies. */
+static int
+mrb_ssh_agent_auth_init (mrb_ssh_agent_auth_t *auth, mrb_ssh_t *ssh)
+{
+    struct libssh2_agent_publickey *identity, *prev = NULL;
+    mrb_ssh_agent_key_t *keys = NULL, *tmp;
+    size_t count = 0, capa = 0;
+    int rc;
+
+    if (!(auth->agent = libssh2_agent_init(ssh->session)))
+        return LIBSSH2_ERROR_ALLOC;
+
+    if ((rc = libssh2_agent_connect(auth->agent)) < 0 || (rc = libssh2_agent_list_identities(auth->agent)) < 0)
+        return rc;
+
+    for (; libssh2_agent_get_identity(auth->agent, &identity, prev) == 0; prev = identity, count++) {
+        if (count == capa) {
+            capa = capa ? capa * 2 : 8;
+
+            if (!(tmp = realloc(keys, capa * sizeof(mrb_ssh_agent_key_t)))) {
+                free(keys);
+                return LIBSSH2_ERROR_ALLOC;
+            }
+
+            keys = tmp;
+        }
+
+        keys[count].blob = identity->blob;
+        keys[count].len  = identity->blob_len;
+    }
+
+    mrb_ssh_agent_lock();
+    mrb_ssh_agent.connects++;
+    rc = mrb_ssh_agent_auth_keys(auth, keys, count);
+    mrb_ssh_agent_unlock();
+
+    free(keys);
+
+    return rc;
+}
+
+static int
+mrb_ssh_agent_auth_try (mrb_ssh_agent_auth_t *auth, mrb_ssh_t *ssh, const char *user, mrb_ssh_agent_key_t *key)
+{
+    struct libssh2_agent_publickey *identity, *prev = NULL;
+
+    for (; libssh2_agent_get_identity(auth->agent, &identity, prev) == 0; prev = identity) {
+        if (mrb_ssh_agent_same_key(key, identity->blob, identity->blob_len))
+            return libssh2_agent_userauth(auth->agent, user, identity);
+    }
+
+    return LIBSSH2_ERROR_AUTHENTICATION_FAILED;
+}
+
+#endif
+
+static void
+mrb_ssh_agent_auth_done (mrb_ssh_agent_auth_t *auth, int rc)
+{
+    mrb_ssh_agent_lock();
+
+    if (rc == 0) {
+        mrb_ssh_agent_memo_set(auth->name, &auth->keys[auth->pos]);
+    } else if (auth->pos >= auth->count) {
+        mrb_ssh_agent.stale = 1;
+    }
+
+    if (rc == 0 && auth->memoized && auth->pos == 0) {
+        mrb_ssh_agent.hits++;
+    } else {
+        mrb_ssh_agent.misses++;
+    }
+
+    mrb_ssh_agent_unlock();
+}
+
+int
+mrb_ssh_agent_auth_step (mrb_ssh_agent_auth_t *auth, mrb_ssh_t *ssh, const char *user, const char *host)
+{
+    char name[1100];
+    int rc;
+
+    if (!auth->name) {
+        mrb_ssh_agent_name(name, sizeof(name), user, host, ssh->port);
+
+        if (!(auth->name = strdup(name)))
+            return LIBSSH2_ERROR_ALLOC;
+
+        if ((rc = mrb_ssh_agent_auth_init(auth, ssh)) != 0) {
+            auth->pos = auth->count;
+            mrb_ssh_agent_set_error(ssh, rc, rc == LIBSSH2_ERROR_AGENT_PROTOCOL ? "Could not talk to the ssh-agent." : "No identity of the ssh-agent accepted.");
+            return rc;
+        }
+    }
+
+    for (rc = LIBSSH2_ERROR_AUTHENTICATION_FAILED; auth->pos < auth->count; auth->pos++) {
+        if ((rc = mrb_ssh_agent_auth_try(auth, ssh, user, &auth->keys[auth->pos])) == LIBSSH2_ERROR_EAGAIN)
+            return rc;
+
+        if (rc == 0 || rc == LIBSSH2_ERROR_SOCKET_DISCONNECT || rc == LIBSSH2_ERROR_SOCKET_SEND || rc == LIBSSH2_ERROR_SOCKET_RECV)
+            break;
+    }
+
+    mrb_ssh_agent_auth_done(auth, rc);
+
+    return rc;
+}
+
+void
+mrb_ssh_agent_auth_free (mrb_ssh_agent_auth_t *auth)
+{
+#ifdef _WIN32
+    if (auth->agent) {
+        libssh2_agent_disconnect(auth->agent);
+        libssh2_agent_free(auth->agent);
+    }
+#endif
+
+    mrb_ssh_agent_free_keys(auth->keys, auth->count);
+    free(auth->name);
+
+    memset(auth, 0, sizeof(mrb_ssh_agent_auth_t));
+}
+
+int
+mrb_ssh_agent_userauth (mrb_ssh_t *ssh, const char *user, const char *host)
+{
+    mrb_ssh_agent_auth_t auth;
+    int rc;
+
+    memset(&auth, 0, sizeof(mrb_ssh_agent_auth_t));
+
+    while ((rc = mrb_ssh_agent_auth_step(&auth, ssh, user, host)) == LIBSSH2_ERROR_EAGAIN) {
+        mrb_ssh_wait_sock(ssh);
+    }
+
+    mrb_ssh_agent_auth_free(&auth);
+
+    return rc;
+}
+
+void
+mrb_ssh_agent_clear (void)
+{
+    mrb_ssh_agent_memo_t *memo, *next;
+    int i;
+
+    mrb_ssh_agent_lock();
+
+    mrb_ssh_agent_disconnect();
+    mrb_ssh_agent_reset();
+
+    for (i = 0; i < MRB_SSH_AGENT_MEMO_BUCKETS; i++) {
+        for (memo = mrb_ssh_agent.memos[i]; memo; memo = next) {
+            next = memo->next;
+            free(memo->name);
+            free(memo->key.blob);
+            free(memo);
+        }
+
+        mrb_ssh_agent.memos[i] = NULL;
+    }
+
+    mrb_ssh_agent.memo_count = 0;
+    mrb_ssh_agent.connects   = 0;
+    mrb_ssh_agent.hits       = 0;
+    mrb_ssh_agent.misses     = 0;
+
+    mrb_ssh_agent_unlock();
+}
+
+static mrb_value
+mrb_ssh_f_agent_reload (mrb_state *mrb, mrb_value self)
+{
+    mrb_int count = -1;
+
+    mrb_ssh_agent_lock();
+
+#ifndef _WIN32
+    mrb_ssh_agent_disconnect();
+
+    if (mrb_ssh_agent_list()) {
+        count = (mrb_int)mrb_ssh_agent.count;
+    }
+#endif
+
+    mrb_ssh_agent_unlock();
+
+    return count < 0 ? mrb_nil_value() : mrb_fixnum_value(count);
+}
+
+static mrb_value
+mrb_ssh_f_agent_identities (mrb_state *mrb, mrb_value self)
+{
+    const char *user, *host;
+    mrb_int port = 22;
+    mrb_ssh_agent_auth_t auth;
+    mrb_value res;
+    char name[1100];
+    size_t i;
+    int rc = LIBSSH2_ERROR_AGENT_PROTOCOL;
+
+    mrb_get_args(mrb, "zz|i", &user, &host, &port);
+
+    memset(&auth, 0, sizeof(mrb_ssh_agent_auth_t));
+    mrb_ssh_agent_name(name, sizeof(name), user, host, (int)port);
+
+    auth.name = name;
+
+    mrb_ssh_agent_lock();
+
+#ifndef _WIN32
+    if (!mrb_ssh_agent.stale || mrb_ssh_agent_list()) {
+        rc = mrb_ssh_agent_auth_keys(&auth, mrb_ssh_agent.keys, mrb_ssh_agent.count);
+    }
+#endif
+
+    mrb_ssh_agent_unlock();
+
+    if (rc == LIBSSH2_ERROR_AGENT_PROTOCOL)
+        return mrb_nil_value();
+
+    res = mrb_ary_new_capa(mrb, (mrb_int)auth.count);
+
+    for (i = 0; i < auth.count; i++) {
+        mrb_ary_push(mrb, res, mrb_str_new(mrb, (const char *)auth.keys[i].blob, (mrb_int)auth.keys[i].len));
+    }
+
+    auth.name = NULL;
+    mrb_ssh_agent_auth_free(&auth);
+
+    return res;
+}
+
+static mrb_value
+mrb_ssh_f_agent_prefer (mrb_state *mrb, mrb_value self)
+{
+    const char *user, *host;
+    mrb_int port = 22;
+    mrb_ssh_agent_key_t key;
+    mrb_value blob;
+    char name[1100];
+
+    mrb_get_args(mrb, "zzS|i", &user, &host, &blob, &port);
+
+    mrb_ssh_agent_name(name, sizeof(name), user, host, (int)port);
+
+    key.blob = (unsigned char *)RSTRING_PTR(blob);
+    key.len  = (size_t)RSTRING_LEN(blob);
+
+    mrb_ssh_agent_lock();
+    mrb_ssh_agent_memo_set(name, &key);
+    mrb_ssh_agent_unlock();
+
+    return self;
+}
+
+static mrb_value
+mrb_ssh_f_agent_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_value stats = mrb_hash_new_capa(mrb, 5);
+    mrb_int connects, hits, misses, size, memos;
+
+    mrb_ssh_agent_lock();
+    connects = mrb_ssh_agent.connects;
+    hits     = mrb_ssh_agent.hits;
+    misses   = mrb_ssh_agent.misses;
+    size     = (mrb_int)mrb_ssh_agent.count;
+    memos    = mrb_ssh_agent.memo_count;
+    mrb_ssh_agent_unlock();
+
+    mrb_hash_set(mrb, stats, SYM("connects", 8),   mrb_fixnum_value(connects));
+    mrb_hash_set(mrb, stats, SYM("hits", 4),       mrb_fixnum_value(hits));
+    mrb_hash_set(mrb, stats, SYM("misses", 6),     mrb_fixnum_value(misses));
+    mrb_hash_set(mrb, stats, SYM("identities", 10), mrb_fixnum_value(size));
+    mrb_hash_set(mrb, stats, SYM("memos", 5),      mrb_fixnum_value(memos));
+
+    return stats;
+}
+
+static mrb_value
+mrb_ssh_f_agent_clear (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_agent_clear();
+
+    return self;
+}
+
+void
+mrb_mruby_ssh_agent_init (mrb_state *mrb)
+{
+    struct RClass *ssh   = mrb_module_get(mrb, "SSH");
+    struct RClass *agent = mrb_define_module_under(mrb, ssh, "Agent");
+
+    mrb_define_module_function(mrb, agent, "reload",     mrb_ssh_f_agent_reload,     MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, agent, "identities", mrb_ssh_f_agent_identities, MRB_ARGS_ARG(2,1));
+    mrb_define_module_function(mrb, agent, "prefer",     mrb_ssh_f_agent_prefer,     MRB_ARGS_ARG(3,1));
+    mrb_define_module_function(mrb, agent, "stats",      mrb_ssh_f_agent_stats,      MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, agent, "clear",      mrb_ssh_f_agent_clear,      MRB_ARGS_NONE());
+}
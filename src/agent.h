@@ -0,0 +1,68 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mruby.h"
+#include "mruby/ext/ssh.h"
+
+#include <stddef.h>
+#include <libssh2.h>
+
+MRB_BEGIN_DECL
+
+#ifndef MRB_SSH_AGENT_MEMO_BUCKETS
+# define MRB_SSH_AGENT_MEMO_BUCKETS 256
+#endif
+
+/* Max. milliseconds to wait for each read or write on the agent socket. */
+#ifndef MRB_SSH_AGENT_TIMEOUT
+# define MRB_SSH_AGENT_TIMEOUT 5000
+#endif
+
+typedef struct mrb_ssh_agent_key
+{
+    unsigned char *blob;
+    size_t len;
+} mrb_ssh_agent_key_t;
+
+/* State of a non-blocking login through the agent, the identities are tried
+   in order starting with the one that logged in last time. */
+typedef struct mrb_ssh_agent_auth
+{
+    char *name;
+    mrb_ssh_agent_key_t *keys;
+    size_t count;
+    size_t pos;
+    int memoized;
+#ifdef _WIN32
+    LIBSSH2_AGENT *agent;
+#endif
+} mrb_ssh_agent_auth_t;
+
+int  mrb_ssh_agent_auth_step (mrb_ssh_agent_auth_t *auth, mrb_ssh_t *ssh, const char *user, const char *host);
+void mrb_ssh_agent_auth_free (mrb_ssh_agent_auth_t *auth);
+int  mrb_ssh_agent_userauth (mrb_ssh_t *ssh, const char *user, const char *host);
+void mrb_ssh_agent_clear (void);
+
+void mrb_mruby_ssh_agent_init (mrb_state *mrb);
+
+MRB_END_DECL
@@ -0,0 +1,255 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "alloc.h"
+#include "store.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MRB_SSH_POOL_SIZE(cls) ((size_t)MRB_SSH_POOL_MIN_SIZE << (cls))
+#define MRB_SSH_POOL_NONE      ((size_t)-1)
+
+/* Bytes all pools hold from the system, live and cached blocks included. */
+static size_t mrb_ssh_pool_bytes = 0;
+MRB_SSH_MUTEX(mrb_ssh_pool_mutex);
+
+/* Every block starts with a header that remembers the requested size for the
+   accounting and the size class to return the block to. */
+typedef union mrb_ssh_block
+{
+    struct {
+        size_t size;
+        size_t cls;
+    } h;
+    double align;
+} mrb_ssh_block_t;
+
+static size_t
+mrb_ssh_pool_class (size_t size)
+{
+    size_t cls;
+
+    for (cls = 0; cls < MRB_SSH_POOL_CLASSES; cls++) {
+        if (size <= MRB_SSH_POOL_SIZE(cls)) return cls;
+    }
+
+    return MRB_SSH_POOL_NONE;
+}
+
+static void
+mrb_ssh_pool_account (size_t freed, size_t taken)
+{
+    mrb_ssh_mutex_lock(mrb_ssh_pool_mutex);
+    mrb_ssh_pool_bytes = mrb_ssh_pool_bytes - freed + taken;
+    mrb_ssh_mutex_unlock(mrb_ssh_pool_mutex);
+}
+
+static size_t
+mrb_ssh_block_bytes (mrb_ssh_block_t *block)
+{
+    return sizeof(mrb_ssh_block_t) + (block->h.cls != MRB_SSH_POOL_NONE ? MRB_SSH_POOL_SIZE(block->h.cls) : block->h.size);
+}
+
+static void *
+mrb_ssh_pool_malloc (mrb_ssh_pool_t *pool, size_t size)
+{
+    void *ptr;
+
+#ifdef MRB_SSH_MRB_ALLOCF
+    ptr = mrb_malloc_simple(pool->mrb, size);
+#else
+    ptr = malloc(size);
+#endif
+
+    if (ptr) mrb_ssh_pool_account(0, size);
+
+    return ptr;
+}
+
+static void *
+mrb_ssh_pool_realloc (mrb_ssh_pool_t *pool, void *ptr, size_t old, size_t size)
+{
+#ifdef MRB_SSH_MRB_ALLOCF
+    ptr = mrb_realloc_simple(pool->mrb, ptr, size);
+#else
+    ptr = realloc(ptr, size);
+#endif
+
+    if (ptr) mrb_ssh_pool_account(old, size);
+
+    return ptr;
+}
+
+static void
+mrb_ssh_pool_free (mrb_ssh_pool_t *pool, mrb_ssh_block_t *block)
+{
+    mrb_ssh_pool_account(mrb_ssh_block_bytes(block), 0);
+
+#ifdef MRB_SSH_MRB_ALLOCF
+    mrb_free(pool->mrb, block);
+#else
+    free(block);
+#endif
+}
+
+LIBSSH2_ALLOC_FUNC(mrb_ssh_alloc)
+{
+    mrb_ssh_pool_t *pool = &((mrb_ssh_t *)*abstract)->pool;
+    size_t cls           = mrb_ssh_pool_class(count);
+    mrb_ssh_block_t *block;
+
+    if (cls != MRB_SSH_POOL_NONE && pool->free[cls]) {
+        block           = (mrb_ssh_block_t *)pool->free[cls];
+        pool->free[cls] = *(void **)(block + 1);
+        pool->cached[cls]--;
+        pool->cached_bytes -= MRB_SSH_POOL_SIZE(cls);
+        pool->hits++;
+    } else {
+        block = mrb_ssh_pool_malloc(pool, sizeof(mrb_ssh_block_t) + (cls != MRB_SSH_POOL_NONE ? MRB_SSH_POOL_SIZE(cls) : count));
+        if (!block) return NULL;
+    }
+
+    block->h.size = count;
+    block->h.cls  = cls;
+
+    pool->allocs++;
+    pool->live += count;
+
+    if (pool->live > pool->peak) {
+        pool->peak = pool->live;
+    }
+
+    return block + 1;
+}
+
+LIBSSH2_FREE_FUNC(mrb_ssh_free)
+{
+    mrb_ssh_pool_t *pool = &((mrb_ssh_t *)*abstract)->pool;
+    mrb_ssh_block_t *block;
+    size_t cls;
+
+    if (!ptr) return;
+
+    block       = (mrb_ssh_block_t *)ptr - 1;
+    cls         = block->h.cls;
+    pool->live -= block->h.size;
+
+    if (cls == MRB_SSH_POOL_NONE || pool->cached[cls] >= MRB_SSH_POOL_DEPTH
+        || pool->cached_bytes + MRB_SSH_POOL_SIZE(cls) > MRB_SSH_POOL_LIMIT) {
+        mrb_ssh_pool_free(pool, block);
+        return;
+    }
+
+    *(void **)ptr   = pool->free[cls];
+    pool->free[cls] = block;
+    pool->cached[cls]++;
+    pool->cached_bytes += MRB_SSH_POOL_SIZE(cls);
+}
+
+LIBSSH2_REALLOC_FUNC(mrb_ssh_realloc)
+{
+    mrb_ssh_pool_t *pool = &((mrb_ssh_t *)*abstract)->pool;
+    mrb_ssh_block_t *block;
+    void *res;
+
+    if (!ptr) return mrb_ssh_alloc(count, abstract);
+
+    block = (mrb_ssh_block_t *)ptr - 1;
+
+    if (block->h.cls != MRB_SSH_POOL_NONE && count <= MRB_SSH_POOL_SIZE(block->h.cls)) {
+        pool->live    = pool->live - block->h.size + count;
+        block->h.size = count;
+    }
+    else if (block->h.cls == MRB_SSH_POOL_NONE && mrb_ssh_pool_class(count) == MRB_SSH_POOL_NONE) {
+        size_t size = block->h.size;
+
+        if (!(block = mrb_ssh_pool_realloc(pool, block, sizeof(mrb_ssh_block_t) + size, sizeof(mrb_ssh_block_t) + count)))
+            return NULL;
+
+        pool->live    = pool->live - size + count;
+        block->h.size = count;
+    }
+    else {
+        if (!(res = mrb_ssh_alloc(count, abstract)))
+            return NULL;
+
+        memcpy(res, ptr, block->h.size < count ? block->h.size : count);
+        mrb_ssh_free(ptr, abstract);
+
+        return res;
+    }
+
+    if (pool->live > pool->peak) {
+        pool->peak = pool->live;
+    }
+
+    return block + 1;
+}
+
+void
+mrb_ssh_pool_init (mrb_state *mrb, mrb_ssh_pool_t *pool)
+{
+    memset(pool, 0, sizeof(mrb_ssh_pool_t));
+    pool->mrb = mrb;
+}
+
+void
+mrb_ssh_pool_clear (mrb_ssh_pool_t *pool)
+{
+    size_t cls;
+    mrb_ssh_block_t *block;
+
+    for (cls = 0; cls < MRB_SSH_POOL_CLASSES; cls++) {
+        while ((block = pool->free[cls])) {
+            pool->free[cls] = *(void **)(block + 1);
+            mrb_ssh_pool_free(pool, block);
+        }
+
+        pool->cached[cls] = 0;
+    }
+
+    pool->cached_bytes = 0;
+}
+
+size_t
+mrb_ssh_pool_trim (mrb_ssh_pool_t *pool)
+{
+    size_t bytes = pool->cached_bytes;
+
+    mrb_ssh_pool_clear(pool);
+
+    return bytes;
+}
+
+size_t
+mrb_ssh_pool_usage ()
+{
+    size_t bytes;
+
+    mrb_ssh_mutex_lock(mrb_ssh_pool_mutex);
+    bytes = mrb_ssh_pool_bytes;
+    mrb_ssh_mutex_unlock(mrb_ssh_pool_mutex);
+
+    return bytes;
+}
@@ -0,0 +1,53 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mruby.h"
+#include "mruby/ext/ssh.h"
+
+#include <libssh2.h>
+
+MRB_BEGIN_DECL
+
+#ifndef MRB_SSH_POOL_MIN_SIZE
+# define MRB_SSH_POOL_MIN_SIZE 64
+#endif
+
+#ifndef MRB_SSH_POOL_DEPTH
+# define MRB_SSH_POOL_DEPTH 16
+#endif
+
+/* Upper bound for the bytes a session keeps in its free lists. */
+#ifndef MRB_SSH_POOL_LIMIT
+# define MRB_SSH_POOL_LIMIT 0x40000
+#endif
+
+LIBSSH2_ALLOC_FUNC(mrb_ssh_alloc);
+LIBSSH2_REALLOC_FUNC(mrb_ssh_realloc);
+LIBSSH2_FREE_FUNC(mrb_ssh_free);
+
+void mrb_ssh_pool_init (mrb_state *mrb, mrb_ssh_pool_t *pool);
+void mrb_ssh_pool_clear (mrb_ssh_pool_t *pool);
+size_t mrb_ssh_pool_trim (mrb_ssh_pool_t *pool);
+size_t mrb_ssh_pool_usage ();
+
+MRB_END_DECL
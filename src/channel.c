@@ -24,6 +24,9 @@
 #ifndef MRB_SSH_TINY
 
 #include "channel.h"
+#include "stream.h"
+#include "poller.h"
+#include "socket.h"
 
 #include "mruby.h"
 #include "mruby/data.h"
@@ -33,6 +36,7 @@
 #include "mruby/variable.h"
 #include "mruby/ext/ssh.h"
 
+#include <string.h>
 #include <libssh2.h>
 
 #define SYM(name, len) mrb_intern_static(mrb, name, len)
@@ -51,6 +55,8 @@ mrb_ssh_channel_free3 (mrb_state *mrb, void *p, mrb_bool wait)
     ssh     = data->session->data;
     channel = data->channel;
 
+    mrb_ssh_stream_release_all(data, ssh);
+
     if (channel && ssh && mrb_ssh_initialized()) {
         if (wait == TRUE) {
             while (libssh2_channel_close(channel)       == LIBSSH2_ERROR_EAGAIN) { mrb_ssh_wait_sock(ssh); }
@@ -102,23 +108,119 @@ mrb_ssh_channel_bang (mrb_state *mrb, mrb_value self)
     return channel;
 }
 
+/* Grows the receive window towards twice the bandwidth-delay product. The
+   bandwidth is the read rate of the last sample, the delay is approximated
+   by the time it took to open the channel, which is one round trip. Once
+   grown, the window gets topped up whenever less than half of it is left.
+   An adjustment that would block is kept pending and retried with the same
+   amount, since libssh2 resumes it with the packet it already built. */
+void
+mrb_ssh_window_tune (mrb_ssh_window_t *win, LIBSSH2_CHANNEL *channel, int64_t rtt, size_t bytes)
+{
+    unsigned long left;
+    uint64_t target;
+    int64_t now, elapsed;
+    int rc;
+
+    if (!win->max) return;
+
+    if (win->pending) {
+        rc = libssh2_channel_receive_window_adjust2(channel, (unsigned long)win->pending, 1, NULL);
+
+        if (rc == LIBSSH2_ERROR_EAGAIN) return;
+
+        win->pending = 0;
+    }
+
+    now          = mrb_ssh_now();
+    elapsed      = now - win->mark;
+    rtt          = rtt > 0 ? rtt : 1000;
+    win->bytes  += bytes;
+
+    if (elapsed >= MRB_SSH_WINDOW_SAMPLE && elapsed >= rtt) {
+        target     = 2 * win->bytes * (uint64_t)rtt / (uint64_t)elapsed;
+        win->bytes = 0;
+        win->mark  = now;
+
+        if (target > win->max) {
+            target = win->max;
+        }
+
+        if (target > win->size) {
+            win->size = target;
+            win->adjusts++;
+        }
+    }
+
+    left = libssh2_channel_window_read_ex(channel, NULL, NULL);
+
+    if (left < win->size / 2) {
+        win->pending = win->size - left;
+        rc           = libssh2_channel_receive_window_adjust2(channel, (unsigned long)win->pending, 1, NULL);
+
+        if (rc != LIBSSH2_ERROR_EAGAIN) {
+            win->pending = 0;
+        }
+    }
+}
+
+void
+mrb_ssh_channel_tune_window (mrb_ssh_channel_t *data, size_t bytes)
+{
+    mrb_ssh_window_tune(&data->window, data->channel, data->stats.open_time, bytes);
+}
+
+/* The upper bound for window: :auto, or 0 if the window stays fixed. */
+mrb_int
+mrb_ssh_window_opt (mrb_state *mrb, mrb_value opts)
+{
+    mrb_value tuning = mrb_hash_get(mrb, opts, mrb_symbol_value(SYM("window", 6)));
+
+    if (!mrb_test(tuning))
+        return 0;
+
+    if (!mrb_symbol_p(tuning) || mrb_symbol(tuning) != SYM("auto", 4)) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "window must be :auto");
+    }
+
+    return mrb_fixnum(mrb_hash_fetch(mrb, opts, mrb_symbol_value(SYM("max_window", 10)), mrb_fixnum_value(MRB_SSH_WINDOW_MAX)));
+}
+
 static mrb_value
-mrb_ssh_f_open (mrb_state *mrb, mrb_value self)
+mrb_ssh_channel_open (mrb_state *mrb, mrb_value self, mrb_bool nonblock)
 {
     const char *ctype, *msg   = NULL;
     mrb_int type_len, msg_len = 0;
-    mrb_int win_size, pkg_size;
+    mrb_int win_size, pkg_size, win_max = 0;
+    mrb_bool opts_given       = FALSE;
+    int blocking = 1;
+    int64_t since;
 
     mrb_ssh_t *ssh;
     LIBSSH2_CHANNEL *channel;
     mrb_ssh_channel_t *data;
-    mrb_value session, type;
+    mrb_value session, type, started, cmd = mrb_nil_value(), opts;
 
     if (DATA_PTR(self)) {
         mrb_raise(mrb, E_SSH_ERROR, "SSH Channel already open.");
     }
 
-    mrb_get_args(mrb, "|s!", &msg, &msg_len);
+    mrb_get_args(mrb, "|oH?", &cmd, &opts, &opts_given);
+
+    if (mrb_hash_p(cmd) && !opts_given) {
+        opts       = cmd;
+        cmd        = mrb_nil_value();
+        opts_given = TRUE;
+    }
+
+    if (!mrb_nil_p(cmd)) {
+        msg     = mrb_string_value_ptr(mrb, cmd);
+        msg_len = mrb_string_value_len(mrb, cmd);
+    }
+
+    if (opts_given) {
+        win_max = mrb_ssh_window_opt(mrb, opts);
+    }
 
     session = mrb_attr_get(mrb, self, SYM("@session", 8));
     ssh     = DATA_PTR(session);
@@ -136,22 +238,54 @@ mrb_ssh_f_open (mrb_state *mrb, mrb_value self)
     type     = mrb_attr_get(mrb, self, SYM("@type", 5));
     ctype    = mrb_string_value_ptr(mrb, type);
     type_len = mrb_string_value_len(mrb, type);
+    started  = mrb_iv_get(mrb, self, SYM("__since__", 9));
+    since    = mrb_float_p(started) ? (int64_t)mrb_float(started) : mrb_ssh_now();
+
+    if (nonblock) {
+        blocking = libssh2_session_get_blocking(ssh->session);
+        libssh2_session_set_blocking(ssh->session, 0);
+    }
 
     do {
         channel = libssh2_channel_open_ex(ssh->session, ctype, (unsigned int)type_len, (unsigned int)win_size, (unsigned int)pkg_size, msg, (unsigned int)msg_len);
 
-        if (channel) break;
+        if (channel || nonblock) break;
 
-        if (libssh2_session_last_errno(ssh->session) == LIBSSH2_ERROR_EAGAIN) {
-            mrb_ssh_wait_sock(ssh);
-        } else {
-            mrb_ssh_raise_last_error(mrb, ssh);
-        }
+        if (libssh2_session_last_errno(ssh->session) != LIBSSH2_ERROR_EAGAIN) break;
+
+        mrb_ssh_wait_sock(ssh);
     } while (!channel);
 
+    if (nonblock) {
+        libssh2_session_set_blocking(ssh->session, blocking);
+    }
+
+    if (!channel && libssh2_session_last_errno(ssh->session) == LIBSSH2_ERROR_EAGAIN) {
+        mrb_iv_set(mrb, self, SYM("__since__", 9), mrb_float_value(mrb, (mrb_float)since));
+        return mrb_ssh_wait_symbol(mrb, ssh->session);
+    }
+
+    mrb_iv_remove(mrb, self, SYM("__since__", 9));
+
+    if (!channel) {
+        mrb_ssh_raise_last_error(mrb, ssh);
+    }
+
     data          = mrb_malloc(mrb, sizeof(mrb_ssh_channel_t));
     data->session = mrb_ptr(session);
     data->channel = channel;
+    data->streams = NULL;
+
+    memset(&data->stats, 0, sizeof(mrb_ssh_channel_stats_t));
+    memset(&data->window, 0, sizeof(mrb_ssh_window_t));
+
+    data->stats.open_time         = mrb_ssh_now() - since;
+    ssh->stats.channel_open_time += data->stats.open_time;
+    ssh->stats.channel_opens++;
+
+    data->window.size = (uint64_t)win_size;
+    data->window.max  = win_max > win_size ? (uint64_t)win_max : 0;
+    data->window.mark = mrb_ssh_now();
 
     mrb_data_init(self, data, &mrb_ssh_channel_type);
     mrb_iv_set(mrb, self, SYM("@exitstatus", 11), mrb_nil_value());
@@ -160,9 +294,21 @@ mrb_ssh_f_open (mrb_state *mrb, mrb_value self)
 }
 
 static mrb_value
-mrb_ssh_f_request (mrb_state *mrb, mrb_value self)
+mrb_ssh_f_open (mrb_state *mrb, mrb_value self)
 {
-    int rc;
+    return mrb_ssh_channel_open(mrb, self, FALSE);
+}
+
+static mrb_value
+mrb_ssh_f_open_nonblock (mrb_state *mrb, mrb_value self)
+{
+    return mrb_ssh_channel_open(mrb, self, TRUE);
+}
+
+static mrb_value
+mrb_ssh_channel_request (mrb_state *mrb, mrb_value self, mrb_bool nonblock)
+{
+    int rc, exec, blocking  = 1;
     const char *req, *msg    = NULL;
     mrb_int req_len, msg_len = 0;
     mrb_int ext_data         = LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL;
@@ -171,14 +317,45 @@ mrb_ssh_f_request (mrb_state *mrb, mrb_value self)
 
     mrb_get_args(mrb, "s|s!i", &req, &req_len, &msg, &msg_len, &ext_data);
 
-    while (libssh2_channel_handle_extended_data2(data->channel, (int)ext_data) == LIBSSH2_ERROR_EAGAIN) {
-        mrb_ssh_wait_sock(ssh);
+    exec = req_len == 4 && memcmp(req, "exec", 4) == 0;
+
+    if (exec && !data->stats.since) {
+        data->stats.since = mrb_ssh_now();
     }
 
-    while ((rc = libssh2_channel_process_startup(data->channel, req, (unsigned int)req_len, msg, (unsigned int)msg_len)) == LIBSSH2_ERROR_EAGAIN) {
+    if (nonblock) {
+        blocking = libssh2_session_get_blocking(ssh->session);
+        libssh2_session_set_blocking(ssh->session, 0);
+    }
+
+    while ((rc = libssh2_channel_handle_extended_data2(data->channel, (int)ext_data)) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
         mrb_ssh_wait_sock(ssh);
     }
 
+    if (rc != LIBSSH2_ERROR_EAGAIN) {
+        while ((rc = libssh2_channel_process_startup(data->channel, req, (unsigned int)req_len, msg, (unsigned int)msg_len)) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+            mrb_ssh_wait_sock(ssh);
+        }
+    }
+
+    if (nonblock) {
+        libssh2_session_set_blocking(ssh->session, blocking);
+    }
+
+    if (rc == LIBSSH2_ERROR_EAGAIN) {
+        return mrb_ssh_wait_symbol(mrb, ssh->session);
+    }
+
+    if (exec) {
+        data->stats.exec_time = mrb_ssh_now() - data->stats.since;
+        data->stats.since     = 0;
+
+        if (rc == 0) {
+            ssh->stats.exec_time += data->stats.exec_time;
+            ssh->stats.execs++;
+        }
+    }
+
     if (rc != 0) {
         mrb_ssh_raise_last_error(mrb, ssh);
     }
@@ -186,6 +363,18 @@ mrb_ssh_f_request (mrb_state *mrb, mrb_value self)
     return mrb_nil_value();
 }
 
+static mrb_value
+mrb_ssh_f_request (mrb_state *mrb, mrb_value self)
+{
+    return mrb_ssh_channel_request(mrb, self, FALSE);
+}
+
+static mrb_value
+mrb_ssh_f_request_nonblock (mrb_state *mrb, mrb_value self)
+{
+    return mrb_ssh_channel_request(mrb, self, TRUE);
+}
+
 static mrb_value
 mrb_ssh_f_pty (mrb_state *mrb, mrb_value self)
 {
@@ -340,6 +529,42 @@ mrb_ssh_f_closed (mrb_state *mrb, mrb_value self)
     return mrb_bool_value(data->session->data ? FALSE : TRUE);
 }
 
+static mrb_value
+mrb_ssh_f_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_channel_t *data = DATA_PTR(self);
+    mrb_value res;
+
+    if (!data) return mrb_nil_value();
+
+    res = mrb_hash_new_capa(mrb, 6);
+
+    mrb_hash_set(mrb, res, mrb_symbol_value(SYM("bytes_sent", 10)),     mrb_fixnum_value((mrb_int)data->stats.bytes_sent));
+    mrb_hash_set(mrb, res, mrb_symbol_value(SYM("bytes_received", 14)), mrb_fixnum_value((mrb_int)data->stats.bytes_received));
+    mrb_hash_set(mrb, res, mrb_symbol_value(SYM("open_time", 9)),       mrb_float_value(mrb, (mrb_float)data->stats.open_time / 1000000));
+    mrb_hash_set(mrb, res, mrb_symbol_value(SYM("exec_time", 9)),       mrb_float_value(mrb, (mrb_float)data->stats.exec_time / 1000000));
+    mrb_hash_set(mrb, res, mrb_symbol_value(SYM("window", 6)),          mrb_fixnum_value((mrb_int)data->window.size));
+    mrb_hash_set(mrb, res, mrb_symbol_value(SYM("window_adjusts", 14)), mrb_fixnum_value((mrb_int)data->window.adjusts));
+
+    return res;
+}
+
+static mrb_value
+mrb_ssh_f_reset_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_channel_t *data = DATA_PTR(self);
+    int64_t since;
+
+    if (!data) return mrb_nil_value();
+
+    since = data->stats.since;
+
+    memset(&data->stats, 0, sizeof(mrb_ssh_channel_stats_t));
+    data->stats.since = since;
+
+    return mrb_nil_value();
+}
+
 void
 mrb_mruby_ssh_channel_init (mrb_state *mrb)
 {
@@ -350,14 +575,18 @@ mrb_mruby_ssh_channel_init (mrb_state *mrb)
 
     MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
 
-    mrb_define_method(mrb, cls, "open",    mrb_ssh_f_open,    MRB_ARGS_OPT(1));
+    mrb_define_method(mrb, cls, "open",    mrb_ssh_f_open,    MRB_ARGS_OPT(2));
     mrb_define_method(mrb, cls, "request", mrb_ssh_f_request, MRB_ARGS_ARG(1,1));
+    mrb_define_method(mrb, cls, "open_nonblock",    mrb_ssh_f_open_nonblock,    MRB_ARGS_OPT(2));
+    mrb_define_method(mrb, cls, "request_nonblock", mrb_ssh_f_request_nonblock, MRB_ARGS_ARG(1,2));
     mrb_define_method(mrb, cls, "request_pty", mrb_ssh_f_pty, MRB_ARGS_OPT(1));
     mrb_define_method(mrb, cls, "env",     mrb_ssh_f_env,     MRB_ARGS_REQ(2));
     mrb_define_method(mrb, cls, "eof?",    mrb_ssh_f_get_eof, MRB_ARGS_NONE());
     mrb_define_method(mrb, cls, "eof",     mrb_ssh_f_set_eof, MRB_ARGS_OPT(1));
     mrb_define_method(mrb, cls, "close",   mrb_ssh_f_close,   MRB_ARGS_OPT(1));
     mrb_define_method(mrb, cls, "closed?", mrb_ssh_f_closed,  MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "stats",   mrb_ssh_f_stats,   MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "reset_stats", mrb_ssh_f_reset_stats, MRB_ARGS_NONE());
 
     mrb_define_const(mrb, cls, "WINDOW_DEFAULT", mrb_fixnum_value(LIBSSH2_CHANNEL_WINDOW_DEFAULT));
     mrb_define_const(mrb, cls, "PACKET_DEFAULT", mrb_fixnum_value(LIBSSH2_CHANNEL_PACKET_DEFAULT));
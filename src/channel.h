@@ -26,20 +26,56 @@
 #include "mruby.h"
 #include "mruby/ext/ssh.h"
 
+#include <stdint.h>
 #include <libssh2.h>
 
 MRB_BEGIN_DECL
 
+#ifndef MRB_SSH_WINDOW_MAX
+# define MRB_SSH_WINDOW_MAX (16 * 1024 * 1024)
+#endif
+
+#ifndef MRB_SSH_WINDOW_SAMPLE
+# define MRB_SSH_WINDOW_SAMPLE 100000
+#endif
+
+typedef struct mrb_ssh_window
+{
+    uint64_t size;
+    uint64_t max;
+    uint64_t bytes;
+    uint64_t adjusts;
+    uint64_t pending;
+    int64_t mark;
+} mrb_ssh_window_t;
+
+typedef struct mrb_ssh_channel_stats
+{
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    int64_t open_time;
+    int64_t exec_time;
+    int64_t since;
+} mrb_ssh_channel_stats_t;
+
+struct mrb_ssh_stream;
+
 typedef struct mrb_ssh_channel
 {
     struct RData *session;
     LIBSSH2_CHANNEL *channel;
+    mrb_ssh_channel_stats_t stats;
+    mrb_ssh_window_t window;
+    struct mrb_ssh_stream *streams;
 } mrb_ssh_channel_t;
 
 void mrb_mruby_ssh_channel_init (mrb_state *mrb);
 
 mrb_ssh_t *mrb_ssh_session (mrb_state *mrb, mrb_value self);
 mrb_ssh_channel_t *mrb_ssh_channel_bang (mrb_state *mrb, mrb_value self);
+void mrb_ssh_channel_tune_window (mrb_ssh_channel_t *data, size_t bytes);
+void mrb_ssh_window_tune (mrb_ssh_window_t *win, LIBSSH2_CHANNEL *channel, int64_t rtt, size_t bytes);
+mrb_int mrb_ssh_window_opt (mrb_state *mrb, mrb_value opts);
 
 MRB_END_DECL
 
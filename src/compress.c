@@ -0,0 +1,112 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* libssh2_config.h renames the zlib calls libssh2 makes so that they end up
+   here. That's how the compression level of a session gets applied and how
+   the bytes before and after compression get counted. */
+
+#if defined(LIBSSH2_HAVE_ZLIB) && !defined(MRB_SSH_LINK_LIB)
+
+#include "mruby.h"
+#include "mruby/ext/ssh.h"
+
+#include <zlib.h>
+#include <libssh2.h>
+
+int mrb_ssh_deflateInit_ (z_streamp strm, int level, const char *version, int stream_size);
+int mrb_ssh_deflate (z_streamp strm, int flush);
+int mrb_ssh_inflate (z_streamp strm, int flush);
+
+/* libssh2 keeps no public link from a z_stream to its session, but its
+   comp.c stores the session in strm->opaque for the zalloc/zfree callbacks.
+   That is an internal detail, so only rely on it for the releases known to
+   do so and check that the session found there points back to it. Streams
+   of any other release simply keep the default level and go uncounted. */
+#if LIBSSH2_VERSION_NUM >= 0x010200 && LIBSSH2_VERSION_NUM < 0x010c00
+# define MRB_SSH_ZLIB_OPAQUE_SESSION
+#endif
+
+static mrb_ssh_t *
+mrb_ssh_zlib_owner (z_streamp strm)
+{
+#ifdef MRB_SSH_ZLIB_OPAQUE_SESSION
+    LIBSSH2_SESSION *session = (LIBSSH2_SESSION *)strm->opaque;
+    void **abstract;
+    mrb_ssh_t *ssh;
+
+    if (!session || !(abstract = libssh2_session_abstract(session)))
+        return NULL;
+
+    ssh = (mrb_ssh_t *)*abstract;
+
+    return ssh && ssh->session == session ? ssh : NULL;
+#else
+    return NULL;
+#endif
+}
+
+int
+mrb_ssh_deflateInit_ (z_streamp strm, int level, const char *version, int stream_size)
+{
+    mrb_ssh_t *ssh = mrb_ssh_zlib_owner(strm);
+
+    if (ssh && ssh->compress_level > 0) {
+        level = ssh->compress_level;
+    }
+
+    return deflateInit_(strm, level, version, stream_size);
+}
+
+int
+mrb_ssh_deflate (z_streamp strm, int flush)
+{
+    mrb_ssh_t *ssh = mrb_ssh_zlib_owner(strm);
+    uLong in       = strm->total_in;
+    uLong out      = strm->total_out;
+    int rc         = deflate(strm, flush);
+
+    if (ssh) {
+        ssh->stats.compress_in  += strm->total_in - in;
+        ssh->stats.compress_out += strm->total_out - out;
+    }
+
+    return rc;
+}
+
+int
+mrb_ssh_inflate (z_streamp strm, int flush)
+{
+    mrb_ssh_t *ssh = mrb_ssh_zlib_owner(strm);
+    uLong in       = strm->total_in;
+    uLong out      = strm->total_out;
+    int rc         = inflate(strm, flush);
+
+    if (ssh) {
+        ssh->stats.decompress_in  += strm->total_in - in;
+        ssh->stats.decompress_out += strm->total_out - out;
+    }
+
+    return rc;
+}
+
+#endif
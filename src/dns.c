@@ -0,0 +1,574 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "dns.h"
+#include "socket.h"
+#include "store.h"
+
+#include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/hash.h"
+#include "mruby/string.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+# include <windows.h>
+#else
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netdb.h>
+# include <pthread.h>
+#endif
+
+#define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
+
+#define MRB_SSH_DNS_BUCKETS 256
+
+typedef struct mrb_ssh_dns_entry
+{
+    struct mrb_ssh_dns_entry *next;
+    char *host;
+    int family;
+    int64_t expires;
+    mrb_ssh_addrs_t addrs;
+} mrb_ssh_dns_entry_t;
+
+MRB_SSH_MUTEX(mrb_ssh_dns_mutex);
+#define mrb_ssh_dns_lock()   mrb_ssh_mutex_lock(mrb_ssh_dns_mutex)
+#define mrb_ssh_dns_unlock() mrb_ssh_mutex_unlock(mrb_ssh_dns_mutex)
+
+/* The cache is shared by all interpreters and threads of the process.
+   Entries are allocated with malloc since they outlive the mrb_state that
+   added them. The lock is never held while getaddrinfo runs. */
+static struct
+{
+    mrb_ssh_dns_entry_t *buckets[MRB_SSH_DNS_BUCKETS];
+    mrb_int ttl;
+    mrb_int negative_ttl;
+    mrb_int size;
+    mrb_int hits;
+    mrb_int misses;
+} mrb_ssh_dns = { { NULL }, MRB_SSH_DNS_TTL, MRB_SSH_DNS_NEGATIVE_TTL, 0, 0, 0 };
+
+static unsigned int
+mrb_ssh_dns_hash (const char *host, int family)
+{
+    return (mrb_ssh_str_hash(host) ^ (unsigned int)family) % MRB_SSH_DNS_BUCKETS;
+}
+
+static mrb_ssh_dns_entry_t **
+mrb_ssh_dns_find (const char *host, int family)
+{
+    mrb_ssh_dns_entry_t **ptr = &mrb_ssh_dns.buckets[mrb_ssh_dns_hash(host, family)];
+
+    while (*ptr && ((*ptr)->family != family || strcmp((*ptr)->host, host) != 0)) {
+        ptr = &(*ptr)->next;
+    }
+
+    return ptr;
+}
+
+static void
+mrb_ssh_dns_remove (mrb_ssh_dns_entry_t **ptr)
+{
+    mrb_ssh_dns_entry_t *entry = *ptr;
+
+    *ptr = entry->next;
+    mrb_ssh_dns.size--;
+
+    free(entry->host);
+    free(entry);
+}
+
+static int
+mrb_ssh_dns_getaddrinfo (const char *host, int family, mrb_ssh_addrs_t *addrs)
+{
+    struct addrinfo hints, *res, *rp;
+    int rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = family;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrs->count = 0;
+
+    if ((rc = getaddrinfo(host, NULL, &hints, &res)) != 0)
+        return rc;
+
+    for (rp = res; rp && addrs->count < MRB_SSH_DNS_MAX_ADDRS; rp = rp->ai_next) {
+        if (rp->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+
+        memcpy(&addrs->addr[addrs->count], rp->ai_addr, rp->ai_addrlen);
+        addrs->len[addrs->count++] = (socklen_t)rp->ai_addrlen;
+    }
+
+    freeaddrinfo(res);
+
+    return addrs->count > 0 ? 0 : EAI_FAIL;
+}
+
+static inline int
+mrb_ssh_dns_permanent (int rc)
+{
+#ifdef EAI_NODATA
+    if (rc == EAI_NODATA) return 1;
+#endif
+    return rc == EAI_NONAME || rc == EAI_FAIL;
+}
+
+/* Drops the expired entries of the bucket. */
+static void
+mrb_ssh_dns_sweep (mrb_ssh_dns_entry_t **ptr, int64_t now)
+{
+    while (*ptr) {
+        if ((*ptr)->expires <= now) {
+            mrb_ssh_dns_remove(ptr);
+        } else {
+            ptr = &(*ptr)->next;
+        }
+    }
+}
+
+/* Makes room for one more entry by dropping the expired ones, or the one
+   that expires first if all are fresh. */
+static void
+mrb_ssh_dns_evict (int64_t now)
+{
+    mrb_ssh_dns_entry_t **ptr, **oldest = NULL;
+    int i;
+
+    for (i = 0; i < MRB_SSH_DNS_BUCKETS; i++) {
+        mrb_ssh_dns_sweep(&mrb_ssh_dns.buckets[i], now);
+    }
+
+    if (mrb_ssh_dns.size < MRB_SSH_DNS_MAX_ENTRIES)
+        return;
+
+    for (i = 0; i < MRB_SSH_DNS_BUCKETS; i++) {
+        for (ptr = &mrb_ssh_dns.buckets[i]; *ptr; ptr = &(*ptr)->next) {
+            if (!oldest || (*ptr)->expires < (*oldest)->expires) oldest = ptr;
+        }
+    }
+
+    if (oldest) mrb_ssh_dns_remove(oldest);
+}
+
+static void
+mrb_ssh_dns_store (const char *host, int family, const mrb_ssh_addrs_t *addrs, int64_t now, int64_t expires)
+{
+    mrb_ssh_dns_entry_t **ptr, *entry;
+    size_t len;
+
+    mrb_ssh_dns_sweep(&mrb_ssh_dns.buckets[mrb_ssh_dns_hash(host, family)], now);
+
+    ptr   = mrb_ssh_dns_find(host, family);
+    entry = *ptr;
+
+    if (!entry && mrb_ssh_dns.size >= MRB_SSH_DNS_MAX_ENTRIES) {
+        mrb_ssh_dns_evict(now);
+        ptr = mrb_ssh_dns_find(host, family);
+    }
+
+    if (!entry) {
+        if (!(entry = malloc(sizeof(mrb_ssh_dns_entry_t)))) return;
+
+        len = strlen(host) + 1;
+
+        if (!(entry->host = malloc(len))) {
+            free(entry);
+            return;
+        }
+
+        memcpy(entry->host, host, len);
+        entry->family = family;
+        entry->next   = NULL;
+        *ptr          = entry;
+        mrb_ssh_dns.size++;
+    }
+
+    entry->expires = expires;
+    memcpy(&entry->addrs, addrs, sizeof(mrb_ssh_addrs_t));
+}
+
+/* Resolves the host into a list of addresses without port. Results are taken
+   from the cache while fresh; failed lookups are cached for negative_ttl. */
+int
+mrb_ssh_dns_lookup (const char *host, int family, mrb_ssh_addrs_t *addrs)
+{
+    mrb_ssh_dns_entry_t **ptr;
+    int64_t now = mrb_ssh_now();
+    mrb_int ttl, negative_ttl;
+    int rc;
+
+    mrb_ssh_dns_lock();
+
+    ptr = mrb_ssh_dns_find(host, family);
+
+    if (*ptr && (*ptr)->expires > now) {
+        mrb_ssh_dns.hits++;
+        memcpy(addrs, &(*ptr)->addrs, sizeof(mrb_ssh_addrs_t));
+        mrb_ssh_dns_unlock();
+        return addrs->count > 0 ? 0 : -1;
+    }
+
+    mrb_ssh_dns.misses++;
+    ttl          = mrb_ssh_dns.ttl;
+    negative_ttl = mrb_ssh_dns.negative_ttl;
+
+    mrb_ssh_dns_unlock();
+
+    rc  = mrb_ssh_dns_getaddrinfo(host, family, addrs);
+    ttl = rc == 0 ? ttl : (mrb_ssh_dns_permanent(rc) ? negative_ttl : 0);
+
+    mrb_ssh_dns_lock();
+
+    if (ttl > 0) {
+        mrb_ssh_dns_store(host, family, addrs, now, now + (int64_t)ttl * 1000000);
+    } else if (*(ptr = mrb_ssh_dns_find(host, family))) {
+        mrb_ssh_dns_remove(ptr);
+    }
+
+    mrb_ssh_dns_unlock();
+
+    return rc == 0 ? 0 : -1;
+}
+
+void
+mrb_ssh_dns_set_port (mrb_ssh_addrs_t *addrs, int port)
+{
+    int i;
+
+    for (i = 0; i < addrs->count; i++) {
+        if (addrs->addr[i].ss_family == AF_INET6) {
+            ((struct sockaddr_in6 *)&addrs->addr[i])->sin6_port = htons((unsigned short)port);
+        } else {
+            ((struct sockaddr_in *)&addrs->addr[i])->sin_port = htons((unsigned short)port);
+        }
+    }
+}
+
+void
+mrb_ssh_dns_clear (void)
+{
+    int i;
+
+    mrb_ssh_dns_lock();
+
+    for (i = 0; i < MRB_SSH_DNS_BUCKETS; i++) {
+        while (mrb_ssh_dns.buckets[i]) {
+            mrb_ssh_dns_remove(&mrb_ssh_dns.buckets[i]);
+        }
+    }
+
+    mrb_ssh_dns.hits   = 0;
+    mrb_ssh_dns.misses = 0;
+
+    mrb_ssh_dns_unlock();
+}
+
+static mrb_value
+mrb_ssh_f_dns_ttl (mrb_state *mrb, mrb_value self)
+{
+    return mrb_fixnum_value(mrb_ssh_dns.ttl);
+}
+
+static mrb_value
+mrb_ssh_f_dns_set_ttl (mrb_state *mrb, mrb_value self)
+{
+    mrb_int ttl;
+
+    mrb_get_args(mrb, "i", &ttl);
+
+    mrb_ssh_dns.ttl = ttl < 0 ? 0 : ttl;
+
+    return mrb_fixnum_value(mrb_ssh_dns.ttl);
+}
+
+static mrb_value
+mrb_ssh_f_dns_negative_ttl (mrb_state *mrb, mrb_value self)
+{
+    return mrb_fixnum_value(mrb_ssh_dns.negative_ttl);
+}
+
+static mrb_value
+mrb_ssh_f_dns_set_negative_ttl (mrb_state *mrb, mrb_value self)
+{
+    mrb_int ttl;
+
+    mrb_get_args(mrb, "i", &ttl);
+
+    mrb_ssh_dns.negative_ttl = ttl < 0 ? 0 : ttl;
+
+    return mrb_fixnum_value(mrb_ssh_dns.negative_ttl);
+}
+
+static mrb_value
+mrb_ssh_f_dns_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_value stats = mrb_hash_new_capa(mrb, 3);
+    mrb_int hits, misses, size;
+
+    mrb_ssh_dns_lock();
+    hits   = mrb_ssh_dns.hits;
+    misses = mrb_ssh_dns.misses;
+    size   = mrb_ssh_dns.size;
+    mrb_ssh_dns_unlock();
+
+    mrb_hash_set(mrb, stats, SYM("hits", 4),   mrb_fixnum_value(hits));
+    mrb_hash_set(mrb, stats, SYM("misses", 6), mrb_fixnum_value(misses));
+    mrb_hash_set(mrb, stats, SYM("size", 4),   mrb_fixnum_value(size));
+
+    return stats;
+}
+
+static mrb_value
+mrb_ssh_f_dns_clear (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_dns_clear();
+
+    return self;
+}
+
+static mrb_value
+mrb_ssh_dns_ips (mrb_state *mrb, const mrb_ssh_addrs_t *addrs)
+{
+    mrb_value res = mrb_ary_new_capa(mrb, addrs->count);
+    char ip[INET6_ADDRSTRLEN];
+    int i;
+
+    for (i = 0; i < addrs->count; i++) {
+        if (getnameinfo((struct sockaddr *)&addrs->addr[i], addrs->len[i], ip, sizeof(ip), NULL, 0, NI_NUMERICHOST) == 0) {
+            mrb_ary_push(mrb, res, mrb_str_new_cstr(mrb, ip));
+        }
+    }
+
+    return res;
+}
+
+static int
+mrb_ssh_dns_batch_next (mrb_ssh_dns_batch_t *batch)
+{
+    int i;
+
+    mrb_ssh_dns_lock();
+    i = batch->next < batch->count ? batch->next++ : -1;
+    mrb_ssh_dns_unlock();
+
+    return i;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI
+mrb_ssh_dns_worker (LPVOID arg)
+#else
+static void *
+mrb_ssh_dns_worker (void *arg)
+#endif
+{
+    mrb_ssh_dns_batch_t *batch = arg;
+    int i;
+
+    while ((i = mrb_ssh_dns_batch_next(batch)) != -1) {
+        batch->rc[i] = mrb_ssh_dns_lookup(batch->hosts[i], AF_UNSPEC, &batch->addrs[i]);
+    }
+
+    return 0;
+}
+
+/* Resolves all hosts of the batch on up to workers threads. The calling
+   thread takes part as well, so workers = 1 resolves sequentially. */
+int
+mrb_ssh_dns_lookup_all (mrb_ssh_dns_batch_t *batch, int workers)
+{
+#ifdef _WIN32
+    HANDLE threads[MRB_SSH_DNS_MAX_WORKERS];
+#else
+    pthread_t threads[MRB_SSH_DNS_MAX_WORKERS];
+#endif
+    int i, started = 0, count = 0;
+
+    batch->next = 0;
+
+    if (workers > batch->count) workers = batch->count;
+    if (workers > MRB_SSH_DNS_MAX_WORKERS) workers = MRB_SSH_DNS_MAX_WORKERS;
+
+    for (i = 1; i < workers; i++) {
+#ifdef _WIN32
+        if (!(threads[started] = CreateThread(NULL, 0, mrb_ssh_dns_worker, batch, 0, NULL))) break;
+#else
+        if (pthread_create(&threads[started], NULL, mrb_ssh_dns_worker, batch) != 0) break;
+#endif
+        started++;
+    }
+
+    mrb_ssh_dns_worker(batch);
+
+    for (i = 0; i < started; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+
+    for (i = 0; i < batch->count; i++) {
+        if (batch->rc[i] == 0) count++;
+    }
+
+    return count;
+}
+
+/* Arrays among the arguments get flattened by one level only, anything
+   nested deeper fails the String check later on instead of recursing into
+   arrays that might contain themselves. */
+static void
+mrb_ssh_dns_collect (mrb_state *mrb, mrb_value hosts, mrb_value *argv, mrb_int argc)
+{
+    mrb_int i, j;
+
+    for (i = 0; i < argc; i++) {
+        if (!mrb_array_p(argv[i])) {
+            mrb_ary_push(mrb, hosts, argv[i]);
+            continue;
+        }
+
+        for (j = 0; j < RARRAY_LEN(argv[i]); j++) {
+            mrb_ary_push(mrb, hosts, mrb_ary_ref(mrb, argv[i], j));
+        }
+    }
+}
+
+static mrb_value
+mrb_ssh_dns_resolve (mrb_state *mrb, mrb_value hosts, mrb_int workers, mrb_bool ips)
+{
+    mrb_ssh_dns_batch_t batch;
+    mrb_value res;
+    mrb_int i, count;
+
+    batch.count = (int)RARRAY_LEN(hosts);
+
+    if (batch.count == 0)
+        return ips ? mrb_hash_new(mrb) : mrb_fixnum_value(0);
+
+    for (i = 0; i < batch.count; i++) {
+        mrb_string_value_cstr(mrb, &RARRAY_PTR(hosts)[i]);
+    }
+
+    batch.hosts = mrb_malloc(mrb, sizeof(char *) * batch.count);
+    batch.rc    = mrb_calloc(mrb, batch.count, sizeof(int));
+    batch.addrs = mrb_malloc_simple(mrb, sizeof(mrb_ssh_addrs_t) * batch.count);
+
+    if (!batch.addrs) {
+        mrb_free(mrb, batch.hosts);
+        mrb_free(mrb, batch.rc);
+        mrb_raise(mrb, E_RUNTIME_ERROR, "Out of memory.");
+    }
+
+    for (i = 0; i < batch.count; i++) {
+        batch.hosts[i] = RSTRING_PTR(RARRAY_PTR(hosts)[i]);
+    }
+
+    count = mrb_ssh_dns_lookup_all(&batch, (int)workers);
+
+    if (ips) {
+        res = mrb_hash_new_capa(mrb, batch.count);
+
+        for (i = 0; i < batch.count; i++) {
+            mrb_hash_set(mrb, res, RARRAY_PTR(hosts)[i], batch.rc[i] == 0 ? mrb_ssh_dns_ips(mrb, &batch.addrs[i]) : mrb_nil_value());
+        }
+    } else {
+        res = mrb_fixnum_value(count);
+    }
+
+    mrb_free(mrb, batch.hosts);
+    mrb_free(mrb, batch.rc);
+    mrb_free(mrb, batch.addrs);
+
+    return res;
+}
+
+static mrb_value
+mrb_ssh_f_dns_lookup (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_addrs_t addrs;
+    const char *host;
+
+    mrb_get_args(mrb, "z", &host);
+
+    if (mrb_ssh_dns_lookup(host, AF_UNSPEC, &addrs) != 0)
+        return mrb_nil_value();
+
+    return mrb_ssh_dns_ips(mrb, &addrs);
+}
+
+static mrb_value
+mrb_ssh_f_dns_warm (mrb_state *mrb, mrb_value self)
+{
+    mrb_value *argv, hosts;
+    mrb_int argc;
+
+    mrb_get_args(mrb, "*", &argv, &argc);
+
+    hosts = mrb_ary_new_capa(mrb, argc);
+    mrb_ssh_dns_collect(mrb, hosts, argv, argc);
+
+    return mrb_ssh_dns_resolve(mrb, hosts, MRB_SSH_DNS_WORKERS, FALSE);
+}
+
+static mrb_value
+mrb_ssh_f_resolve_all (mrb_state *mrb, mrb_value self)
+{
+    mrb_value hosts;
+    mrb_int workers = MRB_SSH_DNS_WORKERS;
+
+    mrb_get_args(mrb, "A|i", &hosts, &workers);
+
+    if (workers < 1) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "Number of threads must be positive.");
+    }
+
+    return mrb_ssh_dns_resolve(mrb, hosts, workers, TRUE);
+}
+
+void
+mrb_mruby_ssh_dns_init (mrb_state *mrb)
+{
+    struct RClass *ssh = mrb_module_get(mrb, "SSH");
+    struct RClass *dns = mrb_define_module_under(mrb, ssh, "DNS");
+
+    mrb_define_class_method(mrb, ssh, "resolve_all", mrb_ssh_f_resolve_all, MRB_ARGS_ARG(1,1));
+
+    mrb_define_module_function(mrb, dns, "ttl",           mrb_ssh_f_dns_ttl,              MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, dns, "ttl=",          mrb_ssh_f_dns_set_ttl,          MRB_ARGS_REQ(1));
+    mrb_define_module_function(mrb, dns, "negative_ttl",  mrb_ssh_f_dns_negative_ttl,     MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, dns, "negative_ttl=", mrb_ssh_f_dns_set_negative_ttl, MRB_ARGS_REQ(1));
+    mrb_define_module_function(mrb, dns, "stats",         mrb_ssh_f_dns_stats,            MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, dns, "clear",         mrb_ssh_f_dns_clear,            MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, dns, "lookup",        mrb_ssh_f_dns_lookup,           MRB_ARGS_REQ(1));
+    mrb_define_module_function(mrb, dns, "warm",          mrb_ssh_f_dns_warm,             MRB_ARGS_ANY());
+}
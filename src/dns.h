@@ -0,0 +1,89 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifdef _WIN32
+# define _WIN32_WINNT _WIN32_WINNT_VISTA
+#endif
+
+#include "mruby.h"
+
+#include <stdint.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#else
+# include <sys/socket.h>
+#endif
+
+MRB_BEGIN_DECL
+
+#ifndef MRB_SSH_DNS_TTL
+# define MRB_SSH_DNS_TTL 60
+#endif
+
+#ifndef MRB_SSH_DNS_NEGATIVE_TTL
+# define MRB_SSH_DNS_NEGATIVE_TTL 5
+#endif
+
+#ifndef MRB_SSH_DNS_MAX_ADDRS
+# define MRB_SSH_DNS_MAX_ADDRS 16
+#endif
+
+/* Upper bound for the cached hosts, the oldest entry is dropped first */
+#ifndef MRB_SSH_DNS_MAX_ENTRIES
+# define MRB_SSH_DNS_MAX_ENTRIES 1024
+#endif
+
+#ifndef MRB_SSH_DNS_WORKERS
+# define MRB_SSH_DNS_WORKERS 8
+#endif
+
+#ifndef MRB_SSH_DNS_MAX_WORKERS
+# define MRB_SSH_DNS_MAX_WORKERS 64
+#endif
+
+typedef struct mrb_ssh_addrs
+{
+    int count;
+    socklen_t len[MRB_SSH_DNS_MAX_ADDRS];
+    struct sockaddr_storage addr[MRB_SSH_DNS_MAX_ADDRS];
+} mrb_ssh_addrs_t;
+
+typedef struct mrb_ssh_dns_batch
+{
+    const char **hosts;
+    mrb_ssh_addrs_t *addrs;
+    int *rc;
+    int count;
+    int next;
+} mrb_ssh_dns_batch_t;
+
+int  mrb_ssh_dns_lookup (const char *host, int family, mrb_ssh_addrs_t *addrs);
+int  mrb_ssh_dns_lookup_all (mrb_ssh_dns_batch_t *batch, int workers);
+void mrb_ssh_dns_set_port (mrb_ssh_addrs_t *addrs, int port);
+void mrb_ssh_dns_clear (void);
+
+void mrb_mruby_ssh_dns_init (mrb_state *mrb);
+
+MRB_END_DECL
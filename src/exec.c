@@ -0,0 +1,431 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "exec.h"
+
+#include "poller.h"
+#include "socket.h"
+#include "channel.h"
+
+#include "mruby.h"
+#include "mruby/data.h"
+#include "mruby/hash.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
+#include "mruby/ext/ssh.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <libssh2.h>
+
+#define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
+
+#define MRB_SSH_EXEC_CHUNK 0x4000
+
+static int
+mrb_ssh_buf_reserve (mrb_state *mrb, mrb_ssh_buf_t *buf, size_t size)
+{
+    size_t capa = buf->capa ? buf->capa : MRB_SSH_EXEC_CHUNK;
+    char *ptr;
+
+    if (buf->capa - buf->len >= size) return 0;
+
+    while (capa - buf->len < size) {
+        capa *= 2;
+    }
+
+    if (!(ptr = mrb_realloc_simple(mrb, buf->ptr, capa)))
+        return LIBSSH2_ERROR_ALLOC;
+
+    buf->ptr  = ptr;
+    buf->capa = capa;
+
+    return 0;
+}
+
+mrb_value
+mrb_ssh_buf_str (mrb_state *mrb, mrb_ssh_buf_t *buf)
+{
+    return mrb_str_new(mrb, buf->ptr, buf->len);
+}
+
+/* Reads what is available. The window of a channel opened with window: :auto
+   is tuned as the reads of its streams do. */
+static int
+mrb_ssh_exec_drain (mrb_state *mrb, mrb_ssh_exec_t *exec, int stream, mrb_ssh_buf_t *buf)
+{
+    ssize_t rc;
+
+    do {
+        if (mrb_ssh_buf_reserve(mrb, buf, MRB_SSH_EXEC_CHUNK) != 0)
+            return LIBSSH2_ERROR_ALLOC;
+
+        rc = libssh2_channel_read_ex(exec->channel, stream, buf->ptr + buf->len, buf->capa - buf->len);
+
+        if (rc <= 0) break;
+
+        buf->len += (size_t)rc;
+
+        if (exec->data) {
+            mrb_ssh_channel_tune_window(exec->data, (size_t)rc);
+        }
+    } while (rc > 0);
+
+    return (int)rc;
+}
+
+static int
+mrb_ssh_exec_fail (LIBSSH2_SESSION *session, mrb_ssh_exec_t *exec, int rc)
+{
+    char *msg = NULL;
+
+    if (rc == LIBSSH2_ERROR_EAGAIN) return rc;
+
+    if (session) {
+        libssh2_session_last_error(session, &msg, NULL, 0);
+    }
+
+    exec->rc    = rc;
+    exec->state = MRB_SSH_EXEC_DONE;
+
+    snprintf(exec->error, sizeof(exec->error), "%s", msg ? msg : "Unknown error.");
+
+    return rc;
+}
+
+void
+mrb_ssh_exec_init (mrb_ssh_exec_t *exec, const char *cmd, size_t cmd_len, int ext)
+{
+    memset(exec, 0, sizeof(mrb_ssh_exec_t));
+
+    exec->cmd        = cmd;
+    exec->cmd_len    = cmd_len;
+    exec->ext        = ext;
+    exec->exitstatus = -1;
+    exec->open_time  = -1;
+    exec->exec_time  = -1;
+    exec->state      = MRB_SSH_EXEC_OPEN;
+}
+
+void
+mrb_ssh_exec_stats (mrb_ssh_stats_t *stats, const mrb_ssh_exec_t *exec)
+{
+    if (exec->open_time >= 0) {
+        stats->channel_opens++;
+        stats->channel_open_time += exec->open_time;
+    }
+
+    if (exec->exec_time >= 0) {
+        stats->execs++;
+        stats->exec_time += exec->exec_time;
+    }
+}
+
+int
+mrb_ssh_exec_step (mrb_state *mrb, LIBSSH2_SESSION *session, mrb_ssh_exec_t *exec)
+{
+    int rc;
+
+    switch (exec->state) {
+    case MRB_SSH_EXEC_OPEN:
+        if (!exec->since) exec->since = mrb_ssh_now();
+
+        exec->channel = libssh2_channel_open_session(session);
+
+        if (!exec->channel)
+            return mrb_ssh_exec_fail(session, exec, libssh2_session_last_errno(session));
+
+        exec->open_time = mrb_ssh_now() - exec->since;
+        exec->since     = mrb_ssh_now();
+        exec->state     = MRB_SSH_EXEC_START;
+        /* fall through */
+    case MRB_SSH_EXEC_START:
+        if (!exec->since) exec->since = mrb_ssh_now();
+
+        if ((rc = libssh2_channel_handle_extended_data2(exec->channel, exec->ext)) != 0)
+            return mrb_ssh_exec_fail(session, exec, rc);
+
+        if ((rc = libssh2_channel_process_startup(exec->channel, "exec", 4, exec->cmd, (unsigned int)exec->cmd_len)) != 0)
+            return mrb_ssh_exec_fail(session, exec, rc);
+
+        exec->exec_time = mrb_ssh_now() - exec->since;
+        exec->state     = MRB_SSH_EXEC_READ;
+        /* fall through */
+    case MRB_SSH_EXEC_READ:
+        rc = mrb_ssh_exec_drain(mrb, exec, 0, &exec->out);
+
+        if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN)
+            return mrb_ssh_exec_fail(session, exec, rc);
+
+        if (exec->ext == LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL) {
+            rc = mrb_ssh_exec_drain(mrb, exec, SSH_EXTENDED_DATA_STDERR, &exec->err);
+
+            if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN)
+                return mrb_ssh_exec_fail(session, exec, rc);
+        }
+
+        if (!libssh2_channel_eof(exec->channel))
+            return LIBSSH2_ERROR_EAGAIN;
+
+        exec->state = MRB_SSH_EXEC_CLOSE;
+        /* fall through */
+    case MRB_SSH_EXEC_CLOSE:
+        if ((rc = libssh2_channel_close(exec->channel)) != 0)
+            return mrb_ssh_exec_fail(session, exec, rc);
+
+        exec->exitstatus = libssh2_channel_get_exit_status(exec->channel);
+        exec->state      = MRB_SSH_EXEC_DONE;
+        /* fall through */
+    default:
+        return exec->rc;
+    }
+}
+
+mrb_value
+mrb_ssh_exec_result (mrb_state *mrb, mrb_ssh_exec_t *exec)
+{
+    mrb_value res = mrb_hash_new_capa(mrb, 4);
+    mrb_bool ok   = exec->state == MRB_SSH_EXEC_DONE && exec->rc == 0;
+
+    mrb_hash_set(mrb, res, SYM("out", 3), mrb_ssh_buf_str(mrb, &exec->out));
+    mrb_hash_set(mrb, res, SYM("err", 3), mrb_ssh_buf_str(mrb, &exec->err));
+    mrb_hash_set(mrb, res, SYM("exitstatus", 10), ok ? mrb_fixnum_value(exec->exitstatus) : mrb_nil_value());
+    mrb_hash_set(mrb, res, SYM("error", 5), exec->rc ? mrb_ssh_exc_new(mrb, exec->rc, exec->error) : mrb_nil_value());
+
+    return res;
+}
+
+void
+mrb_ssh_exec_free (mrb_state *mrb, mrb_ssh_exec_t *exec)
+{
+    if (exec->channel) {
+        libssh2_channel_free(exec->channel);
+    }
+
+    mrb_free(mrb, exec->out.ptr);
+    mrb_free(mrb, exec->err.ptr);
+
+    exec->channel = NULL;
+    memset(&exec->out, 0, sizeof(mrb_ssh_buf_t));
+    memset(&exec->err, 0, sizeof(mrb_ssh_buf_t));
+}
+
+static mrb_value
+mrb_ssh_f_exec_many (mrb_state *mrb, mrb_value self)
+{
+    mrb_value cmds, cmd, opts = mrb_nil_value(), res;
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_ssh_exec_t *execs, *exec;
+    mrb_int len, concurrency = 10;
+    int i, rc, blocking, next = 0, done = 0, opening = -1, arena;
+    long timeout;
+
+    mrb_get_args(mrb, "A|H", &cmds, &opts);
+
+    if (!(ssh && mrb_ssh_initialized())) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
+    }
+
+    if (!libssh2_userauth_authenticated(ssh->session)) {
+        mrb_raise(mrb, E_SSH_NOT_AUTH_ERROR, "SSH session not authenticated.");
+    }
+
+    if (mrb_hash_p(opts)) {
+        concurrency = mrb_fixnum(mrb_hash_fetch(mrb, opts, SYM("concurrency", 11), mrb_fixnum_value(concurrency)));
+    }
+
+    if (concurrency < 1) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "concurrency must be positive");
+    }
+
+    len = RARRAY_LEN(cmds);
+
+    for (i = 0; i < len; i++) {
+        if (!mrb_string_p(mrb_ary_ref(mrb, cmds, i))) {
+            mrb_raise(mrb, E_TYPE_ERROR, "command must be a String");
+        }
+    }
+
+    execs    = mrb_calloc(mrb, (size_t)len + 1, sizeof(mrb_ssh_exec_t));
+    blocking = libssh2_session_get_blocking(ssh->session);
+    timeout  = libssh2_session_get_timeout(ssh->session);
+
+    for (i = 0; i < len; i++) {
+        cmd = mrb_ary_ref(mrb, cmds, i);
+        mrb_ssh_exec_init(&execs[i], RSTRING_PTR(cmd), (size_t)RSTRING_LEN(cmd), LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL);
+    }
+
+    libssh2_session_set_blocking(ssh->session, 0);
+
+    while (done < len) {
+        while (next < len && next - done < concurrency) {
+            next++;
+        }
+
+        for (i = 0; i < next; i++) {
+            exec = &execs[i];
+
+            if (exec->state == MRB_SSH_EXEC_DONE) continue;
+
+            /* libssh2 tracks a pending channel open per session, not per channel */
+            if (exec->state == MRB_SSH_EXEC_OPEN && opening != -1 && opening != i) continue;
+
+            if (exec->state == MRB_SSH_EXEC_OPEN) {
+                opening = i;
+            }
+
+            rc = mrb_ssh_exec_step(mrb, ssh->session, exec);
+
+            if (opening == i && exec->state != MRB_SSH_EXEC_OPEN) {
+                opening = -1;
+            }
+
+            if (rc != LIBSSH2_ERROR_EAGAIN) {
+                done++;
+            }
+        }
+
+        if (done == len || (next < len && next - done < concurrency)) continue;
+
+        if (mrb_ssh_wait_socket(ssh->session, ssh->sock, timeout > 0 ? (int)timeout : MRB_SSH_WAIT_TIMEOUT) != 0 || timeout <= 0)
+            continue;
+
+        for (i = 0; i < next; i++) {
+            if (execs[i].state == MRB_SSH_EXEC_DONE) continue;
+
+            execs[i].rc    = LIBSSH2_ERROR_TIMEOUT;
+            execs[i].state = MRB_SSH_EXEC_DONE;
+            snprintf(execs[i].error, sizeof(execs[i].error), "%s", "Timed out waiting on socket.");
+            done++;
+        }
+    }
+
+    libssh2_session_set_blocking(ssh->session, blocking);
+
+    res = mrb_ary_new_capa(mrb, len);
+
+    for (i = 0; i < len; i++) {
+        arena = mrb_gc_arena_save(mrb);
+
+        mrb_ary_push(mrb, res, mrb_ssh_exec_result(mrb, &execs[i]));
+        mrb_ssh_exec_stats(&ssh->stats, &execs[i]);
+        mrb_ssh_exec_free(mrb, &execs[i]);
+
+        mrb_gc_arena_restore(mrb, arena);
+    }
+
+    mrb_free(mrb, execs);
+
+    return res;
+}
+
+static mrb_value
+mrb_ssh_f_capture (mrb_state *mrb, mrb_value self)
+{
+    int rc, blocking;
+    long timeout;
+    int64_t now, deadline;
+    const char *cmd;
+    mrb_int cmd_len, ext;
+    mrb_value res;
+    mrb_ssh_exec_t exec;
+    mrb_ssh_t *ssh          = mrb_ssh_session(mrb, self);
+    mrb_ssh_channel_t *data = mrb_ssh_channel_bang(mrb, self);
+
+    mrb_get_args(mrb, "si", &cmd, &cmd_len, &ext);
+
+    mrb_ssh_exec_init(&exec, cmd, (size_t)cmd_len, (int)ext);
+
+    exec.channel = data->channel;
+    exec.data    = data;
+    exec.state   = MRB_SSH_EXEC_START;
+    blocking     = libssh2_session_get_blocking(ssh->session);
+    timeout      = libssh2_session_get_timeout(ssh->session);
+    deadline     = mrb_ssh_now() + (int64_t)timeout * 1000;
+
+    libssh2_session_set_blocking(ssh->session, 0);
+
+    /* Keep the session timeout the blocking calls had before */
+    while ((rc = mrb_ssh_exec_step(mrb, ssh->session, &exec)) == LIBSSH2_ERROR_EAGAIN) {
+        now = mrb_ssh_now();
+
+        if (timeout > 0 && now >= deadline) {
+            rc = LIBSSH2_ERROR_TIMEOUT;
+            snprintf(exec.error, sizeof(exec.error), "%s", "Timed out waiting on socket.");
+            break;
+        }
+
+        if (mrb_ssh_wait_socket(ssh->session, ssh->sock, timeout > 0 ? (int)((deadline - now + 999) / 1000) : MRB_SSH_WAIT_TIMEOUT) < 0) {
+            rc = LIBSSH2_ERROR_SOCKET_RECV;
+            snprintf(exec.error, sizeof(exec.error), "%s", "Could not wait on socket.");
+            break;
+        }
+    }
+
+    libssh2_session_set_blocking(ssh->session, blocking);
+
+    exec.channel = NULL;
+    exec.data    = NULL;
+
+    mrb_ssh_exec_stats(&ssh->stats, &exec);
+
+    data->stats.bytes_received += exec.out.len + exec.err.len;
+
+    if (exec.exec_time >= 0) {
+        data->stats.exec_time = exec.exec_time;
+    }
+
+    if (rc != 0) {
+        mrb_ssh_exec_free(mrb, &exec);
+        mrb_ssh_raise(mrb, rc, exec.error);
+    }
+
+    res = mrb_ary_new_capa(mrb, 3);
+
+    mrb_ary_push(mrb, res, mrb_ssh_buf_str(mrb, &exec.out));
+    mrb_ary_push(mrb, res, mrb_ssh_buf_str(mrb, &exec.err));
+    mrb_ary_push(mrb, res, mrb_fixnum_value(exec.exitstatus));
+
+    mrb_ssh_exec_free(mrb, &exec);
+
+    return res;
+}
+
+void
+mrb_mruby_ssh_exec_init (mrb_state *mrb)
+{
+    struct RClass *ssh, *cls;
+
+    ssh = mrb_module_get(mrb, "SSH");
+    cls = mrb_class_get_under(mrb, ssh, "Session");
+
+    mrb_define_method(mrb, cls, "exec_many", mrb_ssh_f_exec_many, MRB_ARGS_ARG(1,1));
+
+    cls = mrb_class_get_under(mrb, ssh, "Channel");
+
+    mrb_define_method(mrb, cls, "__exec__", mrb_ssh_f_capture, MRB_ARGS_REQ(2));
+}
+
+#endif
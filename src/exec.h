@@ -0,0 +1,82 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "mruby.h"
+#include "mruby/ext/ssh.h"
+
+#include <stdint.h>
+#include <libssh2.h>
+
+MRB_BEGIN_DECL
+
+enum mrb_ssh_exec_state
+{
+    MRB_SSH_EXEC_OPEN,
+    MRB_SSH_EXEC_START,
+    MRB_SSH_EXEC_READ,
+    MRB_SSH_EXEC_CLOSE,
+    MRB_SSH_EXEC_DONE
+};
+
+typedef struct mrb_ssh_buf
+{
+    char *ptr;
+    size_t len;
+    size_t capa;
+} mrb_ssh_buf_t;
+
+struct mrb_ssh_channel;
+
+typedef struct mrb_ssh_exec
+{
+    LIBSSH2_CHANNEL *channel;
+    struct mrb_ssh_channel *data;
+    const char *cmd;
+    size_t cmd_len;
+    int ext;
+    int state;
+    int rc;
+    int exitstatus;
+    int64_t since;
+    int64_t open_time;
+    int64_t exec_time;
+    char error[128];
+    mrb_ssh_buf_t out;
+    mrb_ssh_buf_t err;
+} mrb_ssh_exec_t;
+
+void mrb_mruby_ssh_exec_init (mrb_state *mrb);
+
+void mrb_ssh_exec_init (mrb_ssh_exec_t *exec, const char *cmd, size_t cmd_len, int ext);
+int  mrb_ssh_exec_step (mrb_state *mrb, LIBSSH2_SESSION *session, mrb_ssh_exec_t *exec);
+void mrb_ssh_exec_free (mrb_state *mrb, mrb_ssh_exec_t *exec);
+void mrb_ssh_exec_stats (mrb_ssh_stats_t *stats, const mrb_ssh_exec_t *exec);
+
+mrb_value mrb_ssh_buf_str (mrb_state *mrb, mrb_ssh_buf_t *buf);
+mrb_value mrb_ssh_exec_result (mrb_state *mrb, mrb_ssh_exec_t *exec);
+
+MRB_END_DECL
+
+#endif
@@ -0,0 +1,839 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "forward.h"
+#include "poller.h"
+#include "socket.h"
+#include "channel.h"
+
+#include "mruby.h"
+#include "mruby/data.h"
+#include "mruby/hash.h"
+#include "mruby/array.h"
+#include "mruby/class.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#include "mruby/ext/ssh.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libssh2.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+# define MRB_SSH_SHUT_WR SD_SEND
+# define mrb_ssh_forward_again() (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+# include <sys/socket.h>
+# include <netdb.h>
+# define MRB_SSH_SHUT_WR SHUT_WR
+# define mrb_ssh_forward_again() (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+#endif
+
+#ifdef MSG_NOSIGNAL
+# define MRB_SSH_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define MRB_SSH_SEND_FLAGS 0
+#endif
+
+#define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
+
+#define MRB_SSH_TUNNEL_OPENING  0
+#define MRB_SSH_TUNNEL_OPEN     1
+#define MRB_SSH_TUNNEL_CLOSING  2
+#define MRB_SSH_TUNNEL_CLOSED   3
+
+#define MRB_SSH_TUNNEL_CLIENT_EOF  1
+#define MRB_SSH_TUNNEL_REMOTE_EOF  2
+#define MRB_SSH_TUNNEL_EOF_SENT    4
+#define MRB_SSH_TUNNEL_SHUTDOWN    8
+#define MRB_SSH_TUNNEL_READABLE    16
+#define MRB_SSH_TUNNEL_WRITABLE    32
+
+typedef struct mrb_ssh_relay_buf
+{
+    size_t off;
+    size_t len;
+    char data[MRB_SSH_FORWARD_BUFFER];
+} mrb_ssh_relay_buf_t;
+
+/* A tunneled connection relays between an accepted socket and its own
+   direct-tcpip channel. Each direction has a fixed buffer, a full buffer
+   stops reading from its source. For the remote side that means the
+   channel window is not consumed and the server has to hold back.
+   The time to the first byte from the remote side is measured from the
+   first byte sent, or from the channel open if the remote speaks first. */
+typedef struct mrb_ssh_tunnel
+{
+    struct mrb_ssh_tunnel *next;
+    libssh2_socket_t sock;
+    LIBSSH2_CHANNEL *channel;
+    int state;
+    int flags;
+    int idx;
+    int peer_port;
+    char peer[64];
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    int64_t accepted;
+    int64_t open_time;
+    int64_t first_sent;
+    int64_t first_byte_time;
+    mrb_ssh_window_t window;
+    mrb_ssh_relay_buf_t up;
+    mrb_ssh_relay_buf_t down;
+} mrb_ssh_tunnel_t;
+
+typedef struct mrb_ssh_forward
+{
+    struct RData *session;
+    mrb_ssh_t *ssh;
+    libssh2_socket_t listener;
+    int local_port;
+    int remote_port;
+    char *remote_host;
+    int pending;
+    mrb_ssh_poller_t *poller;
+    mrb_ssh_tunnel_t *tunnels;
+    mrb_int active;
+    uint64_t accepted;
+    uint64_t opened;
+    uint64_t failed;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t window_max;
+    int64_t open_time;
+} mrb_ssh_forward_t;
+
+static inline size_t
+mrb_ssh_relay_space (mrb_ssh_relay_buf_t *buf)
+{
+    if (buf->len == 0) {
+        buf->off = 0;
+    } else if (buf->off > 0 && buf->off + buf->len == MRB_SSH_FORWARD_BUFFER) {
+        memmove(buf->data, buf->data + buf->off, buf->len);
+        buf->off = 0;
+    }
+
+    return MRB_SSH_FORWARD_BUFFER - buf->off - buf->len;
+}
+
+static inline void
+mrb_ssh_relay_consume (mrb_ssh_relay_buf_t *buf, size_t len)
+{
+    buf->off += len;
+    buf->len -= len;
+}
+
+static inline int
+mrb_ssh_forward_attached (mrb_ssh_forward_t *fwd)
+{
+    return fwd->ssh && fwd->session->data == fwd->ssh && mrb_ssh_initialized();
+}
+
+static void
+mrb_ssh_tunnel_free (mrb_state *mrb, mrb_ssh_forward_t *fwd, mrb_ssh_tunnel_t *tun, int attached)
+{
+    if (tun->channel && attached) {
+        libssh2_channel_close(tun->channel);
+        libssh2_channel_free(tun->channel);
+    }
+
+    if (tun->sock != LIBSSH2_INVALID_SOCKET) {
+        mrb_ssh_close_socket(tun->sock);
+    }
+
+    fwd->bytes_sent     += tun->bytes_sent;
+    fwd->bytes_received += tun->bytes_received;
+
+    mrb_free(mrb, tun);
+}
+
+/* Removes the tunnel from the poller, the last entry takes over its slot. */
+static void
+mrb_ssh_tunnel_unlink (mrb_ssh_forward_t *fwd, mrb_ssh_tunnel_t *tun)
+{
+    mrb_ssh_tunnel_t *moved;
+
+    mrb_ssh_poller_del(fwd->poller, tun->idx);
+
+    if (tun->idx < fwd->poller->len && (moved = fwd->poller->entries[tun->idx].data)) {
+        moved->idx = tun->idx;
+    }
+
+    fwd->active--;
+}
+
+static void
+mrb_ssh_forward_free_tunnels (mrb_state *mrb, mrb_ssh_forward_t *fwd)
+{
+    int attached = mrb_ssh_forward_attached(fwd);
+    mrb_ssh_tunnel_t *tun, *next;
+
+    for (tun = fwd->tunnels; tun; tun = next) {
+        next = tun->next;
+        mrb_ssh_tunnel_unlink(fwd, tun);
+        mrb_ssh_tunnel_free(mrb, fwd, tun, attached);
+    }
+
+    fwd->tunnels = NULL;
+}
+
+static void
+mrb_ssh_forward_close (mrb_state *mrb, mrb_ssh_forward_t *fwd)
+{
+    if (fwd->poller) {
+        mrb_ssh_forward_free_tunnels(mrb, fwd);
+        mrb_ssh_poller_free(mrb, fwd->poller);
+        fwd->poller = NULL;
+    }
+
+    if (fwd->listener != LIBSSH2_INVALID_SOCKET) {
+        mrb_ssh_close_socket(fwd->listener);
+        fwd->listener = LIBSSH2_INVALID_SOCKET;
+    }
+
+    fwd->ssh = NULL;
+}
+
+static void
+mrb_ssh_forward_free (mrb_state *mrb, void *p)
+{
+    mrb_ssh_forward_t *fwd = p;
+
+    if (!fwd) return;
+
+    mrb_ssh_forward_close(mrb, fwd);
+    mrb_free(mrb, fwd->remote_host);
+    mrb_free(mrb, fwd);
+}
+
+static mrb_data_type const mrb_ssh_forward_type = { "SSH::Forward", mrb_ssh_forward_free };
+
+static libssh2_socket_t
+mrb_ssh_forward_listen (const char *host, int port, int *bound)
+{
+    struct sockaddr_storage addr;
+    libssh2_socket_t sock;
+    socklen_t len;
+    int on = 1;
+
+    if (mrb_ssh_resolve(host, port, AF_UNSPEC, &addr, &len) != 0)
+        return LIBSSH2_INVALID_SOCKET;
+
+    if ((sock = socket(addr.ss_family, SOCK_STREAM, IPPROTO_TCP)) == LIBSSH2_INVALID_SOCKET)
+        return sock;
+
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+
+    if (bind(sock, (struct sockaddr *)&addr, len) != 0 ||
+        listen(sock, MRB_SSH_FORWARD_BACKLOG) != 0 ||
+        mrb_ssh_socket_nonblock(sock, 1) != 0) {
+        mrb_ssh_close_socket(sock);
+        return LIBSSH2_INVALID_SOCKET;
+    }
+
+    len = sizeof(addr);
+
+    if (getsockname(sock, (struct sockaddr *)&addr, &len) == 0) {
+        *bound = ntohs(addr.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&addr)->sin6_port
+                                                  : ((struct sockaddr_in *)&addr)->sin_port);
+    }
+
+    return sock;
+}
+
+static void
+mrb_ssh_forward_accept (mrb_state *mrb, mrb_ssh_forward_t *fwd)
+{
+    char port[8];
+    struct sockaddr_storage addr;
+    mrb_ssh_tunnel_t *tun;
+    libssh2_socket_t sock;
+    socklen_t len;
+
+    while (fwd->active < MRB_SSH_FORWARD_MAX) {
+        len = sizeof(addr);
+
+        if ((sock = accept(fwd->listener, (struct sockaddr *)&addr, &len)) == LIBSSH2_INVALID_SOCKET)
+            break;
+
+        if (mrb_ssh_socket_nonblock(sock, 1) != 0) {
+            mrb_ssh_close_socket(sock);
+            continue;
+        }
+
+#ifdef SO_NOSIGPIPE
+        {
+            int on = 1;
+            setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+        }
+#endif
+
+        tun = mrb_malloc(mrb, sizeof(mrb_ssh_tunnel_t));
+        memset(tun, 0, sizeof(mrb_ssh_tunnel_t));
+
+        tun->sock     = sock;
+        tun->state    = MRB_SSH_TUNNEL_OPENING;
+        tun->flags    = MRB_SSH_TUNNEL_READABLE | MRB_SSH_TUNNEL_WRITABLE;
+        tun->accepted = mrb_ssh_now();
+
+        if (getnameinfo((struct sockaddr *)&addr, len, tun->peer, sizeof(tun->peer), port, sizeof(port),
+                        NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+            tun->peer_port = atoi(port);
+        } else {
+            strcpy(tun->peer, "127.0.0.1");
+        }
+
+        tun->idx     = mrb_ssh_poller_add(mrb, fwd->poller, sock, MRB_SSH_WAIT_READ, tun);
+        tun->next    = fwd->tunnels;
+        fwd->tunnels = tun;
+
+        fwd->active++;
+        fwd->accepted++;
+    }
+}
+
+static int
+mrb_ssh_tunnel_open (mrb_ssh_forward_t *fwd, mrb_ssh_tunnel_t *tun)
+{
+    LIBSSH2_SESSION *session = fwd->ssh->session;
+
+    tun->channel = libssh2_channel_direct_tcpip_ex(session, fwd->remote_host, fwd->remote_port,
+                                                   tun->peer, tun->peer_port);
+
+    if (!tun->channel) {
+        if (libssh2_session_last_errno(session) == LIBSSH2_ERROR_EAGAIN)
+            return 0;
+
+        fwd->failed++;
+        tun->state = MRB_SSH_TUNNEL_CLOSING;
+
+        return 1;
+    }
+
+    tun->state     = MRB_SSH_TUNNEL_OPEN;
+    tun->open_time = mrb_ssh_now() - tun->accepted;
+
+    tun->window.size = LIBSSH2_CHANNEL_WINDOW_DEFAULT;
+    tun->window.max  = fwd->window_max > LIBSSH2_CHANNEL_WINDOW_DEFAULT ? fwd->window_max : 0;
+    tun->window.mark = mrb_ssh_now();
+
+    fwd->opened++;
+    fwd->open_time                    += tun->open_time;
+    fwd->ssh->stats.channel_opens++;
+    fwd->ssh->stats.channel_open_time += tun->open_time;
+
+    return 1;
+}
+
+/* Moves data from the accepted socket into the channel. */
+static int
+mrb_ssh_tunnel_upstream (mrb_ssh_forward_t *fwd, mrb_ssh_tunnel_t *tun)
+{
+    mrb_ssh_relay_buf_t *buf = &tun->up;
+    size_t space;
+    ssize_t n;
+    int progress = 0;
+
+    space = mrb_ssh_relay_space(buf);
+
+    if (space && (tun->flags & MRB_SSH_TUNNEL_READABLE) && !(tun->flags & MRB_SSH_TUNNEL_CLIENT_EOF)) {
+        n = recv(tun->sock, buf->data + buf->off + buf->len, space, 0);
+
+        if (n > 0) {
+            buf->len += (size_t)n;
+            progress  = 1;
+        } else if (n == 0) {
+            tun->flags |= MRB_SSH_TUNNEL_CLIENT_EOF;
+            progress    = 1;
+        } else if (mrb_ssh_forward_again()) {
+            tun->flags &= ~MRB_SSH_TUNNEL_READABLE;
+        } else {
+            return -1;
+        }
+    }
+
+    if (buf->len) {
+        n = libssh2_channel_write(tun->channel, buf->data + buf->off, buf->len);
+
+        if (n > 0) {
+            mrb_ssh_relay_consume(buf, (size_t)n);
+
+            if (!tun->first_sent) {
+                tun->first_sent = mrb_ssh_now();
+            }
+
+            tun->bytes_sent += (uint64_t)n;
+            progress         = 1;
+        } else if (n != LIBSSH2_ERROR_EAGAIN) {
+            return -1;
+        }
+    }
+
+    if (!buf->len && (tun->flags & MRB_SSH_TUNNEL_CLIENT_EOF) && !(tun->flags & MRB_SSH_TUNNEL_EOF_SENT)) {
+        n = libssh2_channel_send_eof(tun->channel);
+
+        if (n == 0) {
+            tun->flags |= MRB_SSH_TUNNEL_EOF_SENT;
+            progress    = 1;
+        } else if (n != LIBSSH2_ERROR_EAGAIN) {
+            return -1;
+        }
+    }
+
+    return progress;
+}
+
+/* Moves data from the channel to the accepted socket. Nothing is read
+   from the channel while the buffer is full. */
+static int
+mrb_ssh_tunnel_downstream (mrb_ssh_forward_t *fwd, mrb_ssh_tunnel_t *tun)
+{
+    mrb_ssh_relay_buf_t *buf = &tun->down;
+    size_t space;
+    ssize_t n;
+    int progress = 0;
+
+    space = mrb_ssh_relay_space(buf);
+
+    if (space && !(tun->flags & MRB_SSH_TUNNEL_REMOTE_EOF)) {
+        n = libssh2_channel_read(tun->channel, buf->data + buf->off + buf->len, space);
+
+        if (n > 0) {
+            buf->len += (size_t)n;
+
+            if (!tun->first_byte_time) {
+                tun->first_byte_time = mrb_ssh_now() - (tun->first_sent ? tun->first_sent : tun->accepted + tun->open_time);
+                tun->first_byte_time = tun->first_byte_time > 0 ? tun->first_byte_time : 1;
+            }
+
+            tun->bytes_received += (uint64_t)n;
+            progress             = 1;
+
+            mrb_ssh_window_tune(&tun->window, tun->channel, tun->open_time, (size_t)n);
+        } else if (n == 0 || libssh2_channel_eof(tun->channel)) {
+            if (libssh2_channel_eof(tun->channel)) {
+                tun->flags |= MRB_SSH_TUNNEL_REMOTE_EOF;
+                progress    = 1;
+            }
+        } else if (n != LIBSSH2_ERROR_EAGAIN) {
+            return -1;
+        }
+    }
+
+    if (buf->len && (tun->flags & MRB_SSH_TUNNEL_WRITABLE)) {
+        n = send(tun->sock, buf->data + buf->off, buf->len, MRB_SSH_SEND_FLAGS);
+
+        if (n > 0) {
+            mrb_ssh_relay_consume(buf, (size_t)n);
+            progress = 1;
+        } else if (n < 0 && mrb_ssh_forward_again()) {
+            tun->flags &= ~MRB_SSH_TUNNEL_WRITABLE;
+        } else {
+            return -1;
+        }
+    }
+
+    if (!buf->len && (tun->flags & MRB_SSH_TUNNEL_REMOTE_EOF) && !(tun->flags & MRB_SSH_TUNNEL_SHUTDOWN)) {
+        shutdown(tun->sock, MRB_SSH_SHUT_WR);
+        tun->flags |= MRB_SSH_TUNNEL_SHUTDOWN;
+        progress    = 1;
+    }
+
+    return progress;
+}
+
+static int
+mrb_ssh_tunnel_pump (mrb_ssh_forward_t *fwd, mrb_ssh_tunnel_t *tun)
+{
+    int up, down;
+
+    if (tun->state == MRB_SSH_TUNNEL_OPENING && !mrb_ssh_tunnel_open(fwd, tun))
+        return 0;
+
+    if (tun->state == MRB_SSH_TUNNEL_OPEN) {
+        up   = mrb_ssh_tunnel_upstream(fwd, tun);
+        down = up < 0 ? -1 : mrb_ssh_tunnel_downstream(fwd, tun);
+
+        if (down >= 0 && !((tun->flags & MRB_SSH_TUNNEL_EOF_SENT) && (tun->flags & MRB_SSH_TUNNEL_SHUTDOWN)))
+            return up || down;
+
+        tun->state = MRB_SSH_TUNNEL_CLOSING;
+    }
+
+    if (tun->state == MRB_SSH_TUNNEL_CLOSING) {
+        if (tun->channel && libssh2_channel_free(tun->channel) == LIBSSH2_ERROR_EAGAIN)
+            return 0;
+
+        tun->channel = NULL;
+        tun->state   = MRB_SSH_TUNNEL_CLOSED;
+    }
+
+    return 1;
+}
+
+static int
+mrb_ssh_tunnel_events (mrb_ssh_tunnel_t *tun)
+{
+    int events = 0;
+
+    if (tun->state != MRB_SSH_TUNNEL_OPEN)
+        return events;
+
+    if (!(tun->flags & MRB_SSH_TUNNEL_CLIENT_EOF) && tun->up.len < MRB_SSH_FORWARD_BUFFER)
+        events |= MRB_SSH_WAIT_READ;
+
+    if (tun->down.len && !(tun->flags & MRB_SSH_TUNNEL_WRITABLE))
+        events |= MRB_SSH_WAIT_WRITE;
+
+    return events;
+}
+
+/* Tells if the next pump of the tunnel calls into libssh2 and thereby
+   reads from the session socket. */
+static int
+mrb_ssh_tunnel_pumps_session (mrb_ssh_tunnel_t *tun)
+{
+    if (tun->state != MRB_SSH_TUNNEL_OPEN)
+        return tun->state != MRB_SSH_TUNNEL_CLOSED;
+
+    if (tun->up.len || ((tun->flags & MRB_SSH_TUNNEL_CLIENT_EOF) && !(tun->flags & MRB_SSH_TUNNEL_EOF_SENT)))
+        return 1;
+
+    return !(tun->flags & MRB_SSH_TUNNEL_REMOTE_EOF) && tun->down.len < MRB_SSH_FORWARD_BUFFER;
+}
+
+/* The session socket is only polled while a tunnel is going to read it.
+   Otherwise any packet from the server (keepalive, window adjust) would
+   leave the socket readable and the wait would return right away. */
+static void
+mrb_ssh_forward_arm (mrb_ssh_forward_t *fwd)
+{
+    mrb_ssh_tunnel_t *tun;
+    int pumps = 0;
+
+    mrb_ssh_poller_set(fwd->poller, 0, fwd->listener,
+                       fwd->active < MRB_SSH_FORWARD_MAX ? MRB_SSH_WAIT_READ : 0);
+
+    for (tun = fwd->tunnels; tun; tun = tun->next) {
+        mrb_ssh_poller_set(fwd->poller, tun->idx, tun->sock, mrb_ssh_tunnel_events(tun));
+        pumps |= mrb_ssh_tunnel_pumps_session(tun);
+    }
+
+    mrb_ssh_poller_set(fwd->poller, 1, fwd->ssh->sock,
+                       pumps ? MRB_SSH_WAIT_READ | mrb_ssh_block_directions(fwd->ssh->session) : 0);
+}
+
+/* Waits up to timeout ms for any socket, then accepts new connections and
+   pumps all tunnels until none of them makes progress anymore. Returns 0
+   if the session socket failed. */
+static int
+mrb_ssh_forward_step (mrb_state *mrb, mrb_ssh_forward_t *fwd, int timeout)
+{
+    mrb_ssh_tunnel_t *tun, **link;
+    mrb_ssh_poll_entry_t *entry;
+    int i, progress, rounds, blocking;
+
+    mrb_ssh_forward_arm(fwd);
+    mrb_ssh_poller_wait(mrb, fwd->poller, fwd->pending ? 0 : timeout);
+
+    if (fwd->poller->entries[1].revents & MRB_SSH_WAIT_ERROR)
+        return 0;
+
+    for (i = 2; i < fwd->poller->len; i++) {
+        entry = &fwd->poller->entries[i];
+        tun   = entry->data;
+
+        if (entry->revents & (MRB_SSH_WAIT_READ | MRB_SSH_WAIT_ERROR))
+            tun->flags |= MRB_SSH_TUNNEL_READABLE;
+
+        if (entry->revents & (MRB_SSH_WAIT_WRITE | MRB_SSH_WAIT_ERROR))
+            tun->flags |= MRB_SSH_TUNNEL_WRITABLE;
+    }
+
+    if (fwd->poller->entries[0].revents) {
+        mrb_ssh_forward_accept(mrb, fwd);
+    }
+
+    blocking = libssh2_session_get_blocking(fwd->ssh->session);
+    libssh2_session_set_blocking(fwd->ssh->session, 0);
+
+    for (rounds = 0, progress = 1; progress && rounds < MRB_SSH_FORWARD_ROUNDS; rounds++) {
+        progress = 0;
+
+        for (link = &fwd->tunnels; (tun = *link);) {
+            progress |= mrb_ssh_tunnel_pump(fwd, tun);
+
+            if (tun->state != MRB_SSH_TUNNEL_CLOSED) {
+                link = &tun->next;
+                continue;
+            }
+
+            *link = tun->next;
+            mrb_ssh_tunnel_unlink(fwd, tun);
+            mrb_ssh_tunnel_free(mrb, fwd, tun, TRUE);
+        }
+    }
+
+    libssh2_session_set_blocking(fwd->ssh->session, blocking);
+
+    fwd->pending = progress;
+
+    return 1;
+}
+
+static inline mrb_ssh_forward_t *
+mrb_ssh_forward_bang (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+
+    if (!fwd || fwd->listener == LIBSSH2_INVALID_SOCKET) {
+        mrb_raise(mrb, E_SSH_CHANNEL_CLOSED_ERROR, "SSH forward closed.");
+    }
+
+    return fwd;
+}
+
+static mrb_value
+mrb_ssh_f_forward_init (mrb_state *mrb, mrb_value self)
+{
+    mrb_value session, opts = mrb_nil_value(), bind;
+    mrb_int local_port, remote_port, win_max;
+    const char *remote_host;
+    mrb_ssh_forward_t *fwd;
+    mrb_ssh_t *ssh;
+    int bound = 0;
+
+    mrb_get_args(mrb, "oizi|H", &session, &local_port, &remote_host, &remote_port, &opts);
+
+    if (!mrb_obj_is_kind_of(mrb, session, mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "Session"))) {
+        mrb_raise(mrb, E_TYPE_ERROR, "expected SSH::Session");
+    }
+
+    ssh = DATA_PTR(session);
+
+    if (!(ssh && mrb_ssh_initialized())) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
+    }
+
+    if (!libssh2_userauth_authenticated(ssh->session)) {
+        mrb_raise(mrb, E_SSH_NOT_AUTH_ERROR, "SSH session not authenticated.");
+    }
+
+    if (local_port < 0 || local_port > 65535 || remote_port <= 0 || remote_port > 65535) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "port out of range");
+    }
+
+    bind    = mrb_hash_p(opts) ? mrb_hash_get(mrb, opts, SYM("bind", 4)) : mrb_nil_value();
+    win_max = mrb_hash_p(opts) ? mrb_ssh_window_opt(mrb, opts) : 0;
+
+    fwd = mrb_malloc(mrb, sizeof(mrb_ssh_forward_t));
+    memset(fwd, 0, sizeof(mrb_ssh_forward_t));
+
+    fwd->window_max = win_max > 0 ? (uint64_t)win_max : 0;
+
+    fwd->listener = LIBSSH2_INVALID_SOCKET;
+    mrb_data_init(self, fwd, &mrb_ssh_forward_type);
+
+    fwd->listener = mrb_ssh_forward_listen(mrb_string_p(bind) ? mrb_string_value_cstr(mrb, &bind) : "127.0.0.1",
+                                           (int)local_port, &bound);
+
+    if (fwd->listener == LIBSSH2_INVALID_SOCKET) {
+        mrb_raisef(mrb, E_SSH_ERROR, "Could not listen on port %d.", (int)local_port);
+    }
+
+    fwd->session     = mrb_ptr(session);
+    fwd->ssh         = ssh;
+    fwd->local_port  = bound ? bound : (int)local_port;
+    fwd->remote_port = (int)remote_port;
+    fwd->remote_host = mrb_malloc(mrb, strlen(remote_host) + 1);
+    fwd->poller      = mrb_ssh_poller_new(mrb, NULL);
+
+    strcpy(fwd->remote_host, remote_host);
+
+    mrb_ssh_poller_add(mrb, fwd->poller, fwd->listener, MRB_SSH_WAIT_READ, NULL);
+    mrb_ssh_poller_add(mrb, fwd->poller, ssh->sock, MRB_SSH_WAIT_READ, NULL);
+
+    mrb_iv_set(mrb, self, mrb_intern_static(mrb, "@session", 8), session);
+
+    return self;
+}
+
+static mrb_value
+mrb_ssh_f_forward_process (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = mrb_ssh_forward_bang(mrb, self);
+    mrb_int timeout        = 0;
+
+    mrb_get_args(mrb, "|i", &timeout);
+
+    if (!mrb_ssh_forward_attached(fwd)) {
+        mrb_ssh_forward_close(mrb, fwd);
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
+    }
+
+    if (!mrb_ssh_forward_step(mrb, fwd, (int)timeout)) {
+        mrb_ssh_forward_close(mrb, fwd);
+        mrb_raise(mrb, E_SSH_DISCONNECT_ERROR, "Connection lost.");
+    }
+
+    return mrb_fixnum_value(fwd->active);
+}
+
+static mrb_value
+mrb_ssh_f_forward_close (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+
+    if (fwd) {
+        mrb_ssh_forward_close(mrb, fwd);
+    }
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_forward_closed (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+
+    return mrb_bool_value(!fwd || fwd->listener == LIBSSH2_INVALID_SOCKET || !mrb_ssh_forward_attached(fwd));
+}
+
+static mrb_value
+mrb_ssh_f_forward_local_port (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+
+    return fwd ? mrb_fixnum_value(fwd->local_port) : mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_forward_remote_host (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+
+    return fwd && fwd->remote_host ? mrb_str_new_cstr(mrb, fwd->remote_host) : mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_forward_remote_port (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+
+    return fwd ? mrb_fixnum_value(fwd->remote_port) : mrb_nil_value();
+}
+
+static inline mrb_value
+mrb_ssh_forward_secs (mrb_state *mrb, int64_t usecs)
+{
+    return mrb_float_value(mrb, (mrb_float)usecs / 1000000);
+}
+
+static mrb_value
+mrb_ssh_f_forward_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+    mrb_value stats        = mrb_hash_new_capa(mrb, 7);
+    uint64_t sent = 0, received = 0;
+    mrb_ssh_tunnel_t *tun;
+
+    if (!fwd) return stats;
+
+    for (tun = fwd->tunnels; tun; tun = tun->next) {
+        sent     += tun->bytes_sent;
+        received += tun->bytes_received;
+    }
+
+    mrb_hash_set(mrb, stats, SYM("accepted", 8),       mrb_fixnum_value((mrb_int)fwd->accepted));
+    mrb_hash_set(mrb, stats, SYM("active", 6),         mrb_fixnum_value(fwd->active));
+    mrb_hash_set(mrb, stats, SYM("opened", 6),         mrb_fixnum_value((mrb_int)fwd->opened));
+    mrb_hash_set(mrb, stats, SYM("failed", 6),         mrb_fixnum_value((mrb_int)fwd->failed));
+    mrb_hash_set(mrb, stats, SYM("bytes_sent", 10),    mrb_fixnum_value((mrb_int)(fwd->bytes_sent + sent)));
+    mrb_hash_set(mrb, stats, SYM("bytes_received", 14), mrb_fixnum_value((mrb_int)(fwd->bytes_received + received)));
+    mrb_hash_set(mrb, stats, SYM("open_time", 9),      mrb_ssh_forward_secs(mrb, fwd->opened ? fwd->open_time / (int64_t)fwd->opened : 0));
+
+    return stats;
+}
+
+static mrb_value
+mrb_ssh_f_forward_tunnels (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_forward_t *fwd = DATA_PTR(self);
+    mrb_value list         = mrb_ary_new(mrb);
+    int64_t now            = mrb_ssh_now();
+    mrb_ssh_tunnel_t *tun;
+    char peer[80];
+    mrb_value item;
+    int arena;
+
+    if (!fwd) return list;
+
+    for (tun = fwd->tunnels; tun; tun = tun->next) {
+        arena = mrb_gc_arena_save(mrb);
+        item  = mrb_hash_new_capa(mrb, 8);
+
+        snprintf(peer, sizeof(peer), "%s:%d", tun->peer, tun->peer_port);
+
+        mrb_hash_set(mrb, item, SYM("peer", 4),            mrb_str_new_cstr(mrb, peer));
+        mrb_hash_set(mrb, item, SYM("open", 4),            mrb_bool_value(tun->state == MRB_SSH_TUNNEL_OPEN));
+        mrb_hash_set(mrb, item, SYM("bytes_sent", 10),     mrb_fixnum_value((mrb_int)tun->bytes_sent));
+        mrb_hash_set(mrb, item, SYM("bytes_received", 14), mrb_fixnum_value((mrb_int)tun->bytes_received));
+        mrb_hash_set(mrb, item, SYM("open_time", 9),       mrb_ssh_forward_secs(mrb, tun->open_time));
+        mrb_hash_set(mrb, item, SYM("first_byte_time", 15), mrb_ssh_forward_secs(mrb, tun->first_byte_time));
+        mrb_hash_set(mrb, item, SYM("age", 3),             mrb_ssh_forward_secs(mrb, now - tun->accepted));
+        mrb_hash_set(mrb, item, SYM("window", 6),          mrb_fixnum_value((mrb_int)tun->window.size));
+
+        mrb_ary_push(mrb, list, item);
+        mrb_gc_arena_restore(mrb, arena);
+    }
+
+    return list;
+}
+
+void
+mrb_mruby_ssh_forward_init (mrb_state *mrb)
+{
+    struct RClass *ssh = mrb_module_get(mrb, "SSH");
+    struct RClass *cls = mrb_define_class_under(mrb, ssh, "Forward", mrb->object_class);
+
+    MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+
+    mrb_define_method(mrb, cls, "initialize",  mrb_ssh_f_forward_init,        MRB_ARGS_ARG(4, 1));
+    mrb_define_method(mrb, cls, "process",     mrb_ssh_f_forward_process,     MRB_ARGS_OPT(1));
+    mrb_define_method(mrb, cls, "close",       mrb_ssh_f_forward_close,       MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "closed?",     mrb_ssh_f_forward_closed,      MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "local_port",  mrb_ssh_f_forward_local_port,  MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "remote_host", mrb_ssh_f_forward_remote_host, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "remote_port", mrb_ssh_f_forward_remote_port, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "stats",       mrb_ssh_f_forward_stats,       MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "tunnels",     mrb_ssh_f_forward_tunnels,     MRB_ARGS_NONE());
+}
+
+#endif
@@ -0,0 +1,50 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "mruby.h"
+
+MRB_BEGIN_DECL
+
+#ifndef MRB_SSH_FORWARD_BUFFER
+# define MRB_SSH_FORWARD_BUFFER (32 * 1024)
+#endif
+
+#ifndef MRB_SSH_FORWARD_MAX
+# define MRB_SSH_FORWARD_MAX 256
+#endif
+
+#ifndef MRB_SSH_FORWARD_BACKLOG
+# define MRB_SSH_FORWARD_BACKLOG 128
+#endif
+
+#ifndef MRB_SSH_FORWARD_ROUNDS
+# define MRB_SSH_FORWARD_ROUNDS 16
+#endif
+
+void mrb_mruby_ssh_forward_init (mrb_state *mrb);
+
+MRB_END_DECL
+
+#endif
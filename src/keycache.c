@@ -0,0 +1,349 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "keycache.h"
+#include "store.h"
+
+#include "mruby.h"
+#include "mruby/hash.h"
+#include "mruby/string.h"
+#include "mruby/ext/ssh.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
+
+MRB_SSH_MUTEX(mrb_ssh_keycache_mutex);
+#define mrb_ssh_keycache_lock()   mrb_ssh_mutex_lock(mrb_ssh_keycache_mutex)
+#define mrb_ssh_keycache_unlock() mrb_ssh_mutex_unlock(mrb_ssh_keycache_mutex)
+
+static struct
+{
+    mrb_ssh_key_t *keys;
+    mrb_int size;
+    mrb_int hits;
+    mrb_int misses;
+} mrb_ssh_keycache = { NULL, 0, 0, 0 };
+
+static void
+mrb_ssh_keycache_wipe (char *buf, size_t len)
+{
+    volatile char *p = buf;
+
+    if (!buf) return;
+
+    while (len--) *p++ = 0;
+
+    free(buf);
+}
+
+static void
+mrb_ssh_key_free (mrb_ssh_key_t *key)
+{
+    mrb_ssh_keycache_wipe(key->priv, key->priv_len);
+    mrb_ssh_keycache_wipe(key->passphrase, key->passphrase ? strlen(key->passphrase) : 0);
+    free(key->pub);
+    free(key->name);
+    free(key);
+}
+
+static char *
+mrb_ssh_keycache_dup (const char *buf, size_t len)
+{
+    char *copy;
+
+    if (!buf || !(copy = malloc(len + 1))) return NULL;
+
+    memcpy(copy, buf, len);
+    copy[len] = '\0';
+
+    return copy;
+}
+
+static char *
+mrb_ssh_keycache_read (const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    char *buf = NULL;
+    long size;
+
+    *len = 0;
+
+    if (!fp) return NULL;
+
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0 && size <= MRB_SSH_KEYCACHE_MAX_SIZE &&
+        fseek(fp, 0, SEEK_SET) == 0 && (buf = malloc((size_t)size + 1))) {
+        if (fread(buf, 1, (size_t)size, fp) == (size_t)size) {
+            buf[size] = '\0';
+            *len      = (size_t)size;
+        } else {
+            mrb_ssh_keycache_wipe(buf, (size_t)size);
+            buf = NULL;
+        }
+    }
+
+    fclose(fp);
+
+    return buf;
+}
+
+static mrb_ssh_key_t **
+mrb_ssh_keycache_find (const char *name)
+{
+    mrb_ssh_key_t **key;
+
+    for (key = &mrb_ssh_keycache.keys; *key; key = &(*key)->next) {
+        if (strcmp((*key)->name, name) == 0) return key;
+    }
+
+    return NULL;
+}
+
+/* Unlinks the entry, it gets freed once the last login released it. */
+static void
+mrb_ssh_keycache_unlink (mrb_ssh_key_t **key)
+{
+    mrb_ssh_key_t *entry = *key;
+
+    *key        = entry->next;
+    entry->next = NULL;
+
+    mrb_ssh_keycache.size--;
+
+    if (--entry->refs == 0) {
+        mrb_ssh_key_free(entry);
+    }
+}
+
+static void
+mrb_ssh_keycache_store (mrb_ssh_key_t *key)
+{
+    mrb_ssh_key_t **old;
+
+    mrb_ssh_keycache_lock();
+
+    if ((old = mrb_ssh_keycache_find(key->name))) {
+        mrb_ssh_keycache_unlink(old);
+    }
+
+    key->refs               = 1;
+    key->next               = mrb_ssh_keycache.keys;
+    mrb_ssh_keycache.keys   = key;
+    mrb_ssh_keycache.size++;
+
+    mrb_ssh_keycache_unlock();
+}
+
+mrb_ssh_key_t *
+mrb_ssh_keycache_get (const char *name)
+{
+    mrb_ssh_key_t **key;
+    mrb_ssh_key_t *res = NULL;
+
+    mrb_ssh_keycache_lock();
+
+    if ((key = mrb_ssh_keycache_find(name))) {
+        res = *key;
+        res->refs++;
+        mrb_ssh_keycache.hits++;
+    } else {
+        mrb_ssh_keycache.misses++;
+    }
+
+    mrb_ssh_keycache_unlock();
+
+    return res;
+}
+
+void
+mrb_ssh_keycache_release (mrb_ssh_key_t *key)
+{
+    if (!key) return;
+
+    mrb_ssh_keycache_lock();
+
+    if (--key->refs == 0) {
+        mrb_ssh_key_free(key);
+    }
+
+    mrb_ssh_keycache_unlock();
+}
+
+void
+mrb_ssh_keycache_clear (void)
+{
+    mrb_ssh_keycache_lock();
+
+    while (mrb_ssh_keycache.keys) {
+        mrb_ssh_keycache_unlink(&mrb_ssh_keycache.keys);
+    }
+
+    mrb_ssh_keycache.hits   = 0;
+    mrb_ssh_keycache.misses = 0;
+
+    mrb_ssh_keycache_unlock();
+}
+
+static mrb_ssh_key_t *
+mrb_ssh_key_new (mrb_state *mrb, const char *name, const char *passphrase)
+{
+    mrb_ssh_key_t *key = calloc(1, sizeof(mrb_ssh_key_t));
+
+    if (!key || !(key->name = mrb_ssh_keycache_dup(name, strlen(name))) ||
+        (passphrase && !(key->passphrase = mrb_ssh_keycache_dup(passphrase, strlen(passphrase))))) {
+        if (key) mrb_ssh_key_free(key);
+        mrb_raise(mrb, E_RUNTIME_ERROR, "Out of memory.");
+    }
+
+    return key;
+}
+
+static mrb_value
+mrb_ssh_f_keycache_load (mrb_state *mrb, mrb_value self)
+{
+    const char *path, *passphrase = NULL;
+    mrb_value pub_path;
+    mrb_ssh_key_t *key;
+
+    mrb_get_args(mrb, "z|z!", &path, &passphrase);
+
+    pub_path = mrb_str_new_cstr(mrb, path);
+    mrb_str_cat_cstr(mrb, pub_path, ".pub");
+
+    key = mrb_ssh_key_new(mrb, path, passphrase);
+
+    if (!(key->priv = mrb_ssh_keycache_read(path, &key->priv_len))) {
+        mrb_ssh_key_free(key);
+        mrb_raisef(mrb, E_SSH_ERROR, "Could not read key file %s.", path);
+    }
+
+    key->pub = mrb_ssh_keycache_read(RSTRING_PTR(pub_path), &key->pub_len);
+
+    mrb_ssh_keycache_store(key);
+
+    return mrb_true_value();
+}
+
+static mrb_value
+mrb_ssh_f_keycache_add (mrb_state *mrb, mrb_value self)
+{
+    const char *name, *priv, *pub = NULL, *passphrase = NULL;
+    mrb_int priv_len, pub_len = 0;
+    mrb_ssh_key_t *key;
+
+    mrb_get_args(mrb, "zs|s!z!", &name, &priv, &priv_len, &pub, &pub_len, &passphrase);
+
+    key = mrb_ssh_key_new(mrb, name, passphrase);
+
+    key->priv     = mrb_ssh_keycache_dup(priv, (size_t)priv_len);
+    key->priv_len = (size_t)priv_len;
+    key->pub      = mrb_ssh_keycache_dup(pub, (size_t)pub_len);
+    key->pub_len  = key->pub ? (size_t)pub_len : 0;
+
+    if (!key->priv) {
+        mrb_ssh_key_free(key);
+        mrb_raise(mrb, E_RUNTIME_ERROR, "Out of memory.");
+    }
+
+    mrb_ssh_keycache_store(key);
+
+    return mrb_true_value();
+}
+
+static mrb_value
+mrb_ssh_f_keycache_include (mrb_state *mrb, mrb_value self)
+{
+    const char *name;
+    mrb_bool found;
+
+    mrb_get_args(mrb, "z", &name);
+
+    mrb_ssh_keycache_lock();
+    found = mrb_ssh_keycache_find(name) != NULL;
+    mrb_ssh_keycache_unlock();
+
+    return mrb_bool_value(found);
+}
+
+static mrb_value
+mrb_ssh_f_keycache_delete (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_key_t **key;
+    const char *name;
+    mrb_bool found;
+
+    mrb_get_args(mrb, "z", &name);
+
+    mrb_ssh_keycache_lock();
+
+    if ((found = (key = mrb_ssh_keycache_find(name)) != NULL)) {
+        mrb_ssh_keycache_unlink(key);
+    }
+
+    mrb_ssh_keycache_unlock();
+
+    return mrb_bool_value(found);
+}
+
+static mrb_value
+mrb_ssh_f_keycache_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_value stats = mrb_hash_new_capa(mrb, 3);
+    mrb_int hits, misses, size;
+
+    mrb_ssh_keycache_lock();
+    hits   = mrb_ssh_keycache.hits;
+    misses = mrb_ssh_keycache.misses;
+    size   = mrb_ssh_keycache.size;
+    mrb_ssh_keycache_unlock();
+
+    mrb_hash_set(mrb, stats, SYM("hits", 4),   mrb_fixnum_value(hits));
+    mrb_hash_set(mrb, stats, SYM("misses", 6), mrb_fixnum_value(misses));
+    mrb_hash_set(mrb, stats, SYM("size", 4),   mrb_fixnum_value(size));
+
+    return stats;
+}
+
+static mrb_value
+mrb_ssh_f_keycache_clear (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_keycache_clear();
+
+    return self;
+}
+
+void
+mrb_mruby_ssh_keycache_init (mrb_state *mrb)
+{
+    struct RClass *ssh   = mrb_module_get(mrb, "SSH");
+    struct RClass *cache = mrb_define_module_under(mrb, ssh, "KeyCache");
+
+    mrb_define_module_function(mrb, cache, "load",     mrb_ssh_f_keycache_load,    MRB_ARGS_ARG(1, 1));
+    mrb_define_module_function(mrb, cache, "add",      mrb_ssh_f_keycache_add,     MRB_ARGS_ARG(2, 2));
+    mrb_define_module_function(mrb, cache, "include?", mrb_ssh_f_keycache_include, MRB_ARGS_REQ(1));
+    mrb_define_module_function(mrb, cache, "delete",   mrb_ssh_f_keycache_delete,  MRB_ARGS_REQ(1));
+    mrb_define_module_function(mrb, cache, "stats",    mrb_ssh_f_keycache_stats,   MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, cache, "clear",    mrb_ssh_f_keycache_clear,   MRB_ARGS_NONE());
+}
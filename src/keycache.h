@@ -0,0 +1,54 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mruby.h"
+
+#include <stddef.h>
+
+MRB_BEGIN_DECL
+
+#ifndef MRB_SSH_KEYCACHE_MAX_SIZE
+# define MRB_SSH_KEYCACHE_MAX_SIZE (1024 * 1024)
+#endif
+
+/* Key material shared by all sessions. Entries are reference counted so
+   that a login can use them without holding the cache lock. */
+typedef struct mrb_ssh_key
+{
+    struct mrb_ssh_key *next;
+    char *name;
+    char *priv;
+    size_t priv_len;
+    char *pub;
+    size_t pub_len;
+    char *passphrase;
+    int refs;
+} mrb_ssh_key_t;
+
+mrb_ssh_key_t * mrb_ssh_keycache_get (const char *name);
+void mrb_ssh_keycache_release (mrb_ssh_key_t *key);
+void mrb_ssh_keycache_clear (void);
+
+void mrb_mruby_ssh_keycache_init (mrb_state *mrb);
+
+MRB_END_DECL
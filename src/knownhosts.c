@@ -0,0 +1,1160 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "knownhosts.h"
+#include "socket.h"
+#include "store.h"
+
+#include "mruby.h"
+#include "mruby/data.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#include "mruby/ext/ssh.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <libssh2.h>
+
+#define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
+
+#define MRB_SSH_KH_BUCKETS 256
+#define MRB_SSH_KH_LINE    8192
+#define MRB_SSH_KH_NAME    1100
+
+#define MRB_SSH_KH_MEMO_BUCKETS 256
+
+#ifndef MRB_SSH_KNOWNHOSTS_MEMO_MAX
+# define MRB_SSH_KNOWNHOSTS_MEMO_MAX 1024
+#endif
+
+MRB_SSH_MUTEX(mrb_ssh_kh_mutex);
+#define mrb_ssh_kh_lock()   mrb_ssh_mutex_lock(mrb_ssh_kh_mutex)
+#define mrb_ssh_kh_unlock() mrb_ssh_mutex_unlock(mrb_ssh_kh_mutex)
+
+/* An entry is either a plain host name, a hashed host name (|1|salt|hash),
+   a wildcard pattern or a revoked key. Entries of a line with negated
+   patterns (!host) share a copy of them in neg, a list of strings ended by
+   an empty one. */
+typedef struct mrb_ssh_kh_entry
+{
+    struct mrb_ssh_kh_entry *next;
+    char *name;
+    char *neg;
+    unsigned char *key;
+    size_t len;
+    unsigned char salt[20];
+    unsigned char hash[20];
+} mrb_ssh_kh_entry_t;
+
+/* The store is shared by all interpreters and threads of the process and
+   allocated with malloc since it outlives the mrb_state that loaded it. */
+static struct
+{
+    mrb_ssh_kh_entry_t **buckets;
+    size_t capa;
+    size_t count;
+    mrb_int size;
+    mrb_ssh_kh_entry_t *hashed;
+    mrb_ssh_kh_entry_t *patterns;
+    mrb_ssh_kh_entry_t *revoked;
+    char *path;
+    int loaded;
+    int partial;
+    unsigned int gen;
+    long offset;
+    long long fsize;
+    long long mtime;
+    uint32_t digest;
+    int64_t checked;
+} mrb_ssh_kh = { NULL, 0, 0, 0, NULL, NULL, NULL, NULL, 0, 0, 1, 0, -1, -1, 0, 0 };
+
+/* Lookups of hashed names and patterns are memoized per host name, a memo
+   without key means that nothing matched. Memos are only valid within the
+   generation of the file they were made in and dropped all at once when
+   the generation changes or the table is full. */
+static struct
+{
+    mrb_ssh_kh_entry_t *buckets[MRB_SSH_KH_MEMO_BUCKETS];
+    size_t count;
+    unsigned int gen;
+} mrb_ssh_kh_memos;
+
+/* SHA-1 is needed for the HMAC of hashed host names only. */
+typedef struct mrb_ssh_sha1
+{
+    uint32_t h[5];
+    uint64_t len;
+    unsigned char buf[64];
+    size_t used;
+} mrb_ssh_sha1_t;
+
+#define MRB_SSH_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+mrb_ssh_sha1_block (uint32_t h[5], const unsigned char *p)
+{
+    uint32_t w[80], a, b, c, d, e, f, k, t;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[i*4] << 24 | (uint32_t)p[i*4+1] << 16 | (uint32_t)p[i*4+2] << 8 | (uint32_t)p[i*4+3];
+    }
+
+    for (; i < 80; i++) {
+        t    = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+        w[i] = MRB_SSH_ROL(t, 1);
+    }
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+    for (i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d); k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d; k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d; k = 0xCA62C1D6;
+        }
+
+        t = MRB_SSH_ROL(a, 5) + f + e + k + w[i];
+        e = d; d = c; c = MRB_SSH_ROL(b, 30); b = a; a = t;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+static void
+mrb_ssh_sha1_init (mrb_ssh_sha1_t *ctx)
+{
+    ctx->h[0] = 0x67452301; ctx->h[1] = 0xEFCDAB89; ctx->h[2] = 0x98BADCFE;
+    ctx->h[3] = 0x10325476; ctx->h[4] = 0xC3D2E1F0;
+    ctx->len  = 0;
+    ctx->used = 0;
+}
+
+static void
+mrb_ssh_sha1_update (mrb_ssh_sha1_t *ctx, const unsigned char *p, size_t len)
+{
+    ctx->len += len;
+
+    while (len--) {
+        ctx->buf[ctx->used++] = *p++;
+
+        if (ctx->used == 64) {
+            mrb_ssh_sha1_block(ctx->h, ctx->buf);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void
+mrb_ssh_sha1_final (mrb_ssh_sha1_t *ctx, unsigned char out[20])
+{
+    uint64_t bits = ctx->len * 8;
+    unsigned char pad = 0x80, zero = 0, len[8];
+    int i;
+
+    mrb_ssh_sha1_update(ctx, &pad, 1);
+
+    while (ctx->used != 56) {
+        mrb_ssh_sha1_update(ctx, &zero, 1);
+    }
+
+    for (i = 0; i < 8; i++) {
+        len[i] = (unsigned char)(bits >> (56 - i * 8));
+    }
+
+    mrb_ssh_sha1_update(ctx, len, 8);
+
+    for (i = 0; i < 20; i++) {
+        out[i] = (unsigned char)(ctx->h[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+static void
+mrb_ssh_hmac_sha1 (const unsigned char key[20], const char *msg, size_t len, unsigned char out[20])
+{
+    unsigned char ipad[64], opad[64], inner[20];
+    mrb_ssh_sha1_t ctx;
+    int i;
+
+    memset(ipad, 0x36, sizeof(ipad));
+    memset(opad, 0x5C, sizeof(opad));
+
+    for (i = 0; i < 20; i++) {
+        ipad[i] ^= key[i];
+        opad[i] ^= key[i];
+    }
+
+    mrb_ssh_sha1_init(&ctx);
+    mrb_ssh_sha1_update(&ctx, ipad, 64);
+    mrb_ssh_sha1_update(&ctx, (const unsigned char *)msg, len);
+    mrb_ssh_sha1_final(&ctx, inner);
+
+    mrb_ssh_sha1_init(&ctx);
+    mrb_ssh_sha1_update(&ctx, opad, 64);
+    mrb_ssh_sha1_update(&ctx, inner, 20);
+    mrb_ssh_sha1_final(&ctx, out);
+}
+
+static const char mrb_ssh_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t
+mrb_ssh_base64_encode (const unsigned char *in, size_t len, char *out)
+{
+    size_t i, pos = 0;
+    uint32_t n;
+
+    for (i = 0; i < len; i += 3) {
+        n = (uint32_t)in[i] << 16;
+
+        if (i + 1 < len) n |= (uint32_t)in[i+1] << 8;
+        if (i + 2 < len) n |= (uint32_t)in[i+2];
+
+        out[pos++] = mrb_ssh_base64_chars[(n >> 18) & 63];
+        out[pos++] = mrb_ssh_base64_chars[(n >> 12) & 63];
+        out[pos++] = i + 1 < len ? mrb_ssh_base64_chars[(n >> 6) & 63] : '=';
+        out[pos++] = i + 2 < len ? mrb_ssh_base64_chars[n & 63] : '=';
+    }
+
+    out[pos] = '\0';
+
+    return pos;
+}
+
+static long
+mrb_ssh_base64_decode (const char *in, size_t len, unsigned char *out, size_t capa)
+{
+    uint32_t n = 0;
+    size_t i, pos = 0;
+    int bits = 0;
+    const char *c;
+
+    for (i = 0; i < len && in[i] != '='; i++) {
+        if (!(c = strchr(mrb_ssh_base64_chars, in[i])) || !in[i])
+            return -1;
+
+        n     = (n << 6) | (uint32_t)(c - mrb_ssh_base64_chars);
+        bits += 6;
+
+        if (bits >= 8) {
+            if (pos == capa) return -1;
+
+            bits      -= 8;
+            out[pos++] = (unsigned char)(n >> bits);
+        }
+    }
+
+    return (long)pos;
+}
+
+/* The key blob starts with the length prefixed name of the key type. */
+static size_t
+mrb_ssh_kh_type_len (const unsigned char *key, size_t len)
+{
+    size_t type_len;
+
+    if (len < 4) return 0;
+
+    type_len = (size_t)key[0] << 24 | (size_t)key[1] << 16 | (size_t)key[2] << 8 | (size_t)key[3];
+
+    return type_len + 4 <= len ? type_len + 4 : 0;
+}
+
+static void
+mrb_ssh_kh_free_list (mrb_ssh_kh_entry_t *entry)
+{
+    mrb_ssh_kh_entry_t *next;
+
+    for (; entry; entry = next) {
+        next = entry->next;
+        free(entry->name);
+        free(entry->neg);
+        free(entry->key);
+        free(entry);
+    }
+}
+
+static void
+mrb_ssh_kh_memo_clear (void)
+{
+    size_t i;
+
+    for (i = 0; i < MRB_SSH_KH_MEMO_BUCKETS; i++) {
+        mrb_ssh_kh_free_list(mrb_ssh_kh_memos.buckets[i]);
+        mrb_ssh_kh_memos.buckets[i] = NULL;
+    }
+
+    mrb_ssh_kh_memos.count = 0;
+}
+
+static void
+mrb_ssh_kh_reset (void)
+{
+    size_t i;
+
+    mrb_ssh_kh_memo_clear();
+
+    for (i = 0; i < mrb_ssh_kh.capa; i++) {
+        mrb_ssh_kh_free_list(mrb_ssh_kh.buckets[i]);
+    }
+
+    mrb_ssh_kh_free_list(mrb_ssh_kh.hashed);
+    mrb_ssh_kh_free_list(mrb_ssh_kh.patterns);
+    mrb_ssh_kh_free_list(mrb_ssh_kh.revoked);
+
+    free(mrb_ssh_kh.buckets);
+
+    mrb_ssh_kh.buckets  = NULL;
+    mrb_ssh_kh.hashed   = NULL;
+    mrb_ssh_kh.patterns = NULL;
+    mrb_ssh_kh.revoked  = NULL;
+    mrb_ssh_kh.capa     = 0;
+    mrb_ssh_kh.count    = 0;
+    mrb_ssh_kh.size     = 0;
+    mrb_ssh_kh.offset   = 0;
+    mrb_ssh_kh.partial  = 0;
+    mrb_ssh_kh.digest   = 2166136261u;
+}
+
+static void
+mrb_ssh_kh_rehash (size_t capa)
+{
+    mrb_ssh_kh_entry_t **buckets = calloc(capa, sizeof(mrb_ssh_kh_entry_t *));
+    mrb_ssh_kh_entry_t *entry, *next;
+    size_t i, j;
+
+    if (!buckets) return;
+
+    for (i = 0; i < mrb_ssh_kh.capa; i++) {
+        for (entry = mrb_ssh_kh.buckets[i]; entry; entry = next) {
+            next        = entry->next;
+            j           = mrb_ssh_str_hash(entry->name) & (capa - 1);
+            entry->next = buckets[j];
+            buckets[j]  = entry;
+        }
+    }
+
+    free(mrb_ssh_kh.buckets);
+
+    mrb_ssh_kh.buckets = buckets;
+    mrb_ssh_kh.capa    = capa;
+}
+
+static mrb_ssh_kh_entry_t *
+mrb_ssh_kh_entry_new (const char *name, const unsigned char *key, size_t len)
+{
+    mrb_ssh_kh_entry_t *entry = calloc(1, sizeof(mrb_ssh_kh_entry_t));
+
+    if (!entry) return NULL;
+
+    if (name && !(entry->name = strdup(name))) {
+        free(entry);
+        return NULL;
+    }
+
+    if (key && (entry->key = malloc(len))) {
+        memcpy(entry->key, key, len);
+        entry->len = len;
+    }
+
+    return entry;
+}
+
+static void
+mrb_ssh_kh_insert (mrb_ssh_kh_entry_t *entry)
+{
+    size_t i;
+
+    if (mrb_ssh_kh.count >= mrb_ssh_kh.capa * 2) {
+        mrb_ssh_kh_rehash(mrb_ssh_kh.capa ? mrb_ssh_kh.capa * 2 : MRB_SSH_KH_BUCKETS);
+    }
+
+    if (!mrb_ssh_kh.capa) {
+        mrb_ssh_kh_free_list(entry);
+        return;
+    }
+
+    i                      = mrb_ssh_str_hash(entry->name) & (mrb_ssh_kh.capa - 1);
+    entry->next            = mrb_ssh_kh.buckets[i];
+    mrb_ssh_kh.buckets[i]  = entry;
+    mrb_ssh_kh.count++;
+}
+
+static void
+mrb_ssh_kh_push (mrb_ssh_kh_entry_t **list, mrb_ssh_kh_entry_t *entry)
+{
+    entry->next = *list;
+    *list       = entry;
+}
+
+static void
+mrb_ssh_kh_downcase (char *str)
+{
+    for (; *str; str++) {
+        *str = (char)tolower((unsigned char)*str);
+    }
+}
+
+static int
+mrb_ssh_kh_hashed_name (mrb_ssh_kh_entry_t *entry, char *name)
+{
+    char *sep = strchr(name + 3, '|');
+
+    if (!sep) return 0;
+
+    return mrb_ssh_base64_decode(name + 3, (size_t)(sep - name - 3), entry->salt, 20) == 20 &&
+           mrb_ssh_base64_decode(sep + 1, strlen(sep + 1), entry->hash, 20) == 20;
+}
+
+/* Collects the negated patterns of a comma separated list of host names
+   as a list of strings ended by an empty one, NULL if there are none. */
+static char *
+mrb_ssh_kh_negations (const char *names, size_t *len)
+{
+    const char *name, *end;
+    char *neg = NULL, *tmp;
+    size_t size = 0, n;
+
+    for (name = names; *name; name = *end ? end + 1 : end) {
+        end = name + strcspn(name, ",");
+
+        if (*name != '!' || end - name < 2) continue;
+
+        n = (size_t)(end - name - 1);
+
+        if (!(tmp = realloc(neg, size + n + 2))) break;
+
+        neg = tmp;
+        memcpy(neg + size, name + 1, n);
+        neg[size + n] = '\0';
+        mrb_ssh_kh_downcase(neg + size);
+        size += n + 1;
+    }
+
+    if (neg) neg[size++] = '\0';
+
+    *len = size;
+
+    return neg;
+}
+
+static void
+mrb_ssh_kh_negate (mrb_ssh_kh_entry_t *entry, const char *neg, size_t len)
+{
+    if (neg && (entry->neg = malloc(len))) {
+        memcpy(entry->neg, neg, len);
+    }
+}
+
+/* Parses a line in the OpenSSH known_hosts format:
+   [@marker] hostnames keytype base64-key [comment] */
+static void
+mrb_ssh_kh_parse (char *line)
+{
+    char *fields[2], *name, *next, *neg;
+    unsigned char key[MRB_SSH_KH_LINE];
+    mrb_ssh_kh_entry_t *entry;
+    int i, revoked = 0;
+    size_t neg_len;
+    long len;
+
+    for (i = 0; i < 2; i++) {
+        while (*line && isspace((unsigned char)*line)) line++;
+
+        if (!*line || (i == 0 && *line == '#')) return;
+
+        fields[i] = line;
+
+        while (*line && !isspace((unsigned char)*line)) line++;
+        if (*line) *line++ = '\0';
+
+        if (i == 0 && fields[0][0] == '@') {
+            if (strcmp(fields[0], "@revoked") != 0) return;
+
+            revoked = 1;
+            i--;
+        }
+    }
+
+    while (*line && isspace((unsigned char)*line)) line++;
+
+    name = line;
+    while (*line && !isspace((unsigned char)*line)) line++;
+
+    if ((len = mrb_ssh_base64_decode(name, (size_t)(line - name), key, sizeof(key))) <= 0)
+        return;
+
+    if (revoked) {
+        if ((entry = mrb_ssh_kh_entry_new(NULL, key, (size_t)len)))
+            mrb_ssh_kh_push(&mrb_ssh_kh.revoked, entry);
+        return;
+    }
+
+    neg = mrb_ssh_kh_negations(fields[0], &neg_len);
+
+    for (name = fields[0]; name; name = next) {
+        if ((next = strchr(name, ','))) *next++ = '\0';
+
+        if (!*name || *name == '!') continue;
+
+        if (strncmp(name, "|1|", 3) == 0) {
+            if (!(entry = mrb_ssh_kh_entry_new(NULL, key, (size_t)len))) continue;
+
+            if (mrb_ssh_kh_hashed_name(entry, name)) {
+                mrb_ssh_kh_negate(entry, neg, neg_len);
+                mrb_ssh_kh_push(&mrb_ssh_kh.hashed, entry);
+                mrb_ssh_kh.size++;
+            } else {
+                mrb_ssh_kh_free_list(entry);
+            }
+
+            continue;
+        }
+
+        mrb_ssh_kh_downcase(name);
+
+        if (!(entry = mrb_ssh_kh_entry_new(name, key, (size_t)len))) continue;
+
+        mrb_ssh_kh_negate(entry, neg, neg_len);
+
+        if (strpbrk(name, "*?")) {
+            mrb_ssh_kh_push(&mrb_ssh_kh.patterns, entry);
+        } else {
+            mrb_ssh_kh_insert(entry);
+        }
+
+        mrb_ssh_kh.size++;
+    }
+
+    free(neg);
+}
+
+static uint32_t
+mrb_ssh_kh_digest (uint32_t hash, const char *buf, size_t len)
+{
+    while (len--) {
+        hash = (hash ^ (unsigned char)*buf++) * 16777619u;
+    }
+
+    return hash;
+}
+
+/* Parses all lines from the current position of the file on and folds
+   them into the digest of the consumed part of the file. A last line
+   without a line break is parsed as well but remembered as partial. */
+static void
+mrb_ssh_kh_read (FILE *fp)
+{
+    char line[MRB_SSH_KH_LINE];
+    size_t len;
+    int skip = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        /* A line that starts with a NUL byte reads as empty */
+        if ((len = strlen(line)) == 0) continue;
+
+        mrb_ssh_kh.digest  = mrb_ssh_kh_digest(mrb_ssh_kh.digest, line, len);
+        mrb_ssh_kh.offset  = ftell(fp);
+        mrb_ssh_kh.partial = line[len - 1] != '\n';
+
+        if (mrb_ssh_kh.partial && !feof(fp)) {
+            skip = 1;
+            continue;
+        }
+
+        if (skip) {
+            skip = 0;
+            continue;
+        }
+
+        mrb_ssh_kh_parse(line);
+    }
+}
+
+/* A partial last line that was parsed before is complete if the appended
+   data starts with a line break, otherwise the line got extended. */
+static int
+mrb_ssh_kh_continues (FILE *fp)
+{
+    int c;
+
+    if (!mrb_ssh_kh.partial || (c = fgetc(fp)) == EOF)
+        return 1;
+
+    if (c != '\n')
+        return 0;
+
+    mrb_ssh_kh.digest  = mrb_ssh_kh_digest(mrb_ssh_kh.digest, "\n", 1);
+    mrb_ssh_kh.offset  = ftell(fp);
+    mrb_ssh_kh.partial = 0;
+
+    return 1;
+}
+
+/* Checks if the part of the file that was consumed before is unchanged,
+   i.e. the file only got appended to. */
+static int
+mrb_ssh_kh_appended (FILE *fp)
+{
+    char buf[MRB_SSH_KH_LINE];
+    uint32_t digest = 2166136261u;
+    long left       = mrb_ssh_kh.offset;
+    size_t len;
+
+    while (left > 0 && (len = fread(buf, 1, left < (long)sizeof(buf) ? (size_t)left : sizeof(buf), fp)) > 0) {
+        digest = mrb_ssh_kh_digest(digest, buf, len);
+        left  -= (long)len;
+    }
+
+    return left == 0 && digest == mrb_ssh_kh.digest;
+}
+
+static void
+mrb_ssh_kh_refresh (int force)
+{
+    struct stat st;
+    int64_t now = mrb_ssh_now();
+    FILE *fp;
+
+    if (!mrb_ssh_kh.path) return;
+
+    if (!force && now - mrb_ssh_kh.checked < (int64_t)MRB_SSH_KNOWNHOSTS_INTERVAL * 1000000)
+        return;
+
+    mrb_ssh_kh.checked = now;
+
+    if (stat(mrb_ssh_kh.path, &st) != 0) {
+        if (mrb_ssh_kh.fsize != 0) {
+            mrb_ssh_kh_reset();
+            mrb_ssh_kh.gen++;
+        }
+
+        mrb_ssh_kh.fsize = 0;
+        mrb_ssh_kh.mtime = 0;
+        return;
+    }
+
+    if ((long long)st.st_size == mrb_ssh_kh.fsize && (long long)st.st_mtime == mrb_ssh_kh.mtime)
+        return;
+
+    if (!(fp = fopen(mrb_ssh_kh.path, "rb")))
+        return;
+
+    if ((long long)st.st_size < mrb_ssh_kh.offset || !mrb_ssh_kh_appended(fp) || !mrb_ssh_kh_continues(fp)) {
+        mrb_ssh_kh_reset();
+        fseek(fp, 0, SEEK_SET);
+    }
+
+    mrb_ssh_kh_read(fp);
+    fclose(fp);
+
+    mrb_ssh_kh.fsize = (long long)st.st_size;
+    mrb_ssh_kh.mtime = (long long)st.st_mtime;
+    mrb_ssh_kh.gen++;
+}
+
+static int
+mrb_ssh_kh_load (const char *path)
+{
+    char *copy = strdup(path);
+
+    if (!copy) return 0;
+
+    mrb_ssh_kh_reset();
+    free(mrb_ssh_kh.path);
+
+    mrb_ssh_kh.path   = copy;
+    mrb_ssh_kh.loaded = 1;
+    mrb_ssh_kh.fsize  = -1;
+    mrb_ssh_kh.mtime  = -1;
+    mrb_ssh_kh.gen++;
+
+    mrb_ssh_kh_refresh(1);
+
+    return 1;
+}
+
+static void
+mrb_ssh_kh_load_default (void)
+{
+    char path[1024];
+    const char *home;
+
+#ifdef _WIN32
+    home = getenv("USERPROFILE");
+#else
+    home = getenv("HOME");
+#endif
+
+    mrb_ssh_kh.loaded = 1;
+
+    if (home && snprintf(path, sizeof(path), "%s/.ssh/known_hosts", home) < (int)sizeof(path)) {
+        mrb_ssh_kh_load(path);
+    }
+}
+
+static int
+mrb_ssh_kh_match (const char *pattern, const char *name)
+{
+    for (; *pattern; pattern++, name++) {
+        if (*pattern == '*') {
+            for (; *name; name++) {
+                if (mrb_ssh_kh_match(pattern + 1, name)) return 1;
+            }
+
+            return mrb_ssh_kh_match(pattern + 1, name);
+        }
+
+        if (!*name || (*pattern != '?' && *pattern != *name))
+            return 0;
+    }
+
+    return !*name;
+}
+
+/* A line does not apply to a host that matches any of its negations. */
+static int
+mrb_ssh_kh_negated (mrb_ssh_kh_entry_t *entry, const char *name)
+{
+    const char *neg;
+
+    for (neg = entry->neg; neg && *neg; neg += strlen(neg) + 1) {
+        if (mrb_ssh_kh_match(neg, name)) return 1;
+    }
+
+    return 0;
+}
+
+static int
+mrb_ssh_kh_compare (mrb_ssh_kh_entry_t *entry, const unsigned char *key, size_t len, int rc)
+{
+    size_t type_len = mrb_ssh_kh_type_len(key, len);
+
+    if (entry->len == len && memcmp(entry->key, key, len) == 0)
+        return MRB_SSH_KNOWNHOSTS_MATCH;
+
+    if (rc == MRB_SSH_KNOWNHOSTS_NOT_FOUND && type_len && mrb_ssh_kh_type_len(entry->key, entry->len) == type_len &&
+        memcmp(entry->key, key, type_len) == 0)
+        return MRB_SSH_KNOWNHOSTS_MISMATCH;
+
+    return rc;
+}
+
+static void
+mrb_ssh_kh_memo (const char *name, mrb_ssh_kh_entry_t *src)
+{
+    mrb_ssh_kh_entry_t *entry = mrb_ssh_kh_entry_new(name, src ? src->key : NULL, src ? src->len : 0);
+    size_t i;
+
+    if (!entry) return;
+
+    i                           = mrb_ssh_str_hash(name) & (MRB_SSH_KH_MEMO_BUCKETS - 1);
+    entry->next                 = mrb_ssh_kh_memos.buckets[i];
+    mrb_ssh_kh_memos.buckets[i] = entry;
+    mrb_ssh_kh_memos.count++;
+}
+
+/* Returns 1 if the name is memoized and compares the key with the memos. */
+static int
+mrb_ssh_kh_memo_lookup (const char *name, const unsigned char *key, size_t len, int *rc)
+{
+    mrb_ssh_kh_entry_t *entry;
+    int memoized = 0;
+
+    entry = mrb_ssh_kh_memos.buckets[mrb_ssh_str_hash(name) & (MRB_SSH_KH_MEMO_BUCKETS - 1)];
+
+    for (; entry; entry = entry->next) {
+        if (strcmp(entry->name, name) != 0) continue;
+
+        memoized = 1;
+
+        if (entry->key) {
+            *rc = mrb_ssh_kh_compare(entry, key, len, *rc);
+        }
+    }
+
+    return memoized;
+}
+
+static int
+mrb_ssh_kh_lookup (const char *name, const unsigned char *key, size_t len)
+{
+    int rc = MRB_SSH_KNOWNHOSTS_NOT_FOUND, found = 0;
+    unsigned char hash[20];
+    mrb_ssh_kh_entry_t *entry;
+
+    if (mrb_ssh_kh_memos.gen != mrb_ssh_kh.gen) {
+        mrb_ssh_kh_memo_clear();
+        mrb_ssh_kh_memos.gen = mrb_ssh_kh.gen;
+    }
+
+    for (entry = mrb_ssh_kh.revoked; entry; entry = entry->next) {
+        if (entry->len == len && memcmp(entry->key, key, len) == 0)
+            return MRB_SSH_KNOWNHOSTS_REVOKED;
+    }
+
+    if (mrb_ssh_kh.capa) {
+        for (entry = mrb_ssh_kh.buckets[mrb_ssh_str_hash(name) & (mrb_ssh_kh.capa - 1)]; entry; entry = entry->next) {
+            if (strcmp(entry->name, name) != 0 || mrb_ssh_kh_negated(entry, name)) continue;
+
+            if ((rc = mrb_ssh_kh_compare(entry, key, len, rc)) == MRB_SSH_KNOWNHOSTS_MATCH)
+                return rc;
+        }
+    }
+
+    if (mrb_ssh_kh_memo_lookup(name, key, len, &rc))
+        return rc;
+
+    if (mrb_ssh_kh_memos.count >= MRB_SSH_KNOWNHOSTS_MEMO_MAX) {
+        mrb_ssh_kh_memo_clear();
+    }
+
+    for (entry = mrb_ssh_kh.hashed; entry; entry = entry->next) {
+        mrb_ssh_hmac_sha1(entry->salt, name, strlen(name), hash);
+
+        if (memcmp(hash, entry->hash, 20) != 0 || mrb_ssh_kh_negated(entry, name)) continue;
+
+        mrb_ssh_kh_memo(name, entry);
+        rc    = mrb_ssh_kh_compare(entry, key, len, rc);
+        found = 1;
+    }
+
+    for (entry = mrb_ssh_kh.patterns; entry; entry = entry->next) {
+        if (!mrb_ssh_kh_match(entry->name, name) || mrb_ssh_kh_negated(entry, name)) continue;
+
+        mrb_ssh_kh_memo(name, entry);
+        rc    = mrb_ssh_kh_compare(entry, key, len, rc);
+        found = 1;
+    }
+
+    if (!found) {
+        mrb_ssh_kh_memo(name, NULL);
+    }
+
+    return rc;
+}
+
+static void
+mrb_ssh_kh_name (const char *host, int port, char *name, size_t size)
+{
+    if (port == 22 || port <= 0) {
+        snprintf(name, size, "%s", host);
+    } else {
+        snprintf(name, size, "[%s]:%d", host, port);
+    }
+
+    mrb_ssh_kh_downcase(name);
+}
+
+int
+mrb_ssh_knownhosts_check (const char *host, int port, const unsigned char *key, size_t len)
+{
+    char name[MRB_SSH_KH_NAME];
+    int rc;
+
+    mrb_ssh_kh_name(host, port, name, sizeof(name));
+
+    mrb_ssh_kh_lock();
+
+    if (!mrb_ssh_kh.loaded) {
+        mrb_ssh_kh_load_default();
+    }
+
+    mrb_ssh_kh_refresh(0);
+    rc = mrb_ssh_kh_lookup(name, key, len);
+
+    mrb_ssh_kh_unlock();
+
+    return rc;
+}
+
+void
+mrb_ssh_knownhosts_clear (void)
+{
+    mrb_ssh_kh_lock();
+
+    mrb_ssh_kh_reset();
+    free(mrb_ssh_kh.path);
+
+    mrb_ssh_kh.path   = NULL;
+    mrb_ssh_kh.loaded = 0;
+    mrb_ssh_kh.fsize  = -1;
+    mrb_ssh_kh.mtime  = -1;
+    mrb_ssh_kh.gen++;
+
+    mrb_ssh_kh_unlock();
+}
+
+static const unsigned char *
+mrb_ssh_kh_session_key (mrb_state *mrb, mrb_value session, const char **host, int *port, size_t *len)
+{
+    mrb_ssh_t *ssh;
+    const char *key;
+    mrb_value name;
+    int type;
+
+    if (!mrb_obj_is_kind_of(mrb, session, mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "Session"))) {
+        mrb_raise(mrb, E_TYPE_ERROR, "expected SSH::Session");
+    }
+
+    ssh = DATA_PTR(session);
+
+    if (!(ssh && ssh->state == MRB_SSH_STATE_READY && mrb_ssh_initialized())) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
+    }
+
+    name = mrb_iv_get(mrb, session, mrb_intern_static(mrb, "@host", 5));
+    key  = libssh2_session_hostkey(ssh->session, len, &type);
+
+    if (!key || !mrb_string_p(name)) {
+        mrb_raise(mrb, E_SSH_HOST_KEY_ERROR, "Host key not available.");
+    }
+
+    *host = mrb_string_value_cstr(mrb, &name);
+    *port = ssh->port;
+
+    return (const unsigned char *)key;
+}
+
+static mrb_value
+mrb_ssh_kh_result (mrb_state *mrb, int rc)
+{
+    switch (rc) {
+    case MRB_SSH_KNOWNHOSTS_MATCH:
+        return SYM("match", 5);
+    case MRB_SSH_KNOWNHOSTS_MISMATCH:
+        return SYM("mismatch", 8);
+    case MRB_SSH_KNOWNHOSTS_REVOKED:
+        return SYM("revoked", 7);
+    default:
+        return SYM("not_found", 9);
+    }
+}
+
+static mrb_value
+mrb_ssh_f_kh_load (mrb_state *mrb, mrb_value self)
+{
+    const char *path = NULL;
+    mrb_int size;
+
+    mrb_get_args(mrb, "|z!", &path);
+
+    mrb_ssh_kh_lock();
+
+    if (path) {
+        mrb_ssh_kh_load(path);
+    } else {
+        mrb_ssh_kh_load_default();
+    }
+
+    size = mrb_ssh_kh.size;
+
+    mrb_ssh_kh_unlock();
+
+    return mrb_fixnum_value(size);
+}
+
+static mrb_value
+mrb_ssh_f_kh_reload (mrb_state *mrb, mrb_value self)
+{
+    mrb_int size;
+
+    mrb_ssh_kh_lock();
+
+    mrb_ssh_kh_refresh(1);
+    size = mrb_ssh_kh.size;
+
+    mrb_ssh_kh_unlock();
+
+    return mrb_fixnum_value(size);
+}
+
+static mrb_value
+mrb_ssh_f_kh_path (mrb_state *mrb, mrb_value self)
+{
+    mrb_value path;
+
+    mrb_ssh_kh_lock();
+    path = mrb_ssh_kh.path ? mrb_str_new_cstr(mrb, mrb_ssh_kh.path) : mrb_nil_value();
+    mrb_ssh_kh_unlock();
+
+    return path;
+}
+
+static mrb_value
+mrb_ssh_f_kh_size (mrb_state *mrb, mrb_value self)
+{
+    mrb_int size;
+
+    mrb_ssh_kh_lock();
+    size = mrb_ssh_kh.size;
+    mrb_ssh_kh_unlock();
+
+    return mrb_fixnum_value(size);
+}
+
+static mrb_value
+mrb_ssh_f_kh_clear (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_knownhosts_clear();
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_kh_verify (mrb_state *mrb, mrb_value self)
+{
+    const unsigned char *key;
+    const char *host;
+    mrb_value session;
+    size_t len;
+    int port;
+
+    mrb_get_args(mrb, "o", &session);
+
+    key = mrb_ssh_kh_session_key(mrb, session, &host, &port, &len);
+
+    return mrb_ssh_kh_result(mrb, mrb_ssh_knownhosts_check(host, port, key, len));
+}
+
+static mrb_value
+mrb_ssh_f_kh_check (mrb_state *mrb, mrb_value self)
+{
+    const char *host;
+    char *b64;
+    mrb_int b64_len, port = 22;
+    mrb_value key;
+    long len;
+
+    mrb_get_args(mrb, "zs|i", &host, &b64, &b64_len, &port);
+
+    key = mrb_str_new(mrb, NULL, b64_len / 4 * 3 + 3);
+    len = mrb_ssh_base64_decode(b64, (size_t)b64_len, (unsigned char *)RSTRING_PTR(key), (size_t)RSTRING_LEN(key));
+
+    if (len <= 0) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid base64 key");
+    }
+
+    return mrb_ssh_kh_result(mrb, mrb_ssh_knownhosts_check(host, (int)port, (unsigned char *)RSTRING_PTR(key), (size_t)len));
+}
+
+static mrb_value
+mrb_ssh_f_kh_hash_host (mrb_state *mrb, mrb_value self)
+{
+    char *host, *salt, b64[32];
+    mrb_int host_len, salt_len;
+    unsigned char hash[20];
+    mrb_value name;
+
+    mrb_get_args(mrb, "ss", &host, &host_len, &salt, &salt_len);
+
+    if (salt_len != 20) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "salt must be 20 bytes");
+    }
+
+    mrb_ssh_hmac_sha1((const unsigned char *)salt, host, (size_t)host_len, hash);
+
+    name = mrb_str_new_cstr(mrb, "|1|");
+    mrb_str_cat(mrb, name, b64, mrb_ssh_base64_encode((const unsigned char *)salt, 20, b64));
+    mrb_str_cat_cstr(mrb, name, "|");
+    mrb_str_cat(mrb, name, b64, mrb_ssh_base64_encode(hash, 20, b64));
+
+    return name;
+}
+
+static mrb_value
+mrb_ssh_f_kh_add (mrb_state *mrb, mrb_value self)
+{
+    char name[MRB_SSH_KH_NAME];
+    const unsigned char *key;
+    const char *host;
+    mrb_value session, line, b64;
+    size_t len, type_len;
+    FILE *fp;
+    int port, ok;
+
+    mrb_get_args(mrb, "o", &session);
+
+    key      = mrb_ssh_kh_session_key(mrb, session, &host, &port, &len);
+    type_len = mrb_ssh_kh_type_len(key, len);
+
+    if (!type_len) {
+        mrb_raise(mrb, E_SSH_HOST_KEY_ERROR, "Invalid host key.");
+    }
+
+    mrb_ssh_kh_name(host, port, name, sizeof(name));
+
+    line = mrb_str_new_cstr(mrb, name);
+    mrb_str_cat_cstr(mrb, line, " ");
+    mrb_str_cat(mrb, line, (const char *)key + 4, type_len - 4);
+    mrb_str_cat_cstr(mrb, line, " ");
+    b64 = mrb_str_new(mrb, NULL, (mrb_int)((len + 2) / 3 * 4));
+    mrb_ssh_base64_encode(key, len, RSTRING_PTR(b64));
+    mrb_str_cat_str(mrb, line, b64);
+    mrb_str_cat_cstr(mrb, line, "\n");
+
+    mrb_ssh_kh_lock();
+
+    if (!mrb_ssh_kh.loaded) {
+        mrb_ssh_kh_load_default();
+    }
+
+    ok = mrb_ssh_kh.path && (fp = fopen(mrb_ssh_kh.path, "ab"));
+
+    if (ok) {
+        ok = fwrite(RSTRING_PTR(line), 1, (size_t)RSTRING_LEN(line), fp) == (size_t)RSTRING_LEN(line);
+        ok = fclose(fp) == 0 && ok;
+        mrb_ssh_kh_refresh(1);
+    }
+
+    mrb_ssh_kh_unlock();
+
+    if (!ok) {
+        mrb_raise(mrb, E_SSH_HOST_KEY_ERROR, "Could not write known_hosts file.");
+    }
+
+    return mrb_true_value();
+}
+
+void
+mrb_mruby_ssh_knownhosts_init (mrb_state *mrb)
+{
+    struct RClass *ssh = mrb_module_get(mrb, "SSH");
+    struct RClass *kh  = mrb_define_module_under(mrb, ssh, "KnownHosts");
+
+    mrb_define_module_function(mrb, kh, "load",      mrb_ssh_f_kh_load,      MRB_ARGS_OPT(1));
+    mrb_define_module_function(mrb, kh, "reload",    mrb_ssh_f_kh_reload,    MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, kh, "path",      mrb_ssh_f_kh_path,      MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, kh, "size",      mrb_ssh_f_kh_size,      MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, kh, "clear",     mrb_ssh_f_kh_clear,     MRB_ARGS_NONE());
+    mrb_define_module_function(mrb, kh, "verify",    mrb_ssh_f_kh_verify,    MRB_ARGS_REQ(1));
+    mrb_define_module_function(mrb, kh, "check",     mrb_ssh_f_kh_check,     MRB_ARGS_ARG(2, 1));
+    mrb_define_module_function(mrb, kh, "add",       mrb_ssh_f_kh_add,       MRB_ARGS_REQ(1));
+    mrb_define_module_function(mrb, kh, "hash_host", mrb_ssh_f_kh_hash_host, MRB_ARGS_REQ(2));
+}
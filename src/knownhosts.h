@@ -0,0 +1,45 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mruby.h"
+
+#include <stddef.h>
+
+MRB_BEGIN_DECL
+
+#ifndef MRB_SSH_KNOWNHOSTS_INTERVAL
+# define MRB_SSH_KNOWNHOSTS_INTERVAL 1
+#endif
+
+#define MRB_SSH_KNOWNHOSTS_MATCH     0
+#define MRB_SSH_KNOWNHOSTS_MISMATCH  1
+#define MRB_SSH_KNOWNHOSTS_NOT_FOUND 2
+#define MRB_SSH_KNOWNHOSTS_REVOKED   3
+
+int    mrb_ssh_knownhosts_check (const char *host, int port, const unsigned char *key, size_t len);
+void   mrb_ssh_knownhosts_clear (void);
+size_t mrb_ssh_base64_encode (const unsigned char *in, size_t len, char *out);
+
+void mrb_mruby_ssh_knownhosts_init (mrb_state *mrb);
+
+MRB_END_DECL
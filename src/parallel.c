@@ -0,0 +1,519 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "socket.h"
+#include "poller.h"
+#include "exec.h"
+#include "alloc.h"
+#include "agent.h"
+#include "keycache.h"
+
+#include "mruby.h"
+#include "mruby/hash.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#include "mruby/ext/ssh.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <libssh2.h>
+
+#ifdef _WIN32
+# define MRB_SSH_SHUT_RDWR SD_BOTH
+#else
+# define MRB_SSH_SHUT_RDWR SHUT_RDWR
+#endif
+
+#define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
+
+enum mrb_ssh_job_state
+{
+    MRB_SSH_JOB_CONNECT,
+    MRB_SSH_JOB_HANDSHAKE,
+    MRB_SSH_JOB_AUTH,
+    MRB_SSH_JOB_EXEC,
+    MRB_SSH_JOB_DISCONNECT,
+    MRB_SSH_JOB_DONE
+};
+
+typedef struct mrb_ssh_parallel
+{
+    const char *cmd;
+    mrb_int cmd_len;
+    const char *user;
+    mrb_int user_len;
+    const char *password;
+    mrb_int password_len;
+    const char *key;
+    char *pubkey;
+    const char *passphrase;
+    mrb_ssh_key_t *cached;
+    mrb_bool use_agent;
+    int port;
+    int64_t timeout;
+} mrb_ssh_parallel_t;
+
+typedef struct mrb_ssh_job
+{
+    char *host;
+    int state;
+    int rc;
+    struct RClass *cls;
+    char error[256];
+    int64_t deadline;
+    mrb_ssh_t ssh;
+    mrb_ssh_agent_auth_t agent;
+    mrb_ssh_exec_t exec;
+} mrb_ssh_job_t;
+
+typedef struct mrb_ssh_batch
+{
+    mrb_ssh_parallel_t cfg;
+    mrb_ssh_poller_t *poller;
+    mrb_ssh_job_t *jobs;
+    mrb_value hosts;
+    mrb_value res;
+    mrb_int concurrency;
+    mrb_int len;
+} mrb_ssh_batch_t;
+
+static int
+mrb_ssh_job_fail (mrb_ssh_job_t *job, struct RClass *cls, int rc, const char *msg)
+{
+    char *err = NULL;
+
+    if (!msg && job->ssh.session) {
+        libssh2_session_last_error(job->ssh.session, &err, NULL, 0);
+    }
+
+    job->rc    = rc;
+    job->cls   = cls;
+    job->state = MRB_SSH_JOB_DONE;
+
+    snprintf(job->error, sizeof(job->error), "%s", msg ? msg : (err ? err : "Unknown error."));
+
+    return rc;
+}
+
+static int
+mrb_ssh_job_auth (mrb_ssh_parallel_t *cfg, mrb_ssh_job_t *job)
+{
+    if (cfg->use_agent) {
+        return mrb_ssh_agent_auth_step(&job->agent, &job->ssh, cfg->user, job->host);
+    }
+
+    if (cfg->cached) {
+        return libssh2_userauth_publickey_frommemory(job->ssh.session, cfg->user, (size_t)cfg->user_len,
+                                                     cfg->cached->pub, cfg->cached->pub_len,
+                                                     cfg->cached->priv, cfg->cached->priv_len,
+                                                     cfg->passphrase ? cfg->passphrase : cfg->cached->passphrase);
+    }
+
+    if (cfg->key) {
+        return libssh2_userauth_publickey_fromfile_ex(job->ssh.session, cfg->user, (unsigned int)cfg->user_len,
+                                                      cfg->pubkey, cfg->key, cfg->passphrase);
+    }
+
+    return libssh2_userauth_password_ex(job->ssh.session, cfg->user, (unsigned int)cfg->user_len,
+                                        cfg->password, (unsigned int)cfg->password_len, NULL);
+}
+
+static void
+mrb_ssh_job_step (mrb_state *mrb, mrb_ssh_parallel_t *cfg, mrb_ssh_job_t *job)
+{
+    int rc;
+
+    switch (job->state) {
+    case MRB_SSH_JOB_CONNECT:
+        if (mrb_ssh_socket_error(job->ssh.sock) != 0) {
+            mrb_ssh_job_fail(job, E_SSH_CONNECT_ERROR, 0, "Failed to connect.");
+            return;
+        }
+
+        mrb_ssh_pool_init(mrb, &job->ssh.pool);
+
+        if (!(job->ssh.session = libssh2_session_init_ex(mrb_ssh_alloc, mrb_ssh_free, mrb_ssh_realloc, &job->ssh))) {
+            mrb_ssh_job_fail(job, NULL, LIBSSH2_ERROR_ALLOC, "Could not init ssh session.");
+            return;
+        }
+
+        libssh2_session_set_blocking(job->ssh.session, 0);
+
+        job->state = MRB_SSH_JOB_HANDSHAKE;
+        /* fall through */
+    case MRB_SSH_JOB_HANDSHAKE:
+        if ((rc = libssh2_session_handshake(job->ssh.session, job->ssh.sock)) == LIBSSH2_ERROR_EAGAIN)
+            return;
+
+        if (rc != 0) {
+            mrb_ssh_job_fail(job, NULL, rc, NULL);
+            return;
+        }
+
+        job->state = MRB_SSH_JOB_AUTH;
+        /* fall through */
+    case MRB_SSH_JOB_AUTH:
+        if ((rc = mrb_ssh_job_auth(cfg, job)) == LIBSSH2_ERROR_EAGAIN)
+            return;
+
+        if (rc != 0) {
+            mrb_ssh_job_fail(job, NULL, rc, NULL);
+            return;
+        }
+
+        mrb_ssh_exec_init(&job->exec, cfg->cmd, (size_t)cfg->cmd_len, LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL);
+
+        job->state = MRB_SSH_JOB_EXEC;
+        /* fall through */
+    case MRB_SSH_JOB_EXEC:
+        if ((rc = mrb_ssh_exec_step(mrb, job->ssh.session, &job->exec)) == LIBSSH2_ERROR_EAGAIN)
+            return;
+
+        if (rc != 0) {
+            mrb_ssh_job_fail(job, NULL, rc, job->exec.error);
+            return;
+        }
+
+        job->state = MRB_SSH_JOB_DISCONNECT;
+        /* fall through */
+    case MRB_SSH_JOB_DISCONNECT:
+        if (libssh2_session_disconnect(job->ssh.session, "Normal Shutdown") == LIBSSH2_ERROR_EAGAIN)
+            return;
+
+        job->state = MRB_SSH_JOB_DONE;
+        /* fall through */
+    default:
+        break;
+    }
+}
+
+static void
+mrb_ssh_job_start (mrb_state *mrb, mrb_ssh_parallel_t *cfg, mrb_ssh_job_t *job)
+{
+    struct sockaddr_storage addr;
+    socklen_t len;
+    int rc;
+
+    job->deadline = mrb_ssh_now() + cfg->timeout * 1000;
+    job->ssh.sock = LIBSSH2_INVALID_SOCKET;
+    job->ssh.port = cfg->port;
+
+    if (mrb_ssh_resolve(job->host, cfg->port, AF_UNSPEC, &addr, &len) != 0) {
+        mrb_ssh_job_fail(job, E_SSH_CONNECT_ERROR, 0, "Failed to resolve host.");
+        return;
+    }
+
+    if ((rc = mrb_ssh_socket_connect((struct sockaddr *)&addr, len, &job->ssh.sock)) < 0) {
+        mrb_ssh_job_fail(job, E_SSH_CONNECT_ERROR, 0, "Failed to connect.");
+        return;
+    }
+
+    job->state = MRB_SSH_JOB_CONNECT;
+
+    if (rc == 0) {
+        mrb_ssh_job_step(mrb, cfg, job);
+    }
+}
+
+static inline int
+mrb_ssh_job_events (mrb_ssh_job_t *job)
+{
+    int events;
+
+    if (job->state == MRB_SSH_JOB_CONNECT)
+        return MRB_SSH_WAIT_WRITE;
+
+    events = mrb_ssh_block_directions(job->ssh.session);
+
+    return events ? events : MRB_SSH_WAIT_READ;
+}
+
+static mrb_value
+mrb_ssh_job_result (mrb_state *mrb, mrb_ssh_job_t *job)
+{
+    mrb_value res = mrb_ssh_exec_result(mrb, &job->exec);
+    mrb_value exc;
+
+    if (job->cls) {
+        exc = mrb_exc_new_str(mrb, job->cls, mrb_str_new_cstr(mrb, job->error));
+        mrb_iv_set(mrb, exc, mrb_intern_static(mrb, "@errno", 6), mrb_fixnum_value(job->rc));
+    } else
+    if (job->rc != 0) {
+        exc = mrb_ssh_exc_new(mrb, job->rc, job->error);
+    } else {
+        return res;
+    }
+
+    mrb_hash_set(mrb, res, SYM("error", 5), exc);
+
+    return res;
+}
+
+static void
+mrb_ssh_job_teardown (mrb_state *mrb, mrb_ssh_job_t *job)
+{
+    int64_t now, deadline = (job->rc || job->cls) ? 0 : job->deadline;
+    mrb_bool shut = FALSE;
+
+    mrb_ssh_exec_free(mrb, &job->exec);
+    mrb_free(mrb, job->host);
+    job->host = NULL;
+
+    mrb_ssh_agent_auth_free(&job->agent);
+
+    if (job->ssh.session) {
+        /* A failed or expired host gets no graceful close: shutting the
+         * socket down makes any pending write fail instead of waiting. */
+        while (libssh2_session_free(job->ssh.session) == LIBSSH2_ERROR_EAGAIN) {
+            if (!shut && (now = mrb_ssh_now()) < deadline) {
+                mrb_ssh_wait_socket(job->ssh.session, job->ssh.sock, (int)((deadline - now + 999) / 1000));
+            } else if (!shut) {
+                shutdown(job->ssh.sock, MRB_SSH_SHUT_RDWR);
+                shut = TRUE;
+            }
+        }
+        job->ssh.session = NULL;
+    }
+
+    mrb_ssh_pool_clear(&job->ssh.pool);
+
+    if (job->ssh.sock != LIBSSH2_INVALID_SOCKET) {
+        mrb_ssh_close_socket(job->ssh.sock);
+        job->ssh.sock = LIBSSH2_INVALID_SOCKET;
+    }
+}
+
+static void
+mrb_ssh_job_release (mrb_state *mrb, mrb_value res, mrb_value host, mrb_ssh_job_t *job)
+{
+    int arena = mrb_gc_arena_save(mrb);
+
+    mrb_hash_set(mrb, res, host, mrb_ssh_job_result(mrb, job));
+    mrb_gc_arena_restore(mrb, arena);
+
+    mrb_ssh_job_teardown(mrb, job);
+}
+
+static void
+mrb_ssh_parallel_opts (mrb_state *mrb, mrb_value opts, mrb_ssh_parallel_t *cfg)
+{
+    mrb_value user, password, key, phrase;
+
+    user     = mrb_hash_get(mrb, opts, SYM("user", 4));
+    password = mrb_hash_get(mrb, opts, SYM("password", 8));
+    key      = mrb_hash_get(mrb, opts, SYM("key", 3));
+    phrase   = mrb_hash_get(mrb, opts, SYM("passphrase", 10));
+
+    if (!mrb_string_p(user)) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "user required");
+    }
+
+    cfg->user      = mrb_string_value_cstr(mrb, &user);
+    cfg->user_len  = RSTRING_LEN(user);
+    cfg->use_agent = mrb_true_p(mrb_hash_get(mrb, opts, SYM("use_agent", 9)));
+    cfg->port      = (int)mrb_fixnum(mrb_hash_fetch(mrb, opts, SYM("port", 4), mrb_fixnum_value(22)));
+    cfg->timeout   = (int64_t)mrb_fixnum(mrb_hash_fetch(mrb, opts, SYM("timeout", 7), mrb_fixnum_value(60000)));
+
+    if (mrb_string_p(key)) {
+        cfg->key        = mrb_string_value_cstr(mrb, &key);
+        cfg->passphrase = mrb_string_p(phrase) ? mrb_string_value_cstr(mrb, &phrase) : NULL;
+        cfg->cached     = mrb_ssh_keycache_get(cfg->key);
+        cfg->pubkey     = mrb_malloc(mrb, RSTRING_LEN(key) + 4 + 1);
+
+        memcpy(cfg->pubkey, cfg->key, RSTRING_LEN(key));
+        memcpy(cfg->pubkey + RSTRING_LEN(key), ".pub", 5);
+    } else
+    if (mrb_string_p(password)) {
+        cfg->password     = RSTRING_PTR(password);
+        cfg->password_len = RSTRING_LEN(password);
+    } else
+    if (!cfg->use_agent) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "password, key or use_agent required");
+    }
+}
+
+static mrb_value
+mrb_ssh_parallel_run (mrb_state *mrb, mrb_value data)
+{
+    mrb_ssh_batch_t *batch = mrb_cptr(data);
+    mrb_ssh_poller_t *poller;
+    mrb_ssh_job_t *job;
+    int64_t now, deadline;
+    int i, next = 0, active = 0, done = 0;
+
+    batch->poller = poller = mrb_ssh_poller_new(mrb, NULL);
+
+    while (done < batch->len) {
+        while (active < batch->concurrency && next < batch->len) {
+            job = &batch->jobs[next++];
+
+            mrb_ssh_job_start(mrb, &batch->cfg, job);
+
+            if (job->state == MRB_SSH_JOB_DONE) {
+                mrb_ssh_job_release(mrb, batch->res, mrb_ary_ref(mrb, batch->hosts, next - 1), job);
+                done++;
+                continue;
+            }
+
+            mrb_ssh_poller_add(mrb, poller, job->ssh.sock, mrb_ssh_job_events(job), job);
+            active++;
+        }
+
+        if (active == 0) continue;
+
+        now      = mrb_ssh_now();
+        deadline = ((mrb_ssh_job_t *)poller->entries[0].data)->deadline;
+
+        for (i = 1; i < poller->len; i++) {
+            job      = poller->entries[i].data;
+            deadline = job->deadline < deadline ? job->deadline : deadline;
+        }
+
+        mrb_ssh_poller_wait(mrb, poller, deadline > now ? (int)((deadline - now + 999) / 1000) : 0);
+
+        now = mrb_ssh_now();
+
+        for (i = poller->len - 1; i >= 0; i--) {
+            job = poller->entries[i].data;
+
+            if (poller->entries[i].revents) {
+                mrb_ssh_job_step(mrb, &batch->cfg, job);
+            }
+
+            if (job->state != MRB_SSH_JOB_DONE && now >= job->deadline) {
+                mrb_ssh_job_fail(job, NULL, LIBSSH2_ERROR_TIMEOUT, "Timed out.");
+            }
+
+            if (job->state != MRB_SSH_JOB_DONE) {
+                mrb_ssh_poller_set(poller, i, job->ssh.sock, mrb_ssh_job_events(job));
+                continue;
+            }
+
+            mrb_ssh_poller_del(poller, i);
+            mrb_ssh_job_release(mrb, batch->res, mrb_ary_ref(mrb, batch->hosts, job - batch->jobs), job);
+
+            active--;
+            done++;
+        }
+    }
+
+    return batch->res;
+}
+
+static mrb_value
+mrb_ssh_parallel_cleanup (mrb_state *mrb, mrb_value data)
+{
+    mrb_ssh_batch_t *batch = mrb_cptr(data);
+    mrb_int i;
+
+    /* Only reached with live jobs if the loop raised, so drop them at once. */
+    for (i = 0; i < batch->len && batch->jobs; i++) {
+        if (!batch->jobs[i].host) continue;
+
+        batch->jobs[i].deadline = 0;
+        mrb_ssh_job_teardown(mrb, &batch->jobs[i]);
+    }
+
+    if (batch->poller) {
+        mrb_ssh_poller_free(mrb, batch->poller);
+    }
+
+    mrb_free(mrb, batch->cfg.pubkey);
+    mrb_ssh_keycache_release(batch->cfg.cached);
+    mrb_free(mrb, batch->jobs);
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_parallel_prepare (mrb_state *mrb, mrb_value data)
+{
+    mrb_ssh_batch_t *batch = mrb_cptr(data);
+    mrb_value hosts        = batch->hosts, host;
+    mrb_int i, len         = RARRAY_LEN(hosts);
+
+    batch->res   = mrb_hash_new_capa(mrb, len);
+    batch->hosts = mrb_ary_new_capa(mrb, len);
+    batch->jobs  = mrb_calloc(mrb, (size_t)len + 1, sizeof(mrb_ssh_job_t));
+
+    /* Each distinct host runs once, so results never overwrite each other. */
+    for (i = 0; i < len; i++) {
+        host = mrb_ary_ref(mrb, hosts, i);
+
+        if (mrb_hash_key_p(mrb, batch->res, host)) continue;
+
+        batch->jobs[batch->len].ssh.sock = LIBSSH2_INVALID_SOCKET;
+        batch->jobs[batch->len].host     = mrb_malloc(mrb, RSTRING_LEN(host) + 1);
+
+        memcpy(batch->jobs[batch->len].host, RSTRING_PTR(host), RSTRING_LEN(host));
+        batch->jobs[batch->len++].host[RSTRING_LEN(host)] = '\0';
+
+        mrb_ary_push(mrb, batch->hosts, host);
+        mrb_hash_set(mrb, batch->res, host, mrb_nil_value());
+    }
+
+    return mrb_ssh_parallel_run(mrb, data);
+}
+
+static mrb_value
+mrb_ssh_f_parallel (mrb_state *mrb, mrb_value self)
+{
+    mrb_value opts, data;
+    mrb_ssh_batch_t batch;
+    mrb_int i;
+
+    memset(&batch, 0, sizeof(mrb_ssh_batch_t));
+
+    mrb_get_args(mrb, "AsH", &batch.hosts, &batch.cfg.cmd, &batch.cfg.cmd_len, &opts);
+
+    batch.concurrency = mrb_fixnum(mrb_hash_fetch(mrb, opts, SYM("concurrency", 11), mrb_fixnum_value(32)));
+
+    if (batch.concurrency < 1) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "concurrency must be positive");
+    }
+
+    for (i = 0; i < RARRAY_LEN(batch.hosts); i++) {
+        if (!mrb_string_p(mrb_ary_ref(mrb, batch.hosts, i))) {
+            mrb_raise(mrb, E_TYPE_ERROR, "host must be a String");
+        }
+    }
+
+    mrb_ssh_parallel_opts(mrb, opts, &batch.cfg);
+
+    data = mrb_cptr_value(mrb, &batch);
+
+    return mrb_ensure(mrb, mrb_ssh_parallel_prepare, data, mrb_ssh_parallel_cleanup, data);
+}
+
+void
+mrb_mruby_ssh_parallel_init (mrb_state *mrb)
+{
+    struct RClass *ssh = mrb_module_get(mrb, "SSH");
+
+    mrb_define_class_method(mrb, ssh, "__parallel__", mrb_ssh_f_parallel, MRB_ARGS_REQ(3));
+}
+
+#endif
@@ -0,0 +1,583 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "poller.h"
+#include "socket.h"
+
+#include "mruby.h"
+#include "mruby/data.h"
+#include "mruby/array.h"
+#include "mruby/class.h"
+#include "mruby/variable.h"
+#include "mruby/ext/ssh.h"
+
+#include <string.h>
+#include <libssh2.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# define poll(fds, nfds, timeout) WSAPoll(fds, nfds, timeout)
+#else
+# include <poll.h>
+# include <errno.h>
+# include <unistd.h>
+#endif
+
+#ifdef MRB_SSH_HAVE_EPOLL
+# include <sys/epoll.h>
+#endif
+
+#define SYM(name, len) mrb_intern_static(mrb, name, len)
+
+#define MRB_SSH_POLL_UNARMED -1
+#define MRB_SSH_POLL_STALE   -2
+
+static inline short
+mrb_ssh_poll_events (int events)
+{
+    short ev = 0;
+
+    if (events & MRB_SSH_WAIT_READ)  ev |= POLLIN;
+    if (events & MRB_SSH_WAIT_WRITE) ev |= POLLOUT;
+
+    return ev;
+}
+
+static inline int
+mrb_ssh_poll_revents (short ev)
+{
+    int events = 0;
+
+    if (ev & POLLIN)  events |= MRB_SSH_WAIT_READ;
+    if (ev & POLLOUT) events |= MRB_SSH_WAIT_WRITE;
+
+    if (ev & (POLLERR|POLLHUP|POLLNVAL))
+        events |= MRB_SSH_WAIT_READ|MRB_SSH_WAIT_WRITE|MRB_SSH_WAIT_ERROR;
+
+    return events;
+}
+
+static inline int
+mrb_ssh_poll_interrupted (int rc)
+{
+#ifdef _WIN32
+    return 0;
+#else
+    return rc == -1 && errno == EINTR;
+#endif
+}
+
+static void
+mrb_ssh_poller_reserve (mrb_state *mrb, mrb_ssh_poller_t *poller, int size)
+{
+    if (poller->buf_capa >= size) return;
+
+    poller->buf      = mrb_realloc(mrb, poller->buf, size);
+    poller->buf_capa = size;
+}
+
+static int
+mrb_ssh_poll_wait (mrb_state *mrb, mrb_ssh_poller_t *poller, int timeout)
+{
+    struct pollfd *fds;
+    mrb_ssh_poll_entry_t *entry;
+    int i, nfds = 0, rc;
+
+    mrb_ssh_poller_reserve(mrb, poller, (int)sizeof(struct pollfd) * (poller->len + 1));
+    fds = (struct pollfd *)poller->buf;
+
+    for (i = 0; i < poller->len; i++) {
+        entry = &poller->entries[i];
+
+        if (!entry->events) continue;
+
+        fds[nfds].fd      = entry->sock;
+        fds[nfds].events  = mrb_ssh_poll_events(entry->events);
+        fds[nfds].revents = 0;
+        nfds++;
+    }
+
+    rc = poll(fds, nfds, timeout);
+
+    if (rc <= 0)
+        return mrb_ssh_poll_interrupted(rc) ? 0 : rc;
+
+    for (i = 0, nfds = 0; i < poller->len; i++) {
+        entry = &poller->entries[i];
+
+        if (!entry->events) continue;
+
+        entry->revents = mrb_ssh_poll_revents(fds[nfds++].revents);
+    }
+
+    return rc;
+}
+
+#ifdef MRB_SSH_HAVE_EPOLL
+
+static int
+mrb_ssh_epoll_init (mrb_ssh_poller_t *poller)
+{
+    poller->fd = epoll_create1(EPOLL_CLOEXEC);
+
+    return poller->fd == -1 ? -1 : 0;
+}
+
+static void
+mrb_ssh_epoll_free (mrb_ssh_poller_t *poller)
+{
+    if (poller->fd != -1) close(poller->fd);
+}
+
+static void
+mrb_ssh_epoll_del (mrb_ssh_poller_t *poller, mrb_ssh_poll_entry_t *entry)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(poller->fd, EPOLL_CTL_DEL, entry->sock, &ev);
+}
+
+static int
+mrb_ssh_epoll_arm (mrb_ssh_poller_t *poller, int idx)
+{
+    mrb_ssh_poll_entry_t *entry = &poller->entries[idx];
+    struct epoll_event ev;
+    int op, rc;
+
+    memset(&ev, 0, sizeof(ev));
+
+    if (entry->events & MRB_SSH_WAIT_READ)  ev.events |= EPOLLIN;
+    if (entry->events & MRB_SSH_WAIT_WRITE) ev.events |= EPOLLOUT;
+
+    ev.data.u32 = (uint32_t)idx;
+    op          = entry->armed == MRB_SSH_POLL_UNARMED ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    rc          = epoll_ctl(poller->fd, op, entry->sock, &ev);
+
+    if (rc == -1 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        rc = epoll_ctl(poller->fd, EPOLL_CTL_MOD, entry->sock, &ev);
+    } else
+    if (rc == -1 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        rc = epoll_ctl(poller->fd, EPOLL_CTL_ADD, entry->sock, &ev);
+    }
+
+    if (rc == 0) {
+        entry->armed = entry->events;
+    }
+
+    return rc;
+}
+
+static int
+mrb_ssh_epoll_wait (mrb_state *mrb, mrb_ssh_poller_t *poller, int timeout)
+{
+    struct epoll_event *evs;
+    mrb_ssh_poll_entry_t *entry;
+    int i, idx, rc, failed = 0;
+
+    for (i = 0; i < poller->len; i++) {
+        entry = &poller->entries[i];
+
+        if (entry->armed == entry->events) continue;
+
+        if (mrb_ssh_epoll_arm(poller, i) != 0) {
+            entry->revents = MRB_SSH_WAIT_READ|MRB_SSH_WAIT_WRITE|MRB_SSH_WAIT_ERROR;
+            failed++;
+        }
+    }
+
+    mrb_ssh_poller_reserve(mrb, poller, (int)sizeof(struct epoll_event) * (poller->len + 1));
+    evs = (struct epoll_event *)poller->buf;
+
+    rc = epoll_wait(poller->fd, evs, poller->len + 1, failed ? 0 : timeout);
+
+    if (rc <= 0)
+        return mrb_ssh_poll_interrupted(rc) || rc == 0 ? failed : rc;
+
+    for (i = 0; i < rc; i++) {
+        idx = (int)evs[i].data.u32;
+
+        if (idx >= poller->len) continue;
+
+        entry = &poller->entries[idx];
+
+        if (evs[i].events & EPOLLIN)  entry->revents |= MRB_SSH_WAIT_READ;
+        if (evs[i].events & EPOLLOUT) entry->revents |= MRB_SSH_WAIT_WRITE;
+
+        if (evs[i].events & (EPOLLERR|EPOLLHUP))
+            entry->revents |= MRB_SSH_WAIT_READ|MRB_SSH_WAIT_WRITE|MRB_SSH_WAIT_ERROR;
+    }
+
+    return rc + failed;
+}
+
+#endif
+
+static const mrb_ssh_poll_backend_t mrb_ssh_poll_backends[] = {
+#ifdef MRB_SSH_HAVE_EPOLL
+    { "epoll", mrb_ssh_epoll_init, mrb_ssh_epoll_free, mrb_ssh_epoll_del, mrb_ssh_epoll_wait },
+#endif
+    { "poll",  NULL, NULL, NULL, mrb_ssh_poll_wait },
+    { NULL,    NULL, NULL, NULL, NULL }
+};
+
+int
+mrb_ssh_block_directions (LIBSSH2_SESSION *session)
+{
+    int dir = libssh2_session_block_directions(session), events = 0;
+
+    if (dir & LIBSSH2_SESSION_BLOCK_INBOUND)  events |= MRB_SSH_WAIT_READ;
+    if (dir & LIBSSH2_SESSION_BLOCK_OUTBOUND) events |= MRB_SSH_WAIT_WRITE;
+
+    return events;
+}
+
+mrb_value
+mrb_ssh_wait_symbol (mrb_state *mrb, LIBSSH2_SESSION *session)
+{
+    if (mrb_ssh_block_directions(session) & MRB_SSH_WAIT_WRITE)
+        return mrb_symbol_value(mrb_intern_lit(mrb, "wait_writable"));
+
+    return mrb_symbol_value(mrb_intern_lit(mrb, "wait_readable"));
+}
+
+int
+mrb_ssh_wait_socket (LIBSSH2_SESSION *session, libssh2_socket_t sock, int timeout)
+{
+    struct pollfd fd;
+    int events = mrb_ssh_block_directions(session), rc;
+
+    fd.fd      = sock;
+    fd.events  = mrb_ssh_poll_events(events ? events : MRB_SSH_WAIT_READ);
+    fd.revents = 0;
+
+    rc = poll(&fd, 1, timeout);
+
+    return mrb_ssh_poll_interrupted(rc) ? 0 : rc;
+}
+
+int
+mrb_ssh_wait_sock (mrb_ssh_t *ssh)
+{
+    int64_t since = mrb_ssh_now();
+    int rc        = mrb_ssh_wait_socket(ssh->session, ssh->sock, MRB_SSH_WAIT_TIMEOUT);
+
+    ssh->stats.waits++;
+    ssh->stats.wait_time += mrb_ssh_now() - since;
+
+    return rc;
+}
+
+mrb_ssh_poller_t *
+mrb_ssh_poller_new (mrb_state *mrb, const char *name)
+{
+    const mrb_ssh_poll_backend_t *backend = mrb_ssh_poll_backends;
+    mrb_ssh_poller_t *poller;
+
+    while (name && backend->name && strcmp(backend->name, name) != 0) {
+        backend++;
+    }
+
+    if (!backend->name) {
+        mrb_raisef(mrb, E_ARGUMENT_ERROR, "unsupported poll backend: %s", name);
+    }
+
+    poller = mrb_malloc(mrb, sizeof(mrb_ssh_poller_t));
+    memset(poller, 0, sizeof(mrb_ssh_poller_t));
+
+    poller->backend = backend;
+    poller->fd      = -1;
+
+    if (backend->init && backend->init(poller) != 0) {
+        mrb_free(mrb, poller);
+        mrb_raisef(mrb, E_RUNTIME_ERROR, "%s backend init failed", backend->name);
+    }
+
+    return poller;
+}
+
+void
+mrb_ssh_poller_free (mrb_state *mrb, mrb_ssh_poller_t *poller)
+{
+    if (!poller) return;
+
+    if (poller->backend->free) {
+        poller->backend->free(poller);
+    }
+
+    mrb_free(mrb, poller->entries);
+    mrb_free(mrb, poller->buf);
+    mrb_free(mrb, poller);
+}
+
+int
+mrb_ssh_poller_add (mrb_state *mrb, mrb_ssh_poller_t *poller, libssh2_socket_t sock, int events, void *data)
+{
+    mrb_ssh_poll_entry_t *entry;
+
+    if (poller->len == poller->capa) {
+        poller->capa    = poller->capa ? poller->capa * 2 : 8;
+        poller->entries = mrb_realloc(mrb, poller->entries, sizeof(mrb_ssh_poll_entry_t) * poller->capa);
+    }
+
+    entry          = &poller->entries[poller->len];
+    entry->sock    = sock;
+    entry->events  = events;
+    entry->revents = 0;
+    entry->armed   = MRB_SSH_POLL_UNARMED;
+    entry->data    = data;
+
+    return poller->len++;
+}
+
+void
+mrb_ssh_poller_del (mrb_ssh_poller_t *poller, int idx)
+{
+    mrb_ssh_poll_entry_t *entry = &poller->entries[idx];
+
+    if (poller->backend->del && entry->armed != MRB_SSH_POLL_UNARMED) {
+        poller->backend->del(poller, entry);
+    }
+
+    if (idx != --poller->len) {
+        *entry       = poller->entries[poller->len];
+        entry->armed = entry->armed == MRB_SSH_POLL_UNARMED ? MRB_SSH_POLL_UNARMED : MRB_SSH_POLL_STALE;
+    }
+}
+
+void
+mrb_ssh_poller_set (mrb_ssh_poller_t *poller, int idx, libssh2_socket_t sock, int events)
+{
+    mrb_ssh_poll_entry_t *entry = &poller->entries[idx];
+
+    if (entry->sock != sock) {
+        entry->sock  = sock;
+        entry->armed = MRB_SSH_POLL_UNARMED;
+    }
+
+    entry->events = events;
+}
+
+int
+mrb_ssh_poller_wait (mrb_state *mrb, mrb_ssh_poller_t *poller, int timeout)
+{
+    for (int i = 0; i < poller->len; i++) {
+        poller->entries[i].revents = 0;
+    }
+
+    return poller->backend->wait(mrb, poller, timeout);
+}
+
+static void
+mrb_ssh_poller_type_free (mrb_state *mrb, void *p)
+{
+    mrb_ssh_poller_free(mrb, (mrb_ssh_poller_t *)p);
+}
+
+static mrb_data_type const mrb_ssh_poller_type = { "SSH::Poller", mrb_ssh_poller_type_free };
+
+static int
+mrb_ssh_poller_index (mrb_ssh_poller_t *poller, mrb_value session)
+{
+    void *ptr = mrb_ptr(session);
+
+    for (int i = 0; i < poller->len; i++) {
+        if (poller->entries[i].data == ptr) return i;
+    }
+
+    return -1;
+}
+
+static inline mrb_ssh_poller_t *
+mrb_ssh_poller_bang (mrb_state *mrb, mrb_value self)
+{
+    return (mrb_ssh_poller_t *)mrb_data_get_ptr(mrb, self, &mrb_ssh_poller_type);
+}
+
+static mrb_value
+mrb_ssh_f_poller_init (mrb_state *mrb, mrb_value self)
+{
+    mrb_sym backend = 0;
+
+    mrb_get_args(mrb, "|n", &backend);
+
+    mrb_ssh_poller_free(mrb, DATA_PTR(self));
+    DATA_PTR(self) = NULL;
+
+    mrb_data_init(self, mrb_ssh_poller_new(mrb, backend ? mrb_sym2name(mrb, backend) : NULL), &mrb_ssh_poller_type);
+    mrb_iv_set(mrb, self, SYM("sessions", 8), mrb_ary_new(mrb));
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_poller_add (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_poller_t *poller = mrb_ssh_poller_bang(mrb, self);
+    mrb_value session;
+    mrb_ssh_t *ssh;
+
+    mrb_get_args(mrb, "o", &session);
+
+    if (!mrb_obj_is_kind_of(mrb, session, mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "Session"))) {
+        mrb_raise(mrb, E_TYPE_ERROR, "expected SSH::Session");
+    }
+
+    if (!(ssh = DATA_PTR(session)) || !mrb_ssh_initialized()) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
+    }
+
+    if (mrb_ssh_poller_index(poller, session) != -1)
+        return self;
+
+    mrb_ssh_poller_add(mrb, poller, ssh->sock, MRB_SSH_WAIT_READ, mrb_ptr(session));
+    mrb_ary_push(mrb, mrb_iv_get(mrb, self, SYM("sessions", 8)), session);
+
+    return self;
+}
+
+static mrb_value
+mrb_ssh_f_poller_delete (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_poller_t *poller = mrb_ssh_poller_bang(mrb, self);
+    mrb_value sessions       = mrb_iv_get(mrb, self, SYM("sessions", 8));
+    mrb_value session;
+    int idx, last;
+
+    mrb_get_args(mrb, "o", &session);
+
+    if ((idx = mrb_ssh_poller_index(poller, session)) == -1)
+        return mrb_nil_value();
+
+    if (!DATA_PTR(session)) {
+        mrb_ssh_poller_set(poller, idx, LIBSSH2_INVALID_SOCKET, 0);
+    }
+
+    last = poller->len - 1;
+
+    mrb_ssh_poller_del(poller, idx);
+    mrb_ary_set(mrb, sessions, idx, mrb_ary_ref(mrb, sessions, last));
+    mrb_ary_pop(mrb, sessions);
+
+    return session;
+}
+
+static mrb_value
+mrb_ssh_f_poller_wait (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_poller_t *poller = mrb_ssh_poller_bang(mrb, self);
+    mrb_ssh_poll_entry_t *entry;
+    mrb_value timeout        = mrb_nil_value();
+    mrb_value ready;
+    mrb_ssh_t *ssh;
+    int i, events, wait = -1, closed = 0;
+
+    mrb_get_args(mrb, "|o", &timeout);
+
+    for (i = 0; i < poller->len; i++) {
+        entry = &poller->entries[i];
+        ssh   = ((struct RData *)entry->data)->data;
+
+        if (!ssh || !mrb_ssh_initialized()) {
+            mrb_ssh_poller_set(poller, i, LIBSSH2_INVALID_SOCKET, 0);
+            closed++;
+            continue;
+        }
+
+        if (ssh->state == MRB_SSH_STATE_CONNECT) {
+            events = MRB_SSH_WAIT_WRITE;
+        } else {
+            events = mrb_ssh_block_directions(ssh->session);
+        }
+
+        mrb_ssh_poller_set(poller, i, ssh->sock, events ? events : MRB_SSH_WAIT_READ);
+    }
+
+    if (closed) {
+        wait = 0;
+    } else
+    if (!mrb_nil_p(timeout)) {
+        wait = (int)mrb_fixnum(timeout);
+    }
+
+    if (mrb_ssh_poller_wait(mrb, poller, wait) < 0) {
+        mrb_raisef(mrb, E_RUNTIME_ERROR, "%s failed", poller->backend->name);
+    }
+
+    ready = mrb_ary_new(mrb);
+
+    for (i = 0; i < poller->len; i++) {
+        entry = &poller->entries[i];
+
+        if (entry->events && !entry->revents) continue;
+
+        mrb_ary_push(mrb, ready, mrb_obj_value(entry->data));
+    }
+
+    return ready;
+}
+
+static mrb_value
+mrb_ssh_f_poller_size (mrb_state *mrb, mrb_value self)
+{
+    return mrb_fixnum_value(mrb_ssh_poller_bang(mrb, self)->len);
+}
+
+static mrb_value
+mrb_ssh_f_poller_backend (mrb_state *mrb, mrb_value self)
+{
+    return mrb_symbol_value(mrb_intern_cstr(mrb, mrb_ssh_poller_bang(mrb, self)->backend->name));
+}
+
+static mrb_value
+mrb_ssh_f_poller_backends (mrb_state *mrb, mrb_value self)
+{
+    const mrb_ssh_poll_backend_t *backend;
+    mrb_value backends = mrb_ary_new(mrb);
+
+    for (backend = mrb_ssh_poll_backends; backend->name; backend++) {
+        mrb_ary_push(mrb, backends, mrb_symbol_value(mrb_intern_cstr(mrb, backend->name)));
+    }
+
+    return backends;
+}
+
+void
+mrb_mruby_ssh_poller_init (mrb_state *mrb)
+{
+    struct RClass *ssh, *cls;
+
+    ssh = mrb_module_get(mrb, "SSH");
+    cls = mrb_define_class_under(mrb, ssh, "Poller", mrb->object_class);
+
+    MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+
+    mrb_define_class_method(mrb, cls, "backends", mrb_ssh_f_poller_backends, MRB_ARGS_NONE());
+
+    mrb_define_method(mrb, cls, "initialize", mrb_ssh_f_poller_init,    MRB_ARGS_OPT(1));
+    mrb_define_method(mrb, cls, "add",        mrb_ssh_f_poller_add,     MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "delete",     mrb_ssh_f_poller_delete,  MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "wait",       mrb_ssh_f_poller_wait,    MRB_ARGS_OPT(1));
+    mrb_define_method(mrb, cls, "size",       mrb_ssh_f_poller_size,    MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "backend",    mrb_ssh_f_poller_backend, MRB_ARGS_NONE());
+}
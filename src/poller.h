@@ -0,0 +1,85 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mruby.h"
+
+#include <libssh2.h>
+
+MRB_BEGIN_DECL
+
+#define MRB_SSH_WAIT_READ    1
+#define MRB_SSH_WAIT_WRITE   2
+#define MRB_SSH_WAIT_ERROR   4
+
+#ifndef MRB_SSH_WAIT_TIMEOUT
+# define MRB_SSH_WAIT_TIMEOUT 10000
+#endif
+
+#if defined(__linux__) && !defined(MRB_SSH_NO_EPOLL)
+# define MRB_SSH_HAVE_EPOLL
+#endif
+
+typedef struct mrb_ssh_poll_entry
+{
+    libssh2_socket_t sock;
+    int events;
+    int revents;
+    int armed;
+    void *data;
+} mrb_ssh_poll_entry_t;
+
+typedef struct mrb_ssh_poller mrb_ssh_poller_t;
+
+typedef struct mrb_ssh_poll_backend
+{
+    const char *name;
+    int  (*init) (mrb_ssh_poller_t *poller);
+    void (*free) (mrb_ssh_poller_t *poller);
+    void (*del)  (mrb_ssh_poller_t *poller, mrb_ssh_poll_entry_t *entry);
+    int  (*wait) (mrb_state *mrb, mrb_ssh_poller_t *poller, int timeout);
+} mrb_ssh_poll_backend_t;
+
+struct mrb_ssh_poller
+{
+    const mrb_ssh_poll_backend_t *backend;
+    mrb_ssh_poll_entry_t *entries;
+    int len, capa;
+    int fd;
+    void *buf;
+    int buf_capa;
+};
+
+void mrb_mruby_ssh_poller_init (mrb_state *mrb);
+
+int mrb_ssh_wait_socket (LIBSSH2_SESSION *session, libssh2_socket_t sock, int timeout);
+int mrb_ssh_block_directions (LIBSSH2_SESSION *session);
+mrb_value mrb_ssh_wait_symbol (mrb_state *mrb, LIBSSH2_SESSION *session);
+
+mrb_ssh_poller_t *mrb_ssh_poller_new (mrb_state *mrb, const char *backend);
+void mrb_ssh_poller_free (mrb_state *mrb, mrb_ssh_poller_t *poller);
+int  mrb_ssh_poller_add (mrb_state *mrb, mrb_ssh_poller_t *poller, libssh2_socket_t sock, int events, void *data);
+void mrb_ssh_poller_del (mrb_ssh_poller_t *poller, int idx);
+void mrb_ssh_poller_set (mrb_ssh_poller_t *poller, int idx, libssh2_socket_t sock, int events);
+int  mrb_ssh_poller_wait (mrb_state *mrb, mrb_ssh_poller_t *poller, int timeout);
+
+MRB_END_DECL
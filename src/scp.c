@@ -0,0 +1,263 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "scp.h"
+
+#include "mruby.h"
+#include "mruby/data.h"
+#include "mruby/ext/ssh.h"
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <libssh2.h>
+
+#ifdef _WIN32
+# define mrb_ssh_fstat(fp, st) _fstat64(_fileno(fp), st)
+typedef struct _stat64 mrb_ssh_stat_t;
+#else
+# define mrb_ssh_fstat(fp, st) fstat(fileno(fp), st)
+typedef struct stat mrb_ssh_stat_t;
+#endif
+
+/* Reused for every chunk, so the file content never becomes an mruby object
+   and the memory use stays the same regardless of the file size */
+#define MRB_SSH_SCP_CHUNK 0x10000
+
+typedef struct mrb_ssh_scp_error
+{
+    int rc;
+    char msg[128];
+} mrb_ssh_scp_error_t;
+
+static inline void
+mrb_ssh_scp_fail (mrb_ssh_t *ssh, mrb_ssh_scp_error_t *err, int rc)
+{
+    char *msg = NULL;
+
+    libssh2_session_last_error(ssh->session, &msg, NULL, 0);
+
+    err->rc = rc;
+    snprintf(err->msg, sizeof(err->msg), "%s", msg ? msg : "Unknown error.");
+}
+
+static inline mrb_ssh_t *
+mrb_ssh_scp_session (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+
+    if (!(ssh && mrb_ssh_initialized())) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
+    }
+
+    if (!libssh2_userauth_authenticated(ssh->session)) {
+        mrb_raise(mrb, E_SSH_NOT_AUTH_ERROR, "SSH session not authenticated.");
+    }
+
+    return ssh;
+}
+
+static void
+mrb_ssh_scp_channel_free (mrb_ssh_t *ssh, LIBSSH2_CHANNEL *channel, mrb_bool wait)
+{
+    if (wait) {
+        while (libssh2_channel_send_eof(channel)    == LIBSSH2_ERROR_EAGAIN) { mrb_ssh_wait_sock(ssh); }
+        while (libssh2_channel_wait_eof(channel)    == LIBSSH2_ERROR_EAGAIN) { mrb_ssh_wait_sock(ssh); }
+        while (libssh2_channel_wait_closed(channel) == LIBSSH2_ERROR_EAGAIN) { mrb_ssh_wait_sock(ssh); }
+    }
+
+    while (libssh2_channel_free(channel) == LIBSSH2_ERROR_EAGAIN) {
+        mrb_ssh_wait_sock(ssh);
+    }
+}
+
+static mrb_value
+mrb_ssh_f_scp_upload (mrb_state *mrb, mrb_value self)
+{
+    ssize_t rc;
+    size_t len, pos;
+    const char *local, *remote;
+    mrb_int mode = -1;
+    mrb_ssh_stat_t st;
+    mrb_ssh_scp_error_t err = { 0, "" };
+    LIBSSH2_CHANNEL *channel;
+    FILE *fp;
+    char *buf;
+    mrb_ssh_t *ssh = mrb_ssh_scp_session(mrb, self);
+
+    mrb_get_args(mrb, "zz|i", &local, &remote, &mode);
+
+    buf = mrb_malloc(mrb, MRB_SSH_SCP_CHUNK);
+
+    if (!(fp = fopen(local, "rb")) || mrb_ssh_fstat(fp, &st) != 0) {
+        if (fp) fclose(fp);
+        mrb_free(mrb, buf);
+        mrb_sys_fail(mrb, local);
+    }
+
+    if (mode < 0) {
+        mode = st.st_mode & 0777;
+    }
+
+    do {
+        channel = libssh2_scp_send64(ssh->session, remote, (int)(mode & 0777), (libssh2_int64_t)st.st_size, 0, 0);
+
+        if (channel) break;
+
+        if ((rc = libssh2_session_last_errno(ssh->session)) != LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_scp_fail(ssh, &err, (int)rc);
+            break;
+        }
+
+        mrb_ssh_wait_sock(ssh);
+    } while (!channel);
+
+    while (channel && err.rc == 0 && (len = fread(buf, 1, MRB_SSH_SCP_CHUNK, fp)) > 0) {
+        for (pos = 0; pos < len;) {
+            rc = libssh2_channel_write(channel, buf + pos, len - pos);
+
+            if (rc == LIBSSH2_ERROR_EAGAIN) {
+                mrb_ssh_wait_sock(ssh);
+                continue;
+            }
+
+            if (rc < 0) {
+                mrb_ssh_scp_fail(ssh, &err, (int)rc);
+                break;
+            }
+
+            pos += (size_t)rc;
+        }
+    }
+
+    if (channel) {
+        mrb_ssh_scp_channel_free(ssh, channel, err.rc == 0);
+    }
+
+    mrb_free(mrb, buf);
+
+    if (err.rc == 0 && ferror(fp)) {
+        fclose(fp);
+        mrb_sys_fail(mrb, local);
+    }
+
+    fclose(fp);
+    mrb_ssh_raise(mrb, err.rc, err.msg);
+
+    return mrb_fixnum_value((mrb_int)st.st_size);
+}
+
+static mrb_value
+mrb_ssh_f_scp_download (mrb_state *mrb, mrb_value self)
+{
+    ssize_t rc;
+    size_t len;
+    const char *remote, *local;
+    libssh2_struct_stat info;
+    libssh2_struct_stat_size got = 0;
+    mrb_ssh_scp_error_t err = { 0, "" };
+    mrb_bool failed = FALSE;
+    LIBSSH2_CHANNEL *channel;
+    FILE *fp;
+    char *buf;
+    mrb_ssh_t *ssh = mrb_ssh_scp_session(mrb, self);
+
+    mrb_get_args(mrb, "zz", &remote, &local);
+
+    buf = mrb_malloc(mrb, MRB_SSH_SCP_CHUNK);
+
+    do {
+        channel = libssh2_scp_recv2(ssh->session, remote, &info);
+
+        if (channel) break;
+
+        if ((rc = libssh2_session_last_errno(ssh->session)) != LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_scp_fail(ssh, &err, (int)rc);
+            mrb_free(mrb, buf);
+            mrb_ssh_raise(mrb, err.rc, err.msg);
+        }
+
+        mrb_ssh_wait_sock(ssh);
+    } while (!channel);
+
+    if (!(fp = fopen(local, "wb"))) {
+        mrb_ssh_scp_channel_free(ssh, channel, FALSE);
+        mrb_free(mrb, buf);
+        mrb_sys_fail(mrb, local);
+    }
+
+    while (got < info.st_size) {
+        len = info.st_size - got < MRB_SSH_SCP_CHUNK ? (size_t)(info.st_size - got) : MRB_SSH_SCP_CHUNK;
+        rc  = libssh2_channel_read(channel, buf, len);
+
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+            continue;
+        }
+
+        if (rc < 0) {
+            mrb_ssh_scp_fail(ssh, &err, (int)rc);
+            break;
+        }
+
+        if (rc == 0 && libssh2_channel_eof(channel)) {
+            err.rc = LIBSSH2_ERROR_SCP_PROTOCOL;
+            snprintf(err.msg, sizeof(err.msg), "%s", "Unexpected end of file.");
+            break;
+        }
+
+        if (fwrite(buf, 1, (size_t)rc, fp) != (size_t)rc) {
+            failed = TRUE;
+            break;
+        }
+
+        got += rc;
+    }
+
+    mrb_ssh_scp_channel_free(ssh, channel, FALSE);
+    mrb_free(mrb, buf);
+
+    if (fclose(fp) != 0 || failed) {
+        mrb_sys_fail(mrb, local);
+    }
+
+    mrb_ssh_raise(mrb, err.rc, err.msg);
+
+    return mrb_fixnum_value((mrb_int)got);
+}
+
+void
+mrb_mruby_ssh_scp_init (mrb_state *mrb)
+{
+    struct RClass *ssh, *cls;
+
+    ssh = mrb_module_get(mrb, "SSH");
+    cls = mrb_class_get_under(mrb, ssh, "Session");
+
+    mrb_define_method(mrb, cls, "scp_upload",   mrb_ssh_f_scp_upload,   MRB_ARGS_ARG(2,1));
+    mrb_define_method(mrb, cls, "scp_download", mrb_ssh_f_scp_download, MRB_ARGS_REQ(2));
+}
+
+#endif
@@ -22,8 +22,16 @@
  */
 
 #include "session.h"
+#include "agent.h"
+#include "alloc.h"
+#include "poller.h"
+#include "socket.h"
+#include "dns.h"
+#include "keycache.h"
+#include "knownhosts.h"
 
 #include "mruby.h"
+#include "mruby/array.h"
 #include "mruby/data.h"
 #include "mruby/hash.h"
 #include "mruby/class.h"
@@ -31,6 +39,7 @@
 #include "mruby/ext/ssh.h"
 #include "mruby/variable.h"
 
+#include <errno.h>
 #include <string.h>
 #include <libssh2.h>
 
@@ -48,15 +57,10 @@
 
 #define SYM(name, len) mrb_symbol_value(mrb_intern_static(mrb, name, len))
 
-static inline void
-mrb_ssh_close_socket (libssh2_socket_t sock)
-{
-#ifdef WIN32
-    closesocket(sock);
-#else
-    close(sock);
+/* Seconds to wait before retrying a keepalive that could not be sent yet */
+#ifndef MRB_SSH_KEEPALIVE_RETRY
+# define MRB_SSH_KEEPALIVE_RETRY 1
 #endif
-}
 
 static void
 mrb_ssh_session_free(mrb_state *mrb, void *p)
@@ -67,8 +71,15 @@ mrb_ssh_session_free(mrb_state *mrb, void *p)
 
     ssh = (mrb_ssh_t *)p;
 
-    if (mrb_ssh_initialized())
+    /* After SSH.shutdown the session is gone with libssh2, only its memory
+       needs to be released. Otherwise the pool must outlive the session. */
+    if (!mrb_ssh_initialized() || !ssh->session)
+        goto cleanup;
+
+    if (ssh->state != MRB_SSH_STATE_READY) {
+        libssh2_session_free(ssh->session);
         goto cleanup;
+    }
 
     while (libssh2_session_disconnect(ssh->session, NULL) == LIBSSH2_ERROR_EAGAIN) {
         mrb_ssh_wait_sock(ssh);
@@ -81,177 +92,245 @@ mrb_ssh_session_free(mrb_state *mrb, void *p)
 cleanup:
 
     mrb_ssh_close_socket((int)ssh->sock);
+    mrb_ssh_pool_clear(&ssh->pool);
     mrb_free(mrb, ssh);
 }
 
 static mrb_data_type const mrb_ssh_session_type = { "SSH::Session", mrb_ssh_session_free };
 
-int
-mrb_ssh_wait_sock (mrb_ssh_t *ssh)
+typedef struct mrb_ssh_connect_opts
+{
+    int blocking;
+    int port;
+    int compress;
+    int compress_level;
+    int sigpipe;
+    int keepalive;
+    int keepalive_reply;
+    long timeout;
+    long connect_timeout;
+    const char *kex;
+    const char *host_key;
+    const char *ciphers;
+    const char *macs;
+} mrb_ssh_connect_opts_t;
+
+/* Compression can be turned on with true or with the zlib level to use. */
+static int
+mrb_ssh_compress_opt (mrb_state *mrb, mrb_value opts, int *level)
 {
-    struct timeval timeout;
-    fd_set fd, *write_fd = NULL, *read_fd = NULL;
-    int rc, dir;
+    mrb_value compress = mrb_hash_get(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "compress")));
+
+    if (!mrb_fixnum_p(compress))
+        return mrb_true_p(compress);
 
-    timeout.tv_sec = 10;
-    timeout.tv_usec = 0;
+    if (mrb_fixnum(compress) < 0 || mrb_fixnum(compress) > 9) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "compression level must be between 0 and 9");
+    }
 
-    FD_ZERO(&fd);
-    FD_SET(ssh->sock, &fd);
+    *level = (int)mrb_fixnum(compress);
 
-    dir = libssh2_session_block_directions(ssh->session);
+    return *level > 0;
+}
 
-    if (dir & LIBSSH2_SESSION_BLOCK_INBOUND)
-        read_fd = &fd;
+/* Algorithm preferences can be given as a comma separated String or as an
+   Array in the order of preference. */
+static const char *
+mrb_ssh_method_pref (mrb_state *mrb, mrb_value opts, const char *name)
+{
+    mrb_value pref = mrb_hash_get(mrb, opts, mrb_symbol_value(mrb_intern_cstr(mrb, name)));
 
-    if (dir & LIBSSH2_SESSION_BLOCK_OUTBOUND)
-        write_fd = &fd;
+    if (mrb_nil_p(pref))
+        return NULL;
 
-    rc = select((int)ssh->sock + 1, read_fd, write_fd, NULL, &timeout);
+    if (mrb_array_p(pref)) {
+        pref = mrb_ary_join(mrb, pref, mrb_str_new_lit(mrb, ","));
+    } else if (mrb_symbol_p(pref)) {
+        pref = mrb_sym2str(mrb, mrb_symbol(pref));
+    }
 
-    return rc;
+    return mrb_string_value_cstr(mrb, &pref);
 }
 
-static char *
-mrb_ssh_host_to_ip (int family, const char *host)
+static void
+mrb_ssh_connect_opts (mrb_state *mrb, mrb_value opts, mrb_bool opts_given, mrb_ssh_connect_opts_t *cfg)
 {
-    struct addrinfo *res, *rp;
-    struct addrinfo hints;
-    static char ipname[INET6_ADDRSTRLEN];
-    void *addr;
+    cfg->blocking        = 1;
+    cfg->port            = 22;
+    cfg->compress        = 0;
+    cfg->compress_level  = 0;
+    cfg->sigpipe         = 0;
+    cfg->keepalive       = 0;
+    cfg->keepalive_reply = 0;
+    cfg->timeout         = 15000;
+    cfg->connect_timeout = -1;
+    cfg->kex             = NULL;
+    cfg->host_key        = NULL;
+    cfg->ciphers         = NULL;
+    cfg->macs            = NULL;
 
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = family;
+    if (opts_given && mrb_hash_p(opts)) {
+        cfg->port     = (int) mrb_fixnum(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "port")), mrb_fixnum_value(cfg->port)));
+        cfg->timeout  = (long)mrb_fixnum(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "timeout")), mrb_fixnum_value(cfg->timeout)));
+        cfg->blocking = mrb_type(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "block")), mrb_true_value())) == MRB_TT_TRUE;
+        cfg->compress = mrb_ssh_compress_opt(mrb, opts, &cfg->compress_level);
+        cfg->sigpipe  = mrb_type(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "sigpipe")), mrb_false_value())) == MRB_TT_TRUE;
+        cfg->connect_timeout = (long)mrb_fixnum(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "connect_timeout")), mrb_fixnum_value(cfg->connect_timeout)));
+        cfg->keepalive       = (int) mrb_fixnum(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "keepalive")), mrb_fixnum_value(cfg->keepalive)));
+        cfg->keepalive_reply = mrb_type(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "keepalive_reply")), mrb_false_value())) == MRB_TT_TRUE;
+        cfg->kex             = mrb_ssh_method_pref(mrb, opts, "kex");
+        cfg->host_key        = mrb_ssh_method_pref(mrb, opts, "host_key");
+        cfg->ciphers         = mrb_ssh_method_pref(mrb, opts, "ciphers");
+        cfg->macs            = mrb_ssh_method_pref(mrb, opts, "macs");
+    }
+}
 
-    if (getaddrinfo(host, NULL, &hints, &res) != 0)
-        return NULL;
+static void
+mrb_ssh_keepalive_config (mrb_ssh_t *ssh, int interval, int want_reply)
+{
+    ssh->keepalive       = interval > 0 ? interval : 0;
+    ssh->keepalive_reply = want_reply;
 
-    for (rp = res; rp != NULL; rp = rp->ai_next) {
-        if (rp->ai_family == AF_INET) {
-            addr = (&((struct sockaddr_in *)(rp->ai_addr))->sin_addr);
-        } else {
-            addr = (&((struct sockaddr_in6 *)(rp->ai_addr))->sin6_addr);
-        }
+    libssh2_keepalive_config(ssh->session, want_reply, (unsigned int)ssh->keepalive);
+}
 
-        if (inet_ntop(rp->ai_family, addr, ipname, sizeof(ipname)) != NULL) {
-            freeaddrinfo(res);
-            return strdup(ipname);
-        }
+#ifdef _WIN32
+static int
+mrb_ssh_wsa2errno (void)
+{
+    switch (WSAGetLastError()) {
+        case WSAEWOULDBLOCK: return EAGAIN;
+        case WSAENOTSOCK:    return EBADF;
+        case WSAEINTR:       return EINTR;
+        default:             return EIO;
     }
+}
+# define mrb_ssh_errno() mrb_ssh_wsa2errno()
+# define mrb_ssh_send_fd(sock, buf, len, flags) send(sock, (const char *)(buf), (int)(len), flags)
+# define mrb_ssh_recv_fd(sock, buf, len, flags) recv(sock, (char *)(buf), (int)(len), flags)
+#else
+# define mrb_ssh_errno() errno
+# define mrb_ssh_send_fd(sock, buf, len, flags) send(sock, buf, len, flags)
+# define mrb_ssh_recv_fd(sock, buf, len, flags) recv(sock, buf, len, flags)
+#endif
+
+/* Counts the bytes on the wire. Errors are reported as -errno the same way
+   libssh2's own socket functions do. */
+static LIBSSH2_SEND_FUNC(mrb_ssh_send)
+{
+    mrb_ssh_t *ssh = *abstract;
+    ssize_t rc     = mrb_ssh_send_fd(socket, buffer, length, flags);
+
+    if (rc < 0) return -mrb_ssh_errno();
 
-    freeaddrinfo(res);
+    ssh->stats.bytes_sent += (uint64_t)rc;
 
-    return NULL;
+    return rc;
 }
 
-static int
-mrb_ssh_init_socket (mrb_state *mrb, int family, const char *host, int port, libssh2_socket_t *ptr)
+static LIBSSH2_RECV_FUNC(mrb_ssh_recv)
 {
-    struct sockaddr_in sin;
-    libssh2_socket_t sock;
-    int rc;
-    char *ip;
+    mrb_ssh_t *ssh = *abstract;
+    ssize_t rc     = mrb_ssh_recv_fd(socket, buffer, length, flags);
+
+    if (rc < 0) return -mrb_ssh_errno();
 
-    sock = socket(family, SOCK_STREAM, 0);
+    ssh->stats.bytes_received += (uint64_t)rc;
 
-    sin.sin_family = family;
-    sin.sin_port   = htons(port);
+    return rc;
+}
 
-    if (!(ip = mrb_ssh_host_to_ip(family, host)))
-        return -1;
+static int
+mrb_ssh_method_prefs (LIBSSH2_SESSION *session, mrb_ssh_connect_opts_t *cfg)
+{
+    int rc = 0;
 
-    inet_pton(family, ip, &(sin.sin_addr));
-    mrb_free(mrb, ip);
+    if (cfg->kex && (rc = libssh2_session_method_pref(session, LIBSSH2_METHOD_KEX, cfg->kex)) < 0)
+        return rc;
 
-    rc = connect(sock, (struct sockaddr*)(&sin), sizeof(struct sockaddr_in));
+    if (cfg->host_key && (rc = libssh2_session_method_pref(session, LIBSSH2_METHOD_HOSTKEY, cfg->host_key)) < 0)
+        return rc;
 
-    if (rc != 0) return rc;
+    if (cfg->ciphers && ((rc = libssh2_session_method_pref(session, LIBSSH2_METHOD_CRYPT_CS, cfg->ciphers)) < 0 ||
+                         (rc = libssh2_session_method_pref(session, LIBSSH2_METHOD_CRYPT_SC, cfg->ciphers)) < 0))
+        return rc;
 
-    *ptr = sock;
+    if (cfg->macs && ((rc = libssh2_session_method_pref(session, LIBSSH2_METHOD_MAC_CS, cfg->macs)) < 0 ||
+                      (rc = libssh2_session_method_pref(session, LIBSSH2_METHOD_MAC_SC, cfg->macs)) < 0))
+        return rc;
 
     return 0;
 }
 
 static int
-mrb_ssh_init_session (libssh2_socket_t sock, LIBSSH2_SESSION **ptr, int blocking, long timeout, int compress, int sigpipe)
+mrb_ssh_session_new (mrb_state *mrb, mrb_ssh_t *ssh, int blocking, mrb_ssh_connect_opts_t *cfg)
 {
     LIBSSH2_SESSION *session;
     int rc;
 
-    session = libssh2_session_init();
+    mrb_ssh_pool_init(mrb, &ssh->pool);
 
-    if (!session) {
-        mrb_ssh_close_socket(sock);
-        return 1;
+    session = libssh2_session_init_ex(mrb_ssh_alloc, mrb_ssh_free, mrb_ssh_realloc, ssh);
+
+    if (!session) return LIBSSH2_ERROR_ALLOC;
+
+    if ((rc = mrb_ssh_method_prefs(session, cfg)) < 0) {
+        libssh2_session_free(session);
+        return rc;
     }
 
 #ifdef MRB_SSH_DEBUG
     libssh2_trace(session, LIBSSH2_TRACE_KEX|LIBSSH2_TRACE_AUTH|LIBSSH2_TRACE_SFTP|LIBSSH2_TRACE_PUBLICKEY|LIBSSH2_TRACE_ERROR|LIBSSH2_TRACE_CONN);
 #endif
 
-    libssh2_session_set_blocking(session, blocking);
-    libssh2_session_set_timeout(session, timeout);
-    libssh2_session_flag(session, LIBSSH2_FLAG_SIGPIPE, sigpipe);
-    libssh2_session_flag(session, LIBSSH2_FLAG_COMPRESS, compress);
+#if LIBSSH2_VERSION_NUM >= 0x010b01
+    libssh2_session_callback_set2(session, LIBSSH2_CALLBACK_SEND, (libssh2_cb_generic *)mrb_ssh_send);
+    libssh2_session_callback_set2(session, LIBSSH2_CALLBACK_RECV, (libssh2_cb_generic *)mrb_ssh_recv);
+#else
+    libssh2_session_callback_set(session, LIBSSH2_CALLBACK_SEND, (void *)mrb_ssh_send);
+    libssh2_session_callback_set(session, LIBSSH2_CALLBACK_RECV, (void *)mrb_ssh_recv);
+#endif
 
-    while ((rc = libssh2_session_handshake(session, sock)) == LIBSSH2_ERROR_EAGAIN);
+    libssh2_session_set_blocking(session, blocking);
+    libssh2_session_set_timeout(session, cfg->timeout);
+    libssh2_session_flag(session, LIBSSH2_FLAG_SIGPIPE, cfg->sigpipe);
+    libssh2_session_flag(session, LIBSSH2_FLAG_COMPRESS, cfg->compress);
 
-    if (rc == 0) {
-        *ptr = session;
-#if LIBSSH2_VERSION_NUM >= 0x010601
-        libssh2_session_set_last_error(session, 0, NULL);
-#endif
-    } else {
-        mrb_ssh_close_socket(sock);
-        libssh2_session_free(session);
-    }
+    ssh->session        = session;
+    ssh->compress_level = cfg->compress_level;
 
-    return rc;
+    return 0;
 }
 
 static int
-mrb_ssh_agent_userauth (LIBSSH2_SESSION *session, const char *user)
+mrb_ssh_init_session (mrb_state *mrb, mrb_ssh_t *ssh, mrb_ssh_connect_opts_t *cfg)
 {
-    int rc = 0;
-    LIBSSH2_AGENT *agent = NULL;
-    struct libssh2_agent_publickey *identity, *prev_identity = NULL;
-
-    agent = libssh2_agent_init(session);
-
-    if (!agent) {
-        return LIBSSH2_ERROR_ALLOC;
-    }
+    int rc;
 
-    if ((rc = libssh2_agent_connect(agent)) < 0) {
-        goto cleanup;
-    }
-    if ((rc = libssh2_agent_list_identities(agent)) < 0) {
-        goto cleanup;
+    if ((rc = mrb_ssh_session_new(mrb, ssh, ssh->blocking, cfg)) != 0) {
+        mrb_ssh_close_socket(ssh->sock);
+        mrb_ssh_pool_clear(&ssh->pool);
+        return rc;
     }
 
-    while (1) {
-        if ((rc = libssh2_agent_get_identity(agent, &identity, prev_identity)) < 0) {
-            goto cleanup;
-        }
+    ssh->stats.since = mrb_ssh_now();
 
-        if (rc == 1) {
-            rc = LIBSSH2_ERROR_AUTHENTICATION_FAILED;
-            goto cleanup;
-        }
-
-        if ((rc = libssh2_agent_userauth(agent, user, identity)) == 0) {
-            break;
-        }
-
-        prev_identity = identity;
+    while ((rc = libssh2_session_handshake(ssh->session, ssh->sock)) == LIBSSH2_ERROR_EAGAIN) {
+        mrb_ssh_wait_sock(ssh);
     }
 
+    ssh->stats.handshake_time = mrb_ssh_now() - ssh->stats.since;
+    ssh->stats.since          = 0;
 
- cleanup:
-
-    if (agent) {
-        libssh2_agent_disconnect(agent);
-        libssh2_agent_free(agent);
+    if (rc == 0) {
+        ssh->state = MRB_SSH_STATE_READY;
+#if LIBSSH2_VERSION_NUM >= 0x010601
+        libssh2_session_set_last_error(ssh->session, 0, NULL);
+#endif
+    } else {
+        mrb_ssh_close_socket(ssh->sock);
+        libssh2_session_free(ssh->session);
+        mrb_ssh_pool_clear(&ssh->pool);
     }
 
     return rc;
@@ -260,7 +339,7 @@ mrb_ssh_agent_userauth (LIBSSH2_SESSION *session, const char *user)
 static inline void
 mrb_ssh_raise_unless_connected (mrb_state *mrb, mrb_ssh_t *ssh)
 {
-    if (ssh && ssh->session) return;
+    if (ssh && ssh->session && ssh->state == MRB_SSH_STATE_READY) return;
     mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
 }
 
@@ -294,36 +373,41 @@ mrb_ssh_f_connect (mrb_state *mrb, mrb_value self)
     mrb_value opts;
 
     mrb_ssh_t *ssh;
-    LIBSSH2_SESSION *session;
+    mrb_ssh_connect_opts_t cfg;
     libssh2_socket_t sock;
-    int blocking = 1, port = 22, compress = 0, sigpipe = 0, ret;
-    long timeout = 15000;
+    int ret;
 
     if (DATA_PTR(self)) {
         mrb_raise(mrb, E_SSH_ERROR, "SSH session already connected.");
     }
 
     mrb_get_args(mrb, "s|H?", &host, &host_len, &opts, &opts_given);
+    mrb_ssh_connect_opts(mrb, opts, opts_given, &cfg);
 
-    if (opts_given && mrb_hash_p(opts)) {
-        port     = (int) mrb_fixnum(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "port")), mrb_fixnum_value(port)));
-        timeout  = (long)mrb_fixnum(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "timeout")), mrb_fixnum_value(timeout)));
-        blocking = mrb_type(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "block")), mrb_true_value())) == MRB_TT_TRUE;
-        compress = mrb_type(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "compress")), mrb_false_value())) == MRB_TT_TRUE;
-        sigpipe  = mrb_type(mrb_hash_fetch(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "sigpipe")), mrb_false_value())) == MRB_TT_TRUE;
+    ret = mrb_ssh_socket_open(host, cfg.port, (int)(cfg.connect_timeout < 0 ? cfg.timeout : cfg.connect_timeout), &sock);
+
+    if (ret == MRB_SSH_CONNECT_TIMEDOUT) {
+        mrb_raise(mrb, E_SSH_TIMEOUT_ERROR, "Timed out connecting to host.");
     }
 
-    if (mrb_ssh_init_socket(mrb, AF_INET, host, port, &sock) != 0) {
+    if (ret != 0) {
         mrb_raise(mrb, E_SSH_CONNECT_ERROR, "Failed to connect.");
     }
 
-    if ((ret = mrb_ssh_init_session(sock, &session, blocking, timeout, compress, sigpipe)) != 0) {
-        mrb_ssh_raise(mrb, ret, "Could not init ssh session.");
+    ssh = mrb_malloc(mrb, sizeof(mrb_ssh_t));
+    memset(ssh, 0, sizeof(mrb_ssh_t));
+
+    ssh->sock     = sock;
+    ssh->state    = MRB_SSH_STATE_HANDSHAKE;
+    ssh->blocking = cfg.blocking;
+    ssh->port     = cfg.port;
+
+    if ((ret = mrb_ssh_init_session(mrb, ssh, &cfg)) != 0) {
+        mrb_free(mrb, ssh);
+        mrb_ssh_raise(mrb, ret, ret == LIBSSH2_ERROR_METHOD_NOT_SUPPORTED ? "Unsupported algorithm preference." : "Could not init ssh session.");
     }
 
-    ssh            = mrb_malloc(mrb, sizeof(mrb_ssh_t));
-    ssh->sock      = (libssh2_socket_t)sock;
-    ssh->session   = session;
+    mrb_ssh_keepalive_config(ssh, cfg.keepalive, cfg.keepalive_reply);
 
     mrb_data_init(self, ssh, &mrb_ssh_session_type);
 
@@ -333,6 +417,128 @@ mrb_ssh_f_connect (mrb_state *mrb, mrb_value self)
     return mrb_nil_value();
 }
 
+static void
+mrb_ssh_connect_abort (mrb_state *mrb, mrb_value self, struct RClass *cls, int err, const char *msg)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_value exc  = cls ? mrb_exc_new_str(mrb, cls, mrb_str_new_cstr(mrb, msg)) : mrb_ssh_exc_new(mrb, err, msg);
+
+    mrb_ssh_session_free(mrb, ssh);
+
+    DATA_PTR(self)  = NULL;
+    DATA_TYPE(self) = NULL;
+
+    mrb_iv_set(mrb, self, mrb_intern_static(mrb, "@host", 5),
+                          mrb_nil_value());
+
+    mrb_exc_raise(mrb, exc);
+}
+
+/* Advances the connect state machine as far as it gets without blocking:
+   TCP connect, then SSH handshake. */
+static mrb_value
+mrb_ssh_connect_step (mrb_state *mrb, mrb_value self, mrb_ssh_t *ssh)
+{
+    int rc;
+
+    if (ssh->state == MRB_SSH_STATE_CONNECT) {
+        if ((rc = mrb_ssh_socket_writable(ssh->sock)) == 0)
+            return mrb_symbol_value(mrb_intern_lit(mrb, "wait_writable"));
+
+        if (rc < 0 || mrb_ssh_socket_error(ssh->sock) != 0) {
+            mrb_ssh_connect_abort(mrb, self, E_SSH_CONNECT_ERROR, 0, "Failed to connect.");
+        }
+
+        ssh->state = MRB_SSH_STATE_HANDSHAKE;
+    }
+
+    if (!ssh->stats.since) {
+        ssh->stats.since = mrb_ssh_now();
+    }
+
+    rc = libssh2_session_handshake(ssh->session, ssh->sock);
+
+    if (rc == LIBSSH2_ERROR_EAGAIN)
+        return mrb_ssh_wait_symbol(mrb, ssh->session);
+
+    if (rc != 0) {
+        mrb_ssh_connect_abort(mrb, self, NULL, rc, "Could not init ssh session.");
+    }
+
+    ssh->state                = MRB_SSH_STATE_READY;
+    ssh->stats.handshake_time = mrb_ssh_now() - ssh->stats.since;
+    ssh->stats.since          = 0;
+
+    libssh2_session_set_blocking(ssh->session, ssh->blocking);
+    mrb_ssh_keepalive_config(ssh, ssh->keepalive, ssh->keepalive_reply);
+#if LIBSSH2_VERSION_NUM >= 0x010601
+    libssh2_session_set_last_error(ssh->session, 0, NULL);
+#endif
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_connect_nonblock (mrb_state *mrb, mrb_value self)
+{
+    mrb_bool opts_given = FALSE;
+    mrb_int host_len;
+    char* host;
+    mrb_value opts;
+
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_ssh_connect_opts_t cfg;
+    mrb_ssh_addrs_t addrs;
+    libssh2_socket_t sock;
+    int rc, err;
+
+    mrb_get_args(mrb, "s|H?", &host, &host_len, &opts, &opts_given);
+
+    if (ssh) {
+        if (ssh->state == MRB_SSH_STATE_READY) {
+            mrb_raise(mrb, E_SSH_ERROR, "SSH session already connected.");
+        }
+
+        return mrb_ssh_connect_step(mrb, self, ssh);
+    }
+
+    mrb_ssh_connect_opts(mrb, opts, opts_given, &cfg);
+
+    if (mrb_ssh_dns_lookup(host, AF_UNSPEC, &addrs) != 0) {
+        mrb_raise(mrb, E_SSH_CONNECT_ERROR, "Failed to resolve host.");
+    }
+
+    mrb_ssh_dns_set_port(&addrs, cfg.port);
+
+    if ((rc = mrb_ssh_socket_connect((struct sockaddr *)&addrs.addr[0], addrs.len[0], &sock)) < 0) {
+        mrb_raise(mrb, E_SSH_CONNECT_ERROR, "Failed to connect.");
+    }
+
+    ssh = mrb_malloc(mrb, sizeof(mrb_ssh_t));
+    memset(ssh, 0, sizeof(mrb_ssh_t));
+
+    if ((err = mrb_ssh_session_new(mrb, ssh, 0, &cfg)) != 0) {
+        mrb_ssh_pool_clear(&ssh->pool);
+        mrb_free(mrb, ssh);
+        mrb_ssh_close_socket(sock);
+        mrb_ssh_raise(mrb, err, err == LIBSSH2_ERROR_METHOD_NOT_SUPPORTED ? "Unsupported algorithm preference." : "Could not init ssh session.");
+    }
+
+    ssh->sock            = sock;
+    ssh->keepalive       = cfg.keepalive > 0 ? cfg.keepalive : 0;
+    ssh->keepalive_reply = cfg.keepalive_reply;
+    ssh->state           = rc == MRB_SSH_CONNECT_PENDING ? MRB_SSH_STATE_CONNECT : MRB_SSH_STATE_HANDSHAKE;
+    ssh->blocking        = cfg.blocking;
+    ssh->port            = cfg.port;
+
+    mrb_data_init(self, ssh, &mrb_ssh_session_type);
+
+    mrb_iv_set(mrb, self, mrb_intern_static(mrb, "@host", 5),
+                          mrb_str_new(mrb, host, host_len));
+
+    return mrb_ssh_connect_step(mrb, self, ssh);
+}
+
 static mrb_value
 mrb_ssh_f_close (mrb_state *mrb, mrb_value self)
 {
@@ -350,45 +556,77 @@ mrb_ssh_f_close (mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_ssh_f_closed (mrb_state *mrb, mrb_value self)
 {
-    return DATA_PTR(self) && mrb_ssh_initialized() ? mrb_false_value() : mrb_true_value();
+    mrb_ssh_t *ssh = DATA_PTR(self);
+
+    return ssh && ssh->state == MRB_SSH_STATE_READY && mrb_ssh_initialized() ? mrb_false_value() : mrb_true_value();
 }
 
-static mrb_value
-mrb_ssh_f_login (mrb_state *mrb, mrb_value self)
+static int
+mrb_ssh_key_userauth (mrb_state *mrb, mrb_ssh_t *ssh, const char *user, mrb_int user_len, mrb_value opts, mrb_bool nonblock)
 {
-    mrb_bool opts_given = FALSE;
-    mrb_int user_len = 0;
-    const char *user;
-    mrb_value opts;
-    int rc = 0;
+    mrb_value privkey   = mrb_hash_get(mrb, opts, SYM("key", 3));
+    mrb_value data      = mrb_hash_get(mrb, opts, SYM("key_data", 8));
+    mrb_value pubdata   = mrb_hash_get(mrb, opts, SYM("public_key_data", 15));
+    mrb_value phrase    = mrb_hash_get(mrb, opts, SYM("passphrase", 10));
+    const char *sphrase = mrb_string_p(phrase) ? mrb_string_value_cstr(mrb, &phrase) : NULL;
+    mrb_ssh_key_t *key  = NULL;
+    mrb_value pubkey;
+    int rc;
 
-    mrb_ssh_t *ssh = DATA_PTR(self);
-    mrb_ssh_raise_unless_connected(mrb, ssh);
+    if (mrb_string_p(data)) {
+        while ((rc =
+                libssh2_userauth_publickey_frommemory(ssh->session, user, (size_t)user_len,
+                                                      mrb_string_p(pubdata) ? RSTRING_PTR(pubdata) : NULL,
+                                                      mrb_string_p(pubdata) ? (size_t)RSTRING_LEN(pubdata) : 0,
+                                                      RSTRING_PTR(data), (size_t)RSTRING_LEN(data), sphrase)
+                ) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+            mrb_ssh_wait_sock(ssh);
+        }
 
-    mrb_get_args(mrb, "s|H!?", &user, &user_len, &opts, &opts_given);
+        return rc;
+    }
 
-    if (opts_given) {
-        if (mrb_true_p(mrb_hash_get(mrb, opts, SYM("use_agent", 9)))) {
-            rc = mrb_ssh_agent_userauth(ssh->session, user);
+    if ((key = mrb_ssh_keycache_get(mrb_string_value_cstr(mrb, &privkey)))) {
+        while ((rc =
+                libssh2_userauth_publickey_frommemory(ssh->session, user, (size_t)user_len,
+                                                      key->pub, key->pub_len, key->priv, key->priv_len,
+                                                      sphrase ? sphrase : key->passphrase)
+                ) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+            mrb_ssh_wait_sock(ssh);
         }
-        else if (mrb_hash_key_p(mrb, opts, SYM("key", 3))) {
-            mrb_value privkey   = mrb_hash_get(mrb,opts, SYM("key", 3));
-            mrb_value phrase    = mrb_hash_get(mrb,opts, SYM("passphrase", 10));
-            const char *sphrase = mrb_string_p(phrase) ? RSTRING_PTR(phrase) : NULL;
 
-            char *pubkey = (char *)mrb_malloc(mrb, sizeof(char) * (RSTRING_LEN(privkey) + 4 + 1));
-            strcpy(pubkey, RSTRING_PTR(privkey));
-            strcat(pubkey, ".pub");
+        mrb_ssh_keycache_release(key);
 
-            while ((rc =
-                    libssh2_userauth_publickey_fromfile_ex(ssh->session, user,
-                                                           (unsigned int)user_len,
-                                                           pubkey,
-                                                           (const char *)RSTRING_PTR(privkey),
-                                                           sphrase)
-                    ) == LIBSSH2_ERROR_EAGAIN);
-
-            mrb_free(mrb, pubkey);
+        return rc;
+    }
+
+    pubkey = mrb_str_dup(mrb, privkey);
+    mrb_str_cat_cstr(mrb, pubkey, ".pub");
+
+    while ((rc =
+            libssh2_userauth_publickey_fromfile_ex(ssh->session, user,
+                                                   (unsigned int)user_len,
+                                                   RSTRING_PTR(pubkey),
+                                                   RSTRING_PTR(privkey),
+                                                   sphrase)
+            ) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+        mrb_ssh_wait_sock(ssh);
+    }
+
+    return rc;
+}
+
+static int
+mrb_ssh_userauth (mrb_state *mrb, mrb_ssh_t *ssh, const char *host, const char *user, mrb_int user_len, mrb_value opts, mrb_bool opts_given, mrb_bool nonblock)
+{
+    int rc = 0;
+
+    if (opts_given) {
+        if (mrb_true_p(mrb_hash_get(mrb, opts, SYM("use_agent", 9)))) {
+            rc = mrb_ssh_agent_userauth(ssh, user, host);
+        }
+        else if (mrb_hash_key_p(mrb, opts, SYM("key", 3)) || mrb_hash_key_p(mrb, opts, SYM("key_data", 8))) {
+            rc = mrb_ssh_key_userauth(mrb, ssh, user, user_len, opts, nonblock);
         }
         else if (mrb_hash_key_p(mrb, opts, SYM("password", 8))) {
             mrb_value pass = mrb_hash_get(mrb,opts, SYM("password", 8));
@@ -398,35 +636,310 @@ mrb_ssh_f_login (mrb_state *mrb, mrb_value self)
                                                  (unsigned int)user_len,
                                                  (const char *)RSTRING_PTR(pass),
                                                  (unsigned int)RSTRING_LEN(pass), NULL)
-                    ) == LIBSSH2_ERROR_EAGAIN);
+                    ) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+                mrb_ssh_wait_sock(ssh);
+            }
         }
         else if (mrb_false_p(mrb_hash_get(mrb, opts, SYM("non_interactive", 15)))) {
             while ((rc =
                     libssh2_userauth_keyboard_interactive_ex(ssh->session, user,
                                                              (unsigned int)user_len,
                                                              &kbd_func)
-                    ) == LIBSSH2_ERROR_EAGAIN);
+                    ) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+                mrb_ssh_wait_sock(ssh);
+            }
         }
     } else {
         while ((rc =
                 libssh2_userauth_keyboard_interactive_ex(ssh->session, user,
                                                          (unsigned int)user_len,
                                                          &kbd_func)
-                ) == LIBSSH2_ERROR_EAGAIN);
+                ) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+            mrb_ssh_wait_sock(ssh);
+        }
+    }
+
+    return rc;
+}
+
+typedef struct mrb_ssh_login_args
+{
+    mrb_ssh_t *ssh;
+    const char *host;
+    const char *user;
+    mrb_int user_len;
+    mrb_value opts;
+    mrb_bool opts_given;
+    int blocking;
+    int rc;
+} mrb_ssh_login_args_t;
+
+static mrb_value
+mrb_ssh_login_nonblock_body (mrb_state *mrb, mrb_value data)
+{
+    mrb_ssh_login_args_t *args = mrb_cptr(data);
+
+    args->rc = mrb_ssh_userauth(mrb, args->ssh, args->host, args->user, args->user_len, args->opts, args->opts_given, TRUE);
+
+    return mrb_nil_value();
+}
+
+/* Runs even if the login raised, so the session never stays non-blocking. */
+static mrb_value
+mrb_ssh_login_nonblock_done (mrb_state *mrb, mrb_value data)
+{
+    mrb_ssh_login_args_t *args = mrb_cptr(data);
+
+    if (args->ssh->session) {
+        libssh2_session_set_blocking(args->ssh->session, args->blocking);
+    }
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_login (mrb_state *mrb, mrb_value self, mrb_bool nonblock)
+{
+    mrb_ssh_login_args_t args;
+    mrb_value host, data;
+    int rc;
+
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_ssh_raise_unless_connected(mrb, ssh);
+
+    memset(&args, 0, sizeof(mrb_ssh_login_args_t));
+
+    mrb_get_args(mrb, "s|H!?", &args.user, &args.user_len, &args.opts, &args.opts_given);
+
+    host      = mrb_iv_get(mrb, self, mrb_intern_static(mrb, "@host", 5));
+    args.ssh  = ssh;
+    args.host = mrb_string_p(host) ? RSTRING_PTR(host) : NULL;
+
+    if (!ssh->stats.since) {
+        ssh->stats.since = mrb_ssh_now();
+    }
+
+    if (nonblock) {
+        args.blocking = libssh2_session_get_blocking(ssh->session);
+        libssh2_session_set_blocking(ssh->session, 0);
+
+        data = mrb_cptr_value(mrb, &args);
+        mrb_ensure(mrb, mrb_ssh_login_nonblock_body, data, mrb_ssh_login_nonblock_done, data);
+
+        rc = args.rc;
+    } else {
+        rc = mrb_ssh_userauth(mrb, ssh, args.host, args.user, args.user_len, args.opts, args.opts_given, FALSE);
+    }
+
+    if (rc != LIBSSH2_ERROR_EAGAIN) {
+        ssh->stats.auth_time = mrb_ssh_now() - ssh->stats.since;
+        ssh->stats.since     = 0;
     }
 
     switch (rc) {
         case LIBSSH2_ERROR_NONE:
             break;
+        case LIBSSH2_ERROR_EAGAIN:
+            return mrb_ssh_wait_symbol(mrb, ssh->session);
+        case LIBSSH2_ERROR_SOCKET_DISCONNECT:
+            mrb_ssh_f_close(mrb, self);
+            mrb_raise(mrb, E_SSH_DISCONNECT_ERROR, "Connection lost.");
+        default:
+            mrb_ssh_raise_last_error(mrb, ssh);
+    }
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_login (mrb_state *mrb, mrb_value self)
+{
+    return mrb_ssh_login(mrb, self, FALSE);
+}
+
+static mrb_value
+mrb_ssh_f_login_nonblock (mrb_state *mrb, mrb_value self)
+{
+    return mrb_ssh_login(mrb, self, TRUE);
+}
+
+static mrb_value
+mrb_ssh_f_alive (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    int next;
+
+    if (!(ssh && ssh->state == MRB_SSH_STATE_READY && mrb_ssh_initialized()))
+        return mrb_false_value();
+
+    if (!mrb_ssh_socket_alive(ssh->sock))
+        return mrb_false_value();
+
+    /* Without keepalive the socket probe has to do, as a probe must not
+     * change the session's keepalive settings. */
+    if (!ssh->keepalive)
+        return mrb_true_value();
+
+    switch (libssh2_keepalive_send(ssh->session, &next)) {
+    case 0:
+    case LIBSSH2_ERROR_EAGAIN:
+        return mrb_true_value();
+    default:
+        return mrb_false_value();
+    }
+}
+
+static mrb_value
+mrb_ssh_f_keepalive (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+
+    if (!ssh) return mrb_fixnum_value(0);
+
+    return mrb_fixnum_value(ssh->keepalive);
+}
+
+static mrb_value
+mrb_ssh_f_keepalive_p (mrb_state *mrb, mrb_value self)
+{
+    mrb_int interval;
+    mrb_bool want_reply = FALSE, reply_given = FALSE;
+
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_ssh_raise_unless_connected(mrb, ssh);
+
+    mrb_get_args(mrb, "i|b?", &interval, &want_reply, &reply_given);
+
+    mrb_ssh_keepalive_config(ssh, (int)interval, reply_given ? want_reply : ssh->keepalive_reply);
+
+    return mrb_fixnum_value(ssh->keepalive);
+}
+
+/* Sends a keepalive message if one is due and returns the seconds until the
+   next one. A non-blocking session that cannot send right now is retried
+   soon. Raises if the message could not be sent. */
+static mrb_value
+mrb_ssh_f_keepalive_tick (mrb_state *mrb, mrb_value self)
+{
+    int next = 0;
+
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_ssh_raise_unless_connected(mrb, ssh);
+
+    if (!ssh->keepalive)
+        return mrb_nil_value();
+
+    if (!mrb_ssh_socket_alive(ssh->sock)) {
+        mrb_ssh_f_close(mrb, self);
+        mrb_raise(mrb, E_SSH_DISCONNECT_ERROR, "Connection lost.");
+    }
+
+    switch (libssh2_keepalive_send(ssh->session, &next)) {
+        case LIBSSH2_ERROR_NONE:
+            break;
+        case LIBSSH2_ERROR_EAGAIN:
+            next = MRB_SSH_KEEPALIVE_RETRY;
+            break;
+        case LIBSSH2_ERROR_SOCKET_SEND:
         case LIBSSH2_ERROR_SOCKET_DISCONNECT:
             mrb_ssh_f_close(mrb, self);
+            mrb_raise(mrb, E_SSH_DISCONNECT_ERROR, "Connection lost.");
         default:
             mrb_ssh_raise_last_error(mrb, ssh);
     }
 
+    return mrb_fixnum_value(next);
+}
+
+static inline mrb_value
+mrb_ssh_secs (mrb_state *mrb, int64_t usecs)
+{
+    return mrb_float_value(mrb, (mrb_float)usecs / 1000000);
+}
+
+static mrb_value
+mrb_ssh_f_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_ssh_stats_t *stats;
+    mrb_value res;
+
+    if (!ssh) return mrb_nil_value();
+
+    stats = &ssh->stats;
+    res   = mrb_hash_new_capa(mrb, 14);
+
+    mrb_hash_set(mrb, res, SYM("bytes_sent", 10),        mrb_fixnum_value((mrb_int)stats->bytes_sent));
+    mrb_hash_set(mrb, res, SYM("bytes_received", 14),    mrb_fixnum_value((mrb_int)stats->bytes_received));
+    mrb_hash_set(mrb, res, SYM("waits", 5),              mrb_fixnum_value((mrb_int)stats->waits));
+    mrb_hash_set(mrb, res, SYM("wait_time", 9),          mrb_ssh_secs(mrb, stats->wait_time));
+    mrb_hash_set(mrb, res, SYM("handshake_time", 14),    mrb_ssh_secs(mrb, stats->handshake_time));
+    mrb_hash_set(mrb, res, SYM("auth_time", 9),          mrb_ssh_secs(mrb, stats->auth_time));
+    mrb_hash_set(mrb, res, SYM("channel_opens", 13),     mrb_fixnum_value((mrb_int)stats->channel_opens));
+    mrb_hash_set(mrb, res, SYM("channel_open_time", 17), mrb_ssh_secs(mrb, stats->channel_open_time));
+    mrb_hash_set(mrb, res, SYM("execs", 5),              mrb_fixnum_value((mrb_int)stats->execs));
+    mrb_hash_set(mrb, res, SYM("exec_time", 9),          mrb_ssh_secs(mrb, stats->exec_time));
+    mrb_hash_set(mrb, res, SYM("compress_in", 11),       mrb_fixnum_value((mrb_int)stats->compress_in));
+    mrb_hash_set(mrb, res, SYM("compress_out", 12),      mrb_fixnum_value((mrb_int)stats->compress_out));
+    mrb_hash_set(mrb, res, SYM("decompress_in", 13),     mrb_fixnum_value((mrb_int)stats->decompress_in));
+    mrb_hash_set(mrb, res, SYM("decompress_out", 14),    mrb_fixnum_value((mrb_int)stats->decompress_out));
+
+    return res;
+}
+
+static mrb_value
+mrb_ssh_f_reset_stats (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    int64_t since;
+
+    if (!ssh) return mrb_nil_value();
+
+    since = ssh->stats.since;
+
+    memset(&ssh->stats, 0, sizeof(mrb_ssh_stats_t));
+    ssh->stats.since = since;
+
     return mrb_nil_value();
 }
 
+static mrb_value
+mrb_ssh_f_memory_usage (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh    = DATA_PTR(self);
+    mrb_bool detailed = FALSE;
+    mrb_ssh_pool_t *pool;
+    mrb_value res;
+
+    mrb_get_args(mrb, "|b", &detailed);
+
+    if (!ssh) return mrb_nil_value();
+
+    pool = &ssh->pool;
+
+    if (!detailed) return mrb_fixnum_value((mrb_int)pool->live);
+
+    res = mrb_hash_new_capa(mrb, 5);
+
+    mrb_hash_set(mrb, res, SYM("live", 4),      mrb_fixnum_value((mrb_int)pool->live));
+    mrb_hash_set(mrb, res, SYM("peak", 4),      mrb_fixnum_value((mrb_int)pool->peak));
+    mrb_hash_set(mrb, res, SYM("cached", 6),    mrb_fixnum_value((mrb_int)pool->cached_bytes));
+    mrb_hash_set(mrb, res, SYM("allocs", 6),    mrb_fixnum_value((mrb_int)pool->allocs));
+    mrb_hash_set(mrb, res, SYM("pool_hits", 9), mrb_fixnum_value((mrb_int)pool->hits));
+
+    return res;
+}
+
+static mrb_value
+mrb_ssh_f_trim_memory (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+
+    if (!ssh) return mrb_fixnum_value(0);
+
+    return mrb_fixnum_value((mrb_int)mrb_ssh_pool_trim(&ssh->pool));
+}
+
 static mrb_value
 mrb_ssh_f_logged (mrb_state *mrb, mrb_value self)
 {
@@ -509,12 +1022,31 @@ static mrb_value
 mrb_ssh_f_fingerprint (mrb_state *mrb, mrb_value self)
 {
     char fingerprint[76] = "\0";
+    mrb_sym type         = mrb_intern_static(mrb, "sha1", 4);
     const char *keys;
     char key[4];
 
     mrb_ssh_t *ssh = DATA_PTR(self);
+
+    mrb_get_args(mrb, "|n", &type);
     mrb_ssh_raise_unless_connected(mrb, ssh);
 
+#ifdef LIBSSH2_HOSTKEY_HASH_SHA256
+    if (type == mrb_intern_static(mrb, "sha256", 6)) {
+        if (!(keys = libssh2_hostkey_hash(ssh->session, LIBSSH2_HOSTKEY_HASH_SHA256)))
+            return mrb_nil_value();
+
+        strcpy(fingerprint, "SHA256:");
+        mrb_ssh_base64_encode((const unsigned char *)keys, 32, fingerprint + 7);
+
+        return mrb_str_new(mrb, fingerprint, 7 + 43);
+    }
+#endif
+
+    if (type != mrb_intern_static(mrb, "sha1", 4)) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "Unsupported fingerprint type.");
+    }
+
     keys = libssh2_hostkey_hash(ssh->session, LIBSSH2_HOSTKEY_HASH_SHA1);
 
     for (int i = 0; i < 20; i++) {
@@ -525,6 +1057,76 @@ mrb_ssh_f_fingerprint (mrb_state *mrb, mrb_value self)
     return mrb_str_new(mrb, fingerprint, 59);
 }
 
+static mrb_value
+mrb_ssh_method_value (mrb_state *mrb, mrb_ssh_t *ssh, int type)
+{
+    const char *method = libssh2_session_methods(ssh->session, type);
+    return method ? mrb_str_new_cstr(mrb, method) : mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_algorithms (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    mrb_value res;
+
+    mrb_ssh_raise_unless_connected(mrb, ssh);
+
+    res = mrb_hash_new_capa(mrb, 8);
+
+    mrb_hash_set(mrb, res, SYM("kex", 3),             mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_KEX));
+    mrb_hash_set(mrb, res, SYM("host_key", 8),        mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_HOSTKEY));
+    mrb_hash_set(mrb, res, SYM("cipher_cs", 9),       mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_CRYPT_CS));
+    mrb_hash_set(mrb, res, SYM("cipher_sc", 9),       mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_CRYPT_SC));
+    mrb_hash_set(mrb, res, SYM("mac_cs", 6),          mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_MAC_CS));
+    mrb_hash_set(mrb, res, SYM("mac_sc", 6),          mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_MAC_SC));
+    mrb_hash_set(mrb, res, SYM("compression_cs", 14), mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_COMP_CS));
+    mrb_hash_set(mrb, res, SYM("compression_sc", 14), mrb_ssh_method_value(mrb, ssh, LIBSSH2_METHOD_COMP_SC));
+
+    return res;
+}
+
+static mrb_value
+mrb_ssh_f_supported_algorithms (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh = DATA_PTR(self);
+    const char **algs;
+    mrb_sym type;
+    mrb_value res;
+    int method, count;
+
+    mrb_get_args(mrb, "n", &type);
+    mrb_ssh_raise_unless_connected(mrb, ssh);
+
+    if (type == mrb_intern_lit(mrb, "kex")) {
+        method = LIBSSH2_METHOD_KEX;
+    } else if (type == mrb_intern_lit(mrb, "host_key")) {
+        method = LIBSSH2_METHOD_HOSTKEY;
+    } else if (type == mrb_intern_lit(mrb, "ciphers")) {
+        method = LIBSSH2_METHOD_CRYPT_CS;
+    } else if (type == mrb_intern_lit(mrb, "macs")) {
+        method = LIBSSH2_METHOD_MAC_CS;
+    } else {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "type must be one of :kex, :host_key, :ciphers or :macs");
+    }
+
+    if ((count = libssh2_session_supported_algs(ssh->session, method, &algs)) < 0) {
+        mrb_ssh_raise_last_error(mrb, ssh);
+    }
+
+    res = mrb_ary_new_capa(mrb, count);
+
+    for (int i = 0; i < count; i++) {
+        mrb_ary_push(mrb, res, mrb_str_new_cstr(mrb, algs[i]));
+    }
+
+    if (count > 0) {
+        libssh2_free(ssh->session, (void *)algs);
+    }
+
+    return res;
+}
+
 static mrb_value
 mrb_ssh_f_userauth_list (mrb_state *mrb, mrb_value self)
 {
@@ -551,15 +1153,27 @@ mrb_mruby_ssh_session_init (mrb_state *mrb)
     MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
 
     mrb_define_method(mrb, cls, "connect",     mrb_ssh_f_connect, MRB_ARGS_ARG(1,1));
+    mrb_define_method(mrb, cls, "connect_nonblock", mrb_ssh_f_connect_nonblock, MRB_ARGS_ARG(1,1));
     mrb_define_method(mrb, cls, "close",       mrb_ssh_f_close,   MRB_ARGS_NONE());
     mrb_define_method(mrb, cls, "closed?",     mrb_ssh_f_closed,  MRB_ARGS_NONE());
     mrb_define_method(mrb, cls, "login",       mrb_ssh_f_login,   MRB_ARGS_ARG(1,1));
+    mrb_define_method(mrb, cls, "login_nonblock", mrb_ssh_f_login_nonblock, MRB_ARGS_ARG(1,1));
     mrb_define_method(mrb, cls, "logged_in?",  mrb_ssh_f_logged,  MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "alive?",      mrb_ssh_f_alive,   MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "keepalive",   mrb_ssh_f_keepalive, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "keepalive=",  mrb_ssh_f_keepalive_p, MRB_ARGS_ARG(1,1));
+    mrb_define_method(mrb, cls, "keepalive_tick", mrb_ssh_f_keepalive_tick, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "stats",       mrb_ssh_f_stats,   MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "reset_stats", mrb_ssh_f_reset_stats, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "memory_usage", mrb_ssh_f_memory_usage, MRB_ARGS_OPT(1));
+    mrb_define_method(mrb, cls, "trim_memory", mrb_ssh_f_trim_memory, MRB_ARGS_NONE());
     mrb_define_method(mrb, cls, "blocking?",   mrb_ssh_f_blocking,MRB_ARGS_NONE());
     mrb_define_method(mrb, cls, "timeout",     mrb_ssh_f_timeout, MRB_ARGS_NONE());
     mrb_define_method(mrb, cls, "timeout=",    mrb_ssh_f_timeout_p, MRB_ARGS_REQ(1));
     mrb_define_method(mrb, cls, "last_errno",  mrb_ssh_f_last_errno, MRB_ARGS_NONE());
     mrb_define_method(mrb, cls, "last_error",  mrb_ssh_f_last_error, MRB_ARGS_NONE());
-    mrb_define_method(mrb, cls, "fingerprint", mrb_ssh_f_fingerprint, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "fingerprint", mrb_ssh_f_fingerprint, MRB_ARGS_OPT(1));
     mrb_define_method(mrb, cls, "userauth_list", mrb_ssh_f_userauth_list, MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "algorithms",  mrb_ssh_f_algorithms, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "supported_algorithms", mrb_ssh_f_supported_algorithms, MRB_ARGS_REQ(1));
 }
@@ -0,0 +1,711 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "sftp.h"
+
+#include "mruby.h"
+#include "mruby/data.h"
+#include "mruby/hash.h"
+#include "mruby/array.h"
+#include "mruby/class.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#include "mruby/ext/ssh.h"
+
+#include <stdio.h>
+#include <libssh2.h>
+#include <libssh2_sftp.h>
+
+#define SYM(name, len) mrb_intern_static(mrb, name, len)
+
+/* libssh2 splits larger buffers into packets of up to 30000 bytes and keeps
+   all of them in flight, so every call pipelines about eight requests */
+#define MRB_SSH_SFTP_CHUNK 0x40000
+
+static inline mrb_ssh_t *
+mrb_ssh_sftp_session (mrb_ssh_sftp_t *data)
+{
+    return data && data->sftp && data->session->data && mrb_ssh_initialized() ? data->session->data : NULL;
+}
+
+static const char *
+mrb_ssh_sftp_strerror (unsigned long status)
+{
+    switch (status) {
+    case LIBSSH2_FX_EOF:
+        return "End of file.";
+    case LIBSSH2_FX_NO_SUCH_FILE:
+        return "No such file.";
+    case LIBSSH2_FX_PERMISSION_DENIED:
+        return "Permission denied.";
+    case LIBSSH2_FX_BAD_MESSAGE:
+        return "Bad message.";
+    case LIBSSH2_FX_NO_CONNECTION:
+        return "No connection.";
+    case LIBSSH2_FX_CONNECTION_LOST:
+        return "Connection lost.";
+    case LIBSSH2_FX_OP_UNSUPPORTED:
+        return "Operation not supported.";
+    case LIBSSH2_FX_INVALID_HANDLE:
+        return "Invalid handle.";
+    case LIBSSH2_FX_NO_SUCH_PATH:
+        return "No such path.";
+    case LIBSSH2_FX_FILE_ALREADY_EXISTS:
+        return "File already exists.";
+    case LIBSSH2_FX_WRITE_PROTECT:
+        return "Write protected.";
+    case LIBSSH2_FX_NO_SPACE_ON_FILESYSTEM:
+        return "No space left on filesystem.";
+    case LIBSSH2_FX_QUOTA_EXCEEDED:
+        return "Quota exceeded.";
+    case LIBSSH2_FX_NOT_A_DIRECTORY:
+        return "Not a directory.";
+    case LIBSSH2_FX_DIR_NOT_EMPTY:
+        return "Directory not empty.";
+    default:
+        return "SFTP operation failed.";
+    }
+}
+
+static mrb_value
+mrb_ssh_sftp_exc (mrb_state *mrb, mrb_ssh_t *ssh, LIBSSH2_SFTP *sftp)
+{
+    int err = libssh2_session_last_errno(ssh->session);
+    unsigned long status;
+    mrb_value exc;
+    char *msg;
+
+    if (err != LIBSSH2_ERROR_SFTP_PROTOCOL) {
+        libssh2_session_last_error(ssh->session, &msg, NULL, 0);
+        return mrb_ssh_exc_new(mrb, err, msg);
+    }
+
+    status = libssh2_sftp_last_error(sftp);
+    exc    = mrb_exc_new_str(mrb, E_SSH_SFTP_ERROR, mrb_str_new_cstr(mrb, mrb_ssh_sftp_strerror(status)));
+
+    mrb_iv_set(mrb, exc, SYM("@errno", 6), mrb_fixnum_value((mrb_int)status));
+
+    return exc;
+}
+
+static LIBSSH2_SFTP_HANDLE *
+mrb_ssh_sftp_open_handle (mrb_ssh_t *ssh, LIBSSH2_SFTP *sftp, const char *path, mrb_int path_len, unsigned long flags, long mode, int type)
+{
+    LIBSSH2_SFTP_HANDLE *handle;
+
+    do {
+        handle = libssh2_sftp_open_ex(sftp, path, (unsigned int)path_len, flags, mode, type);
+
+        if (handle) break;
+
+        if (libssh2_session_last_errno(ssh->session) != LIBSSH2_ERROR_EAGAIN)
+            return NULL;
+
+        mrb_ssh_wait_sock(ssh);
+    } while (!handle);
+
+    return handle;
+}
+
+static int
+mrb_ssh_sftp_close_handle (mrb_ssh_t *ssh, LIBSSH2_SFTP_HANDLE *handle)
+{
+    int rc;
+
+    while ((rc = libssh2_sftp_close_handle(handle)) == LIBSSH2_ERROR_EAGAIN) {
+        mrb_ssh_wait_sock(ssh);
+    }
+
+    return rc;
+}
+
+static mrb_value
+mrb_ssh_sftp_attrs (mrb_state *mrb, LIBSSH2_SFTP_ATTRIBUTES *attrs)
+{
+    mrb_value stat = mrb_hash_new_capa(mrb, 7);
+    mrb_value nil  = mrb_nil_value();
+    mrb_value type = nil;
+    unsigned long perm = attrs->permissions;
+
+    if (attrs->flags & LIBSSH2_SFTP_ATTR_PERMISSIONS) {
+        if (LIBSSH2_SFTP_S_ISREG(perm)) {
+            type = mrb_symbol_value(SYM("file", 4));
+        } else
+        if (LIBSSH2_SFTP_S_ISDIR(perm)) {
+            type = mrb_symbol_value(SYM("directory", 9));
+        } else
+        if (LIBSSH2_SFTP_S_ISLNK(perm)) {
+            type = mrb_symbol_value(SYM("symlink", 7));
+        } else {
+            type = mrb_symbol_value(SYM("other", 5));
+        }
+    }
+
+    mrb_hash_set(mrb, stat, mrb_symbol_value(SYM("type", 4)), type);
+    mrb_hash_set(mrb, stat, mrb_symbol_value(SYM("size", 4)),
+                 attrs->flags & LIBSSH2_SFTP_ATTR_SIZE ? mrb_fixnum_value((mrb_int)attrs->filesize) : nil);
+    mrb_hash_set(mrb, stat, mrb_symbol_value(SYM("permissions", 11)),
+                 attrs->flags & LIBSSH2_SFTP_ATTR_PERMISSIONS ? mrb_fixnum_value((mrb_int)perm) : nil);
+    mrb_hash_set(mrb, stat, mrb_symbol_value(SYM("uid", 3)),
+                 attrs->flags & LIBSSH2_SFTP_ATTR_UIDGID ? mrb_fixnum_value((mrb_int)attrs->uid) : nil);
+    mrb_hash_set(mrb, stat, mrb_symbol_value(SYM("gid", 3)),
+                 attrs->flags & LIBSSH2_SFTP_ATTR_UIDGID ? mrb_fixnum_value((mrb_int)attrs->gid) : nil);
+    mrb_hash_set(mrb, stat, mrb_symbol_value(SYM("atime", 5)),
+                 attrs->flags & LIBSSH2_SFTP_ATTR_ACMODTIME ? mrb_fixnum_value((mrb_int)attrs->atime) : nil);
+    mrb_hash_set(mrb, stat, mrb_symbol_value(SYM("mtime", 5)),
+                 attrs->flags & LIBSSH2_SFTP_ATTR_ACMODTIME ? mrb_fixnum_value((mrb_int)attrs->mtime) : nil);
+
+    return stat;
+}
+
+static void
+mrb_ssh_sftp_free (mrb_state *mrb, void *p)
+{
+    mrb_ssh_sftp_t *data = (mrb_ssh_sftp_t *)p;
+    mrb_ssh_t *ssh;
+
+    if (!data) return;
+
+    if ((ssh = mrb_ssh_sftp_session(data))) {
+        while (libssh2_sftp_shutdown(data->sftp) == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+        }
+    }
+
+    mrb_free(mrb, data);
+}
+
+static void
+mrb_ssh_sftp_file_free (mrb_state *mrb, void *p)
+{
+    mrb_ssh_sftp_file_t *data = (mrb_ssh_sftp_file_t *)p;
+    mrb_ssh_t *ssh;
+
+    if (!data) return;
+
+    if (data->handle && (ssh = mrb_ssh_sftp_session(data->sftp->data))) {
+        mrb_ssh_sftp_close_handle(ssh, data->handle);
+    }
+
+    mrb_free(mrb, data);
+}
+
+static mrb_data_type const mrb_ssh_sftp_type      = { "SSH::SFTP", mrb_ssh_sftp_free };
+static mrb_data_type const mrb_ssh_sftp_file_type = { "SSH::SFTP::File", mrb_ssh_sftp_file_free };
+
+static mrb_ssh_sftp_t *
+mrb_ssh_sftp_bang (mrb_state *mrb, mrb_value self, mrb_ssh_t **ssh)
+{
+    mrb_ssh_sftp_t *data = DATA_PTR(self);
+
+    if (!(*ssh = mrb_ssh_sftp_session(data))) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SFTP session not opened.");
+    }
+
+    return data;
+}
+
+static mrb_ssh_sftp_file_t *
+mrb_ssh_sftp_file_bang (mrb_state *mrb, mrb_value self, mrb_ssh_t **ssh)
+{
+    mrb_ssh_sftp_file_t *data = DATA_PTR(self);
+
+    if (!(data && (*ssh = mrb_ssh_sftp_session(data->sftp->data)))) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SFTP file not opened.");
+    }
+
+    return data;
+}
+
+static mrb_value
+mrb_ssh_f_sftp_init (mrb_state *mrb, mrb_value self)
+{
+    mrb_value session;
+    mrb_ssh_sftp_t *data;
+    mrb_ssh_t *ssh;
+    LIBSSH2_SFTP *sftp;
+
+    mrb_get_args(mrb, "o", &session);
+
+    if (!mrb_obj_is_kind_of(mrb, session, mrb_class_get_under(mrb, mrb_module_get(mrb, "SSH"), "Session"))) {
+        mrb_raise(mrb, E_TYPE_ERROR, "expected SSH::Session");
+    }
+
+    ssh = DATA_PTR(session);
+
+    if (!(ssh && mrb_ssh_initialized())) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SSH session not connected.");
+    }
+
+    if (!libssh2_userauth_authenticated(ssh->session)) {
+        mrb_raise(mrb, E_SSH_NOT_AUTH_ERROR, "SSH session not authenticated.");
+    }
+
+    do {
+        sftp = libssh2_sftp_init(ssh->session);
+
+        if (sftp) break;
+
+        if (libssh2_session_last_errno(ssh->session) == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+        } else {
+            mrb_ssh_raise_last_error(mrb, ssh);
+        }
+    } while (!sftp);
+
+    mrb_ssh_sftp_free(mrb, DATA_PTR(self));
+
+    data          = mrb_malloc(mrb, sizeof(mrb_ssh_sftp_t));
+    data->session = mrb_ptr(session);
+    data->sftp    = sftp;
+
+    mrb_data_init(self, data, &mrb_ssh_sftp_type);
+    mrb_iv_set(mrb, self, SYM("@session", 8), session);
+
+    return self;
+}
+
+static mrb_value
+mrb_ssh_f_sftp_stat (mrb_state *mrb, mrb_value self)
+{
+    int rc;
+    const char *path;
+    mrb_int path_len;
+    mrb_bool follow = TRUE;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_t *data = mrb_ssh_sftp_bang(mrb, self, &ssh);
+
+    mrb_get_args(mrb, "s|b", &path, &path_len, &follow);
+
+    while ((rc = libssh2_sftp_stat_ex(data->sftp, path, (unsigned int)path_len, follow ? LIBSSH2_SFTP_STAT : LIBSSH2_SFTP_LSTAT, &attrs)) == LIBSSH2_ERROR_EAGAIN) {
+        mrb_ssh_wait_sock(ssh);
+    }
+
+    if (rc != 0) {
+        mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, data->sftp));
+    }
+
+    return mrb_ssh_sftp_attrs(mrb, &attrs);
+}
+
+static mrb_value
+mrb_ssh_f_sftp_readdir (mrb_state *mrb, mrb_value self)
+{
+    int rc, arena;
+    char name[512];
+    const char *path;
+    mrb_int path_len;
+    mrb_value entries, exc;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    LIBSSH2_SFTP_HANDLE *handle;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_t *data = mrb_ssh_sftp_bang(mrb, self, &ssh);
+
+    mrb_get_args(mrb, "s", &path, &path_len);
+
+    if (!(handle = mrb_ssh_sftp_open_handle(ssh, data->sftp, path, path_len, 0, 0, LIBSSH2_SFTP_OPENDIR))) {
+        mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, data->sftp));
+    }
+
+    entries = mrb_ary_new(mrb);
+    arena   = mrb_gc_arena_save(mrb);
+
+    for (;;) {
+        rc = libssh2_sftp_readdir_ex(handle, name, sizeof(name), NULL, 0, &attrs);
+
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+            continue;
+        }
+
+        if (rc <= 0) break;
+
+        mrb_ary_push(mrb, entries, mrb_str_new(mrb, name, rc));
+        mrb_gc_arena_restore(mrb, arena);
+    }
+
+    if (rc < 0) {
+        exc = mrb_ssh_sftp_exc(mrb, ssh, data->sftp);
+        mrb_ssh_sftp_close_handle(ssh, handle);
+        mrb_exc_raise(mrb, exc);
+    }
+
+    mrb_ssh_sftp_close_handle(ssh, handle);
+
+    return entries;
+}
+
+static mrb_value
+mrb_ssh_f_sftp_download (mrb_state *mrb, mrb_value self)
+{
+    ssize_t rc;
+    const char *remote, *local;
+    mrb_int remote_len, total = 0;
+    mrb_bool failed = FALSE;
+    mrb_value buf, exc = mrb_nil_value();
+    LIBSSH2_SFTP_HANDLE *handle;
+    FILE *fp;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_t *data = mrb_ssh_sftp_bang(mrb, self, &ssh);
+
+    mrb_get_args(mrb, "sz", &remote, &remote_len, &local);
+
+    buf = mrb_str_buf_new(mrb, MRB_SSH_SFTP_CHUNK);
+
+    if (!(handle = mrb_ssh_sftp_open_handle(ssh, data->sftp, remote, remote_len, LIBSSH2_FXF_READ, 0, LIBSSH2_SFTP_OPENFILE))) {
+        mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, data->sftp));
+    }
+
+    if (!(fp = fopen(local, "wb"))) {
+        mrb_ssh_sftp_close_handle(ssh, handle);
+        mrb_sys_fail(mrb, local);
+    }
+
+    for (;;) {
+        rc = libssh2_sftp_read(handle, RSTRING_PTR(buf), MRB_SSH_SFTP_CHUNK);
+
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+            continue;
+        }
+
+        if (rc < 0) {
+            exc = mrb_ssh_sftp_exc(mrb, ssh, data->sftp);
+            break;
+        }
+
+        if (rc == 0) break;
+
+        if (fwrite(RSTRING_PTR(buf), 1, (size_t)rc, fp) != (size_t)rc) {
+            failed = TRUE;
+            break;
+        }
+
+        total += rc;
+    }
+
+    mrb_ssh_sftp_close_handle(ssh, handle);
+
+    if (fclose(fp) != 0 || failed) {
+        mrb_sys_fail(mrb, local);
+    }
+
+    if (!mrb_nil_p(exc)) {
+        mrb_exc_raise(mrb, exc);
+    }
+
+    return mrb_fixnum_value(total);
+}
+
+static mrb_value
+mrb_ssh_f_sftp_upload (mrb_state *mrb, mrb_value self)
+{
+    ssize_t rc;
+    size_t len, pos;
+    const char *remote, *local;
+    mrb_int remote_len, mode = 0644, total = 0;
+    mrb_value buf, exc = mrb_nil_value();
+    LIBSSH2_SFTP_HANDLE *handle;
+    FILE *fp;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_t *data = mrb_ssh_sftp_bang(mrb, self, &ssh);
+
+    mrb_get_args(mrb, "zs|i", &local, &remote, &remote_len, &mode);
+
+    buf = mrb_str_buf_new(mrb, MRB_SSH_SFTP_CHUNK);
+
+    if (!(fp = fopen(local, "rb"))) {
+        mrb_sys_fail(mrb, local);
+    }
+
+    if (!(handle = mrb_ssh_sftp_open_handle(ssh, data->sftp, remote, remote_len, LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC, (long)mode, LIBSSH2_SFTP_OPENFILE))) {
+        fclose(fp);
+        mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, data->sftp));
+    }
+
+    while (mrb_nil_p(exc) && (len = fread(RSTRING_PTR(buf), 1, MRB_SSH_SFTP_CHUNK, fp)) > 0) {
+        for (pos = 0; pos < len;) {
+            rc = libssh2_sftp_write(handle, RSTRING_PTR(buf) + pos, len - pos);
+
+            if (rc == LIBSSH2_ERROR_EAGAIN) {
+                mrb_ssh_wait_sock(ssh);
+                continue;
+            }
+
+            if (rc < 0) {
+                exc = mrb_ssh_sftp_exc(mrb, ssh, data->sftp);
+                break;
+            }
+
+            pos += (size_t)rc;
+        }
+
+        total += (mrb_int)pos;
+    }
+
+    if (mrb_ssh_sftp_close_handle(ssh, handle) != 0 && mrb_nil_p(exc)) {
+        exc = mrb_ssh_sftp_exc(mrb, ssh, data->sftp);
+    }
+
+    if (ferror(fp)) {
+        fclose(fp);
+        mrb_sys_fail(mrb, local);
+    }
+
+    fclose(fp);
+
+    if (!mrb_nil_p(exc)) {
+        mrb_exc_raise(mrb, exc);
+    }
+
+    return mrb_fixnum_value(total);
+}
+
+static mrb_value
+mrb_ssh_f_sftp_close (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_sftp_free(mrb, DATA_PTR(self));
+
+    DATA_PTR(self)  = NULL;
+    DATA_TYPE(self) = NULL;
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_sftp_closed (mrb_state *mrb, mrb_value self)
+{
+    return mrb_bool_value(mrb_ssh_sftp_session(DATA_PTR(self)) ? FALSE : TRUE);
+}
+
+static mrb_value
+mrb_ssh_f_file_init (mrb_state *mrb, mrb_value self)
+{
+    const char *path;
+    mrb_int path_len, flags = LIBSSH2_FXF_READ, mode = 0644;
+    mrb_value sftp;
+    mrb_ssh_sftp_file_t *data;
+    mrb_ssh_sftp_t *sftp_data;
+    LIBSSH2_SFTP_HANDLE *handle;
+    mrb_ssh_t *ssh;
+
+    mrb_get_args(mrb, "os|ii", &sftp, &path, &path_len, &flags, &mode);
+
+    sftp_data = mrb_data_check_get_ptr(mrb, sftp, &mrb_ssh_sftp_type);
+
+    if (!(ssh = mrb_ssh_sftp_session(sftp_data))) {
+        mrb_raise(mrb, E_SSH_NOT_CONNECTED_ERROR, "SFTP session not opened.");
+    }
+
+    if (!(handle = mrb_ssh_sftp_open_handle(ssh, sftp_data->sftp, path, path_len, (unsigned long)flags, (long)mode, LIBSSH2_SFTP_OPENFILE))) {
+        mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, sftp_data->sftp));
+    }
+
+    mrb_ssh_sftp_file_free(mrb, DATA_PTR(self));
+
+    data         = mrb_malloc(mrb, sizeof(mrb_ssh_sftp_file_t));
+    data->sftp   = mrb_ptr(sftp);
+    data->handle = handle;
+
+    mrb_data_init(self, data, &mrb_ssh_sftp_file_type);
+    mrb_iv_set(mrb, self, SYM("@sftp", 5), sftp);
+    mrb_iv_set(mrb, self, SYM("@path", 5), mrb_str_new(mrb, path, path_len));
+
+    return self;
+}
+
+static mrb_value
+mrb_ssh_f_file_read (mrb_state *mrb, mrb_value self)
+{
+    ssize_t rc;
+    mrb_int len = -1, pos = 0, size;
+    mrb_value buf;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_file_t *data = mrb_ssh_sftp_file_bang(mrb, self, &ssh);
+
+    mrb_get_args(mrb, "|i", &len);
+
+    buf = mrb_str_buf_new(mrb, len < 0 ? MRB_SSH_SFTP_CHUNK : (size_t)len);
+
+    while ((size = len < 0 ? MRB_SSH_SFTP_CHUNK : len - pos) > 0) {
+        mrb_str_resize(mrb, buf, pos + size);
+
+        rc = libssh2_sftp_read(data->handle, RSTRING_PTR(buf) + pos, (size_t)size);
+
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+            continue;
+        }
+
+        if (rc < 0) {
+            mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, ((mrb_ssh_sftp_t *)data->sftp->data)->sftp));
+        }
+
+        if (rc == 0) break;
+
+        pos += rc;
+    }
+
+    mrb_str_resize(mrb, buf, pos);
+
+    return len > 0 && pos == 0 ? mrb_nil_value() : buf;
+}
+
+static mrb_value
+mrb_ssh_f_file_write (mrb_state *mrb, mrb_value self)
+{
+    ssize_t rc;
+    const char *str;
+    mrb_int len, pos = 0;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_file_t *data = mrb_ssh_sftp_file_bang(mrb, self, &ssh);
+
+    mrb_get_args(mrb, "s", &str, &len);
+
+    while (pos < len) {
+        rc = libssh2_sftp_write(data->handle, str + pos, (size_t)(len - pos));
+
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+            continue;
+        }
+
+        if (rc < 0) {
+            mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, ((mrb_ssh_sftp_t *)data->sftp->data)->sftp));
+        }
+
+        pos += rc;
+    }
+
+    return mrb_fixnum_value(len);
+}
+
+static mrb_value
+mrb_ssh_f_file_stat (mrb_state *mrb, mrb_value self)
+{
+    int rc;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_file_t *data = mrb_ssh_sftp_file_bang(mrb, self, &ssh);
+
+    while ((rc = libssh2_sftp_fstat_ex(data->handle, &attrs, 0)) == LIBSSH2_ERROR_EAGAIN) {
+        mrb_ssh_wait_sock(ssh);
+    }
+
+    if (rc != 0) {
+        mrb_exc_raise(mrb, mrb_ssh_sftp_exc(mrb, ssh, ((mrb_ssh_sftp_t *)data->sftp->data)->sftp));
+    }
+
+    return mrb_ssh_sftp_attrs(mrb, &attrs);
+}
+
+static mrb_value
+mrb_ssh_f_file_seek (mrb_state *mrb, mrb_value self)
+{
+    mrb_int pos;
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_file_t *data = mrb_ssh_sftp_file_bang(mrb, self, &ssh);
+
+    mrb_get_args(mrb, "i", &pos);
+
+    if (pos < 0) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "negative offset");
+    }
+
+    libssh2_sftp_seek64(data->handle, (libssh2_uint64_t)pos);
+
+    return mrb_fixnum_value(0);
+}
+
+static mrb_value
+mrb_ssh_f_file_tell (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh;
+    mrb_ssh_sftp_file_t *data = mrb_ssh_sftp_file_bang(mrb, self, &ssh);
+
+    return mrb_fixnum_value((mrb_int)libssh2_sftp_tell64(data->handle));
+}
+
+static mrb_value
+mrb_ssh_f_file_close (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_sftp_file_free(mrb, DATA_PTR(self));
+
+    DATA_PTR(self)  = NULL;
+    DATA_TYPE(self) = NULL;
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_file_closed (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_sftp_file_t *data = DATA_PTR(self);
+
+    if (!data) return mrb_true_value();
+
+    return mrb_bool_value(mrb_ssh_sftp_session(data->sftp->data) ? FALSE : TRUE);
+}
+
+void
+mrb_mruby_ssh_sftp_init (mrb_state *mrb)
+{
+    struct RClass *ssh, *cls, *file;
+
+    ssh  = mrb_module_get(mrb, "SSH");
+    cls  = mrb_define_class_under(mrb, ssh, "SFTP", mrb->object_class);
+    file = mrb_define_class_under(mrb, cls, "File", mrb->object_class);
+
+    MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+    MRB_SET_INSTANCE_TT(file, MRB_TT_DATA);
+
+    mrb_define_method(mrb, cls, "initialize", mrb_ssh_f_sftp_init,    MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "stat",       mrb_ssh_f_sftp_stat,    MRB_ARGS_ARG(1,1));
+    mrb_define_method(mrb, cls, "readdir",    mrb_ssh_f_sftp_readdir, MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "download",   mrb_ssh_f_sftp_download,MRB_ARGS_REQ(2));
+    mrb_define_method(mrb, cls, "upload",     mrb_ssh_f_sftp_upload,  MRB_ARGS_ARG(2,1));
+    mrb_define_method(mrb, cls, "close",      mrb_ssh_f_sftp_close,   MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "closed?",    mrb_ssh_f_sftp_closed,  MRB_ARGS_NONE());
+
+    mrb_define_method(mrb, file, "initialize", mrb_ssh_f_file_init,   MRB_ARGS_ARG(2,2));
+    mrb_define_method(mrb, file, "read",       mrb_ssh_f_file_read,   MRB_ARGS_OPT(1));
+    mrb_define_method(mrb, file, "write",      mrb_ssh_f_file_write,  MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, file, "stat",       mrb_ssh_f_file_stat,   MRB_ARGS_NONE());
+    mrb_define_method(mrb, file, "seek",       mrb_ssh_f_file_seek,   MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, file, "tell",       mrb_ssh_f_file_tell,   MRB_ARGS_NONE());
+    mrb_define_method(mrb, file, "close",      mrb_ssh_f_file_close,  MRB_ARGS_NONE());
+    mrb_define_method(mrb, file, "closed?",    mrb_ssh_f_file_closed, MRB_ARGS_NONE());
+
+    mrb_define_const(mrb, cls, "CHUNK_SIZE", mrb_fixnum_value(MRB_SSH_SFTP_CHUNK));
+    mrb_define_const(mrb, cls, "READ",       mrb_fixnum_value(LIBSSH2_FXF_READ));
+    mrb_define_const(mrb, cls, "WRITE",      mrb_fixnum_value(LIBSSH2_FXF_WRITE));
+    mrb_define_const(mrb, cls, "APPEND",     mrb_fixnum_value(LIBSSH2_FXF_APPEND));
+    mrb_define_const(mrb, cls, "CREAT",      mrb_fixnum_value(LIBSSH2_FXF_CREAT));
+    mrb_define_const(mrb, cls, "TRUNC",      mrb_fixnum_value(LIBSSH2_FXF_TRUNC));
+    mrb_define_const(mrb, cls, "EXCL",       mrb_fixnum_value(LIBSSH2_FXF_EXCL));
+}
+
+#endif
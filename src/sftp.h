@@ -0,0 +1,50 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MRB_SSH_TINY
+
+#include "mruby.h"
+#include "mruby/ext/ssh.h"
+
+#include <libssh2.h>
+#include <libssh2_sftp.h>
+
+MRB_BEGIN_DECL
+
+typedef struct mrb_ssh_sftp
+{
+    struct RData *session;
+    LIBSSH2_SFTP *sftp;
+} mrb_ssh_sftp_t;
+
+typedef struct mrb_ssh_sftp_file
+{
+    struct RData *sftp;
+    LIBSSH2_SFTP_HANDLE *handle;
+} mrb_ssh_sftp_file_t;
+
+void mrb_mruby_ssh_sftp_init (mrb_state *mrb);
+
+MRB_END_DECL
+
+#endif
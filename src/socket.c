@@ -0,0 +1,324 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "socket.h"
+#include "dns.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <libssh2.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <windows.h>
+# include <ws2tcpip.h>
+# define poll(fds, nfds, timeout) WSAPoll(fds, nfds, timeout)
+#else
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netdb.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <time.h>
+# include <unistd.h>
+#endif
+
+int64_t
+mrb_ssh_now (void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+
+    QueryPerformanceCounter(&now);
+
+    return (int64_t)(now.QuadPart * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+int
+mrb_ssh_resolve (const char *host, int port, int family, struct sockaddr_storage *addr, socklen_t *len)
+{
+    mrb_ssh_addrs_t addrs;
+
+    if (mrb_ssh_dns_lookup(host, family, &addrs) != 0)
+        return -1;
+
+    mrb_ssh_dns_set_port(&addrs, port);
+
+    memcpy(addr, &addrs.addr[0], addrs.len[0]);
+    *len = addrs.len[0];
+
+    return 0;
+}
+
+int
+mrb_ssh_socket_nonblock (libssh2_socket_t sock, int nonblock)
+{
+#ifdef _WIN32
+    u_long mode = nonblock ? 1 : 0;
+
+    return ioctlsocket(sock, FIONBIO, &mode) == 0 ? 0 : -1;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+
+    if (flags == -1) return -1;
+
+    flags = nonblock ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+
+    return fcntl(sock, F_SETFL, flags);
+#endif
+}
+
+static inline int
+mrb_ssh_socket_in_progress (void)
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+int
+mrb_ssh_socket_connect (const struct sockaddr *addr, socklen_t len, libssh2_socket_t *ptr)
+{
+    libssh2_socket_t sock = socket(addr->sa_family, SOCK_STREAM, 0);
+
+    if (sock == LIBSSH2_INVALID_SOCKET)
+        return -1;
+
+    if (mrb_ssh_socket_nonblock(sock, 1) != 0) {
+        mrb_ssh_close_socket(sock);
+        return -1;
+    }
+
+    *ptr = sock;
+
+    if (connect(sock, addr, len) == 0)
+        return 0;
+
+    if (mrb_ssh_socket_in_progress())
+        return MRB_SSH_CONNECT_PENDING;
+
+    mrb_ssh_close_socket(sock);
+    *ptr = LIBSSH2_INVALID_SOCKET;
+
+    return -1;
+}
+
+static inline int
+mrb_ssh_socket_would_block (void)
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static int
+mrb_ssh_interleave (const mrb_ssh_addrs_t *addrs, int *order)
+{
+    int family = addrs->addr[0].ss_family, a = 0, b = 0, n = 0;
+
+    while (n < addrs->count) {
+        while (a < addrs->count && addrs->addr[a].ss_family != family) a++;
+
+        if (a < addrs->count) order[n++] = a++;
+
+        while (b < addrs->count && addrs->addr[b].ss_family == family) b++;
+
+        if (b < addrs->count) order[n++] = b++;
+    }
+
+    return n;
+}
+
+static inline int
+mrb_ssh_poll_remaining (int64_t now, int64_t until)
+{
+    if (until <= now) return 0;
+
+    return (int)((until - now + 999) / 1000);
+}
+
+/* Connects to the first address of the host that answers. Attempts are
+   started MRB_SSH_CONNECT_DELAY ms apart with alternating address families
+   and race each other, as described by RFC 8305 (Happy Eyeballs). */
+int
+mrb_ssh_socket_open (const char *host, int port, int timeout, libssh2_socket_t *ptr)
+{
+    mrb_ssh_addrs_t addrs;
+    int order[MRB_SSH_DNS_MAX_ADDRS];
+    struct pollfd fds[MRB_SSH_DNS_MAX_ADDRS];
+    libssh2_socket_t sock, winner = LIBSSH2_INVALID_SOCKET;
+    int64_t now, next_at, deadline, until;
+    int n, i, rc, next = 0, pending = 0, timedout = 0;
+
+    if (mrb_ssh_dns_lookup(host, AF_UNSPEC, &addrs) != 0)
+        return -1;
+
+    mrb_ssh_dns_set_port(&addrs, port);
+
+    n        = mrb_ssh_interleave(&addrs, order);
+    now      = mrb_ssh_now();
+    next_at  = now;
+    deadline = timeout > 0 ? now + (int64_t)timeout * 1000 : 0;
+
+    for (;;) {
+        now = mrb_ssh_now();
+
+        if (next < n && (pending == 0 || now >= next_at)) {
+            rc = mrb_ssh_socket_connect((struct sockaddr *)&addrs.addr[order[next]], addrs.len[order[next]], &sock);
+            next++;
+
+            if (rc == 0) {
+                winner = sock;
+                break;
+            }
+
+            if (rc == MRB_SSH_CONNECT_PENDING) {
+                fds[pending].fd      = sock;
+                fds[pending].events  = POLLOUT;
+                fds[pending].revents = 0;
+                pending++;
+                next_at = now + MRB_SSH_CONNECT_DELAY * 1000;
+            }
+
+            continue;
+        }
+
+        if (pending == 0) break;
+
+        if (deadline && now >= deadline) {
+            timedout = 1;
+            break;
+        }
+
+        until = next < n ? next_at : deadline;
+        until = deadline && deadline < until ? deadline : until;
+        rc    = poll(fds, pending, until ? mrb_ssh_poll_remaining(now, until) : -1);
+
+        if (rc < 0 && !mrb_ssh_socket_would_block()) break;
+        if (rc <= 0) continue;
+
+        for (i = pending - 1; i >= 0; i--) {
+            if (fds[i].revents == 0) continue;
+
+            if ((fds[i].revents & POLLOUT) && mrb_ssh_socket_error(fds[i].fd) == 0) {
+                winner = fds[i].fd;
+                fds[i] = fds[--pending];
+                break;
+            }
+
+            mrb_ssh_close_socket(fds[i].fd);
+            fds[i]  = fds[--pending];
+            next_at = now;
+        }
+
+        if (winner != LIBSSH2_INVALID_SOCKET) break;
+    }
+
+    for (i = 0; i < pending; i++) {
+        mrb_ssh_close_socket(fds[i].fd);
+    }
+
+    if (winner == LIBSSH2_INVALID_SOCKET)
+        return timedout ? MRB_SSH_CONNECT_TIMEDOUT : -1;
+
+    mrb_ssh_socket_nonblock(winner, 0);
+    *ptr = winner;
+
+    return 0;
+}
+
+int
+mrb_ssh_socket_error (libssh2_socket_t sock)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&err, &len) != 0)
+        return -1;
+
+    return err;
+}
+
+int
+mrb_ssh_socket_writable (libssh2_socket_t sock)
+{
+    struct pollfd fd;
+
+    fd.fd      = sock;
+    fd.events  = POLLOUT;
+    fd.revents = 0;
+
+    return poll(&fd, 1, 0);
+}
+
+int
+mrb_ssh_socket_alive (libssh2_socket_t sock)
+{
+    struct pollfd fd;
+    char c;
+    int rc;
+
+    fd.fd      = sock;
+    fd.events  = POLLIN;
+    fd.revents = 0;
+
+    if ((rc = poll(&fd, 1, 0)) == 0)
+        return 1;
+
+    if (rc < 0 || (fd.revents & (POLLERR|POLLNVAL)))
+        return 0;
+
+    rc = (int)recv(sock, &c, 1, MSG_PEEK);
+
+    if (rc > 0)
+        return 1;
+
+    return rc < 0 && mrb_ssh_socket_would_block();
+}
+
+void
+mrb_ssh_close_socket (libssh2_socket_t sock)
+{
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
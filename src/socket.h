@@ -0,0 +1,60 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifdef _WIN32
+# define _WIN32_WINNT _WIN32_WINNT_VISTA
+#endif
+
+#include "mruby.h"
+
+#include <stdint.h>
+#include <libssh2.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#else
+# include <sys/socket.h>
+#endif
+
+MRB_BEGIN_DECL
+
+#define MRB_SSH_CONNECT_PENDING   1
+#define MRB_SSH_CONNECT_TIMEDOUT -2
+
+#ifndef MRB_SSH_CONNECT_DELAY
+# define MRB_SSH_CONNECT_DELAY 250
+#endif
+
+int64_t mrb_ssh_now (void);
+
+int  mrb_ssh_resolve (const char *host, int port, int family, struct sockaddr_storage *addr, socklen_t *len);
+int  mrb_ssh_socket_nonblock (libssh2_socket_t sock, int nonblock);
+int  mrb_ssh_socket_connect (const struct sockaddr *addr, socklen_t len, libssh2_socket_t *ptr);
+int  mrb_ssh_socket_open (const char *host, int port, int timeout, libssh2_socket_t *ptr);
+int  mrb_ssh_socket_error (libssh2_socket_t sock);
+int  mrb_ssh_socket_writable (libssh2_socket_t sock);
+int  mrb_ssh_socket_alive (libssh2_socket_t sock);
+void mrb_ssh_close_socket (libssh2_socket_t sock);
+
+MRB_END_DECL
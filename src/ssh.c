@@ -27,10 +27,22 @@
 #endif
 
 #include "session.h"
+#include "agent.h"
+#include "socket.h"
+#include "dns.h"
+#include "knownhosts.h"
+#include "keycache.h"
+#include "poller.h"
+#include "alloc.h"
 
 #ifndef MRB_SSH_TINY
 # include "channel.h"
 # include "stream.h"
+# include "exec.h"
+# include "sftp.h"
+# include "scp.h"
+# include "parallel.h"
+# include "forward.h"
 #endif
 
 #include "mruby.h"
@@ -88,6 +100,18 @@ mrb_ssh_f_ready (mrb_state *mrb, mrb_value self)
     return mrb_bool_value(mrb_ssh_ready);
 }
 
+static mrb_value
+mrb_ssh_f_clock (mrb_state *mrb, mrb_value self)
+{
+    return mrb_float_value(mrb, (mrb_float)mrb_ssh_now() / 1000000);
+}
+
+static mrb_value
+mrb_ssh_f_memory_usage (mrb_state *mrb, mrb_value self)
+{
+    return mrb_fixnum_value((mrb_int)mrb_ssh_pool_usage());
+}
+
 inline unsigned int
 mrb_ssh_initialized()
 {
@@ -105,15 +129,13 @@ mrb_ssh_raise_last_error (mrb_state *mrb, mrb_ssh_t *ssh)
     mrb_ssh_raise(mrb, err, msg);
 }
 
-void
-mrb_ssh_raise (mrb_state *mrb, int err, const char* msg)
+mrb_value
+mrb_ssh_exc_new (mrb_state *mrb, int err, const char* msg)
 {
     struct RClass *c;
     mrb_value exc;
 
     switch (err) {
-    case LIBSSH2_ERROR_NONE:
-        return;
     case LIBSSH2_ERROR_KEY_EXCHANGE_FAILURE:
         c = E_SSH_HOST_KEY_ERROR; break;
     case LIBSSH2_ERROR_SOCKET_TIMEOUT:
@@ -132,7 +154,15 @@ mrb_ssh_raise (mrb_state *mrb, int err, const char* msg)
     exc = mrb_exc_new_str(mrb, c, mrb_str_new_cstr(mrb, msg));
     mrb_iv_set(mrb, exc, mrb_intern_static(mrb, "@errno", 6), mrb_fixnum_value(err));
 
-    mrb_exc_raise(mrb, exc);
+    return exc;
+}
+
+void
+mrb_ssh_raise (mrb_state *mrb, int err, const char* msg)
+{
+    if (err == LIBSSH2_ERROR_NONE) return;
+
+    mrb_exc_raise(mrb, mrb_ssh_exc_new(mrb, err, msg));
 }
 
 void
@@ -143,12 +173,24 @@ mrb_mruby_ssh_gem_init (mrb_state *mrb)
     mrb_define_class_method(mrb, ssh, "startup",  mrb_ssh_f_startup,  MRB_ARGS_NONE());
     mrb_define_class_method(mrb, ssh, "shutdown", mrb_ssh_f_shutdown, MRB_ARGS_NONE());
     mrb_define_class_method(mrb, ssh, "ready?",   mrb_ssh_f_ready,    MRB_ARGS_NONE());
+    mrb_define_class_method(mrb, ssh, "clock",    mrb_ssh_f_clock,    MRB_ARGS_NONE());
+    mrb_define_class_method(mrb, ssh, "memory_usage", mrb_ssh_f_memory_usage, MRB_ARGS_NONE());
 
     mrb_mruby_ssh_session_init(mrb);
+    mrb_mruby_ssh_poller_init(mrb);
+    mrb_mruby_ssh_dns_init(mrb);
+    mrb_mruby_ssh_knownhosts_init(mrb);
+    mrb_mruby_ssh_agent_init(mrb);
+    mrb_mruby_ssh_keycache_init(mrb);
 
 #ifndef MRB_SSH_TINY
     mrb_mruby_ssh_channel_init(mrb);
     mrb_mruby_ssh_stream_init(mrb);
+    mrb_mruby_ssh_exec_init(mrb);
+    mrb_mruby_ssh_sftp_init(mrb);
+    mrb_mruby_ssh_scp_init(mrb);
+    mrb_mruby_ssh_parallel_init(mrb);
+    mrb_mruby_ssh_forward_init(mrb);
 #endif
 
     if (mrb_main_p == 0) {
@@ -163,6 +205,10 @@ mrb_mruby_ssh_gem_final (mrb_state *mrb)
 {
     if (mrb_main_p == (size_t) mrb) {
         mrb_ssh_f_shutdown(mrb, mrb_nil_value());
+        mrb_ssh_dns_clear();
+        mrb_ssh_knownhosts_clear();
+        mrb_ssh_agent_clear();
+        mrb_ssh_keycache_clear();
         mrb_main_p = 0;
     }
 }
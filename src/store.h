@@ -0,0 +1,50 @@
+/* MIT License
+ *
+ * Copyright (c) Sebastian Katzer 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Shared by the process-wide stores (DNS cache, known hosts, agent and key
+   cache), which outlive any mrb_state and may be used by several threads. */
+
+#ifdef _WIN32
+# include <windows.h>
+# define MRB_SSH_MUTEX(name)        static SRWLOCK name = SRWLOCK_INIT
+# define mrb_ssh_mutex_lock(name)   AcquireSRWLockExclusive(&(name))
+# define mrb_ssh_mutex_unlock(name) ReleaseSRWLockExclusive(&(name))
+#else
+# include <pthread.h>
+# define MRB_SSH_MUTEX(name)        static pthread_mutex_t name = PTHREAD_MUTEX_INITIALIZER
+# define mrb_ssh_mutex_lock(name)   pthread_mutex_lock(&(name))
+# define mrb_ssh_mutex_unlock(name) pthread_mutex_unlock(&(name))
+#endif
+
+/* djb2, the callers reduce it to their number of buckets. */
+static inline unsigned int
+mrb_ssh_str_hash (const char *str)
+{
+    unsigned int hash = 5381;
+
+    while (*str) {
+        hash = hash * 33 + (unsigned char)*str++;
+    }
+
+    return hash;
+}
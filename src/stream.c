@@ -25,6 +25,8 @@
 
 #include "stream.h"
 #include "channel.h"
+#include "poller.h"
+#include "socket.h"
 
 #include "mruby.h"
 #include "mruby/data.h"
@@ -34,43 +36,280 @@
 #include "mruby/variable.h"
 #include "mruby/ext/ssh.h"
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <libssh2.h>
 
 #define SYM(name, len) mrb_intern_static(mrb, name, len)
 
-#if MRUBY_RELEASE_NO < 10400
-static inline mrb_int
-mrb_str_index(mrb_state *mrb, mrb_value str, const char *lit, mrb_int len, mrb_int off)
+static int MAX_READ_SIZE = 0x4000;
+
+/* Buffers grown past this size by a large read are released once drained */
+static size_t MAX_KEEP_SIZE = 0x10000;
+
+static int mrb_ssh_stream_flush_out (mrb_ssh_t *ssh, mrb_ssh_channel_t *data, mrb_ssh_stream_t *stream, mrb_bool nonblock);
+
+/* Sends as much buffered output as the socket takes without waiting, also
+   on a blocking session. */
+static int
+mrb_ssh_stream_flush_nonblock (mrb_ssh_t *ssh, mrb_ssh_channel_t *data, mrb_ssh_stream_t *stream)
 {
-    mrb_value pos = mrb_funcall(mrb, str, "index", 2, mrb_str_new_static(mrb, lit, len), mrb_fixnum_value(off));
-    return mrb_nil_p(pos) ? -1 : mrb_fixnum(pos);
+    int blocking = libssh2_session_get_blocking(ssh->session), rc;
+
+    libssh2_session_set_blocking(ssh->session, 0);
+    rc = mrb_ssh_stream_flush_out(ssh, data, stream, TRUE);
+    libssh2_session_set_blocking(ssh->session, blocking);
+
+    return rc;
 }
-#endif
 
-static int MAX_READ_SIZE = 0x4000;
+/* Unlinks the stream from its channel. Buffered output gets one more try
+   first, the same best effort a garbage collected channel gets for its close
+   message. What the socket does not take right away is dropped. */
+static void
+mrb_ssh_stream_release (mrb_ssh_stream_t *stream, mrb_ssh_t *ssh)
+{
+    mrb_ssh_channel_t *data = stream->data;
+    mrb_ssh_stream_t **link;
+
+    if (!data) return;
+
+    if (stream->out_off < stream->out_len && data->channel && ssh && mrb_ssh_initialized()) {
+        mrb_ssh_stream_flush_nonblock(ssh, data, stream);
+    }
+
+    stream->out_len = 0;
+    stream->out_off = 0;
+
+    for (link = &data->streams; *link; link = &(*link)->next) {
+        if (*link == stream) {
+            *link = stream->next;
+            break;
+        }
+    }
+
+    stream->data = NULL;
+    stream->next = NULL;
+}
+
+void
+mrb_ssh_stream_release_all (mrb_ssh_channel_t *data, mrb_ssh_t *ssh)
+{
+    while (data->streams) {
+        mrb_ssh_stream_release(data->streams, ssh);
+    }
+}
+
+static void
+mrb_ssh_stream_free (mrb_state *mrb, void *p)
+{
+    mrb_ssh_stream_t *stream = (mrb_ssh_stream_t *)p;
+
+    if (!stream) return;
+
+    mrb_ssh_stream_release(stream, stream->data ? stream->data->session->data : NULL);
+
+    mrb_free(mrb, stream->buf);
+    mrb_free(mrb, stream->out);
+    mrb_free(mrb, stream);
+}
+
+static mrb_data_type const mrb_ssh_stream_type = { "SSH::Stream", mrb_ssh_stream_free };
+
+static mrb_ssh_stream_t *
+mrb_ssh_stream_bang (mrb_state *mrb, mrb_value self, mrb_ssh_t **ssh, mrb_ssh_channel_t **channel)
+{
+    mrb_ssh_stream_t *stream = DATA_PTR(self);
+    mrb_value obj;
 
-static inline int
-mrb_ssh_stream_id (mrb_state *mrb, mrb_value self)
+    if (!stream) {
+        mrb_raise(mrb, E_SSH_CHANNEL_CLOSED_ERROR, "SSH channel not opened.");
+    }
+
+    obj      = mrb_obj_value(stream->channel);
+    *ssh     = mrb_ssh_session(mrb, obj);
+    *channel = mrb_ssh_channel_bang(mrb, obj);
+
+    return stream;
+}
+
+static char *
+mrb_ssh_stream_reserve (mrb_state *mrb, mrb_ssh_stream_t *stream, size_t size)
 {
-    return (int) mrb_fixnum(mrb_attr_get(mrb, self, SYM("@id", 3)));
+    size_t capa = stream->capa ? stream->capa : (size_t)MAX_READ_SIZE;
+
+    if (stream->capa - stream->head - stream->len >= size)
+        return stream->buf + stream->head + stream->len;
+
+    if (size > SIZE_MAX / 2 - stream->len) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "length too big");
+    }
+
+    if (stream->head > 0) {
+        memmove(stream->buf, stream->buf + stream->head, stream->len);
+        stream->head = 0;
+    }
+
+    while (capa - stream->len < size) {
+        capa *= 2;
+    }
+
+    if (capa != stream->capa) {
+        stream->buf  = mrb_realloc(mrb, stream->buf, capa);
+        stream->capa = capa;
+    }
+
+    return stream->buf + stream->len;
+}
+
+static mrb_value
+mrb_ssh_stream_shift (mrb_state *mrb, mrb_ssh_stream_t *stream, size_t len)
+{
+    mrb_value str = mrb_str_new(mrb, stream->buf + stream->head, (mrb_int)len);
+
+    stream->head += len;
+    stream->len  -= len;
+
+    if (stream->len > 0) return str;
+
+    stream->head = 0;
+
+    if (stream->capa > MAX_KEEP_SIZE) {
+        mrb_free(mrb, stream->buf);
+        stream->buf  = NULL;
+        stream->capa = 0;
+    }
+
+    return str;
+}
+
+static const char *
+mrb_ssh_stream_search (const char *buf, size_t len, const char *sep, size_t sep_len)
+{
+    const char *ptr = buf, *end = buf + len;
+
+    if (len < sep_len)
+        return NULL;
+
+    if (sep_len == 1)
+        return memchr(buf, sep[0], len);
+
+    while (end - ptr >= (ptrdiff_t)sep_len && (ptr = memchr(ptr, sep[0], end - ptr - sep_len + 1))) {
+        if (memcmp(ptr, sep, sep_len) == 0) return ptr;
+        ptr++;
+    }
+
+    return NULL;
+}
+
+static int
+mrb_ssh_stream_flush_out (mrb_ssh_t *ssh, mrb_ssh_channel_t *data, mrb_ssh_stream_t *stream, mrb_bool nonblock)
+{
+    ssize_t rc;
+
+    while (stream->out_off < stream->out_len) {
+        rc = libssh2_channel_write_ex(data->channel, stream->id, stream->out + stream->out_off, stream->out_len - stream->out_off);
+
+        if (rc == LIBSSH2_ERROR_EAGAIN && nonblock)
+            return (int)rc;
+
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+            continue;
+        }
+
+        if (rc < 0)
+            return (int)rc;
+
+        stream->out_off        += (size_t)rc;
+        data->stats.bytes_sent += (uint64_t)rc;
+    }
+
+    stream->out_len = 0;
+    stream->out_off = 0;
+
+    return 0;
+}
+
+static void
+mrb_ssh_stream_flush_bang (mrb_state *mrb, mrb_ssh_t *ssh, mrb_ssh_channel_t *data, mrb_ssh_stream_t *stream)
+{
+    if (mrb_ssh_stream_flush_out(ssh, data, stream, FALSE) != 0) {
+        mrb_ssh_raise_last_error(mrb, ssh);
+    }
+}
+
+/* Buffered output older than flush_interval is due to be sent. */
+static mrb_bool
+mrb_ssh_stream_due (mrb_ssh_stream_t *stream)
+{
+    return stream->out_len > 0 && stream->interval > 0 && mrb_ssh_now() - stream->out_since >= (int64_t)stream->interval * 1000;
+}
+
+static void
+mrb_ssh_stream_buffer (mrb_state *mrb, mrb_ssh_t *ssh, mrb_ssh_channel_t *data, mrb_ssh_stream_t *stream, const char *ptr, size_t len)
+{
+    size_t size;
+
+    if (mrb_ssh_stream_due(stream)) {
+        mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+    }
+
+    if (!stream->out) {
+        stream->out      = mrb_malloc(mrb, stream->out_size);
+        stream->out_capa = stream->out_size;
+    }
+
+    while (len > 0) {
+        if (stream->out_len == 0) {
+            stream->out_since = mrb_ssh_now();
+        }
+
+        size = stream->out_capa - stream->out_len;
+        size = size < len ? size : len;
+
+        memcpy(stream->out + stream->out_len, ptr, size);
+
+        stream->out_len += size;
+        ptr             += size;
+        len             -= size;
+
+        if (stream->out_len == stream->out_capa) {
+            mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+        }
+    }
 }
 
 static mrb_value
 mrb_ssh_f_init (mrb_state *mrb, mrb_value self)
 {
     mrb_value channel;
-    mrb_int stream = 0;
+    mrb_int id = 0;
+    mrb_ssh_stream_t *stream;
 
-    mrb_get_args(mrb, "o|i", &channel, &stream);
+    mrb_get_args(mrb, "o|i", &channel, &id);
 
     if (DATA_PTR(channel) == NULL) {
         mrb_raise(mrb, E_SSH_ERROR, "Channel not opened.");
     }
 
-    mrb_iv_set(mrb, self, SYM("@id", 3), mrb_fixnum_value(stream));
+    mrb_iv_set(mrb, self, SYM("@id", 3), mrb_fixnum_value(id));
     mrb_iv_set(mrb, self, SYM("@channel", 8), channel);
 
-    DATA_PTR(self) = DATA_PTR(channel);
+    mrb_ssh_stream_free(mrb, DATA_PTR(self));
+
+    stream          = mrb_calloc(mrb, 1, sizeof(mrb_ssh_stream_t));
+    stream->channel  = mrb_ptr(channel);
+    stream->data     = DATA_PTR(channel);
+    stream->next     = stream->data->streams;
+    stream->id       = (int)id;
+    stream->sync     = TRUE;
+    stream->out_size = LIBSSH2_CHANNEL_PACKET_DEFAULT;
+
+    stream->data->streams = stream;
+
+    mrb_data_init(self, stream, &mrb_ssh_stream_type);
 
     return mrb_nil_value();
 }
@@ -79,22 +318,25 @@ static mrb_value
 mrb_ssh_f_gets (mrb_state *mrb, mrb_value self)
 {
     ssize_t rc;
-    int stream              = mrb_ssh_stream_id(mrb, self);
-    mrb_ssh_t *ssh          = mrb_ssh_session(mrb, self);
-    mrb_ssh_channel_t *data = mrb_ssh_channel_bang(mrb, self);
-    mrb_value buf           = mrb_attr_get(mrb, self, SYM("buf", 3));
-    mrb_bool arg_given      = FALSE;
-    mrb_bool opts_given     = FALSE;
-    mrb_bool mem_size_given = FALSE;
-    size_t mem_size         = 256;
-    mrb_int pos, sep_len    = 0;
-    int chomp               = FALSE;
-    const char *sep         = NULL;
-    char *mem               = NULL;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+    mrb_bool arg_given       = FALSE;
+    mrb_bool opts_given      = FALSE;
+    mrb_bool mem_size_given  = FALSE;
+    size_t mem_size          = MAX_READ_SIZE;
+    size_t scanned           = 0;
+    mrb_int sep_len          = 0;
+    int chomp                = FALSE;
+    const char *sep          = NULL;
+    const char *hit          = NULL;
+    char *mem;
     mrb_value arg, opts, res;
 
     mrb_get_args(mrb, "|o?H!?", &arg, &arg_given, &opts, &opts_given);
 
+    mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+
     if (opts_given && mrb_hash_p(opts)) {
         chomp = mrb_type(mrb_hash_get(mrb, opts, mrb_symbol_value(SYM("chomp", 5)))) == MRB_TT_TRUE;
     }
@@ -109,7 +351,11 @@ mrb_ssh_f_gets (mrb_state *mrb, mrb_value self)
         chomp   = mrb_type(mrb_hash_get(mrb, arg, mrb_symbol_value(SYM("chomp", 5)))) == MRB_TT_TRUE;
     } else
     if (arg_given && mrb_fixnum_p(arg)) {
-        mem_size       = (int)mrb_fixnum(arg);
+        if (mrb_fixnum(arg) < 0) {
+            mrb_raise(mrb, E_ARGUMENT_ERROR, "negative length");
+        }
+
+        mem_size       = (size_t)mrb_fixnum(arg);
         mem_size_given = TRUE;
     } else
     if (arg_given && mrb_nil_p(arg)) {
@@ -122,69 +368,56 @@ mrb_ssh_f_gets (mrb_state *mrb, mrb_value self)
         mrb_raise(mrb, E_TYPE_ERROR, "String or Fixnum expected.");
     }
 
-    if (sep && mrb_test(buf) && ((pos = mrb_str_index(mrb, buf, sep, sep_len, 0)) != -1))
-        goto hit;
-
-    if (mem_size_given && mrb_test(buf)) {
-        if (RSTRING_LEN(buf) >= mem_size) {
-            pos = mem_size;
-            goto hit;
-        } else {
-            mem_size -= RSTRING_LEN(buf);
-        }
+    if (sep_len == 0) {
+        sep = NULL;
     }
 
-    mem = mrb_malloc(mrb, mem_size * sizeof(char));
-
-  read:
-
-    while ((rc = libssh2_channel_read_ex(data->channel, stream, mem, mem_size)) == LIBSSH2_ERROR_EAGAIN) {
-        mrb_ssh_wait_sock(ssh);
-    };
-
-    if (rc <= 0) {
-        mrb_iv_remove(mrb, self, SYM("buf", 3));
-        res = buf;
+    if (mem_size_given && stream->len >= mem_size) {
+        res = mrb_ssh_stream_shift(mrb, stream, mem_size);
         goto chomp;
     }
 
-    if (mrb_test(buf)) {
-        buf = mrb_str_cat(mrb, buf, mem, rc);
-    } else {
-        buf = mrb_str_new(mrb, mem, rc);
+    if (mem_size_given) {
+        mem_size -= stream->len;
     }
 
-    if (!sep && !mem_size_given && rc > 0)
-        goto read;
+    for (;;) {
+        if (sep && (hit = mrb_ssh_stream_search(stream->buf + stream->head + scanned, stream->len - scanned, sep, (size_t)sep_len)))
+            break;
 
-    if (!sep) {
-        mrb_iv_remove(mrb, self, SYM("buf", 3));
-        res = buf;
-        goto chomp;
-    }
+        if (sep && stream->len >= (size_t)sep_len) {
+            scanned = stream->len - (size_t)sep_len + 1;
+        }
 
-    if ((pos = mrb_str_index(mrb, buf, sep, sep_len, 0)) == -1)
-        goto read;
+        mem = mrb_ssh_stream_reserve(mrb, stream, mem_size);
 
-  hit:
+        while ((rc = libssh2_channel_read_ex(data->channel, stream->id, mem, mem_size)) == LIBSSH2_ERROR_EAGAIN) {
+            mrb_ssh_wait_sock(ssh);
+        };
 
-    pos += sep_len;
-    res = mrb_str_new(mrb, RSTRING_PTR(buf), pos);
-    buf = mrb_str_substr(mrb, buf, pos, RSTRING_LEN(buf) - pos);
+        if (rc <= 0) break;
 
-    mrb_iv_set(mrb, self, SYM("buf", 3), buf);
+        stream->len                += (size_t)rc;
+        data->stats.bytes_received += (uint64_t)rc;
 
-  chomp:
+        mrb_ssh_channel_tune_window(data, (size_t)rc);
 
-    if (mem) {
-        mrb_free(mrb, mem);
+        if (mem_size_given) break;
     }
 
-    if (mrb_string_p(res) && RSTRING_LEN(res) == 0) {
+    if (hit) {
+        res = mrb_ssh_stream_shift(mrb, stream, (size_t)(hit - stream->buf - stream->head) + (size_t)sep_len);
+    } else {
+        res = mrb_ssh_stream_shift(mrb, stream, stream->len);
+    }
+
+  chomp:
+
+    if (RSTRING_LEN(res) == 0) {
         return mrb_nil_value();
     }
 
-    if (chomp && mrb_string_p(res)) {
+    if (chomp) {
         mrb_funcall(mrb, res, "chomp!", 0);
     }
 
@@ -198,13 +431,20 @@ mrb_ssh_f_write (mrb_state *mrb, mrb_value self)
     const char *buf;
     mrb_int buf_len;
 
-    int stream              = mrb_ssh_stream_id(mrb, self);
-    mrb_ssh_t *ssh          = mrb_ssh_session(mrb, self);
-    mrb_ssh_channel_t *data = mrb_ssh_channel_bang(mrb, self);
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
 
     mrb_get_args(mrb, "s", &buf, &buf_len);
 
-    while ((rc = libssh2_channel_write_ex(data->channel, stream, buf, (size_t)buf_len)) == LIBSSH2_ERROR_EAGAIN) {
+    if (!stream->sync) {
+        mrb_ssh_stream_buffer(mrb, ssh, data, stream, buf, (size_t)buf_len);
+        return mrb_fixnum_value(buf_len);
+    }
+
+    mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+
+    while ((rc = libssh2_channel_write_ex(data->channel, stream->id, buf, (size_t)buf_len)) == LIBSSH2_ERROR_EAGAIN) {
         mrb_ssh_wait_sock(ssh);
     }
 
@@ -212,21 +452,262 @@ mrb_ssh_f_write (mrb_state *mrb, mrb_value self)
         mrb_ssh_raise_last_error(mrb, ssh);
     }
 
+    data->stats.bytes_sent += (uint64_t)rc;
+
     return mrb_fixnum_value(rc);
 }
 
+static mrb_value
+mrb_ssh_stream_read_partial (mrb_state *mrb, mrb_value self, mrb_bool nonblock)
+{
+    ssize_t rc;
+    mrb_int len;
+    int blocking = 1;
+    char *mem;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_get_args(mrb, "i", &len);
+
+    if (len < 0) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "negative length");
+    }
+
+    if (!nonblock) {
+        mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+    } else if (mrb_ssh_stream_due(stream)) {
+        mrb_ssh_stream_flush_nonblock(ssh, data, stream);
+    }
+
+    if (len == 0 || stream->len > 0)
+        goto shift;
+
+    mem = mrb_ssh_stream_reserve(mrb, stream, (size_t)len);
+
+    if (nonblock) {
+        blocking = libssh2_session_get_blocking(ssh->session);
+        libssh2_session_set_blocking(ssh->session, 0);
+    }
+
+    while ((rc = libssh2_channel_read_ex(data->channel, stream->id, mem, (size_t)len)) == LIBSSH2_ERROR_EAGAIN && !nonblock) {
+        mrb_ssh_wait_sock(ssh);
+    }
+
+    if (nonblock) {
+        libssh2_session_set_blocking(ssh->session, blocking);
+    }
+
+    if (rc == LIBSSH2_ERROR_EAGAIN) {
+        return mrb_ssh_wait_symbol(mrb, ssh->session);
+    }
+
+    if (rc < 0) {
+        mrb_ssh_raise_last_error(mrb, ssh);
+    }
+
+    if (rc == 0 && nonblock) {
+        return mrb_nil_value();
+    }
+
+    if (rc == 0) {
+        mrb_raise(mrb, mrb_class_get(mrb, "EOFError"), "end of file reached");
+    }
+
+    stream->len                += (size_t)rc;
+    data->stats.bytes_received += (uint64_t)rc;
+
+    mrb_ssh_channel_tune_window(data, (size_t)rc);
+
+  shift:
+
+    return mrb_ssh_stream_shift(mrb, stream, stream->len < (size_t)len ? stream->len : (size_t)len);
+}
+
+static mrb_value
+mrb_ssh_f_read_nonblock (mrb_state *mrb, mrb_value self)
+{
+    return mrb_ssh_stream_read_partial(mrb, self, TRUE);
+}
+
+static mrb_value
+mrb_ssh_f_readpartial (mrb_state *mrb, mrb_value self)
+{
+    return mrb_ssh_stream_read_partial(mrb, self, FALSE);
+}
+
+static mrb_value
+mrb_ssh_f_write_nonblock (mrb_state *mrb, mrb_value self)
+{
+    ssize_t rc;
+    const char *buf;
+    mrb_int buf_len;
+    int blocking;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_get_args(mrb, "s", &buf, &buf_len);
+
+    blocking = libssh2_session_get_blocking(ssh->session);
+    libssh2_session_set_blocking(ssh->session, 0);
+
+    if ((rc = mrb_ssh_stream_flush_out(ssh, data, stream, TRUE)) == 0) {
+        rc = libssh2_channel_write_ex(data->channel, stream->id, buf, (size_t)buf_len);
+    }
+
+    libssh2_session_set_blocking(ssh->session, blocking);
+
+    if (rc == LIBSSH2_ERROR_EAGAIN) {
+        return mrb_ssh_wait_symbol(mrb, ssh->session);
+    }
+
+    if (rc < 0) {
+        mrb_ssh_raise_last_error(mrb, ssh);
+    }
+
+    data->stats.bytes_sent += (uint64_t)rc;
+
+    return mrb_fixnum_value(rc);
+}
+
+static mrb_value
+mrb_ssh_f_write_v (mrb_state *mrb, mrb_value self)
+{
+    mrb_value *argv;
+    mrb_int argc, i, len = 0;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_get_args(mrb, "*", &argv, &argc);
+
+    for (i = 0; i < argc; i++) {
+        mrb_check_type(mrb, argv[i], MRB_TT_STRING);
+    }
+
+    for (i = 0; i < argc; i++) {
+        mrb_ssh_stream_buffer(mrb, ssh, data, stream, RSTRING_PTR(argv[i]), (size_t)RSTRING_LEN(argv[i]));
+        len += RSTRING_LEN(argv[i]);
+    }
+
+    if (stream->sync) {
+        mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+    }
+
+    return mrb_fixnum_value(len);
+}
+
+static mrb_value
+mrb_ssh_f_flush_out (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+
+    return mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_get_sync (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_stream_t *stream = DATA_PTR(self);
+
+    return mrb_bool_value(stream ? stream->sync : TRUE);
+}
+
+static mrb_value
+mrb_ssh_f_set_sync (mrb_state *mrb, mrb_value self)
+{
+    mrb_bool sync;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_get_args(mrb, "b", &sync);
+
+    if (sync) {
+        mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+    }
+
+    stream->sync = sync;
+
+    return mrb_bool_value(sync);
+}
+
+static mrb_value
+mrb_ssh_f_get_buffer_size (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_stream_t *stream = DATA_PTR(self);
+
+    return mrb_fixnum_value(stream ? (mrb_int)stream->out_size : LIBSSH2_CHANNEL_PACKET_DEFAULT);
+}
+
+static mrb_value
+mrb_ssh_f_set_buffer_size (mrb_state *mrb, mrb_value self)
+{
+    mrb_int size;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_get_args(mrb, "i", &size);
+
+    if (size < 1) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "buffer size must be positive");
+    }
+
+    mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
+    mrb_free(mrb, stream->out);
+
+    stream->out      = NULL;
+    stream->out_capa = 0;
+    stream->out_size = (size_t)size;
+
+    return mrb_fixnum_value(size);
+}
+
+static mrb_value
+mrb_ssh_f_get_interval (mrb_state *mrb, mrb_value self)
+{
+    mrb_ssh_stream_t *stream = DATA_PTR(self);
+
+    return stream && stream->interval ? mrb_fixnum_value(stream->interval) : mrb_nil_value();
+}
+
+static mrb_value
+mrb_ssh_f_set_interval (mrb_state *mrb, mrb_value self)
+{
+    mrb_value ms;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_get_args(mrb, "o", &ms);
+
+    stream->interval = mrb_nil_p(ms) ? 0 : (int)mrb_fixnum(mrb_Integer(mrb, ms));
+
+    return ms;
+}
+
 static mrb_value
 mrb_ssh_f_flush (mrb_state *mrb, mrb_value self)
 {
-    int rc, stream          = mrb_ssh_stream_id(mrb, self);
-    mrb_ssh_t *ssh          = mrb_ssh_session(mrb, self);
-    mrb_ssh_channel_t *data = mrb_ssh_channel_bang(mrb, self);
+    int rc;
+    mrb_ssh_t *ssh;
+    mrb_ssh_channel_t *data;
+    mrb_ssh_stream_t *stream = mrb_ssh_stream_bang(mrb, self, &ssh, &data);
+
+    mrb_ssh_stream_flush_bang(mrb, ssh, data, stream);
 
-    while ((rc = libssh2_channel_flush_ex(data->channel, stream)) == LIBSSH2_ERROR_EAGAIN) {
+    while ((rc = libssh2_channel_flush_ex(data->channel, stream->id)) == LIBSSH2_ERROR_EAGAIN) {
         mrb_ssh_wait_sock(ssh);
     }
 
-    mrb_iv_set(mrb, self, SYM("buf", 3), mrb_nil_value());
+    stream->head = 0;
+    stream->len  = 0;
 
     return mrb_fixnum_value(rc);
 }
@@ -239,10 +720,23 @@ mrb_mruby_ssh_stream_init (mrb_state *mrb)
     ssh = mrb_module_get(mrb, "SSH");
     cls = mrb_define_class_under(mrb, ssh, "Stream", mrb->object_class);
 
+    MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+
     mrb_define_method(mrb, cls, "initialize", mrb_ssh_f_init,  MRB_ARGS_ARG(1,1));
     mrb_define_method(mrb, cls, "gets",       mrb_ssh_f_gets,  MRB_ARGS_OPT(2));
     mrb_define_method(mrb, cls, "write",      mrb_ssh_f_write, MRB_ARGS_REQ(1));
     mrb_define_method(mrb, cls, "flush",      mrb_ssh_f_flush, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "read_nonblock",  mrb_ssh_f_read_nonblock,  MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "write_nonblock", mrb_ssh_f_write_nonblock, MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "readpartial",    mrb_ssh_f_readpartial,    MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "write_v",        mrb_ssh_f_write_v,        MRB_ARGS_ANY());
+    mrb_define_method(mrb, cls, "sync",           mrb_ssh_f_get_sync,       MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "sync=",          mrb_ssh_f_set_sync,       MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "buffer_size",    mrb_ssh_f_get_buffer_size, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "buffer_size=",   mrb_ssh_f_set_buffer_size, MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "flush_interval",  mrb_ssh_f_get_interval,  MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, "flush_interval=", mrb_ssh_f_set_interval,  MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, "__flush__",      mrb_ssh_f_flush_out,      MRB_ARGS_NONE());
 
     mrb_define_const(mrb, cls, "STDIO",   mrb_fixnum_value(0));
     mrb_define_const(mrb, cls, "STDERR",  mrb_fixnum_value(SSH_EXTENDED_DATA_STDERR));
@@ -24,10 +24,35 @@
 #ifndef MRB_SSH_TINY
 
 #include "mruby.h"
+#include "mruby/ext/ssh.h"
+
+#include <stddef.h>
+#include <stdint.h>
 
 MRB_BEGIN_DECL
 
+typedef struct mrb_ssh_stream
+{
+    struct RData *channel;
+    struct mrb_ssh_channel *data;
+    struct mrb_ssh_stream *next;
+    int id;
+    char *buf;
+    size_t capa;
+    size_t head;
+    size_t len;
+    mrb_bool sync;
+    char *out;
+    size_t out_size;
+    size_t out_capa;
+    size_t out_len;
+    size_t out_off;
+    int64_t out_since;
+    int interval;
+} mrb_ssh_stream_t;
+
 void mrb_mruby_ssh_stream_init (mrb_state *mrb);
+void mrb_ssh_stream_release_all (struct mrb_ssh_channel *data, mrb_ssh_t *ssh);
 
 MRB_END_DECL
 
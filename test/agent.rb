@@ -0,0 +1,77 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+assert 'SSH::Agent.clear' do
+  SSH::Agent.clear
+
+  SSH::Agent.prefer('demo', 'test.rebex.net', 'blob')
+  SSH::Agent.prefer('demo', 'test.rebex.net', 'blob', 2222)
+  SSH::Agent.prefer('root', 'test.rebex.net', 'blob')
+  assert_equal 3, SSH::Agent.stats[:memos]
+
+  SSH::Agent.clear
+  stats = SSH::Agent.stats
+
+  assert_equal 0, stats[:connects]
+  assert_equal 0, stats[:hits]
+  assert_equal 0, stats[:misses]
+  assert_equal 0, stats[:identities]
+  assert_equal 0, stats[:memos]
+end
+
+assert 'SSH::Agent.reload' do
+  res = SSH::Agent.reload
+
+  assert_true res.nil? || res.is_a?(Integer)
+  assert_equal res || 0, SSH::Agent.stats[:identities]
+ensure
+  SSH::Agent.clear
+end
+
+assert 'SSH::Session#login', 'use_agent' do
+  ssh = SSH::Session.new('test.rebex.net')
+
+  assert_raise(SSH::Exception) { ssh.login('unknown', use_agent: true) }
+  assert_equal 0, SSH::Agent.stats[:memos]
+ensure
+  ssh.close
+  SSH::Agent.clear
+end
+
+assert 'SSH::Agent.prefer' do
+  SSH::Agent.clear
+
+  SSH::Agent.prefer('demo', 'test.rebex.net', 'blob')
+  SSH::Agent.prefer('demo', 'test.rebex.net', 'other')
+  assert_equal 1, SSH::Agent.stats[:memos]
+
+  keys = SSH::Agent.identities('demo', 'test.rebex.net')
+  skip 'Needs an ssh-agent with two identities.' unless keys && keys.size > 1
+
+  SSH::Agent.prefer('demo', 'test.rebex.net', keys.last)
+
+  assert_equal keys.last, SSH::Agent.identities('demo', 'test.rebex.net').first
+  assert_equal keys.sort, SSH::Agent.identities('demo', 'test.rebex.net').sort
+  assert_equal keys, SSH::Agent.identities('demo', 'test.rebex.net', 2222)
+ensure
+  SSH::Agent.clear
+end
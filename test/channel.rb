@@ -166,6 +166,17 @@ SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
     assert_raise(SSH::ChannelNotOpened) { channel.capture2('echo ETNA') }
   end
 
+  assert 'SSH::Channel#capture2', 'opts' do
+    out, = open_channel(ssh).capture2("printf 'ETNA\\nETNA\\n'")
+    assert_equal "ETNA\nETNA\n", out
+
+    out, = open_channel(ssh).capture2("printf 'ETNA\\nETNA\\n'", {})
+    assert_equal "ETNA\n", out
+
+    out, = open_channel(ssh).capture2("printf 'ETNA\\nETNA\\n'", chomp: true)
+    assert_equal 'ETNA', out
+  end
+
   assert 'SSH::Channel#capture2e' do
     channel = open_channel(ssh)
 
@@ -204,6 +215,21 @@ SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
     assert_raise(SSH::ChannelNotOpened) { channel.capture3('echo ETNA') }
   end
 
+  assert 'SSH::Channel#capture3', 'large stderr' do
+    if rb_in_path
+      channel = open_channel(ssh)
+      out, err, suc = channel.capture3("ruby -e '$stderr.print(?e * 4_000_000);print(1)'")
+
+      assert_equal '1', out
+      assert_equal 4_000_000, err.size
+      assert_true suc
+
+      channel.close
+    else
+      skip "Command 'ruby' not supported."
+    end
+  end
+
   assert 'SSH::Channel#popen2' do
     io, ok = open_channel(ssh).popen2('echo ETNA')
 
@@ -338,4 +364,116 @@ SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
     assert_equal 127, channel.exitstatus
     assert_true channel.closed?
   end
+
+  assert 'SSH::Channel#open_nonblock' do
+    channel = SSH::Channel.new(ssh)
+    res     = nil
+
+    loop do
+      res = channel.open_nonblock
+      break unless res.is_a? Symbol
+
+      assert_include %i[wait_readable wait_writable], res
+      SSH::Poller.wait([ssh], 1000)
+    end
+
+    assert_nil res
+    assert_true channel.open?
+    assert_raise(SSH::Exception) { channel.open_nonblock }
+
+    channel.close
+  end
+
+  assert 'SSH::Channel#request_nonblock' do
+    channel = open_channel(ssh)
+    res     = nil
+
+    loop do
+      res = channel.request_nonblock('exec', 'echo ETNA')
+      break unless res.is_a? Symbol
+
+      SSH::Poller.wait([ssh], 1000)
+    end
+
+    assert_nil res
+    assert_equal "ETNA\n", SSH::Stream.new(channel).gets
+
+    channel.close
+  end
+end
+
+assert 'SSH::Channel#open_nonblock', 'not connected' do
+  assert_raise(SSH::NotConnected) { SSH::Channel.new(dummy).open_nonblock }
+  assert_raise(SSH::ChannelNotOpened) { SSH::Channel.new(dummy).request_nonblock('exec', 'echo') }
+end
+
+SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+  assert 'SSH::Channel#stats' do
+    assert_nil SSH::Channel.new(ssh).stats
+
+    channel = open_channel(ssh)
+    stats   = channel.stats
+
+    assert_equal 0, stats[:bytes_sent]
+    assert_equal 0, stats[:bytes_received]
+    assert_true stats[:open_time] > 0
+
+    channel.request('exec', 'echo ETNA')
+    assert_equal "ETNA\n", SSH::Stream.new(channel).gets
+
+    stats = channel.stats
+    assert_equal 5, stats[:bytes_received]
+    assert_true stats[:exec_time] > 0
+
+    channel.reset_stats
+    assert_equal 0, channel.stats[:bytes_received]
+    assert_equal 0.0, channel.stats[:exec_time]
+
+    channel.close
+    assert_nil channel.stats
+  end
+
+  assert 'SSH::Channel#open with window: :auto' do
+    channel = SSH::Channel.new(ssh)
+
+    assert_raise(ArgumentError) { channel.open(window: :big) }
+    assert_false channel.open?
+
+    channel.open(window: :auto, max_window: 4 * 1024 * 1024)
+    assert_equal SSH::Channel::WINDOW_DEFAULT, channel.stats[:window]
+    assert_equal 0, channel.stats[:window_adjusts]
+
+    channel.request('exec', 'echo ETNA')
+    assert_equal "ETNA\n", SSH::Stream.new(channel).gets
+
+    stats = channel.stats
+    assert_true stats[:window] >= SSH::Channel::WINDOW_DEFAULT
+    assert_true stats[:window] <= 4 * 1024 * 1024
+  ensure
+    channel.close if channel
+  end
+
+  assert 'SSH::Channel#capture2 with window: :auto' do
+    channel = SSH::Channel.new(ssh)
+    channel.open(window: :auto, max_window: 4 * 1024 * 1024)
+
+    out, = channel.__exec__('echo ETNA', SSH::Channel::EXT_NORMAL)
+    stats = channel.stats
+
+    assert_equal "ETNA\n", out
+    assert_true stats[:window] >= SSH::Channel::WINDOW_DEFAULT
+    assert_true stats[:window] <= 4 * 1024 * 1024
+  ensure
+    channel.close if channel
+  end
+
+  assert 'SSH::Channel#open with command and window: :auto' do
+    channel = SSH::Channel.new(ssh, :session)
+    channel.open(nil, window: :auto)
+
+    assert_true channel.open?
+    assert_kind_of Integer, channel.stats[:window]
+  ensure
+    channel.close if channel
+  end
 end
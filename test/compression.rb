@@ -0,0 +1,132 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+class CompressionStub
+  attr_reader :host
+
+  def initialize(host, stats)
+    @host  = host
+    @stats = { bytes_sent: 0, bytes_received: 0,
+               compress_in: 0, compress_out: 0, decompress_in: 0, decompress_out: 0 }.merge(stats)
+  end
+
+  def stats
+    @stats.dup
+  end
+
+  def receive(bytes)
+    @stats[:bytes_received] += bytes
+  end
+end
+
+assert 'SSH::Compression' do
+  assert_kind_of Module, SSH::Compression
+  assert_equal 4 * 1024 * 1024, SSH::Compression.max_throughput
+  assert_equal 0.8, SSH::Compression.max_ratio
+  assert_false SSH::Compression.default
+end
+
+assert 'SSH::Compression.compress?' do
+  SSH::Compression.clear
+
+  assert_false SSH::Compression.compress?('unknown.host')
+  assert_nil SSH::Compression['unknown.host']
+
+  slow = CompressionStub.new('slow.host', bytes_received: 1024 * 1024)
+  SSH::Compression.record(slow, 2.0)
+  assert_true SSH::Compression.compress?('slow.host')
+  assert_equal 512.0 * 1024, SSH::Compression['slow.host'][:throughput]
+
+  fast = CompressionStub.new('fast.host', bytes_received: 64 * 1024 * 1024)
+  SSH::Compression.record(fast, 1.0)
+  assert_false SSH::Compression.compress?('fast.host')
+
+  packed = CompressionStub.new('packed.host', bytes_received: 1024 * 1024,
+                                              decompress_in: 1024 * 1024, decompress_out: 1024 * 1024)
+  SSH::Compression.record(packed, 2.0)
+  assert_false SSH::Compression.compress?('packed.host')
+  assert_equal 1.0, SSH::Compression['packed.host'][:ratio]
+
+  tiny = CompressionStub.new('tiny.host', bytes_received: 100)
+  SSH::Compression.record(tiny, 1.0)
+  assert_false SSH::Compression.compress?('tiny.host')
+  assert_nil SSH::Compression['tiny.host'][:throughput]
+ensure
+  SSH::Compression.clear
+end
+
+assert 'SSH::Compression.record', 'only the transfer counts' do
+  SSH::Compression.clear
+
+  busy = CompressionStub.new('busy.host', bytes_received: 9 * 1024 * 1024)
+  SSH::Compression.record(busy, 4.0, bytes_received: 1024 * 1024)
+  assert_equal 2.0 * 1024 * 1024, SSH::Compression['busy.host'][:throughput]
+
+  idle = CompressionStub.new('idle.host', bytes_received: 1024 * 1024)
+  SSH::Compression.record(idle, 1.0, bytes_received: 1024 * 1024)
+  assert_nil SSH::Compression['idle.host'][:throughput]
+ensure
+  SSH::Compression.clear
+end
+
+assert 'SSH::Compression.measure' do
+  SSH::Compression.clear
+
+  stub = CompressionStub.new('measured.host', bytes_received: 0)
+  res  = SSH::Compression.measure(stub) { stub.receive(1024 * 1024) && :done }
+
+  assert_equal :done, res
+  assert_true SSH::Compression['measured.host'][:throughput] > 0
+ensure
+  SSH::Compression.clear
+end
+
+assert 'SSH.start with compress: :auto' do
+  SSH::Compression.clear
+
+  SSH.start('test.rebex.net', 'demo', password: 'password', compress: :auto) do |ssh|
+    assert_true ssh.connected?
+  end
+
+  assert_kind_of Hash, SSH::Compression['test.rebex.net']
+ensure
+  SSH::Compression.clear
+end
+
+assert 'SSH::Session#connect with compression level' do
+  ssh = SSH::Session.new
+
+  assert_raise(ArgumentError) { ssh.connect 'test.rebex.net', compress: 10 }
+  assert_false ssh.connected?
+
+  ssh.connect 'test.rebex.net', compress: 9
+  ssh.login 'demo', password: 'password'
+
+  stats = ssh.stats
+
+  assert_kind_of Integer, stats[:compress_in]
+  assert_kind_of Integer, stats[:compress_out]
+  assert_kind_of Integer, stats[:decompress_in]
+  assert_kind_of Integer, stats[:decompress_out]
+ensure
+  ssh.close if ssh
+end
@@ -0,0 +1,152 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+assert 'SSH::DNS.lookup', 'cached copy' do
+  SSH::DNS.clear
+
+  ips = SSH::DNS.lookup('localhost')
+  ips << '192.0.2.1'
+
+  assert_equal ips[0...-1], SSH::DNS.lookup('localhost')
+  assert_equal 1, SSH::DNS.stats[:hits]
+ensure
+  SSH::DNS.clear
+end
+
+assert 'SSH::DNS.ttl' do
+  assert_equal 60, SSH::DNS.ttl
+  assert_equal 5, SSH::DNS.negative_ttl
+
+  SSH::DNS.ttl = 10
+  assert_equal 10, SSH::DNS.ttl
+
+  SSH::DNS.ttl = -1
+  assert_equal 0, SSH::DNS.ttl
+ensure
+  SSH::DNS.ttl = 60
+end
+
+assert 'SSH::DNS.lookup' do
+  SSH::DNS.clear
+
+  ips = SSH::DNS.lookup('localhost')
+  assert_kind_of Array, ips
+  assert_false ips.empty?
+  assert_true ips.include?('127.0.0.1') || ips.include?('::1')
+
+  assert_equal ['10.0.0.1'], SSH::DNS.lookup('10.0.0.1')
+  assert_nil SSH::DNS.lookup('unknown.host.invalid')
+end
+
+assert 'SSH::DNS.stats' do
+  SSH::DNS.clear
+  assert_equal({ hits: 0, misses: 0, size: 0 }, SSH::DNS.stats)
+
+  SSH::DNS.lookup('localhost')
+  SSH::DNS.lookup('localhost')
+  assert_equal({ hits: 1, misses: 1, size: 1 }, SSH::DNS.stats)
+
+  SSH::DNS.lookup('unknown.host.invalid')
+  SSH::DNS.lookup('unknown.host.invalid')
+  assert_equal({ hits: 2, misses: 2, size: 2 }, SSH::DNS.stats)
+
+  SSH::DNS.clear
+  assert_equal 0, SSH::DNS.stats[:size]
+end
+
+assert 'SSH::DNS.lookup', 'bounded cache' do
+  SSH::DNS.clear
+
+  1100.times { |i| SSH::DNS.lookup("10.0.#{i / 256}.#{i % 256}") }
+  assert_true SSH::DNS.stats[:size] < 1100
+
+  assert_equal ['10.0.4.75'], SSH::DNS.lookup('10.0.4.75')
+  assert_equal 1, SSH::DNS.stats[:hits]
+  assert_equal ['10.0.0.0'], SSH::DNS.lookup('10.0.0.0')
+  assert_equal 1, SSH::DNS.stats[:hits]
+ensure
+  SSH::DNS.clear
+end
+
+assert 'SSH::DNS.ttl = 0' do
+  SSH::DNS.clear
+  SSH::DNS.ttl = 0
+
+  SSH::DNS.lookup('localhost')
+  SSH::DNS.lookup('localhost')
+  assert_equal({ hits: 0, misses: 2, size: 0 }, SSH::DNS.stats)
+ensure
+  SSH::DNS.ttl = 60
+end
+
+assert 'SSH::DNS.warm' do
+  SSH::DNS.clear
+
+  assert_equal 2, SSH::DNS.warm('localhost', ['127.0.0.1', 'unknown.host.invalid'])
+  assert_equal 3, SSH::DNS.stats[:size]
+
+  nested = ['localhost']
+  nested << nested
+
+  assert_raise(TypeError) { SSH::DNS.warm([['localhost']]) }
+  assert_raise(TypeError) { SSH::DNS.warm(nested) }
+
+  assert_equal 1, SSH::DNS.warm('test.rebex.net')
+  hits = SSH::DNS.stats[:hits]
+
+  ssh = SSH::Session.new
+  ssh.connect 'test.rebex.net'
+  assert_equal hits + 1, SSH::DNS.stats[:hits]
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH.resolve_all' do
+  SSH::DNS.clear
+
+  res = SSH.resolve_all(%w[localhost 127.0.0.1 unknown.host.invalid])
+  assert_kind_of Hash, res
+  assert_equal 3, res.size
+  assert_false res['localhost'].empty?
+  assert_equal ['127.0.0.1'], res['127.0.0.1']
+  assert_nil res['unknown.host.invalid']
+  assert_equal 3, SSH::DNS.stats[:size]
+
+  assert_equal({}, SSH.resolve_all([]))
+  assert_equal ['127.0.0.1'], SSH.resolve_all(['127.0.0.1'], 1)['127.0.0.1']
+  assert_raise(ArgumentError) { SSH.resolve_all(['127.0.0.1'], 0) }
+  assert_raise(TypeError) { SSH.resolve_all([1]) }
+end
+
+assert 'SSH.resolve_all with many hosts' do
+  SSH::DNS.clear
+
+  hosts = (1..200).map { |i| "10.0.#{i / 256}.#{i % 256}" }
+  res   = SSH.resolve_all(hosts, 16)
+
+  assert_equal 200, res.size
+  hosts.each { |host| assert_equal [host], res[host] }
+  assert_equal({ hits: 0, misses: 200, size: 200 }, SSH::DNS.stats)
+
+  SSH.resolve_all(hosts)
+  assert_equal 200, SSH::DNS.stats[:hits]
+end
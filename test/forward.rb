@@ -0,0 +1,195 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+dummy = SSH::Session.new
+
+# Drives the forward until the block returns true or the time is up.
+def relay(fwd, secs = 10)
+  stop = SSH.clock + secs
+  fwd.process(50) until yield || SSH.clock > stop
+end
+
+# Reads what is available on the socket without blocking.
+def read_available(sock)
+  IO.select([sock], nil, nil, 0) ? sock.recv(1024) : ''
+end
+
+assert 'SSH::Forward' do
+  assert_kind_of Class, SSH::Forward
+end
+
+assert 'SSH::Forward#initialize' do
+  assert_raise(ArgumentError) { SSH::Forward.new }
+  assert_raise(TypeError) { SSH::Forward.new(1, 0, 'localhost', 22) }
+  assert_raise(SSH::NotConnected) { dummy.forward_local(0, 'localhost', 22) }
+end
+
+SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+  assert 'SSH::Session#forward_local' do
+    fwd = ssh.forward_local(0, 'localhost', 22)
+
+    assert_kind_of SSH::Forward, fwd
+    assert_true fwd.local_port > 0
+    assert_equal 'localhost', fwd.remote_host
+    assert_equal 22, fwd.remote_port
+    assert_equal ssh, fwd.session
+    assert_false fwd.closed?
+
+    assert_raise(ArgumentError) { ssh.forward_local(0, 'localhost', 0) }
+    assert_raise(ArgumentError) { ssh.forward_local(70_000, 'localhost', 22) }
+    assert_raise(ArgumentError) { ssh.forward_local(0, 'localhost', 22, window: :big) }
+
+    fwd.close
+  end
+
+  assert 'SSH::Forward#process' do
+    fwd = ssh.forward_local(0, 'localhost', 22)
+
+    assert_equal 0, fwd.process
+    assert_equal 0, fwd.process(10)
+
+    t = SSH.clock
+    assert_equal 0, fwd.process(200)
+    assert_true SSH.clock - t >= 0.15
+    assert_nil fwd.run(0.05)
+    assert_equal [], fwd.tunnels
+
+    fwd.close
+  end
+
+  assert 'SSH::Forward#stats' do
+    fwd   = ssh.forward_local(0, 'localhost', 22)
+    stats = fwd.stats
+
+    assert_kind_of Hash, stats
+    assert_equal 0, stats[:accepted]
+    assert_equal 0, stats[:active]
+    assert_equal 0, stats[:opened]
+    assert_equal 0, stats[:failed]
+    assert_equal 0, stats[:bytes_sent]
+    assert_equal 0, stats[:bytes_received]
+    assert_equal 0.0, stats[:open_time]
+
+    fwd.close
+  end
+
+  assert 'SSH::Forward', 'relay' do
+    fwd    = ssh.forward_local(0, 'localhost', 22)
+    sock   = TCPSocket.new('127.0.0.1', fwd.local_port)
+    banner = ''
+
+    relay(fwd) { (banner << read_available(sock)).include?("\n") }
+
+    assert_equal 'SSH-2.0-', banner[0, 8]
+
+    tunnel = fwd.tunnels.first
+
+    assert_equal 1, fwd.tunnels.size
+    assert_true tunnel[:open]
+    assert_true tunnel[:bytes_received] >= banner.size
+    assert_equal 0, tunnel[:bytes_sent]
+    assert_true tunnel[:open_time] > 0
+    assert_true tunnel[:first_byte_time] > 0
+    assert_equal '127.0.0.1', tunnel[:peer].split(':').first
+
+    sock.write("SSH-2.0-mruby\r\n")
+    relay(fwd) { fwd.tunnels.first && fwd.tunnels.first[:bytes_sent] == 15 }
+
+    assert_equal 15, fwd.tunnels.first[:bytes_sent]
+
+    sock.close
+    relay(fwd) { fwd.tunnels.empty? }
+
+    stats = fwd.stats
+
+    assert_equal [], fwd.tunnels
+    assert_equal 1, stats[:accepted]
+    assert_equal 1, stats[:opened]
+    assert_equal 0, stats[:active]
+    assert_equal 15, stats[:bytes_sent]
+    assert_true stats[:bytes_received] >= banner.size
+    assert_true stats[:open_time] > 0
+
+    fwd.close
+  end
+
+  assert 'SSH::Forward', 'window: :auto' do
+    fwd    = ssh.forward_local(0, 'localhost', 22, window: :auto, max_window: 4 * 1024 * 1024)
+    sock   = TCPSocket.new('127.0.0.1', fwd.local_port)
+    banner = ''
+
+    relay(fwd) { (banner << read_available(sock)).include?("\n") }
+
+    window = fwd.tunnels.first[:window]
+
+    assert_equal 'SSH-2.0-', banner[0, 8]
+    assert_true window >= SSH::Channel::WINDOW_DEFAULT
+    assert_true window <= 4 * 1024 * 1024
+  ensure
+    sock.close if sock
+    fwd.close if fwd
+  end
+
+  assert 'SSH::Forward', 'concurrent tunnels' do
+    fwd     = ssh.forward_local(0, 'localhost', 22)
+    socks   = Array.new(3) { TCPSocket.new('127.0.0.1', fwd.local_port) }
+    banners = socks.map { '' }
+
+    relay(fwd) do
+      socks.each_with_index { |sock, i| banners[i] << read_available(sock) }
+      banners.all? { |banner| banner.include?("\n") }
+    end
+
+    banners.each { |banner| assert_equal 'SSH-2.0-', banner[0, 8] }
+
+    assert_equal 3, fwd.stats[:accepted]
+    assert_equal 3, fwd.stats[:active]
+    assert_equal 3, fwd.tunnels.size
+    assert_true fwd.tunnels.all? { |t| t[:bytes_received] >= 8 }
+
+    socks.each(&:close)
+    relay(fwd) { fwd.tunnels.empty? }
+
+    assert_equal 0, fwd.stats[:active]
+
+    fwd.close
+  end
+
+  assert 'SSH::Forward#close' do
+    fwd = ssh.forward_local(0, 'localhost', 22)
+
+    assert_nil fwd.close
+    assert_true fwd.closed?
+    assert_nil fwd.close
+    assert_raise(SSH::ChannelNotOpened) { fwd.process }
+  end
+end
+
+assert 'SSH::Forward', 'closed session' do
+  ssh = SSH.start('test.rebex.net', 'demo', password: 'password')
+  fwd = ssh.forward_local(0, 'localhost', 22)
+
+  ssh.close
+
+  assert_true fwd.closed?
+  assert_raise(SSH::NotConnected) { fwd.process }
+end
@@ -0,0 +1,101 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+assert 'SSH::Keepalive.delete' do
+  ssh = SSH::Session.new('test.rebex.net', keepalive: 5)
+  assert_nil SSH::Keepalive.delete(ssh)
+
+  SSH::Keepalive.add(ssh)
+  ssh.close
+
+  assert_nil SSH::Keepalive.tick
+  assert_true SSH::Keepalive.sessions.empty?
+  assert_nil SSH::Keepalive.delete(ssh)
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Keepalive.add' do
+  ssh = SSH::Session.new('test.rebex.net', keepalive: 5)
+
+  assert_equal ssh, SSH::Keepalive.add(ssh)
+  assert_equal ssh, SSH::Keepalive.add(ssh)
+  assert_equal [ssh], SSH::Keepalive.sessions
+
+  assert_equal ssh, SSH::Keepalive.delete(ssh)
+  assert_true SSH::Keepalive.sessions.empty?
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Keepalive.tick' do
+  assert_nil SSH::Keepalive.tick
+
+  ssh1 = SSH::Session.new('test.rebex.net', keepalive: 5)
+  ssh2 = SSH::Session.new('test.rebex.net')
+  ssh3 = SSH::Session.new('test.rebex.net', keepalive: 10)
+
+  [ssh1, ssh2, ssh3].each { |ssh| SSH::Keepalive.add(ssh) }
+
+  due = SSH::Keepalive.tick
+  assert_kind_of Integer, due
+  assert_true due <= 5
+  assert_equal 3, SSH::Keepalive.sessions.size
+
+  ssh1.close
+  assert_true SSH::Keepalive.tick <= 10
+  assert_equal [ssh2, ssh3], SSH::Keepalive.sessions
+ensure
+  [ssh1, ssh2, ssh3].compact.each do |ssh|
+    SSH::Keepalive.delete(ssh)
+    ssh.close
+  end
+end
+
+assert 'SSH::Keepalive.tick', 'non-blocking session under write pressure' do
+  ssh = SSH::Session.new
+  ssh.connect 'test.rebex.net', block: false, keepalive: 5
+
+  poller = SSH::Poller.new
+  poller.add(ssh)
+  poller.wait(1000) while ssh.login_nonblock('demo', password: 'password')
+
+  channel = SSH::Channel.new(ssh)
+  channel.open
+  channel.request('exec', 'cat')
+
+  io    = SSH::Stream.new(channel)
+  chunk = 'x' * 0x8000
+
+  100.times { break if io.write_nonblock(chunk).is_a?(Symbol) }
+
+  SSH::Keepalive.add(ssh)
+  due = SSH::Keepalive.tick
+
+  assert_kind_of Integer, due
+  assert_true due <= 5
+  assert_false ssh.closed?
+  assert_equal [ssh], SSH::Keepalive.sessions
+ensure
+  SSH::Keepalive.delete(ssh) if ssh
+  ssh.close if ssh
+end
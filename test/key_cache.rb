@@ -0,0 +1,83 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+assert 'SSH::KeyCache.load', 'file' do
+  SSH::KeyCache.clear
+
+  File.open('key.test', 'w') { |f| f.write('invalid key') }
+  File.open('key_empty.test', 'w') { |f| f.write('') }
+
+  assert_true SSH::KeyCache.load('key.test')
+  assert_true SSH::KeyCache.include? 'key.test'
+  assert_equal 1, SSH::KeyCache.stats[:size]
+
+  assert_raise(SSH::Exception) { SSH::KeyCache.load('key_empty.test') }
+  assert_false SSH::KeyCache.include? 'key_empty.test'
+  assert_equal 1, SSH::KeyCache.stats[:size]
+ensure
+  SSH::KeyCache.clear
+  File.delete('key.test') if File.exist?('key.test')
+  File.delete('key_empty.test') if File.exist?('key_empty.test')
+end
+
+assert 'SSH::KeyCache.load' do
+  assert_raise(SSH::Exception) { SSH::KeyCache.load('unknown_key') }
+  assert_false SSH::KeyCache.include? 'unknown_key'
+end
+
+assert 'SSH::KeyCache.add' do
+  SSH::KeyCache.clear
+
+  assert_true SSH::KeyCache.add('deploy', 'invalid key', nil, 'secret')
+  assert_true SSH::KeyCache.include? 'deploy'
+  assert_equal 1, SSH::KeyCache.stats[:size]
+
+  assert_true SSH::KeyCache.add('deploy', 'invalid key')
+  assert_equal 1, SSH::KeyCache.stats[:size]
+
+  assert_true SSH::KeyCache.delete('deploy')
+  assert_false SSH::KeyCache.delete('deploy')
+  assert_equal 0, SSH::KeyCache.stats[:size]
+ensure
+  SSH::KeyCache.clear
+end
+
+assert 'SSH::Session#login', 'cached key' do
+  SSH::KeyCache.add('deploy', 'invalid key')
+
+  ssh = SSH::Session.new('test.rebex.net')
+
+  assert_raise(SSH::Exception) { ssh.login('demo', key: 'deploy') }
+  assert_equal 1, SSH::KeyCache.stats[:hits]
+ensure
+  ssh.close
+  SSH::KeyCache.clear
+end
+
+assert 'SSH::Session#login', 'key_data' do
+  ssh = SSH::Session.new('test.rebex.net')
+
+  assert_raise(SSH::Exception) { ssh.login('demo', key_data: 'invalid key') }
+  assert_false ssh.logged_in?
+ensure
+  ssh.close
+end
@@ -0,0 +1,220 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+KEY_A = 'AAAAC3NzaC1lZDI1NTE5AAAAIEFBQUFBQUFBQUFBQUFBQUFBQUFBQUFBQUFBQUFBQUFB'.freeze
+KEY_B = 'AAAAC3NzaC1lZDI1NTE5AAAAIEJCQkJCQkJCQkJCQkJCQkJCQkJCQkJCQkJCQkJCQkJC'.freeze
+KEY_R = 'AAAAB3NzaC1yc2EAAAAgUlJSUlJSUlJSUlJSUlJSUlJSUlJSUlJSUlJSUlJSUlI='.freeze
+
+def write_known_hosts(content, mode = 'w')
+  File.open('known_hosts.test', mode) { |f| f.write(content) }
+end
+
+def with_known_hosts(content)
+  write_known_hosts(content)
+  SSH::KnownHosts.load('known_hosts.test')
+  yield
+ensure
+  SSH::KnownHosts.clear
+  File.delete('known_hosts.test') if File.exist?('known_hosts.test')
+end
+
+assert 'SSH::KnownHosts.load' do
+  assert_equal 0, SSH::KnownHosts.load('known_hosts.missing')
+  assert_equal 'known_hosts.missing', SSH::KnownHosts.path
+  assert_equal 0, SSH::KnownHosts.size
+  assert_equal 0, SSH::KnownHosts.reload
+
+  SSH::KnownHosts.clear
+
+  assert_nil SSH::KnownHosts.path
+end
+
+assert 'SSH::KnownHosts.hash_host' do
+  # RFC 2202 test cases 1 and 3
+  assert_equal '|1|CwsLCwsLCwsLCwsLCwsLCwsLCws=|thcxhlUFcmTii8C2+zeMjvFGvgA=',
+               SSH::KnownHosts.hash_host('Hi There', "\x0b" * 20)
+  assert_equal '|1|qqqqqqqqqqqqqqqqqqqqqqqqqqo=|El1zQrmsEc2Ro5r0iqF7T2PxddM=',
+               SSH::KnownHosts.hash_host("\xdd" * 50, "\xaa" * 20)
+
+  assert_raise(ArgumentError) { SSH::KnownHosts.hash_host('host', 'salt') }
+end
+
+assert 'SSH::KnownHosts.check' do
+  with_known_hosts "# comment\n\nhost.example.com,10.0.0.1 ssh-ed25519 #{KEY_A} comment\n" do
+    assert_equal 2, SSH::KnownHosts.size
+    assert_equal :match, SSH::KnownHosts.check('host.example.com', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('HOST.example.com', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('10.0.0.1', KEY_A)
+    assert_equal :mismatch, SSH::KnownHosts.check('host.example.com', KEY_B)
+    assert_equal :not_found, SSH::KnownHosts.check('host.example.com', KEY_R)
+    assert_equal :not_found, SSH::KnownHosts.check('other.example.com', KEY_A)
+    assert_equal :not_found, SSH::KnownHosts.check('host.example.com', KEY_A, 2222)
+    assert_raise(ArgumentError) { SSH::KnownHosts.check('host.example.com', '!!!') }
+  end
+end
+
+assert 'SSH::KnownHosts.check', 'binary lines' do
+  with_known_hosts "\0garbage\nhost.example.com ssh-ed25519 #{KEY_A}\n\0" do
+    assert_equal 1, SSH::KnownHosts.size
+    assert_equal :match, SSH::KnownHosts.check('host.example.com', KEY_A)
+  end
+end
+
+assert 'SSH::KnownHosts.check', 'port' do
+  with_known_hosts "[host.example.com]:2222 ssh-ed25519 #{KEY_A}\n" do
+    assert_equal :match, SSH::KnownHosts.check('host.example.com', KEY_A, 2222)
+    assert_equal :not_found, SSH::KnownHosts.check('host.example.com', KEY_A)
+  end
+end
+
+assert 'SSH::KnownHosts.check', 'hashed' do
+  name = SSH::KnownHosts.hash_host('hashed.example.com', '0123456789abcdefghij')
+
+  assert_equal '|1|MDEyMzQ1Njc4OWFiY2RlZmdoaWo=|gzfxEI74iflku6CWHlY6D9H4tKY=', name
+
+  with_known_hosts "#{name} ssh-ed25519 #{KEY_A}\n" do
+    assert_equal :match, SSH::KnownHosts.check('hashed.example.com', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('hashed.example.com', KEY_A)
+    assert_equal :mismatch, SSH::KnownHosts.check('hashed.example.com', KEY_B)
+    assert_equal :not_found, SSH::KnownHosts.check('other.example.com', KEY_A)
+  end
+end
+
+assert 'SSH::KnownHosts.check', 'wildcards' do
+  with_known_hosts "*.example.com ssh-ed25519 #{KEY_A}\nhost?.test ssh-ed25519 #{KEY_B}\n" do
+    assert_equal :match, SSH::KnownHosts.check('a.example.com', KEY_A)
+    assert_equal :mismatch, SSH::KnownHosts.check('a.example.com', KEY_B)
+    assert_equal :not_found, SSH::KnownHosts.check('example.com', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('host1.test', KEY_B)
+    assert_equal :not_found, SSH::KnownHosts.check('host10.test', KEY_B)
+  end
+end
+
+assert 'SSH::KnownHosts.check', 'negation' do
+  with_known_hosts "*.corp,!evil.corp,!bad?.corp ssh-ed25519 #{KEY_A}\n" do
+    assert_equal :match, SSH::KnownHosts.check('good.corp', KEY_A)
+    assert_equal :not_found, SSH::KnownHosts.check('evil.corp', KEY_A)
+    assert_equal :not_found, SSH::KnownHosts.check('Evil.corp', KEY_A)
+    assert_equal :not_found, SSH::KnownHosts.check('bad1.corp', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('bad12.corp', KEY_A)
+  end
+
+  with_known_hosts "host.corp,!host.corp ssh-ed25519 #{KEY_A}\n" do
+    assert_equal :not_found, SSH::KnownHosts.check('host.corp', KEY_A)
+  end
+end
+
+assert 'SSH::KnownHosts.check', 'revoked' do
+  with_known_hosts "@revoked * ssh-ed25519 #{KEY_B}\nhost.example.com ssh-ed25519 #{KEY_B}\n" do
+    assert_equal :revoked, SSH::KnownHosts.check('host.example.com', KEY_B)
+    assert_equal :revoked, SSH::KnownHosts.check('other.example.com', KEY_B)
+    assert_equal :mismatch, SSH::KnownHosts.check('host.example.com', KEY_A)
+  end
+end
+
+assert 'SSH::KnownHosts.reload' do
+  with_known_hosts "a.example.com ssh-ed25519 #{KEY_A}\n" do
+    assert_equal :not_found, SSH::KnownHosts.check('b.example.com', KEY_B)
+
+    write_known_hosts "b.example.com ssh-ed25519 #{KEY_B}\n", 'a'
+
+    assert_equal 2, SSH::KnownHosts.reload
+    assert_equal :match, SSH::KnownHosts.check('a.example.com', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('b.example.com', KEY_B)
+
+    write_known_hosts "c.example.com ssh-ed25519 #{KEY_R}\n"
+
+    assert_equal 1, SSH::KnownHosts.reload
+    assert_equal :not_found, SSH::KnownHosts.check('a.example.com', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('c.example.com', KEY_R)
+  end
+end
+
+assert 'SSH::KnownHosts.reload', 'last line without line break' do
+  with_known_hosts "a.example.com ssh-ed25519 #{KEY_A}" do
+    assert_equal 1, SSH::KnownHosts.size
+    assert_equal :match, SSH::KnownHosts.check('a.example.com', KEY_A)
+
+    write_known_hosts "\nb.example.com ssh-ed25519 #{KEY_B}", 'a'
+
+    assert_equal 2, SSH::KnownHosts.reload
+    assert_equal :match, SSH::KnownHosts.check('b.example.com', KEY_B)
+
+    write_known_hosts " comment\nc.example.com ssh-ed25519 #{KEY_R}\n", 'a'
+
+    assert_equal 3, SSH::KnownHosts.reload
+    assert_equal :match, SSH::KnownHosts.check('a.example.com', KEY_A)
+    assert_equal :match, SSH::KnownHosts.check('b.example.com', KEY_B)
+    assert_equal :match, SSH::KnownHosts.check('c.example.com', KEY_R)
+  end
+end
+
+assert 'SSH::KnownHosts.verify' do
+  ssh = SSH::Session.new('test.rebex.net')
+
+  SSH::KnownHosts.load('known_hosts.test')
+
+  assert_include [:match, :not_found], SSH::KnownHosts.verify(ssh)
+  assert_include [:match, :added], SSH::KnownHosts.verify!(ssh, :accept_new)
+  assert_equal :match, SSH::KnownHosts.verify(ssh)
+  assert_equal :match, SSH::KnownHosts.verify!(ssh)
+  assert_true SSH::KnownHosts.size > 0
+
+  assert_raise(SSH::NotConnected) { SSH::KnownHosts.verify(SSH::Session.new) }
+  assert_raise(TypeError) { SSH::KnownHosts.verify(1) }
+  assert_raise(TypeError) { SSH::KnownHosts.verify('test.rebex.net') }
+  assert_raise(TypeError) { SSH::KnownHosts.add(SSH::Channel.new(ssh)) }
+ensure
+  ssh.close
+  SSH::KnownHosts.clear
+  File.delete('known_hosts.test') if File.exist?('known_hosts.test')
+end
+
+assert 'SSH::KnownHosts.verify!' do
+  SSH::KnownHosts.load('known_hosts.missing')
+
+  ssh = SSH::Session.new('test.rebex.net')
+
+  assert_raise(SSH::HostKeyError) { SSH::KnownHosts.verify!(ssh) }
+ensure
+  ssh.close
+  SSH::KnownHosts.clear
+end
+
+assert 'SSH::Session#new', 'verify_host_key' do
+  SSH::KnownHosts.load('known_hosts.missing')
+
+  assert_raise(SSH::HostKeyError) { SSH::Session.new('test.rebex.net', verify_host_key: :always) }
+ensure
+  SSH::KnownHosts.clear
+end
+
+assert 'SSH::Session#fingerprint' do
+  ssh = SSH::Session.new('test.rebex.net')
+
+  assert_equal 59, ssh.fingerprint(:sha1).length
+  assert_equal 'SHA256:', ssh.fingerprint(:sha256)[0, 7]
+  assert_equal 50, ssh.fingerprint(:sha256).length
+  assert_raise(ArgumentError) { ssh.fingerprint(:md5) }
+ensure
+  ssh.close
+end
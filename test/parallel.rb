@@ -0,0 +1,62 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+assert 'SSH.parallel' do
+  hosts = %w[test.rebex.net test.rebex.net]
+  res   = SSH.parallel(hosts, 'echo ETNA', user: 'demo', password: 'password')
+
+  assert_kind_of Hash, res
+  assert_equal ['test.rebex.net'], res.keys
+  assert_equal "ETNA\n", res['test.rebex.net'][:out]
+  assert_equal 0, res['test.rebex.net'][:exitstatus]
+  assert_nil res['test.rebex.net'][:error]
+end
+
+assert 'SSH.parallel(concurrency:)' do
+  res = SSH.parallel(%w[test.rebex.net], 'echo ETNA', user: 'demo', password: 'password', concurrency: 1)
+  assert_equal "ETNA\n", res['test.rebex.net'][:out]
+
+  assert_raise(ArgumentError) do
+    SSH.parallel(%w[test.rebex.net], 'echo', user: 'demo', password: 'password', concurrency: 0)
+  end
+end
+
+assert 'SSH.parallel(errors)' do
+  assert_raise(ArgumentError) { SSH.parallel(%w[test.rebex.net], 'echo ETNA', password: 'password') }
+  assert_raise(ArgumentError) { SSH.parallel(%w[test.rebex.net], 'echo ETNA', user: 'demo') }
+  assert_raise(TypeError) { SSH.parallel([1], 'echo ETNA', user: 'demo', password: 'password') }
+
+  res = SSH.parallel(%w[test.rebex.net 0.0.0.1], 'echo', user: 'demo', password: '123', timeout: 5000)
+
+  assert_kind_of SSH::AuthenticationFailed, res['test.rebex.net'][:error]
+  assert_nil res['test.rebex.net'][:exitstatus]
+  assert_kind_of SSH::Exception, res['0.0.0.1'][:error]
+end
+
+assert 'SSH.parallel(teardown)' do
+  t   = SSH.clock
+  res = SSH.parallel(%w[test.rebex.net test.rebex.net 0.0.0.1], 'echo', user: 'demo', password: '123', timeout: 3000)
+
+  assert_equal %w[test.rebex.net 0.0.0.1], res.keys
+  assert_kind_of SSH::AuthenticationFailed, res['test.rebex.net'][:error]
+  assert_true SSH.clock - t < 6
+end
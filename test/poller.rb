@@ -0,0 +1,86 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+assert 'SSH::Poller' do
+  assert_kind_of Class, SSH::Poller
+end
+
+assert 'SSH::Poller.backends' do
+  assert_include SSH::Poller.backends, :poll
+end
+
+assert 'SSH::Poller#initialize' do
+  assert_equal SSH::Poller.backends.first, SSH::Poller.new.backend
+  assert_equal :poll, SSH::Poller.new(:poll).backend
+  assert_raise(ArgumentError) { SSH::Poller.new(:select) }
+end
+
+assert 'SSH::Poller#add' do
+  poller = SSH::Poller.new
+
+  assert_true poller.empty?
+  assert_raise(SSH::NotConnected) { poller.add SSH::Session.new }
+  assert_raise(TypeError) { poller.add 1 }
+  assert_raise(TypeError) { poller.add SSH::Poller.new }
+
+  SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+    assert_raise(TypeError) { poller.add SSH::Channel.new(ssh) }
+
+    poller << ssh << ssh
+    assert_equal 1, poller.size
+  end
+end
+
+assert 'SSH::Poller#delete' do
+  poller = SSH::Poller.new
+
+  SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+    poller.add ssh
+    assert_equal ssh, poller.delete(ssh)
+    assert_nil poller.delete(ssh)
+    assert_true poller.empty?
+  end
+end
+
+assert 'SSH::Poller#wait' do
+  SSH::Poller.backends.each do |backend|
+    poller   = SSH::Poller.new(backend)
+    sessions = Array.new(2) { SSH.start('test.rebex.net', 'demo', password: 'password') }
+
+    sessions.each { |ssh| poller.add ssh }
+    assert_equal [], poller.wait(10)
+
+    sessions[0].close
+    assert_equal [sessions[0]], poller.wait
+
+    sessions.each { |ssh| poller.delete ssh }
+    assert_true poller.empty?
+  ensure
+    sessions.each(&:close)
+  end
+end
+
+assert 'SSH::Poller.wait' do
+  SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+    assert_equal [], SSH::Poller.wait([ssh], 10)
+  end
+end
@@ -0,0 +1,120 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+assert 'SSH::Pool' do
+  assert_kind_of Class, SSH::Pool
+end
+
+assert 'SSH::Pool#initialize' do
+  pool = SSH::Pool.new
+
+  assert_equal 4,   pool.max
+  assert_equal 300, pool.ttl
+  assert_equal 0,   pool.size
+
+  pool = SSH::Pool.new(max: 1, ttl: 10)
+
+  assert_equal 1,  pool.max
+  assert_equal 10, pool.ttl
+end
+
+assert 'SSH::Pool#checkout' do
+  pool = SSH::Pool.new(password: 'password', max: 1)
+  ssh  = pool.checkout('test.rebex.net', 'demo')
+
+  assert_kind_of SSH::Session, ssh
+  assert_true ssh.logged_in?
+  assert_equal 1, pool.size
+  assert_raise(SSH::PoolExhausted) { pool.checkout('test.rebex.net', 'demo') }
+
+  pool.checkin(ssh)
+  assert_equal ssh, pool.checkout('test.rebex.net', 'demo')
+  assert_equal 1, pool.size
+
+  pool.checkin(ssh)
+  ssh.close
+  assert_not_equal ssh, pool.checkout('test.rebex.net', 'demo')
+ensure
+  pool.close
+end
+
+assert 'SSH::Pool#with' do
+  pool = SSH::Pool.new(password: 'password')
+  used = nil
+
+  res = pool.with('test.rebex.net', 'demo') { |ssh| (used = ssh).exec('echo ETNA') }
+
+  assert_equal "ETNA\n", res
+  assert_true used.connected?
+  assert_equal 1, pool.size
+
+  pool.with('test.rebex.net', 'demo') { |ssh| assert_equal used, ssh }
+ensure
+  pool.close
+end
+
+assert 'SSH::Pool#reap' do
+  pool = SSH::Pool.new(password: 'password', ttl: 0)
+  ssh  = pool.checkout('test.rebex.net', 'demo')
+
+  pool.checkin(ssh)
+
+  assert_equal 1, pool.reap
+  assert_true ssh.closed?
+  assert_equal 0, pool.size
+end
+
+assert 'SSH::Pool#keepalive' do
+  pool = SSH::Pool.new(password: 'password')
+  assert_nil pool.keepalive
+
+  ssh = pool.checkout('test.rebex.net', 'demo', keepalive: 10)
+  pool.checkin(ssh)
+  assert_true pool.keepalive <= 10
+
+  ssh.close
+  assert_nil pool.keepalive
+  assert_equal 0, pool.size
+ensure
+  pool.close
+end
+
+assert 'SSH::Pool#close' do
+  pool = SSH::Pool.new(password: 'password')
+  idle = pool.checkout('test.rebex.net', 'demo')
+  ssh  = pool.checkout('test.rebex.net', 'demo')
+
+  pool.checkin(idle)
+  pool.close
+
+  assert_true pool.closed?
+  assert_true idle.closed?
+  assert_false ssh.closed?
+  assert_equal "ETNA\n", ssh.exec('echo ETNA')
+  assert_equal 1, pool.size
+  assert_raise(SSH::Exception) { pool.checkout('test.rebex.net', 'demo') }
+
+  pool.checkin(ssh)
+
+  assert_true ssh.closed?
+  assert_equal 0, pool.size
+end
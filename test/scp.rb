@@ -0,0 +1,41 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+  assert 'SSH::Session#scp_download' do
+    size = ssh.exec('wc -c < /readme.txt').to_i
+
+    assert_equal size, ssh.scp_download('/readme.txt', 'scp_readme.txt')
+    assert_raise(SSH::Exception) { ssh.scp_download('/unknown', 'scp_readme.txt') }
+    assert_raise(StandardError) { ssh.scp_download('/readme.txt', '/unknown/readme.txt') }
+  end
+
+  assert 'SSH::Session#scp_upload' do
+    assert_raise(SSH::Exception) { ssh.scp_upload('scp_readme.txt', '/readme.txt') }
+    assert_raise(StandardError) { ssh.scp_upload('unknown.txt', '/readme.txt') }
+  end
+end
+
+assert 'SSH::Session#scp_upload', 'not connected' do
+  assert_raise(SSH::NotConnected) { SSH::Session.new.scp_upload('scp_readme.txt', '/readme.txt') }
+  assert_raise(SSH::NotConnected) { SSH::Session.new.scp_download('/readme.txt', 'scp_readme.txt') }
+end
@@ -122,6 +122,259 @@ assert 'SSH::Session#timeout' do
   assert_true ssh.logged_in?
 end
 
+assert 'SSH::Session#connect with connect_timeout' do
+  ssh = SSH::Session.new
+
+  assert_raise(SSH::Timeout) { ssh.connect '10.255.255.1', connect_timeout: 100 }
+  assert_false ssh.connected?
+
+  assert_raise(SSH::ConnectError) { ssh.connect 'unknown.host.invalid' }
+  assert_false ssh.connected?
+
+  ssh.connect 'test.rebex.net', connect_timeout: 5000
+  assert_true ssh.connected?
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#connect with algorithm preferences' do
+  ssh = SSH::Session.new
+
+  assert_raise(SSH::NotConnected) { ssh.algorithms }
+  assert_raise(SSH::Exception) { ssh.connect 'test.rebex.net', ciphers: 'unknown-cipher' }
+  assert_false ssh.connected?
+
+  ssh.connect 'test.rebex.net', ciphers: %w[aes256-ctr aes128-ctr], macs: 'hmac-sha2-256,hmac-sha1'
+  algs = ssh.algorithms
+
+  assert_kind_of Hash, algs
+  assert_equal 'aes256-ctr', algs[:cipher_cs]
+  assert_equal 'aes256-ctr', algs[:cipher_sc]
+  assert_equal 'hmac-sha2-256', algs[:mac_cs]
+  assert_kind_of String, algs[:kex]
+  assert_kind_of String, algs[:host_key]
+
+  assert_include ssh.supported_algorithms(:ciphers), 'aes256-ctr'
+  assert_include ssh.supported_algorithms(:kex), algs[:kex]
+  assert_raise(ArgumentError) { ssh.supported_algorithms(:unknown) }
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#connect_nonblock' do
+  ssh = SSH::Session.new
+  res = ssh.connect_nonblock('test.rebex.net')
+
+  assert_include [:wait_readable, :wait_writable, nil], res
+  assert_false ssh.connected? if res
+  assert_false ssh.alive? if res
+
+  poller = SSH::Poller.new
+  poller.add(ssh)
+
+  poller.wait(1000) while (res = ssh.connect_nonblock('test.rebex.net'))
+
+  assert_nil res
+  assert_true ssh.connected?
+  assert_true ssh.blocking?
+  assert_raise(SSH::Exception) { ssh.connect_nonblock('test.rebex.net') }
+
+  poller.wait(1000) while (res = ssh.login_nonblock('demo', password: 'password'))
+
+  assert_nil res
+  assert_true ssh.logged_in?
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#connect_nonblock with errors' do
+  ssh = SSH::Session.new
+
+  assert_raise(SSH::ConnectError) { ssh.connect_nonblock('unknown.host.invalid') }
+  assert_false ssh.connected?
+
+  assert_raise(SSH::ConnectError) do
+    poller = SSH::Poller.new
+    poller.add(ssh) if ssh.connect_nonblock('127.0.0.1', port: 1)
+    poller.wait(100) while ssh.connect_nonblock('127.0.0.1', port: 1)
+  end
+
+  assert_false ssh.connected?
+  assert_nil ssh.host
+end
+
+assert 'SSH::Session#login_nonblock' do
+  ssh = SSH::Session.new
+
+  assert_raise(SSH::NotConnected) { ssh.login_nonblock 'demo', password: 'password' }
+
+  ssh.connect 'test.rebex.net', block: false
+
+  poller = SSH::Poller.new
+  poller.add(ssh)
+
+  assert_raise(SSH::AuthenticationFailed) do
+    poller.wait(1000) while ssh.login_nonblock('demo', password: '123')
+  end
+
+  assert_false ssh.logged_in?
+
+  poller.wait(1000) while ssh.login_nonblock('demo', password: 'password')
+  assert_true ssh.logged_in?
+  assert_false ssh.blocking?
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#login_nonblock', 'raises' do
+  ssh = SSH::Session.new('test.rebex.net')
+
+  assert_true ssh.blocking?
+  assert_raise(TypeError) { ssh.login_nonblock('demo', key: 1) }
+  assert_true ssh.blocking?
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#keepalive' do
+  ssh = SSH::Session.new
+
+  assert_equal 0, ssh.keepalive
+  assert_raise(SSH::NotConnected) { ssh.keepalive = 5 }
+  assert_raise(SSH::NotConnected) { ssh.keepalive_tick }
+
+  ssh.connect 'test.rebex.net', keepalive: 10, keepalive_reply: true
+  assert_equal 10, ssh.keepalive
+  assert_kind_of Integer, ssh.keepalive_tick
+  assert_true ssh.keepalive_tick <= 10
+
+  ssh.keepalive = 0
+  assert_equal 0, ssh.keepalive
+  assert_nil ssh.keepalive_tick
+
+  ssh.close
+  assert_raise(SSH::NotConnected) { ssh.keepalive_tick }
+end
+
+assert 'SSH::Session#stats' do
+  ssh = SSH::Session.new
+  assert_nil ssh.stats
+
+  ssh.connect 'test.rebex.net'
+  stats = ssh.stats
+
+  assert_kind_of Hash, stats
+  assert_true stats[:bytes_sent] > 0
+  assert_true stats[:bytes_received] > 0
+  assert_true stats[:handshake_time] > 0
+  assert_equal 0.0, stats[:auth_time]
+
+  ssh.login 'demo', password: 'password'
+  assert_true ssh.stats[:auth_time] > 0
+
+  assert_kind_of Integer, stats[:waits]
+  assert_kind_of Float, stats[:wait_time]
+
+  ssh.reset_stats
+  assert_equal 0, ssh.stats[:bytes_sent]
+  assert_equal 0, ssh.stats[:execs]
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#memory_usage' do
+  ssh = SSH::Session.new
+  assert_nil ssh.memory_usage
+
+  ssh.connect 'test.rebex.net'
+  ssh.login 'demo', password: 'password'
+
+  assert_kind_of Integer, ssh.memory_usage
+  assert_true ssh.memory_usage > 0
+
+  usage = ssh.memory_usage(true)
+
+  assert_kind_of Hash, usage
+  assert_equal ssh.memory_usage, usage[:live]
+  assert_true usage[:peak] >= usage[:live]
+  assert_true usage[:allocs] > 0
+  assert_true usage[:pool_hits] > 0
+  assert_kind_of Integer, usage[:cached]
+  assert_true usage[:cached] <= 0x40000
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#trim_memory' do
+  ssh = SSH::Session.new
+  assert_equal 0, ssh.trim_memory
+
+  ssh.connect 'test.rebex.net'
+  ssh.login 'demo', password: 'password'
+
+  cached = ssh.memory_usage(true)[:cached]
+  live   = ssh.memory_usage
+
+  assert_equal cached, ssh.trim_memory
+  assert_equal 0, ssh.memory_usage(true)[:cached]
+  assert_equal live, ssh.memory_usage
+  assert_equal 0, ssh.trim_memory
+ensure
+  ssh.close if ssh
+end
+
+assert 'SSH::Session#close', 'releases memory' do
+  usage = SSH.memory_usage
+
+  3.times do
+    ssh = SSH::Session.new('test.rebex.net')
+    ssh.login 'demo', password: 'password'
+    assert_true SSH.memory_usage > usage
+    ssh.close
+    assert_true SSH.memory_usage <= usage
+  end
+end
+
+assert 'SSH::Session#alive?' do
+  ssh = SSH::Session.new
+
+  assert_false ssh.alive?
+
+  ssh.connect 'test.rebex.net'
+  assert_true ssh.alive?
+
+  ssh.close
+  assert_false ssh.alive?
+end
+
+assert 'SSH::Session#alive?', 'keepalive' do
+  ssh = SSH::Session.new
+  ssh.connect 'test.rebex.net'
+
+  assert_true ssh.alive?
+  assert_equal 0, ssh.keepalive
+
+  ssh.close
+
+  ssh = SSH::Session.new
+  ssh.connect 'test.rebex.net', block: false, keepalive: 5
+
+  poller = SSH::Poller.new
+  poller.add(ssh)
+  poller.wait(1000) while ssh.login_nonblock('demo', password: 'password')
+
+  channel = SSH::Channel.new(ssh)
+  channel.open
+  channel.request('exec', 'cat')
+
+  io = SSH::Stream.new(channel)
+  100.times { break if io.write_nonblock('x' * 0x8000).is_a?(Symbol) }
+
+  assert_true ssh.alive?
+ensure
+  ssh.close if ssh
+end
+
 assert 'SSH::start' do
   session = nil
 
@@ -47,4 +47,40 @@ SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
     assert_true called
     assert_nil ret
   end
+
+  assert 'SSH::Session#exec_many' do
+    res = ssh.exec_many(['echo 1', 'echo 2', 'unknown'], concurrency: 2)
+
+    assert_kind_of Array, res
+    assert_equal 3, res.size
+    assert_equal "1\n", res[0][:out]
+    assert_equal 0,     res[0][:exitstatus]
+    assert_equal "2\n", res[1][:out]
+    assert_equal 127,   res[2][:exitstatus]
+    assert_nil res[0][:error]
+
+    assert_equal [], ssh.exec_many([])
+    assert_raise(ArgumentError) { ssh.exec_many(['echo 1'], concurrency: 0) }
+  end
+end
+
+assert 'SSH::Session#exec_many', 'not connected' do
+  assert_raise(SSH::NotConnected) { SSH::Session.new.exec_many(['echo 1']) }
+end
+
+assert 'SSH::Session#stats', 'channels' do
+  SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+    ssh.reset_stats
+    ssh.exec_many(%w[hostname hostname])
+
+    stats = ssh.stats
+    assert_equal 2, stats[:channel_opens]
+    assert_equal 2, stats[:execs]
+    assert_true stats[:channel_open_time] > 0
+    assert_true stats[:exec_time] > 0
+
+    ssh.open_channel { |channel| channel.exec('hostname') }
+    assert_equal 3, ssh.stats[:channel_opens]
+    assert_equal 3, ssh.stats[:execs]
+  end
 end
@@ -0,0 +1,100 @@
+# MIT License
+#
+# Copyright (c) Sebastian Katzer 2017
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
+  assert 'SSH::Session#sftp' do
+    sftp = ssh.sftp
+
+    assert_kind_of SSH::SFTP, sftp
+    assert_true sftp.open?
+    assert_equal ssh, sftp.session
+
+    sftp.close
+
+    assert_true sftp.closed?
+    assert_raise(SSH::NotConnected) { sftp.stat('/readme.txt') }
+    assert_nil ssh.sftp { |s| assert_true s.open? }
+  end
+
+  ssh.sftp do |sftp|
+    assert 'SSH::SFTP#stat' do
+      stat = sftp.stat('/readme.txt')
+
+      assert_equal :file, stat[:type]
+      assert_true stat[:size] > 0
+      assert_kind_of Integer, stat[:mtime]
+      assert_equal :directory, sftp.stat('/pub')[:type]
+      assert_raise(SSH::SFTPError) { sftp.stat('/unknown') }
+    end
+
+    assert 'SSH::SFTP#readdir' do
+      entries = sftp.readdir('/')
+
+      assert_include entries, 'readme.txt'
+      assert_include entries, 'pub'
+      assert_raise(SSH::SFTPError) { sftp.readdir('/unknown') }
+    end
+
+    assert 'SSH::SFTP#open' do
+      sftp.open('/readme.txt') do |file|
+        assert_equal '/readme.txt', file.path
+        assert_equal 'Welcome', file.read(7)
+        assert_equal 7, file.tell
+
+        file.rewind
+        data = file.read
+
+        assert_equal file.size, data.size
+        assert_nil file.read(1)
+        assert_equal '', file.read
+      end
+
+      file = sftp.open('/readme.txt', 'rb')
+      file.close
+
+      assert_true file.closed?
+      assert_raise(SSH::NotConnected) { file.read }
+      assert_raise(ArgumentError) { sftp.open('/readme.txt', 'x') }
+      assert_raise(SSH::SFTPError) { sftp.open('/unknown') }
+      assert_raise(SSH::SFTPError) { sftp.open('/readme.txt', 'w') }
+    end
+
+    assert 'SSH::SFTP#read' do
+      assert_equal sftp.stat('/readme.txt')[:size], sftp.read('/readme.txt').size
+    end
+
+    assert 'SSH::SFTP#download' do
+      assert_equal sftp.stat('/readme.txt')[:size], sftp.download('/readme.txt', 'sftp_readme.txt')
+      assert_raise(SSH::SFTPError) { sftp.download('/unknown', 'sftp_readme.txt') }
+    end
+
+    assert 'SSH::SFTP#upload' do
+      assert_raise(SSH::SFTPError) { sftp.upload('sftp_readme.txt', '/readme.txt') }
+      assert_raise(StandardError) { sftp.upload('unknown.txt', '/readme.txt') }
+    end
+  end
+end
+
+assert 'SSH::SFTP', 'not connected' do
+  assert_raise(SSH::NotConnected) { SSH::SFTP.new(SSH::Session.new) }
+  assert_raise(TypeError) { SSH::SFTP.new('session') }
+end
@@ -36,6 +36,13 @@ ensure
   assert_nothing_raised { SSH.startup }
 end
 
+assert 'SSH.clock' do
+  time = SSH.clock
+
+  assert_kind_of Float, time
+  assert_true SSH.clock >= time
+end
+
 assert 'SSH.start' do
   assert_kind_of SSH::Session, SSH.start
 end
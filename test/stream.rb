@@ -32,6 +32,13 @@ def pipe(ssh, cmd)
   [SSH::Stream.new(channel), SSH::Stream.new(channel, SSH::Stream::STDERR)]
 end
 
+def buffered_write(channel, str)
+  io      = SSH::Stream.new(channel)
+  io.sync = false
+  io.write(str)
+  nil
+end
+
 assert 'SSH::Stream' do
   assert_kind_of Class, SSH::Stream
 end
@@ -66,6 +73,7 @@ SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
 
     assert_equal 'hello',   io.gets(5)
     assert_equal "\nworld", io.gets(6)
+    assert_raise(ArgumentError) { io.gets(-1) }
   end
 
   assert 'SSH::Stream#gets(str)' do
@@ -75,6 +83,23 @@ SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
     assert_equal 'world', io.gets(chomp: true)
   end
 
+  assert 'SSH::Stream#gets(multi-byte separator)' do
+    io, = pipe(ssh, 'echo a--b--c')
+
+    assert_equal 'a--',  io.gets('--')
+    assert_equal 'b--',  io.gets('--')
+    assert_equal "c\n", io.gets('--')
+    assert_nil           io.gets('--')
+  end
+
+  assert 'SSH::Stream#gets', 'mixed' do
+    io, = pipe(ssh, 'echo hello;echo world')
+
+    assert_equal 'he',       io.gets(2)
+    assert_equal "llo\n",   io.gets
+    assert_equal "world\n", io.gets(nil)
+  end
+
   assert 'SSH::Stream#readlines' do
     io, = pipe(ssh, 'echo hello;echo world')
 
@@ -162,4 +187,126 @@ SSH.start('test.rebex.net', 'demo', password: 'password') do |ssh|
     assert_nil  io.getc
     assert_true io.eof?
   end
+
+  assert 'SSH::Stream#read_nonblock' do
+    io, = pipe(ssh, 'echo hello')
+    out = ''
+
+    loop do
+      res = io.read_nonblock(3)
+      break unless res
+
+      if res.is_a? Symbol
+        SSH::Poller.wait([ssh], 1000)
+      else
+        assert_true res.size <= 3
+        out << res
+      end
+    end
+
+    assert_equal "hello\n", out
+    assert_raise(ArgumentError) { io.read_nonblock(-1) }
+  end
+
+  assert 'SSH::Stream#readpartial' do
+    io, = pipe(ssh, 'echo hello')
+    out = ''
+
+    begin
+      loop { out << io.readpartial(2) }
+    rescue EOFError
+      assert_equal "hello\n", out
+    end
+
+    assert_equal "hello\n", out
+  end
+
+  assert 'SSH::Stream#write_nonblock' do
+    io, = pipe(ssh, 'cat')
+    res = io.write_nonblock("ETNA\n")
+
+    assert_true res.is_a?(Symbol) || res == 5
+
+    io.write("ETNA\n") if res.is_a?(Symbol)
+
+    assert_equal "ETNA\n", io.gets
+    io.close
+  end
+
+  assert 'SSH::Stream#sync' do
+    io, = pipe(ssh, 'cat')
+
+    assert_true io.sync
+    io.sync = false
+    assert_false io.sync
+
+    assert_equal 1, io.write('E')
+    assert_equal 4, io.write("TNA\n")
+    assert_equal "ETNA\n", io.gets
+
+    io.sync = true
+    io.close
+  end
+
+  assert 'SSH::Stream#sync', 'garbage collected stream' do
+    channel = open_channel(ssh) { |ch| ch.request('exec', 'cat') }
+
+    buffered_write(channel, 'ETNA')
+    GC.start
+
+    io = SSH::Stream.new(channel)
+    io.puts
+
+    assert_equal "ETNA\n", io.gets
+    io.close
+  end
+
+  assert 'SSH::Stream#write_v' do
+    io, = pipe(ssh, 'cat')
+
+    assert_equal 5, io.write_v('ET', 'NA', "\n")
+    assert_equal 0, io.write_v
+    assert_equal "ETNA\n", io.gets
+    assert_raise(TypeError) { io.write_v(1) }
+
+    io.close
+  end
+
+  assert 'SSH::Stream#buffer_size' do
+    io, = pipe(ssh, 'cat')
+
+    assert_equal SSH::Channel::PACKET_DEFAULT, io.buffer_size
+    io.buffer_size = 2
+    assert_equal 2, io.buffer_size
+    assert_raise(ArgumentError) { io.buffer_size = 0 }
+
+    io.sync = false
+    io.puts 'ETNA'
+    assert_equal "ETNA\n", io.gets
+
+    io.close
+  end
+
+  assert 'SSH::Stream#flush_interval' do
+    io, = pipe(ssh, 'cat')
+
+    assert_nil io.flush_interval
+    io.flush_interval = 10
+    assert_equal 10, io.flush_interval
+    io.flush_interval = nil
+    assert_nil io.flush_interval
+
+    io.sync           = false
+    io.flush_interval = 10
+    io.write 'ETNA'
+
+    since = SSH.clock
+    nil while SSH.clock - since < 0.02
+
+    res = nil
+    res = io.read_nonblock(4) until res.is_a?(String) || SSH.clock - since > 5
+    assert_equal 'ETNA', res
+
+    io.close
+  end
 end